@@ -0,0 +1,119 @@
+#include "arena.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <new>
+
+namespace music_data {
+
+Arena::Arena(size_t chunkSize)
+    : m_chunkSize(std::max<size_t>(chunkSize, 64)) {
+}
+
+Arena::~Arena() {
+    while (m_current!=nullptr) {
+        Chunk* prev = m_current->prev; 
+        free(m_current); 
+        m_current = prev; 
+    }
+}
+
+void Arena::addChunk(size_t minSize) {
+    size_t size = std::max(m_chunkSize, minSize); 
+    Chunk* chunk = (Chunk*)malloc(sizeof(Chunk)+size); 
+    if (chunk==nullptr) {
+        throw std::bad_alloc(); 
+    }
+    chunk->prev = m_current; 
+    chunk->size = size; 
+    chunk->used = 0; 
+    m_current = chunk; 
+}
+
+void* Arena::allocate(size_t size, size_t align) {
+    if (m_current!=nullptr) {
+        uintptr_t base = (uintptr_t)m_current->getData(); 
+        uintptr_t pos = (base+m_current->used+align-1)&~(uintptr_t)(align-1); 
+        if (pos+size<=base+m_current->size) {
+            m_current->used = pos+size-base; 
+            return (void*)pos; 
+        }
+    }
+
+    // 当前块不足，新块多留对齐余量（malloc只保证max_align_t对齐）
+    addChunk(size+align); 
+    uintptr_t base = (uintptr_t)m_current->getData(); 
+    uintptr_t pos = (base+align-1)&~(uintptr_t)(align-1); 
+    m_current->used = pos+size-base; 
+    return (void*)pos; 
+}
+
+char* Arena::copy(const void* data, size_t length) {
+    if (length==0) {
+        return nullptr; 
+    }
+    char* dest = (char*)allocate(length, 1); 
+    memcpy(dest, data, length); 
+    return dest; 
+}
+
+void Arena::reset() {
+    Chunk* largest = nullptr; 
+    while (m_current!=nullptr) {
+        Chunk* prev = m_current->prev; 
+        if (largest==nullptr||m_current->size>largest->size) {
+            if (largest!=nullptr) {
+                free(largest); 
+            }
+            largest = m_current; 
+        } else {
+            free(m_current); 
+        }
+        m_current = prev; 
+    }
+
+    m_current = largest; 
+    if (m_current!=nullptr) {
+        m_current->prev = nullptr; 
+        m_current->used = 0; 
+    }
+}
+
+void Arena::reserve(size_t size) {
+    if (m_current!=nullptr&&m_current->size-m_current->used>=size) {
+        return; 
+    }
+    if (m_current!=nullptr&&m_current->used==0) {
+        Chunk* prev = m_current->prev; 
+        free(m_current); 
+        m_current = prev; 
+    }
+    addChunk(size); 
+}
+
+size_t Arena::getUsedSize() const {
+    size_t size = 0; 
+    for (Chunk* item=m_current; item!=nullptr; item=item->prev) {
+        size+=item->used; 
+    }
+    return size; 
+}
+
+size_t Arena::getCapacity() const {
+    size_t size = 0; 
+    for (Chunk* item=m_current; item!=nullptr; item=item->prev) {
+        size+=item->size; 
+    }
+    return size; 
+}
+
+uint32_t Arena::getChunkNum() const {
+    uint32_t num = 0; 
+    for (Chunk* item=m_current; item!=nullptr; item=item->prev) {
+        ++num; 
+    }
+    return num; 
+}
+
+}
\ No newline at end of file
@@ -0,0 +1,155 @@
+#ifndef __MD_ARENA_H_
+#define __MD_ARENA_H_
+
+#include "noncopyable.h"
+
+#include <memory>
+#include <cstddef>
+#include <stdint.h>
+
+namespace music_data {
+
+/**
+ * @brief 单调分配器：按块向系统申请内存，分配只移动指针，释放时整体释放；非线程安全
+*/
+class Arena: Noncopyable {
+public: 
+    typedef std::shared_ptr<Arena> ptr; 
+
+    /**
+     * @brief 构造函数
+     * @param[in] chunkSize 第一块内存大小(byte)，之后不足时按此大小（或请求大小）追加
+    */
+    Arena(size_t chunkSize = 4096); 
+
+    /**
+     * @brief 析构函数，释放全部内存块
+    */
+    ~Arena(); 
+
+    /**
+     * @brief 分配内存
+     * @param[in] size 大小(byte)
+     * @param[in] align 对齐(byte)，必须为2的幂
+     * @retval 内存首地址
+    */
+    void* allocate(size_t size, size_t align = alignof(std::max_align_t)); 
+
+    /**
+     * @brief 分配内存并复制数据
+     * @param[in] data 数据指针
+     * @param[in] length 数据长度
+     * @retval 复制后的首地址，length为0时为nullptr
+    */
+    char* copy(const void* data, size_t length); 
+
+    /**
+     * @brief 丢弃全部分配，只保留最大的一块内存供之后复用
+    */
+    void reset(); 
+
+    /**
+     * @brief 保证当前块剩余空间不少于size，当前块为空且不足时直接换成更大的块
+     * @param[in] size 大小(byte)
+    */
+    void reserve(size_t size); 
+
+    /**
+     * @brief 取得已分配的大小
+     * @retval 已分配的大小(byte)，包括对齐填充
+    */
+    size_t getUsedSize() const; 
+
+    /**
+     * @brief 取得向系统申请的内存总大小
+     * @retval 内存总大小(byte)
+    */
+    size_t getCapacity() const; 
+
+    /**
+     * @brief 取得内存块数量
+     * @retval 内存块数量
+    */
+    uint32_t getChunkNum() const; 
+
+private: 
+    /**
+     * @brief 内存块头，数据紧跟其后
+    */
+    struct Chunk {
+        /// @brief 前一块（链表由新到旧）
+        Chunk* prev; 
+        /// @brief 数据区大小(byte)
+        size_t size; 
+        /// @brief 已使用大小(byte)
+        size_t used; 
+
+        /**
+         * @brief 取得数据区首地址
+        */
+        uint8_t* getData() { return (uint8_t*)(this+1); }
+    }; 
+
+    /**
+     * @brief 申请新内存块并设为当前块
+     * @param[in] minSize 数据区最小大小(byte)
+    */
+    void addChunk(size_t minSize); 
+
+private: 
+    /// @brief 当前内存块
+    Chunk* m_current = nullptr; 
+    /// @brief 追加内存块的大小(byte)
+    size_t m_chunkSize; 
+}; 
+
+/**
+ * @brief 从Arena分配内存的标准分配器，持有Arena智能指针，
+ *        用于std::allocate_shared时对象（及控制块）存活期间Arena不会被释放
+*/
+template<class T>
+class ArenaAllocator {
+public: 
+    typedef T value_type; 
+
+    /**
+     * @brief 构造函数
+     * @param[in] arena 内存来源
+    */
+    ArenaAllocator(Arena::ptr arena): m_arena(arena) {}
+
+    /**
+     * @brief 其他类型分配器转换（std::allocate_shared内部使用）
+    */
+    template<class U>
+    ArenaAllocator(const ArenaAllocator<U>& other): m_arena(other.getArena()) {}
+
+    /**
+     * @brief 分配n个T的内存
+    */
+    T* allocate(size_t n) { return (T*)m_arena->allocate(n*sizeof(T), alignof(T)); }
+
+    /**
+     * @brief Arena整体释放，单个对象不释放
+    */
+    void deallocate(T*, size_t) {}
+
+    /**
+     * @brief 取得内存来源
+    */
+    Arena::ptr getArena() const { return m_arena; }
+
+    template<class U>
+    bool operator==(const ArenaAllocator<U>& other) const { return m_arena==other.getArena(); }
+
+    template<class U>
+    bool operator!=(const ArenaAllocator<U>& other) const { return m_arena!=other.getArena(); }
+
+private: 
+    /// @brief 内存来源
+    Arena::ptr m_arena; 
+}; 
+
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,137 @@
+#include "asyncio.h"
+#include "log.h"
+
+namespace music_data {
+
+INITONLYLOGGER(); 
+
+AsyncFlacIO::AsyncFlacIO(ThreadPool::ptr pool, uint32_t maxInFlight)
+    : m_pool(pool==nullptr?DefaultThreadPool::GetInstance():pool)
+    , m_maxInFlight(maxInFlight==0?m_pool->getThreadNum():maxInFlight) {
+}
+
+AsyncFlacIO::~AsyncFlacIO() {
+    wait(); 
+}
+
+void AsyncFlacIO::post(std::function<void()> task) {
+    {
+        std::unique_lock<std::mutex> lock(m_mutex); 
+        if (m_inFlight>=m_maxInFlight) {
+            m_queue.emplace_back(std::move(task)); 
+            return; 
+        }
+        ++m_inFlight; 
+    }
+    dispatch(std::move(task)); 
+}
+
+void AsyncFlacIO::dispatch(std::function<void()> task) {
+    m_pool->submit([this, task]() {
+        task(); 
+        // 同一个线程池任务中接着执行排队的任务，不再重新提交
+        std::function<void()> next; 
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(m_mutex); 
+                if (m_queue.empty()) {
+                    --m_inFlight; 
+                    if (m_inFlight==0) {
+                        m_idleCond.notify_all(); 
+                    }
+                    return; 
+                }
+                next = std::move(m_queue.front()); 
+                m_queue.pop_front(); 
+            }
+            next(); 
+        }
+    }); 
+}
+
+void AsyncFlacIO::wait() {
+    std::unique_lock<std::mutex> lock(m_mutex); 
+    m_idleCond.wait(lock, [this]() { return m_inFlight==0&&m_queue.empty(); }); 
+}
+
+uint32_t AsyncFlacIO::getInFlightNum() const {
+    std::unique_lock<std::mutex> lock(m_mutex); 
+    return m_inFlight; 
+}
+
+uint32_t AsyncFlacIO::getQueuedNum() const {
+    std::unique_lock<std::mutex> lock(m_mutex); 
+    return m_queue.size(); 
+}
+
+AsyncFlacIO::OpenResult AsyncFlacIO::Open(const std::wstring& path, ProbeLevel level) {
+    OpenResult ans; 
+    ans.path = path; 
+    if (level==PROBE_HEADERS) {
+        ans.success = MusicDecoderflac::ListMetaBlocks(path.c_str(), ans.blocks); 
+        return ans; 
+    }
+
+    MusicDecoderflac::ptr decoder = std::make_shared<MusicDecoderflac>(); 
+    if (decoder->openFile(path.c_str())&&decoder->isValid()) {
+        ans.success = true; 
+        ans.decoder = decoder; 
+    }
+    return ans; 
+}
+
+std::future<AsyncFlacIO::OpenResult> AsyncFlacIO::openAsync(const std::wstring& path, ProbeLevel level) {
+    auto promise = std::make_shared<std::promise<OpenResult>>(); 
+    std::future<OpenResult> ans = promise->get_future(); 
+    post([promise, path, level]() {
+        promise->set_value(Open(path, level)); 
+    }); 
+    return ans; 
+}
+
+void AsyncFlacIO::openAsync(const std::wstring& path, ProbeLevel level, OpenCallback cb) {
+    post([cb, path, level]() {
+        OpenResult res = Open(path, level); 
+        if (cb) {
+            cb(res); 
+        }
+    }); 
+}
+
+std::future<FlacEdit::Result> AsyncFlacIO::saveAsync(const std::wstring& path, const FlacEdit& edit) {
+    auto promise = std::make_shared<std::promise<FlacEdit::Result>>(); 
+    std::future<FlacEdit::Result> ans = promise->get_future(); 
+    saveAsync(path, edit, [promise](const FlacEdit::Result& res) {
+        promise->set_value(res); 
+    }); 
+    return ans; 
+}
+
+void AsyncFlacIO::saveAsync(const std::wstring& path, const FlacEdit& edit, SaveCallback cb) {
+    post([cb, path, edit]() {
+        FlacEdit::Result res; 
+        res.path = path; 
+        res.success = edit.commit(path.c_str(), &res.strategy); 
+        if (cb) {
+            cb(res); 
+        }
+    }); 
+}
+
+std::future<FlacEdit::Result> AsyncFlacIO::saveAsync(MusicDecoderflac::ptr decoder) {
+    auto promise = std::make_shared<std::promise<FlacEdit::Result>>(); 
+    std::future<FlacEdit::Result> ans = promise->get_future(); 
+    post([promise, decoder]() {
+        FlacEdit::Result res; 
+        if (decoder!=nullptr) {
+            res.path = decoder->getFileName(); 
+            res.success = decoder->save(&res.strategy); 
+        } else {
+            LOGE("decoder is null, save termination"); 
+        }
+        promise->set_value(res); 
+    }); 
+    return ans; 
+}
+
+}
\ No newline at end of file
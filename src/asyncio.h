@@ -0,0 +1,168 @@
+#ifndef __MD_ASYNCIO_H_
+#define __MD_ASYNCIO_H_
+
+#include "decoderflac.h"
+#include "flacedit.h"
+#include "threadpool.h"
+#include "noncopyable.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <stdint.h>
+
+namespace music_data {
+
+/**
+ * @brief flac文件的异步打开与保存：任务在线程池中执行，结果通过future或回调返回；
+ *        同时执行的任务数超过上限时在内部排队，提交不会阻塞
+*/
+class AsyncFlacIO: Noncopyable {
+public: 
+    typedef std::shared_ptr<AsyncFlacIO> ptr; 
+
+    /**
+     * @brief 打开文件时的解析程度
+    */
+    enum ProbeLevel {
+        /// @brief 只读取各block头（类型与大小），不构造block
+        PROBE_HEADERS = 0, 
+        /// @brief 完整解析metadata
+        PROBE_FULL = 1
+    }; 
+
+    /**
+     * @brief 打开结果
+    */
+    struct OpenResult {
+        /// @brief 文件路径
+        std::wstring path; 
+        /// @brief 是否成功
+        bool success = false; 
+        /// @brief 各block头信息，PROBE_HEADERS时有效
+        std::vector<MetaBlockIterator::BlockInfo> blocks; 
+        /// @brief 解码器，PROBE_FULL且成功时有效
+        MusicDecoderflac::ptr decoder = nullptr; 
+    }; 
+
+    typedef std::function<void(OpenResult&)> OpenCallback; 
+    typedef std::function<void(const FlacEdit::Result&)> SaveCallback; 
+
+    /**
+     * @brief 构造函数
+     * @param[in] pool 执行任务的线程池，nullptr使用默认线程池
+     * @param[in] maxInFlight 同时执行的任务数上限，0表示线程池线程数
+    */
+    AsyncFlacIO(ThreadPool::ptr pool = nullptr, uint32_t maxInFlight = 0); 
+
+    /**
+     * @brief 析构函数，等待全部任务完成
+    */
+    ~AsyncFlacIO(); 
+
+    /**
+     * @brief 异步打开文件
+     * @param[in] path 文件路径
+     * @param[in] level 解析程度
+     * @retval 打开结果future
+    */
+    std::future<OpenResult> openAsync(const std::wstring& path, ProbeLevel level = PROBE_FULL); 
+
+    /**
+     * @brief 异步打开文件，完成后在工作线程中调用回调
+     * @param[in] path 文件路径
+     * @param[in] level 解析程度
+     * @param[in] cb 回调
+    */
+    void openAsync(const std::wstring& path, ProbeLevel level, OpenCallback cb); 
+
+    /**
+     * @brief 异步将修改事务提交到文件（打开、修改并写回）
+     * @param[in] path 文件路径
+     * @param[in] edit 修改事务，提交时复制
+     * @retval 提交结果future
+    */
+    std::future<FlacEdit::Result> saveAsync(const std::wstring& path, const FlacEdit& edit); 
+
+    /**
+     * @brief 异步将修改事务提交到文件，完成后在工作线程中调用回调
+     * @param[in] path 文件路径
+     * @param[in] edit 修改事务，提交时复制
+     * @param[in] cb 回调
+    */
+    void saveAsync(const std::wstring& path, const FlacEdit& edit, SaveCallback cb); 
+
+    /**
+     * @brief 异步保存已修改的解码器，保存完成前不能再使用该解码器
+     * @param[in] decoder 解码器
+     * @retval 保存结果future
+    */
+    std::future<FlacEdit::Result> saveAsync(MusicDecoderflac::ptr decoder); 
+
+    /**
+     * @brief 阻塞到已提交的任务全部完成
+    */
+    void wait(); 
+
+    /**
+     * @brief 取得执行中的任务数
+     * @retval 执行中的任务数
+    */
+    uint32_t getInFlightNum() const; 
+
+    /**
+     * @brief 取得排队等待的任务数
+     * @retval 排队的任务数
+    */
+    uint32_t getQueuedNum() const; 
+
+    /**
+     * @brief 取得同时执行的任务数上限
+     * @retval 任务数上限
+    */
+    uint32_t getMaxInFlight() const { return m_maxInFlight; }
+
+private: 
+    /**
+     * @brief 提交任务，未达上限时直接交给线程池，否则排队
+     * @param[in] task 任务
+    */
+    void post(std::function<void()> task); 
+
+    /**
+     * @brief 在线程池中执行任务，结束后取出下一个排队的任务继续执行
+     * @param[in] task 任务
+    */
+    void dispatch(std::function<void()> task); 
+
+    /**
+     * @brief 打开文件
+     * @param[in] path 文件路径
+     * @param[in] level 解析程度
+     * @retval 打开结果
+    */
+    static OpenResult Open(const std::wstring& path, ProbeLevel level); 
+
+private: 
+    /// @brief 执行任务的线程池
+    ThreadPool::ptr m_pool; 
+    /// @brief 同时执行的任务数上限
+    uint32_t m_maxInFlight; 
+    /// @brief 执行中的任务数
+    uint32_t m_inFlight = 0; 
+    /// @brief 排队等待的任务
+    std::deque<std::function<void()>> m_queue; 
+    /// @brief 任务计数与队列锁
+    mutable std::mutex m_mutex; 
+    /// @brief 全部任务完成时通知
+    std::condition_variable m_idleCond; 
+}; 
+
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,74 @@
+#include "crc.h"
+
+namespace music_data {
+
+/**
+ * @brief CRC-8查表，多项式0x07
+*/
+struct Crc8Table {
+    Crc8Table() {
+        for (uint32_t i=0; i<256; ++i) {
+            uint8_t crc = i; 
+            for (int j=0; j<8; ++j) {
+                crc = (crc&0x80)?((crc<<1)^0x07):(crc<<1); 
+            }
+            table[i] = crc; 
+        }
+    }
+
+    uint8_t table[256]; 
+}; 
+
+static const Crc8Table s_crc8Table; 
+
+/**
+ * @brief CRC-16查表，多项式0x8005，slicing-by-8：
+ *        table[k][b]为字节b之后再跟k个0字节的crc，一次处理8 byte
+*/
+struct Crc16Table {
+    Crc16Table() {
+        for (uint32_t i=0; i<256; ++i) {
+            uint16_t crc = i<<8; 
+            for (int j=0; j<8; ++j) {
+                crc = (crc&0x8000)?((crc<<1)^0x8005):(crc<<1); 
+            }
+            table[0][i] = crc; 
+        }
+        for (uint32_t k=1; k<8; ++k) {
+            for (uint32_t i=0; i<256; ++i) {
+                uint16_t crc = table[k-1][i]; 
+                table[k][i] = (crc<<8)^table[0][crc>>8]; 
+            }
+        }
+    }
+
+    uint16_t table[8][256]; 
+}; 
+
+static const Crc16Table s_crc16Table; 
+
+uint8_t crc8(const void* data, size_t length, uint8_t crc) {
+    const uint8_t* pin = (const uint8_t*)data; 
+    for (size_t i=0; i<length; ++i) {
+        crc = s_crc8Table.table[crc^pin[i]]; 
+    }
+    return crc; 
+}
+
+uint16_t crc16(const void* data, size_t length, uint16_t crc) {
+    const uint8_t* pin = (const uint8_t*)data; 
+    const uint16_t (*table)[256] = s_crc16Table.table; 
+
+    // crc只影响前两个字节，8个字节的查表结果互相独立，可以并行查表
+    for (; length>=8; length-=8, pin+=8) {
+        crc = table[7][(crc>>8)^pin[0]]^table[6][(crc&0xFF)^pin[1]]
+            ^table[5][pin[2]]^table[4][pin[3]]^table[3][pin[4]]
+            ^table[2][pin[5]]^table[1][pin[6]]^table[0][pin[7]]; 
+    }
+    for (size_t i=0; i<length; ++i) {
+        crc = (crc<<8)^table[0][(crc>>8)^pin[i]]; 
+    }
+    return crc; 
+}
+
+}
\ No newline at end of file
@@ -0,0 +1,29 @@
+#ifndef __MD_CRC_H_
+#define __MD_CRC_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace music_data {
+
+/**
+ * @brief 计算CRC-8，多项式x^8+x^2+x^1+x^0 (0x07)，初值0，flac frame header校验用
+ * @param[in] data 数据指针
+ * @param[in] length 数据长度
+ * @param[in] crc 上一段的crc值，分段计算时使用
+ * @retval crc值
+*/
+uint8_t crc8(const void* data, size_t length, uint8_t crc = 0); 
+
+/**
+ * @brief 计算CRC-16，多项式x^16+x^15+x^2+x^0 (0x8005)，初值0，flac frame校验用
+ * @param[in] data 数据指针
+ * @param[in] length 数据长度
+ * @param[in] crc 上一段的crc值，分段计算时使用
+ * @retval crc值
+*/
+uint16_t crc16(const void* data, size_t length, uint16_t crc = 0); 
+
+}
+
+#endif
\ No newline at end of file
@@ -22,57 +22,40 @@ bool MusicDecoder::openFile(std::wstring& file_path) {
 }
 
 bool MusicDecoder::openFile(const wchar_t* file_path) {
-    // open file for file mapping	
-    HANDLE hFile = CreateFileW(file_path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, 0, NULL);	
-    
-    if (hFile==INVALID_HANDLE_VALUE) {
-        LOGE("file not exists \n"); 
-        return false; 
+    // 映射文件并保持，之后按需从映射中读取大块数据；reset后没有其他引用的映射对象直接复用
+    if (m_source==nullptr||m_source.use_count()>1) {
+        m_source = std::make_shared<MappedFile>(); 
     }
-
-    // get file size
-    size_t nStreamSize = GetFileSize(hFile, NULL); 
-
-    if(nStreamSize == 0xFFFFFFFF || nStreamSize == 0)
-	{
-		CloseHandle(hFile);
-		hFile = INVALID_HANDLE_VALUE; 
-        LOGE("file not exists \n"); 
-        return false;
-	}
-
-    // create file mapping
-    HANDLE hFileMapping = CreateFileMappingW(hFile,NULL,PAGE_READONLY,0,0,NULL);
-
-    if (hFileMapping==INVALID_HANDLE_VALUE) {
-        LOGE("CreateFileMappingW fail \n"); 
-        CloseHandle(hFile); 
+    // 上次覆盖写入中途崩溃时先恢复原数据
+    if (!FileWriter::Recover(file_path)) {
+        LOGE("recover interrupted overwrite fail \n"); 
         return false; 
     }
-
-    // create file view
-    LPVOID hViewOfFile = MapViewOfFile(hFileMapping,FILE_MAP_READ,0,0,0); 
-
-    if (hViewOfFile==NULL) {
-        LOGE("MapViewOfFile fail \n"); 
-        CloseHandle(hFileMapping); 
-        CloseHandle(hFile); 
+    if (!m_source->open(file_path)) {
+        LOGE("open file fail \n"); 
         return false; 
     }
 
-    LOGD("read file successfully, %d byte read", GetFileSize(hFile, NULL)); 
-
-    initData((void*)hViewOfFile, nStreamSize); 
+    initData((void*)m_source->getData(), m_source->getSize()); 
 
     if (isValid()) {
-        m_file_path = std::wstring(file_path); 
+        m_file_path.assign(file_path); 
     }
 
-    UnmapViewOfFile(hViewOfFile); 
-    CloseHandle(hFileMapping); 
-    CloseHandle(hFile); 
-
     return true; 
 }
 
+void MusicDecoder::reset() {
+    if (m_source!=nullptr) {
+        // 映射仍被外部引用时交给引用方，不关闭
+        if (m_source.use_count()==1) {
+            m_source->close(); 
+        } else {
+            m_source = nullptr; 
+        }
+    }
+    m_file_path.clear(); 
+    m_isValid = true; 
+}
+
 }
\ No newline at end of file
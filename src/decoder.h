@@ -2,6 +2,7 @@
 #define __MD_DECODER_H_
 
 #include "image.h"
+#include "mappedfile.h"
 
 #include <memory>
 #include <string>
@@ -50,6 +51,17 @@ public:
     */
     bool isValid() const { return m_isValid; }
 
+    /**
+     * @brief 清空文件相关的全部状态以便打开下一个文件，已分配的内存尽量保留复用
+    */
+    virtual void reset(); 
+
+    /**
+     * @brief 取得源文件映射
+     * @retval 源文件映射指针，未打开文件时为nullptr
+    */
+    MappedFile::ptr getSource() const { return m_source; }
+
 protected: 
     /**
      * @brief 设置是否有效
@@ -244,6 +256,8 @@ protected:
     std::wstring m_file_path = L""; 
     /// @brief 是否有效
     bool m_isValid; 
+    /// @brief 源文件映射，解码器存活期间一直保持，供按需读取图片、音频帧等大块数据
+    MappedFile::ptr m_source = nullptr; 
 }; 
 
 }
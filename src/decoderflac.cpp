@@ -1,10 +1,15 @@
 #include "decoderflac.h"
+#include "flacframe.h"
+#include "flacdecoder.h"
+#include "flacparallel.h"
+#include "md5.h"
 #include "utils.h"
 #include "log.h"
 
 #include <stdlib.h>
 #include <algorithm>
 #include <unordered_set>
+#include <atomic>
 #include <fileapi.h>
 #include <Windows.h>
 
@@ -12,6 +17,9 @@ namespace music_data {
 
 INITONLYLOGGER(); 
 
+/// @brief 预估arena大小时每个block预留的大小：block对象、shared_ptr控制块及MIME类型、描述等短字段
+static const size_t s_arenaBlockReserve = 512; 
+
 Metadata_block::ptr Metadata_block::CreateMetadataBlock(void* data, uint32_t length, MetadataBlockType type, uint8_t typeNum) {
     switch (type) {
         case STREAM_INFO: {
@@ -53,7 +61,8 @@ Metadata_block::ptr Metadata_block::CreateMetadataBlock(void* data, uint32_t len
     }
 }
 
-Metadata_block::Metadata_block(uint32_t length, MetadataBlockType type, bool dataValid) {
+Metadata_block::Metadata_block(uint32_t length, MetadataBlockType type, bool dataValid, Arena* arena)
+    : m_arena(arena) {
     if (length!=0) {
         m_type = type; 
     }
@@ -63,6 +72,74 @@ Metadata_block::Metadata_block(uint32_t length, MetadataBlockType type, bool dat
 Metadata_block::~Metadata_block() {
 }
 
+char* Metadata_block::allocField(size_t length) {
+    return m_arena!=nullptr?(char*)m_arena->allocate(length, 1):new char[length]; 
+}
+
+void Metadata_block::freeField(char* data) {
+    if (m_arena==nullptr) {
+        delete[] data; 
+    }
+}
+
+bool Metadata_block::checkWritable() const {
+    if (m_shared) {
+        LOGE("metablock %d is shared by forked decoders, couldn't modify", m_type); 
+        return false; 
+    }
+    return true; 
+}
+
+bool Metadata_block::bindSource(MappedFile::ptr source, uint64_t offset, uint32_t length) {
+    if (source==nullptr||offset<4||!source->contains(offset-4, (uint64_t)length+4)) {
+        LOGW("bindSource fail, range out of file"); 
+        return false; 
+    }
+
+    m_rawSource = source; 
+    m_rawOffset = offset; 
+    m_rawLength = length; 
+    m_rawTypeNum = source->getData()[offset-4]&0x7F; 
+    m_dirty = false; 
+    m_blockSizeCached = false; 
+
+    return true; 
+}
+
+const uint8_t* Metadata_block::getSourceData() const {
+    if (m_dirty||m_rawSource==nullptr||!m_rawSource->contains(m_rawOffset, m_rawLength)) {
+        return nullptr; 
+    }
+    return m_rawSource->getData()+m_rawOffset; 
+}
+
+uint32_t Metadata_block::getCachedBlockSize() const {
+    if (!m_dirty&&m_rawSource!=nullptr) {
+        return m_rawLength; 
+    }
+    if (!m_blockSizeCached) {
+        m_cachedBlockSize = getBlockSize(); 
+        m_blockSizeCached = true; 
+    }
+    return m_cachedBlockSize; 
+}
+
+uint32_t Metadata_block::write(void* data, bool ifLast) {
+    const uint8_t* raw = getSourceData(); 
+    if (raw==nullptr) {
+        return resave(data, ifLast); 
+    }
+
+    // 未修改的block只需重写block头（last标记可能变化），数据直接复制
+    uint8_t* pin = (uint8_t*)data; 
+    pin[0] = ifLast?(m_rawTypeNum|0x80):m_rawTypeNum; 
+    uint32_t unblockSize = byteswap(m_rawLength); 
+    memcpy(pin+1, (char*)&unblockSize+1, 3); 
+    memcpy(pin+4, raw, m_rawLength); 
+
+    return m_rawLength+4; 
+}
+
 StreamInfoMetaBlock::StreamInfoMetaBlock(void* data, uint32_t length)
     : Metadata_block(length, STREAM_INFO) {
     // 判断长度是否合理
@@ -87,65 +164,93 @@ bool StreamInfoMetaBlock::getUnencoderedMD5(void* dest, uint32_t length) const {
 }; 
 
 bool StreamInfoMetaBlock::setMinFrameSize(uint32_t val) {
+    if (!checkWritable()) {
+        return false; 
+    }
     if (val>UINT24_MAX) {
         LOGW("fail setMinFrameSize, val should <= 16777215, but got %d\n", val); 
         return false; 
     }
     m_minFrameSize = val; 
+    setDirty(); 
     return true; 
 }
 
 bool StreamInfoMetaBlock::setMaxFrameSize(uint32_t val) {
+    if (!checkWritable()) {
+        return false; 
+    }
     if (val>UINT24_MAX) {
         LOGW("fail setMaxFrameSize, val should <= 16777215, but got %d\n", val); 
         return false; 
     }
     m_maxFrameSize = val; 
+    setDirty(); 
     return true; 
 }
 
 bool StreamInfoMetaBlock::setSampleRate(uint32_t val) {
+    if (!checkWritable()) {
+        return false; 
+    }
     if (val>0xFFFFF) {
         LOGW("fail setSampleRate, val should <= 1048575, but got %d\n", val); 
         return false; 
     }
     m_sampleRate = val; 
+    setDirty(); 
     return true; 
 }
 
 bool StreamInfoMetaBlock::setChannels(uint8_t val) {
+    if (!checkWritable()) {
+        return false; 
+    }
     if (val<1||val>8) {
         LOGW("fail setChannels, val should 1~8, but got %d\n", val); 
         return false; 
     }
     m_channels = val - 1; 
+    setDirty(); 
     return true; 
 }
 
 bool StreamInfoMetaBlock::setSampleBits(uint8_t val) {
+    if (!checkWritable()) {
+        return false; 
+    }
     if (val<4||val>32) {
         LOGW("fail setSampleBits, val should 4~32, but got %d\n", val); 
         return false; 
     }
     m_sampleBits = val - 1; 
+    setDirty(); 
     return true; 
 }
 
 bool StreamInfoMetaBlock::setSamplePerChannel(uint64_t val) {
+    if (!checkWritable()) {
+        return false; 
+    }
     if (val>0xFFFFFFFFF) {
         LOGW("fail setSamplePerChannel, val should <= 68719476735, but got %lld\n", val); 
         return false; 
     }
     m_samplePerChannel = val; 
+    setDirty(); 
     return true; 
 }
 
 bool StreamInfoMetaBlock::setUnencoderedMD5(void* val, uint32_t length) {
+    if (!checkWritable()) {
+        return false; 
+    }
     if (length!=STREAMINFO_MD5_SIZE) {
         LOGW("fail setUnencoderedMD5, val's length should be %d, but got %d\n", STREAMINFO_MD5_SIZE, length); 
         return false; 
     }
     memcpy(m_unencoderedMD5, val, STREAMINFO_MD5_SIZE); 
+    setDirty(); 
     return true; 
 }
 
@@ -320,7 +425,11 @@ bool ApplicationMetaBlock::getAppData(void* dest, uint32_t length) const {
 }
 
 void ApplicationMetaBlock::setAppData(void* val, uint8_t length) {
+    if (!checkWritable()) {
+        return; 
+    }
     m_appData.rewrite(val, length); 
+    setDirty(); 
 }
 
 uint32_t ApplicationMetaBlock::getBlockSize() const {
@@ -388,6 +497,10 @@ SeekTableMetaBlock::SeekTableMetaBlock(void* data, uint32_t length)
     }
 }
 
+SeekTableMetaBlock::SeekTableMetaBlock()
+    : Metadata_block(1, SEEKTABLE) {
+}
+
 SeekTableMetaBlock::~SeekTableMetaBlock() {
 }
 
@@ -402,7 +515,10 @@ bool SeekTableMetaBlock::getSeekPoints(std::vector<SeekPoint>& dest) const {
 }
 
 bool SeekTableMetaBlock::addSeekPoint(SeekTableMetaBlock::SeekPoint& val) {
-    uint32_t blockSize = getBlockSize(); 
+    if (!checkWritable()) {
+        return false; 
+    }
+    uint32_t blockSize = getCachedBlockSize(); 
     if (UINT24_MAX-18<blockSize) {
         LOGW("fail addSeekPoint, the block is too much, size = %d\n", blockSize); 
         return false; 
@@ -413,6 +529,7 @@ bool SeekTableMetaBlock::addSeekPoint(SeekTableMetaBlock::SeekPoint& val) {
         return false; 
     }
     m_seekPoints.emplace(val); 
+    setDirty(); 
     return true; 
 }
 
@@ -422,12 +539,16 @@ bool SeekTableMetaBlock::addSeekPoint(uint64_t fsn, uint64_t ofs, uint16_t sn) {
 }
 
 bool SeekTableMetaBlock::delSeekPoint(SeekTableMetaBlock::SeekPoint& val) {
+    if (!checkWritable()) {
+        return false; 
+    }
     if (m_seekPoints.find(val)==m_seekPoints.end()) {
         LOGW("fail delSeekPoint, seekPoint {firstSampleNO = %d, offsetFromFirst = %d, sampleNum = %d} not exists\n",
             val.firstSampleNO, val.offsetFromFirst, val.sampleNum); 
         return false; 
     }
     m_seekPoints.erase(val); 
+    setDirty(); 
     return true; 
 }
 
@@ -508,8 +629,8 @@ uint32_t SeekTableMetaBlock::resave(void* data, bool ifLast) {
     return blockSize+4;
 }
 
-VorbisCommentMetaBlock::VorbisCommentMetaBlock(void* data, uint32_t length)
-    : Metadata_block(length, VORBIS_COMMEN) {
+VorbisCommentMetaBlock::VorbisCommentMetaBlock(void* data, uint32_t length, Arena* arena)
+    : Metadata_block(length, VORBIS_COMMEN, true, arena) {
     if (length>=8&&length<=UINT24_MAX) {
         initBlock(data, length); 
     } else {
@@ -525,14 +646,14 @@ VorbisCommentMetaBlock::VorbisCommentMetaBlock(const std::string& encoderIdentif
         setDataValid(false); 
     } else {
         m_encoderIdentificationLength = encoderIdentification.size(); 
-        m_encoderIdentification = new char[m_encoderIdentificationLength]; 
+        m_encoderIdentification = allocField(m_encoderIdentificationLength); 
         memcpy(m_encoderIdentification, encoderIdentification.c_str(), m_encoderIdentificationLength); 
     }
 }
 
 VorbisCommentMetaBlock::~VorbisCommentMetaBlock() {
     if (m_encoderIdentification!=nullptr) {
-        delete[] m_encoderIdentification; 
+        freeField(m_encoderIdentification); 
     }
 }
 
@@ -598,29 +719,36 @@ std::string VorbisCommentMetaBlock::getLabelWithKey(const std::string& key, uint
 }
 
 bool VorbisCommentMetaBlock::setEncoderIdentification(const std::string& val) {
+    if (!checkWritable()) {
+        return false; 
+    }
     if (val.size()>m_encoderIdentificationLength
-        &&val.size()>UINT24_MAX-getBlockSize()+m_encoderIdentificationLength) {
+        &&val.size()>UINT24_MAX-getCachedBlockSize()+m_encoderIdentificationLength) {
         LOGW("fail setEncoderIdentification, new val is too long, should <=%d, length = %d\n"
-            , UINT24_MAX-getBlockSize()+m_encoderIdentificationLength, val.size()); 
+            , UINT24_MAX-getCachedBlockSize()+m_encoderIdentificationLength, val.size()); 
         return false; 
     }
     
     m_encoderIdentificationLength = val.size(); 
     if (m_encoderIdentification!=nullptr) {
-        delete[] m_encoderIdentification; 
+        freeField(m_encoderIdentification); 
         m_encoderIdentification = nullptr; 
     }
     if (m_encoderIdentificationLength>0) {
-        m_encoderIdentification = new char[m_encoderIdentificationLength]; 
+        m_encoderIdentification = allocField(m_encoderIdentificationLength); 
         memcpy(m_encoderIdentification, val.c_str(), m_encoderIdentificationLength); 
     }
     
+    setDirty(); 
     return true; 
 }
 
 bool VorbisCommentMetaBlock::addInfoLabel(const std::string& key, const std::string& val, int pos) {
+    if (!checkWritable()) {
+        return false; 
+    }
     if (key.size()>UINT24_MAX||val.size()>UINT24_MAX||
-        key.size()+val.size()+5+getBlockSize()>UINT24_MAX) {
+        key.size()+val.size()+5+getCachedBlockSize()>UINT24_MAX) {
         LOGW("fail addInfoLabel, new val is too long, key length = %d, val length = %d\n", key.size(), val.size()); 
         return false; 
     }
@@ -635,10 +763,14 @@ bool VorbisCommentMetaBlock::addInfoLabel(const std::string& key, const std::str
         m_infoLabels.at(key).emplace(m_infoLabels.at(key).begin()+pos, val); 
     }
 
+    setDirty(); 
     return true; 
 }
 
 bool VorbisCommentMetaBlock::delInfoLabel(const std::string& key, const std::string& val) {
+    if (!checkWritable()) {
+        return false; 
+    }
     if (m_infoLabels.find(key)==m_infoLabels.end()) {
         LOGW("fail delInfoLabel, key not exists, key = %s", key); 
         return false; 
@@ -656,10 +788,14 @@ bool VorbisCommentMetaBlock::delInfoLabel(const std::string& key, const std::str
         m_infoLabels.erase(key); 
     }
 
+    setDirty(); 
     return true; 
 }
 
 bool VorbisCommentMetaBlock::delInfoLabel(const std::string& key, uint32_t pos) {
+    if (!checkWritable()) {
+        return false; 
+    }
     if (m_infoLabels.find(key)==m_infoLabels.end()) {
         LOGW("fail delInfoLabel, key not exists, key = %s", key); 
         return false; 
@@ -676,10 +812,30 @@ bool VorbisCommentMetaBlock::delInfoLabel(const std::string& key, uint32_t pos)
         m_infoLabels.erase(key); 
     }
 
+    setDirty(); 
     return true; 
 }
 
+uint32_t VorbisCommentMetaBlock::delAllInfoLabel(const std::string& key) {
+    if (!checkWritable()) {
+        return 0; 
+    }
+    auto it = m_infoLabels.find(key); 
+    if (it==m_infoLabels.end()) {
+        return 0; 
+    }
+
+    uint32_t num = it->second.size(); 
+    m_infoLabels.erase(it); 
+
+    setDirty(); 
+    return num; 
+}
+
 uint32_t VorbisCommentMetaBlock::delAllMatchInfoLabel(const std::string& key, const std::string& val) {
+    if (!checkWritable()) {
+        return 0; 
+    }
     if (m_infoLabels.find(key)==m_infoLabels.end()) {
         LOGW("fail delAllMatchInfoLabel, key not exists, key = %s", key); 
         return 0; 
@@ -702,10 +858,14 @@ uint32_t VorbisCommentMetaBlock::delAllMatchInfoLabel(const std::string& key, co
         m_infoLabels.erase(key); 
     }
 
+    setDirty(); 
     return num; 
 }
 
 int8_t VorbisCommentMetaBlock::setLabelVal(const std::string& key, const std::string& val, uint32_t pos) {
+    if (!checkWritable()) {
+        return 4; 
+    }
     if (m_infoLabels.find(key)==m_infoLabels.end()) {
         LOGW("fail setLabelVal, key not exists, key = %s", key); 
         return 1; 
@@ -720,17 +880,21 @@ int8_t VorbisCommentMetaBlock::setLabelVal(const std::string& key, const std::st
     std::string old_val = key_label[pos]; 
     
     if (val.size()>UINT24_MAX
-        ||getBlockSize()-old_val.size()>UINT24_MAX-val.size()) {
+        ||getCachedBlockSize()-old_val.size()>UINT24_MAX-val.size()) {
         LOGW("fail setLabelVal, new value too long, length = %d", val.size()); 
         return 3; 
     }
 
     key_label[pos] = val; 
 
+    setDirty(); 
     return 0; 
 }
 
 bool  VorbisCommentMetaBlock::resetPosLabelVal(const std::string& key, uint32_t old_pos, uint32_t new_pos) {
+    if (!checkWritable()) {
+        return false; 
+    }
     if (old_pos==new_pos) {
         LOGW("new_pos=old_pos, do not need to change"); 
         return true; 
@@ -750,10 +914,14 @@ bool  VorbisCommentMetaBlock::resetPosLabelVal(const std::string& key, uint32_t
     labels.erase(labels.begin()+old_pos); 
     labels.emplace(labels.begin()+new_pos, value); 
 
+    setDirty(); 
     return true; 
 }
 
 uint32_t VorbisCommentMetaBlock::deduplication() {
+    if (!checkWritable()) {
+        return 0; 
+    }
     uint32_t decreaseByte = 0; 
     uint32_t num = 0; 
 
@@ -774,6 +942,10 @@ uint32_t VorbisCommentMetaBlock::deduplication() {
         }
     }
 
+    if (num>0) {
+        setDirty(); 
+    }
+
     return num; 
 }
 
@@ -803,11 +975,11 @@ void VorbisCommentMetaBlock::initBlock(void* data, uint32_t length) {
     pin+=4; 
 
     if (m_encoderIdentification!=nullptr) {
-        delete[] m_encoderIdentification; 
+        freeField(m_encoderIdentification); 
         m_encoderIdentification = nullptr; 
     }
     if (m_encoderIdentificationLength>0) {
-        m_encoderIdentification = new char[m_encoderIdentificationLength]; 
+        m_encoderIdentification = allocField(m_encoderIdentificationLength); 
         memcpy(m_encoderIdentification, pin, m_encoderIdentificationLength); 
         pin+=m_encoderIdentificationLength; 
     }
@@ -828,13 +1000,10 @@ void VorbisCommentMetaBlock::initBlock(void* data, uint32_t length) {
         uint32_t label_length = *(uint32_t*)pin; 
         pin+=4; 
 
-        char tmp_str[label_length]; 
-        memcpy(tmp_str, pin, label_length); 
+        std::string tmp_s((const char*)pin, label_length); 
         pin+=label_length; 
 
         dataSize-=4+label_length; 
-
-        std::string tmp_s = tmp_str; 
         
         uint32_t equ_pos = tmp_s.find_first_of('=', 0); 
         if (equ_pos==-1) {
@@ -1123,9 +1292,10 @@ uint32_t CuesheetMetaBlock::resave(void* data, bool ifLast) {
     return blockSize+4;
 }
 
-PictureMetaBlock::PictureMetaBlock(void* data, uint32_t length)
-    : Metadata_block(length, PICTURE)
-    , m_pictureData() {
+PictureMetaBlock::PictureMetaBlock(void* data, uint32_t length, MappedFile::ptr source, Arena* arena)
+    : Metadata_block(length, PICTURE, true, arena)
+    , m_pictureData()
+    , m_source(source) {
     // 数据至少是32 byte
     if (length>=32&&length<=UINT24_MAX) {
         initBlock(data, length); 
@@ -1145,7 +1315,7 @@ PictureMetaBlock::PictureMetaBlock(const Image& img)
             LOGE("img data too long"); 
             setDataValid(false); 
         } else {
-            m_mimeType = new char[m_mimeLength]; 
+            m_mimeType = allocField(m_mimeLength); 
             memcpy(m_mimeType, mimeType.c_str(), m_mimeLength); 
             m_descriptorLength = 0; 
             m_pictureWidth = img.getWidth(); 
@@ -1155,6 +1325,7 @@ PictureMetaBlock::PictureMetaBlock(const Image& img)
             void* buf = malloc(dataLength); 
             img.getData(buf, dataLength); 
             m_pictureData.rewrite(buf, dataLength); 
+            m_pictureDataLength = dataLength; 
             free(buf); 
         }
     } else {
@@ -1165,10 +1336,10 @@ PictureMetaBlock::PictureMetaBlock(const Image& img)
 
 PictureMetaBlock::~PictureMetaBlock() {
     if (m_mimeType!=nullptr) {
-        delete[] m_mimeType; 
+        freeField(m_mimeType); 
     }
     if (m_descriptor!=nullptr) {
-        delete[] m_descriptor; 
+        freeField(m_descriptor); 
     }
 }
 
@@ -1217,17 +1388,66 @@ bool PictureMetaBlock::getDescriptor(void* dest, uint32_t length) const {
 }
 
 bool PictureMetaBlock::getPictureData(void* dest, uint32_t length) const {
-    if (length!=m_pictureData.getSize()) {
-        LOGE("fail getPictureData, length should be %d, but got %d\n", m_pictureData.getSize(), length); 
+    if (length!=m_pictureDataLength) {
+        LOGE("fail getPictureData, length should be %d, but got %d\n", m_pictureDataLength, length); 
+        return false; 
+    }
+
+    if (m_source!=nullptr) {
+        const uint8_t* pin = getMappedPictureData(); 
+        if (pin==nullptr) {
+            LOGE("fail getPictureData, source file not available"); 
+            return false; 
+        }
+        memcpy(dest, pin, length); 
+    } else {
+        m_pictureData.getDataBuffers(dest, length); 
+    }
+
+    return true; 
+}
+
+const uint8_t* PictureMetaBlock::getMappedPictureData() const {
+    if (m_source==nullptr||!m_source->contains(m_sourceOffset, m_pictureDataLength)) {
+        return nullptr; 
+    }
+    return m_source->getData()+m_sourceOffset; 
+}
+
+bool PictureMetaBlock::loadPictureData() {
+    if (m_source==nullptr) {
+        return true; 
+    }
+
+    const uint8_t* pin = getMappedPictureData(); 
+    if (pin==nullptr) {
+        LOGE("fail loadPictureData, source file not available"); 
+        return false; 
+    }
+    m_pictureData.rewrite(pin, m_pictureDataLength); 
+    m_source = nullptr; 
+    m_sourceOffset = 0; 
+
+    return true; 
+}
+
+bool PictureMetaBlock::bindPictureData(MappedFile::ptr source, uint64_t offset) {
+    if (source==nullptr||!source->contains(offset, m_pictureDataLength)) {
+        LOGE("fail bindPictureData, offset out of file"); 
         return false; 
     }
 
-    m_pictureData.getDataBuffers(dest, length); 
+    m_source = source; 
+    m_sourceOffset = offset; 
+    m_pictureData.clear(); 
 
     return true; 
 }
 
 bool PictureMetaBlock::setDescriptor(const std::string& val) {
+    if (!checkWritable()) {
+        return false; 
+    }
     if (val.size()>0xFFFFFF-getBlockSize()-m_descriptorLength) {
         LOGE("fail setDescriptor, length too long, set length = \n", val.size()); 
         return false; 
@@ -1236,19 +1456,23 @@ bool PictureMetaBlock::setDescriptor(const std::string& val) {
     if (m_descriptorLength!=val.size()) {
         m_descriptorLength = val.size(); 
         if (m_descriptor!=nullptr) {
-            delete[] m_descriptor; 
+            freeField(m_descriptor); 
             m_descriptor=nullptr; 
         }
         if (m_descriptorLength>0) {
-            m_descriptor=new char[val.size()]; 
+            m_descriptor=allocField(val.size()); 
             memcpy(m_descriptor, val.c_str(), m_descriptorLength); 
         }
     }
 
+    setDirty(); 
     return true; 
 }
 
 bool PictureMetaBlock::setPicture(const Image& img) {
+    if (!checkWritable()) {
+        return false; 
+    }
     size_t img_size = img.getDataSize(); 
     std::string mimeType = Image::getMimeTyepFromImageType(img.getType()); 
     // 判断大小是否合适，应该img data和mimeType字符串长度和应该小于0xFFFFFF-32
@@ -1258,15 +1482,15 @@ bool PictureMetaBlock::setPicture(const Image& img) {
     }
 
     if (m_mimeType!=nullptr) {
-        delete[] m_mimeType; 
+        freeField(m_mimeType); 
         m_mimeType = nullptr; 
     }
     m_mimeLength = mimeType.size(); 
-    m_mimeType = new char[m_mimeLength]; 
+    m_mimeType = allocField(m_mimeLength); 
     memcpy(m_mimeType, mimeType.c_str(), m_mimeLength); 
 
     if (m_descriptor!=nullptr) {
-        delete[] m_descriptor; 
+        freeField(m_descriptor); 
         m_descriptor = nullptr; 
     }
     m_descriptor = 0; 
@@ -1279,8 +1503,14 @@ bool PictureMetaBlock::setPicture(const Image& img) {
     void* buf = malloc(img_size); 
     img.getData(buf, img_size); 
     m_pictureData.rewrite(buf, img_size); 
+    m_pictureDataLength = img_size; 
     free(buf); 
 
+    // 图片已替换，不再引用源文件
+    m_source = nullptr; 
+    m_sourceOffset = 0; 
+
+    setDirty(); 
     return true; 
 }
 
@@ -1290,7 +1520,7 @@ uint32_t PictureMetaBlock::getBlockSize() const {
         return 0; 
     }
 
-    uint32_t blockSize = 32+m_mimeLength+m_descriptorLength+m_pictureData.getSize(); 
+    uint32_t blockSize = 32+m_mimeLength+m_descriptorLength+m_pictureDataLength; 
 
     return blockSize; 
 }
@@ -1306,11 +1536,11 @@ void PictureMetaBlock::initBlock(void* data, uint32_t length) {
     pin+=4; 
 
     if (m_mimeType!=nullptr) {
-        delete[] m_mimeType; 
+        freeField(m_mimeType); 
         m_mimeType = nullptr; 
     }
     if (m_mimeLength>0) {
-        m_mimeType = new char[m_mimeLength]; 
+        m_mimeType = allocField(m_mimeLength); 
     }
     memcpy(m_mimeType, pin, m_mimeLength); 
     pin+=m_mimeLength; 
@@ -1319,11 +1549,11 @@ void PictureMetaBlock::initBlock(void* data, uint32_t length) {
     pin+=4; 
 
     if (m_descriptor!=nullptr) {
-        delete[] m_descriptor; 
+        freeField(m_descriptor); 
         m_descriptor = nullptr; 
     }
     if (m_descriptorLength>0) {
-        m_descriptor = new char[m_descriptorLength]; 
+        m_descriptor = allocField(m_descriptorLength); 
     }
     memcpy(m_descriptor, pin, m_descriptorLength); 
     pin+=m_descriptorLength; 
@@ -1343,15 +1573,40 @@ void PictureMetaBlock::initBlock(void* data, uint32_t length) {
     uint32_t pictureDataLength = byteswap(*(uint32_t*)pin); 
     pin+=4; 
 
-    m_pictureData.rewrite(pin, pictureDataLength); 
-
     if (m_mimeLength+m_descriptorLength+pictureDataLength+32!=length) {
-        LOGE("invalid length for Picture block, length not fit data but length=%d\n"); 
+        LOGE("invalid length for Picture block, length not fit data but length=%d\n", length); 
         setDataValid(false); 
+        m_source = nullptr; 
+        return; 
+    }
+
+    m_pictureDataLength = pictureDataLength; 
+    // 图片数据在源文件映射中时只记录位置，需要时再读取
+    if (m_source!=nullptr&&pin>=m_source->getData()&&m_source->contains(pin-m_source->getData(), pictureDataLength)) {
+        m_sourceOffset = pin-m_source->getData(); 
+    } else {
+        m_source = nullptr; 
+        m_pictureData.rewrite(pin, pictureDataLength); 
     }
 }
 
 uint32_t PictureMetaBlock::resave(void* data, bool ifLast) {
+    uint32_t headerSize = resaveHeader(data, ifLast); 
+    if (headerSize==0) {
+        return 0; 
+    }
+
+    if (m_pictureDataLength>0) {
+        if (!getPictureData((uint8_t*)data+headerSize, m_pictureDataLength)) {
+            LOGE("picture data not available, resave fail"); 
+            return 0; 
+        }
+    }
+
+    return headerSize+m_pictureDataLength; 
+}
+
+uint32_t PictureMetaBlock::resaveHeader(void* data, bool ifLast) {
     if (!isDataValid()) {
         LOGE("can not convert invalid block!\n"); 
         return 0; 
@@ -1415,20 +1670,15 @@ uint32_t PictureMetaBlock::resave(void* data, bool ifLast) {
     memcpy(pin, &pic_cn, 4); 
     pin+=4; 
 
-    uint32_t pictureDataLength = m_pictureData.getSize(); 
-    uint32_t pic_dl = byteswap(pictureDataLength); 
+    uint32_t pic_dl = byteswap(m_pictureDataLength); 
     memcpy(pin, &pic_dl, 4); 
     pin+=4; 
 
-    if (pictureDataLength>0) {
-        m_pictureData.getDataBuffers(pin, pictureDataLength); 
-    }
-
-    return blockSize+4;
+    return 4+getPictureDataOffset(); 
 }
 
-UnknownMetaBlock::UnknownMetaBlock(void* data, uint32_t length, uint8_t typeNum)
-    : Metadata_block(length, UNKNOWN_RESERVED)
+UnknownMetaBlock::UnknownMetaBlock(void* data, uint32_t length, uint8_t typeNum, Arena* arena)
+    : Metadata_block(length, UNKNOWN_RESERVED, true, arena)
     , m_typeNum(typeNum) {
     if (length>0) {
         initBlock(data, length); 
@@ -1441,7 +1691,7 @@ UnknownMetaBlock::UnknownMetaBlock(void* data, uint32_t length, uint8_t typeNum)
 
 UnknownMetaBlock::~UnknownMetaBlock() {
     if (m_data!=nullptr) {
-        delete[] m_data; 
+        freeField(m_data); 
     }
 }
 
@@ -1467,12 +1717,12 @@ uint32_t UnknownMetaBlock::getBlockSize() const {
 
 void UnknownMetaBlock::initBlock(void* data, uint32_t length) {
     if (m_data!=nullptr) {
-        delete[] m_data; 
+        freeField(m_data); 
         m_data = nullptr; 
     }
     uint32_t data_length = length; 
     if (data_length>0) {
-        m_data = new char[data_length]; 
+        m_data = allocField(data_length); 
         memcpy(m_data, data, data_length); 
     }
 }
@@ -1510,8 +1760,8 @@ uint32_t UnknownMetaBlock::resave(void* data, bool ifLast) {
     return blockSize+4;
 }
 
-InvalidMetaBlock::InvalidMetaBlock(void* data, uint32_t length)
-    : Metadata_block(length, UNKNOWN_RESERVED) {
+InvalidMetaBlock::InvalidMetaBlock(void* data, uint32_t length, Arena* arena)
+    : Metadata_block(length, UNKNOWN_RESERVED, true, arena) {
     if (length>0) {
         initBlock(data, length); 
         m_length = length; 
@@ -1523,7 +1773,7 @@ InvalidMetaBlock::InvalidMetaBlock(void* data, uint32_t length)
 
 InvalidMetaBlock::~InvalidMetaBlock() {
     if (m_data!=nullptr) {
-        delete[] m_data; 
+        freeField(m_data); 
     }
 }
 
@@ -1549,12 +1799,12 @@ uint32_t InvalidMetaBlock::getBlockSize() const {
 
 void InvalidMetaBlock::initBlock(void* data, uint32_t length) {
     if (m_data!=nullptr) {
-        delete[] m_data; 
+        freeField(m_data); 
         m_data = nullptr; 
     }
     uint32_t data_length = length; 
     if (data_length>0) {
-        m_data = new char[data_length]; 
+        m_data = allocField(data_length); 
         memcpy(m_data, data, data_length); 
     }
 }
@@ -1592,6 +1842,39 @@ uint32_t InvalidMetaBlock::resave(void* data, bool ifLast) {
     return blockSize+4;
 }
 
+MetaBlockIterator::MetaBlockIterator(const void* data, size_t length)
+    : m_data((const uint8_t*)data)
+    , m_length(data==nullptr?0:length) {
+    m_isFlac = m_length>=4&&memcmp(m_data, "fLaC", 4)==0; 
+}
+
+bool MetaBlockIterator::next(BlockInfo& dest) {
+    if (!m_isFlac||m_isFinished||m_isBroken||m_position>=m_length) {
+        return false; 
+    }
+    if (m_position+4>m_length) {
+        m_isBroken = true; 
+        return false; 
+    }
+
+    // block头：1 bit last标记 + 7 bit类型，24 bit大端长度
+    const uint8_t* pin = m_data+m_position; 
+    uint32_t blockSize = ((uint32_t)pin[1]<<16)|((uint32_t)pin[2]<<8)|pin[3]; 
+    if (m_position+4+blockSize>m_length) {
+        m_isBroken = true; 
+        return false; 
+    }
+
+    dest.typeNum = pin[0]&0x7F; 
+    dest.isLast = (pin[0]&0x80)!=0; 
+    dest.offset = m_position+4; 
+    dest.length = blockSize; 
+
+    m_position+=4+blockSize; 
+    m_isFinished = dest.isLast; 
+    return true; 
+}
+
 MusicDecoderflac::MusicDecoderflac() {
 }
 
@@ -1606,6 +1889,73 @@ MusicDecoderflac::MusicDecoderflac(const wchar_t* file_name) {
 MusicDecoderflac::~MusicDecoderflac() {
 }
 
+void MusicDecoderflac::reset() {
+    // 先释放全部block，arena没有其他引用时才能重置
+    m_streamInfo = nullptr; 
+    m_padding = nullptr; 
+    m_application = nullptr; 
+    m_seekTable = nullptr; 
+    m_vorbisComment = nullptr; 
+    m_cuesheet = nullptr; 
+    m_pictures.clear(); 
+    m_unknownReservedData.clear(); 
+    m_invalidData.clear(); 
+    m_pendingSave = nullptr; 
+    m_audioFramesLength = 0; 
+
+    if (m_arena!=nullptr) {
+        if (m_arena.use_count()==1) {
+            m_arena->reset(); 
+        } else {
+            m_arena = nullptr; 
+        }
+    }
+
+    MusicDecoder::reset(); 
+}
+
+/// @brief 每个线程池中最多保留的空闲解码器数
+static const size_t s_maxIdleDecoderNum = 8; 
+
+std::vector<MusicDecoderflac::ptr>& MusicDecoderflacPool::GetIdleList() {
+    thread_local std::vector<MusicDecoderflac::ptr> s_idle; 
+    return s_idle; 
+}
+
+MusicDecoderflac::ptr MusicDecoderflacPool::Acquire(const wchar_t* file_path) {
+    auto& idle = GetIdleList(); 
+    MusicDecoderflac::ptr decoder; 
+    if (idle.empty()) {
+        decoder = std::make_shared<MusicDecoderflac>(); 
+    } else {
+        decoder = idle.back(); 
+        idle.pop_back(); 
+    }
+    if (!decoder->openFile(file_path)) {
+        Release(decoder); 
+    }
+    return decoder; 
+}
+
+void MusicDecoderflacPool::Release(MusicDecoderflac::ptr& decoder) {
+    if (decoder==nullptr) {
+        return; 
+    }
+    auto& idle = GetIdleList(); 
+    if (decoder.use_count()==1&&idle.size()<s_maxIdleDecoderNum) {
+        decoder->reset(); 
+        if (idle.capacity()==0) {
+            idle.reserve(s_maxIdleDecoderNum); 
+        }
+        idle.emplace_back(decoder); 
+    }
+    decoder = nullptr; 
+}
+
+size_t MusicDecoderflacPool::GetIdleNum() {
+    return GetIdleList().size(); 
+}
+
 bool MusicDecoderflac::addMetaDataBlock(void* data, uint32_t length, uint8_t type) {
     Metadata_block::MetadataBlockType mtype = (type>=7&&type<127)?Metadata_block::UNKNOWN_RESERVED:Metadata_block::MetadataBlockType(type); 
     bool isvalid = true; 
@@ -1613,7 +1963,8 @@ bool MusicDecoderflac::addMetaDataBlock(void* data, uint32_t length, uint8_t typ
     switch (mtype) {
         case Metadata_block::STREAM_INFO: {
             if (m_streamInfo==nullptr) {
-                m_streamInfo = std::make_shared<StreamInfoMetaBlock>(data, length); 
+                m_streamInfo = createBlock<StreamInfoMetaBlock>(data, length); 
+                bindBlockSource(m_streamInfo, data, length); 
                 isvalid = m_streamInfo->isDataValid(); 
             } else {
                 LOGE("StreamInfoBlock is exsiting already, please do not add new StreamInfoBlock\n"); 
@@ -1622,16 +1973,20 @@ bool MusicDecoderflac::addMetaDataBlock(void* data, uint32_t length, uint8_t typ
         }
         case Metadata_block::PADDING: {
             if (m_padding==nullptr) {
-                m_padding = std::make_shared<PaddingMetaBlock>(length); 
+                m_padding = createBlock<PaddingMetaBlock>(length); 
+                bindBlockSource(m_padding, data, length); 
                 isvalid = m_padding->isDataValid(); 
             } else {
-                LOGE("PaddingBlock is exsiting already, please do not add new PaddingBlock\n"); 
+                // 多个padding block合并为一个，总长度不变
+                LOGI("merge duplicate PaddingBlock\n"); 
+                m_padding->addPaddingByte(length+4); 
             }
             break; 
         }
         case Metadata_block::APPLICATION: {
             if (m_application==nullptr) {
-                m_application = std::make_shared<ApplicationMetaBlock>(data, length); 
+                m_application = createBlock<ApplicationMetaBlock>(data, length); 
+                bindBlockSource(m_application, data, length); 
                 isvalid = m_application->isDataValid(); 
             } else {
                 LOGE("ApplicationMetaBlock is exsiting already, please do not add new ApplicationMetaBlock\n"); 
@@ -1640,7 +1995,8 @@ bool MusicDecoderflac::addMetaDataBlock(void* data, uint32_t length, uint8_t typ
         }
         case Metadata_block::SEEKTABLE: {
             if (m_seekTable==nullptr) {
-                m_seekTable = std::make_shared<SeekTableMetaBlock>(data, length); 
+                m_seekTable = createBlock<SeekTableMetaBlock>(data, length); 
+                bindBlockSource(m_seekTable, data, length); 
                 isvalid = m_seekTable->isDataValid(); 
             } else {
                 LOGE("SeekTableMetaBlock is exsiting already, please do not add new SeekTableMetaBlock\n"); 
@@ -1649,7 +2005,8 @@ bool MusicDecoderflac::addMetaDataBlock(void* data, uint32_t length, uint8_t typ
         }
         case Metadata_block::VORBIS_COMMEN: {
             if (m_vorbisComment==nullptr) {
-                m_vorbisComment = std::make_shared<VorbisCommentMetaBlock>(data, length); 
+                m_vorbisComment = createBlock<VorbisCommentMetaBlock>(data, length, m_arena.get()); 
+                bindBlockSource(m_vorbisComment, data, length); 
                 isvalid = m_vorbisComment->isDataValid(); 
             } else {
                 LOGE("VorbisCommentMetaBlock is exsiting already, please do not add new VorbisCommentMetaBlock\n"); 
@@ -1658,7 +2015,8 @@ bool MusicDecoderflac::addMetaDataBlock(void* data, uint32_t length, uint8_t typ
         }
         case Metadata_block::CUESHEET: {
             if (m_cuesheet==nullptr) {
-                m_cuesheet = std::make_shared<CuesheetMetaBlock>(data, length); 
+                m_cuesheet = createBlock<CuesheetMetaBlock>(data, length); 
+                bindBlockSource(m_cuesheet, data, length); 
                 isvalid = m_cuesheet->isDataValid(); 
             } else {
                 LOGE("CuesheetMetaBlock is exsiting already, please do not add new CuesheetMetaBlock\n"); 
@@ -1666,20 +2024,23 @@ bool MusicDecoderflac::addMetaDataBlock(void* data, uint32_t length, uint8_t typ
             break; 
         }
         case Metadata_block::PICTURE: {
-            PictureMetaBlock::ptr ans(new PictureMetaBlock(data, length)); 
+            PictureMetaBlock::ptr ans = createBlock<PictureMetaBlock>(data, length, m_source, m_arena.get()); 
             isvalid = ans->isDataValid(); 
+            bindBlockSource(ans, data, length); 
             m_pictures.emplace_back(ans); 
             break; 
         }
         case Metadata_block::INVALID: {
-            InvalidMetaBlock::ptr ans(new InvalidMetaBlock(data, length)); 
+            InvalidMetaBlock::ptr ans = createBlock<InvalidMetaBlock>(data, length, m_arena.get()); 
             isvalid = ans->isDataValid(); 
+            bindBlockSource(ans, data, length); 
             m_invalidData.emplace_back(ans); 
             break; 
         }
         default: {
-            UnknownMetaBlock::ptr ans(new UnknownMetaBlock(data, length, type)); 
+            UnknownMetaBlock::ptr ans = createBlock<UnknownMetaBlock>(data, length, type, m_arena.get()); 
             isvalid = ans->isDataValid(); 
+            bindBlockSource(ans, data, length); 
             m_unknownReservedData.emplace_back(ans); 
             break; 
         }
@@ -1688,13 +2049,23 @@ bool MusicDecoderflac::addMetaDataBlock(void* data, uint32_t length, uint8_t typ
     return isvalid; 
 }
 
+void MusicDecoderflac::bindBlockSource(Metadata_block::ptr block, void* data, uint32_t length) {
+    if (m_source==nullptr||!m_source->isOpen()||(const uint8_t*)data<m_source->getData()) {
+        return; 
+    }
+    uint64_t offset = (const uint8_t*)data-m_source->getData(); 
+    if (block->isDataValid()&&m_source->contains(offset, length)) {
+        block->bindSource(m_source, offset, length); 
+    }
+}
+
 bool MusicDecoderflac::addVorbisCommentMetaBlock(const std::string& encoderIdentification) {
     if (m_vorbisComment!=nullptr) {
         LOGE("fail addVorbisCommentMetaBlock, already exists\n"); 
         return false; 
     }
 
-    m_vorbisComment.reset(new VorbisCommentMetaBlock(encoderIdentification)); 
+    m_vorbisComment = createBlock<VorbisCommentMetaBlock>(encoderIdentification); 
     if (!m_vorbisComment->isDataValid()) {
         LOGE("fail addVorbisCommentMetaBlock, create VorbisCommentMetaBlock fail\n"); 
         m_vorbisComment.reset(); 
@@ -1717,57 +2088,155 @@ bool MusicDecoderflac::getPictures(std::vector<PictureMetaBlock::ptr>& dest) con
 }
 
 void MusicDecoderflac::initData(void* data, size_t length) {
-    uint8_t* pin = (uint8_t*)data; 
-    char label[5]; 
-    strncpy(label, (const char*)pin, 4); 
-    label[4]='\0'; 
-    if (!isFlac(label)) {
+    MetaBlockIterator iter(data, length); 
+    if (!iter.isFlac()) {
         LOGE("file is not flac\n"); 
         setIsValid(false); 
         return; 
     }
 
-    pin+=4; 
-
-    uint64_t n_position=4; 
-    bool ifMetaOver = false; 
-    while (n_position<length) {
-        // 判断metadata是否读完
-        if (ifMetaOver) {
-            m_audioFramesLength = length-n_position; 
-            m_audioFrames.rewrite(pin, m_audioFramesLength); 
-            n_position=length; 
-            break; 
-        }
-        
-        uint8_t metaHeaderType = *(uint8_t*)pin; 
-        if (metaHeaderType>>7==1) {
-            ifMetaOver = true; 
+    // 先遍历block头预估全部block对象与变长字段的大小，arena只申请一次内存
+    size_t arenaSize = 0; 
+    size_t pictureNum = 0; 
+    MetaBlockIterator::BlockInfo info; 
+    while (iter.next(info)) {
+        arenaSize+=s_arenaBlockReserve; 
+        if (info.getType()==Metadata_block::UNKNOWN_RESERVED||info.getType()==Metadata_block::INVALID) {
+            arenaSize+=info.length; 
+        } else if (info.getType()==Metadata_block::PICTURE) {
+            ++pictureNum; 
         }
+    }
+    // reset后没有block引用的arena直接复用
+    if (m_arena==nullptr||m_arena.use_count()>1) {
+        m_arena = std::make_shared<Arena>(arenaSize); 
+    } else {
+        m_arena->reset(); 
+        m_arena->reserve(arenaSize); 
+    }
+    m_pictures.reserve(pictureNum); 
 
-        uint8_t metaBlockType = 0x7F&metaHeaderType; 
-        
-        pin+=1; 
-
-        uint32_t blockSize = byteswap(*(uint32_t*)pin<<8); 
-        pin+=3; 
-
-        m_isValid = addMetaDataBlock((void*)pin, blockSize, metaBlockType); 
+    iter = MetaBlockIterator(data, length); 
+    while (iter.next(info)) {
+        m_isValid = addMetaDataBlock((void*)iter.getBlockData(info), info.length, info.typeNum); 
 
         if (!m_isValid) {
-            LOGE("flac file broken in block ID=%d", metaBlockType); 
+            LOGE("flac file broken in block ID=%d", info.typeNum); 
             return; 
         }
-
-        pin+=blockSize; 
-        n_position+=4+blockSize; 
     }
+    if (iter.isBroken()) {
+        setIsValid(false); 
+        LOGE("flac file broken, metadata block out of file"); 
+        return; 
+    }
+    m_audioFramesLength = length-iter.getPosition(); 
+
     if (m_streamInfo==nullptr) {
         setIsValid(false); 
         LOGE("flac file broken, no streaminfo block"); 
     }
 }
 
+bool MusicDecoderflac::ListMetaBlocks(const wchar_t* file_path, std::vector<MetaBlockIterator::BlockInfo>& dest) {
+    dest.clear(); 
+    MappedFile file; 
+    if (!file.open(file_path)) {
+        return false; 
+    }
+
+    MetaBlockIterator iter(file.getData(), file.getSize()); 
+    if (!iter.isFlac()) {
+        LOGE("file is not flac\n"); 
+        return false; 
+    }
+    MetaBlockIterator::BlockInfo info; 
+    while (iter.next(info)) {
+        dest.emplace_back(info); 
+    }
+    return iter.isFinished(); 
+}
+
+MusicDecoderflac::ptr MusicDecoderflac::fork(uint32_t cloneMask) const {
+    if (!isValid()||m_streamInfo==nullptr) {
+        LOGE("decoder is not valid, fork termination"); 
+        return nullptr; 
+    }
+
+    MusicDecoderflac::ptr ans = std::make_shared<MusicDecoderflac>(); 
+    ans->m_source = m_source; 
+    ans->m_file_path = m_file_path; 
+    ans->m_audioFramesLength = m_audioFramesLength; 
+    ans->m_paddingPolicy = m_paddingPolicy; 
+    ans->m_layout = m_layout; 
+    ans->m_ifAtomicSave = m_ifAtomicSave; 
+
+    // padding会在删除封面、保存时被调整，不能共享
+    cloneMask|=1u<<Metadata_block::PADDING; 
+    std::vector<Metadata_block::ptr> blocks; 
+    getMetaBlocks(blocks); 
+    std::vector<uint8_t> buffer; 
+    for (auto& item: blocks) {
+        if ((cloneMask&(1u<<item->getBlockType()))==0) {
+            // 双方都不能再修改共享的block
+            item->setShared(); 
+            ans->shareBlock(item); 
+            continue; 
+        }
+
+        // 未修改的block直接从映射重新解析（图片数据仍引用映射），否则先序列化
+        const uint8_t* data = item->getSourceData(); 
+        uint32_t length = item->getCachedBlockSize(); 
+        if (data==nullptr) {
+            buffer.resize(4+length); 
+            if (item->write(buffer.data())!=4+length) {
+                LOGE("metablock %d resave fail, fork termination", item->getBlockType()); 
+                return nullptr; 
+            }
+            data = buffer.data()+4; 
+        }
+        // block头中的类型号（unknown block需要原始类型号）
+        if (!ans->addMetaDataBlock((void*)data, length, data[-4]&0x7F)) {
+            LOGE("metablock %d clone fail, fork termination", item->getBlockType()); 
+            return nullptr; 
+        }
+    }
+
+    return ans; 
+}
+
+void MusicDecoderflac::shareBlock(Metadata_block::ptr block) {
+    switch (block->getBlockType()) {
+        case Metadata_block::STREAM_INFO:
+            m_streamInfo = std::static_pointer_cast<StreamInfoMetaBlock>(block); 
+            break; 
+        case Metadata_block::PADDING:
+            m_padding = std::static_pointer_cast<PaddingMetaBlock>(block); 
+            break; 
+        case Metadata_block::APPLICATION:
+            m_application = std::static_pointer_cast<ApplicationMetaBlock>(block); 
+            break; 
+        case Metadata_block::SEEKTABLE:
+            m_seekTable = std::static_pointer_cast<SeekTableMetaBlock>(block); 
+            break; 
+        case Metadata_block::VORBIS_COMMEN:
+            m_vorbisComment = std::static_pointer_cast<VorbisCommentMetaBlock>(block); 
+            break; 
+        case Metadata_block::CUESHEET:
+            m_cuesheet = std::static_pointer_cast<CuesheetMetaBlock>(block); 
+            break; 
+        case Metadata_block::PICTURE:
+            m_pictures.emplace_back(std::static_pointer_cast<PictureMetaBlock>(block)); 
+            break; 
+        case Metadata_block::INVALID:
+            m_invalidData.emplace_back(std::static_pointer_cast<InvalidMetaBlock>(block)); 
+            break; 
+        default:
+            m_unknownReservedData.emplace_back(std::static_pointer_cast<UnknownMetaBlock>(block)); 
+            break; 
+    }
+}
+
 bool MusicDecoderflac::setVorbisCommentLabel(const std::string& key, const std::string& val, uint32_t pos) {
     if (m_vorbisComment==nullptr) {
         bool res = addVorbisCommentMetaBlock(); 
@@ -1794,6 +2263,61 @@ bool MusicDecoderflac::setVorbisCommentLabel(const std::string& key, const std::
     return true; 
 }
 
+bool MusicDecoderflac::rebuildSeekTable(uint64_t spacing, SeekPointSpacing unit) {
+    if (m_streamInfo==nullptr) {
+        LOGE("fail rebuildSeekTable, no stream info block"); 
+        return false; 
+    }
+
+    uint64_t spacingSamples = unit==SPACING_SECONDS?spacing*m_streamInfo->getSampleRate():spacing; 
+    if (spacingSamples==0) {
+        LOGE("fail rebuildSeekTable, spacing should be >0"); 
+        return false; 
+    }
+
+    const uint8_t* audio = getAudioFrames(); 
+    if (audio==nullptr||m_audioFramesLength==0) {
+        LOGE("fail rebuildSeekTable, no audio frames"); 
+        return false; 
+    }
+
+    FlacFrameScanner scanner(audio, m_audioFramesLength, m_streamInfo); 
+    std::vector<FlacFrameScanner::FrameInfo> frames; 
+    if (!scanner.scan(frames)) {
+        LOGE("fail rebuildSeekTable, no frame found"); 
+        return false; 
+    }
+
+    SeekTableMetaBlock::ptr seekTable = createBlock<SeekTableMetaBlock>(); 
+    uint64_t firstOffset = frames[0].offset; 
+    uint64_t target = 0; 
+    // 每个目标采样取包含它的帧作为seekpoint
+    for (auto& item: frames) {
+        if (item.firstSample+item.blockSize<=target) {
+            continue; 
+        }
+        if (!seekTable->addSeekPoint(item.firstSample, item.offset-firstOffset, item.blockSize)) {
+            LOGE("fail rebuildSeekTable, too many seek points"); 
+            return false; 
+        }
+        while (target<item.firstSample+item.blockSize) {
+            target+=spacingSamples; 
+        }
+    }
+
+    m_seekTable = seekTable; 
+    LOGD("seektable rebuilt, %d frames scanned, %d seek points", frames.size(), m_seekTable->getSeekPointsLength()); 
+
+    return true; 
+}
+
+const uint8_t* MusicDecoderflac::getAudioFrames() const {
+    if (m_source==nullptr||!m_source->isOpen()||m_source->getSize()<m_audioFramesLength) {
+        return nullptr; 
+    }
+    return m_source->getData()+m_source->getSize()-m_audioFramesLength; 
+}
+
 bool MusicDecoderflac::setbackTitle(const std::string& val) {
     return setVorbisCommentLabel("TITLE", val); 
 }
@@ -1851,7 +2375,7 @@ bool MusicDecoderflac::addbackCover(const Image& img, uint32_t pos) {
         return false; 
     }
 
-    m_pictures.emplace(m_pictures.begin()+pos, new PictureMetaBlock(img)); 
+    m_pictures.emplace(m_pictures.begin()+pos, createBlock<PictureMetaBlock>(img)); 
 
     return true; 
 }
@@ -1862,6 +2386,7 @@ bool MusicDecoderflac::delbackCover(uint32_t pos) {
         return false; 
     }
 
+    // 空出的空间不在此转为padding，保存时按padding策略与保存方式确定padding大小
     m_pictures.erase(m_pictures.begin()+pos); 
 
     return true; 
@@ -1920,6 +2445,11 @@ bool MusicDecoderflac::getCovers(std::vector<Image::ptr>& dest) const {
     dest.resize(m_pictures.size()); 
     for (int i=0; i<m_pictures.size(); ++i) {
         uint32_t img_size = m_pictures[i]->getPictureDataLength(); 
+        const uint8_t* mapped = m_pictures[i]->getMappedPictureData(); 
+        if (mapped!=nullptr) {
+            dest[i] = Image::TryCreateImage((void*)mapped, img_size); 
+            continue; 
+        }
         void* buf = malloc(img_size); 
         bool res = m_pictures[i]->getPictureData(buf, img_size); 
         if (!res) {
@@ -1947,18 +2477,35 @@ bool MusicDecoderflac::resaveCover(const wchar_t* path, bool ifCheckSuffix, uint
 
     auto pic = m_pictures[index]; 
     uint32_t pic_size = pic->getPictureDataLength(); 
+
+    // 图片数据仍在源文件中时直接从映射写出，只读取文件头判断格式
+    const uint8_t* mapped = pic->getMappedPictureData(); 
+    if (mapped!=nullptr) {
+        ImageType type = Image::ProbeImageType(mapped, pic_size); 
+        if (type==UNKNOW) {
+            LOGE("Unknown img type, covert fail"); 
+            return false; 
+        }
+        std::wstring sfile = ifCheckSuffix?Image::CheckSuffix(path, type):std::wstring(path); 
+        return m_source->exportRange(mapped-m_source->getData(), pic_size, sfile.c_str()); 
+    }
+
     void* buf = malloc(pic_size); 
-    pic->getPictureData(buf, pic_size); 
-    std::string mimeType = pic->getMimeTypeToString(); 
-    Image::ptr img = Image::TryCreateImage(buf, pic_size, mimeType); 
-    free(buf); 
+    if (!pic->getPictureData(buf, pic_size)) {
+        LOGE("get picture data fail!"); 
+        free(buf); 
+        return false; 
+    }
 
-    if (img==nullptr) {
+    ImageType type = Image::ProbeImageType(buf, pic_size); 
+    if (type==UNKNOW) {
         LOGE("Unknown img type, covert fail"); 
+        free(buf); 
         return false; 
     }
-
-    bool res = img->resave(path, ifCheckSuffix); 
+    std::wstring sfile = ifCheckSuffix?Image::CheckSuffix(path, type):std::wstring(path); 
+    bool res = WriteDataToFile(sfile.c_str(), buf, pic_size); 
+    free(buf); 
 
     return res; 
 }
@@ -1967,11 +2514,336 @@ bool MusicDecoderflac::resaveCover(const std::wstring& path, bool ifCheckSuffix,
     return resaveCover(path.c_str(), ifCheckSuffix, index); 
 }
 
-std::wstring MusicDecoderflac::checkSuffix(const wchar_t* path) const {
-    std::wstring tmp_s(path); 
-    size_t t_size = tmp_s.size(); 
-    size_t dot_pos = tmp_s.find_last_of(L"."); 
-    if (dot_pos!=std::wstring::npos) {
+uint32_t MusicDecoderflac::resaveCovers(const std::wstring& pathPrefix, ThreadPool::ptr pool) const {
+    if (m_pictures.size()==0) {
+        LOGW("no covers"); 
+        return 0; 
+    }
+    if (pool==nullptr) {
+        pool = DefaultThreadPool::GetInstance(); 
+    }
+
+    std::atomic<uint32_t> count(0); 
+    pool->parallelFor(m_pictures.size(), [this, &pathPrefix, &count](size_t i) {
+        std::wstring path = pathPrefix+L"_"+std::to_wstring(i); 
+        if (resaveCover(path.c_str(), true, i)) {
+            ++count; 
+        }
+    }); 
+
+    return count; 
+}
+
+uint32_t MusicDecoderflac::ResaveCovers(const std::vector<std::wstring>& files, const std::wstring& outDir, ThreadPool::ptr pool) {
+    if (pool==nullptr) {
+        pool = DefaultThreadPool::GetInstance(); 
+    }
+
+    std::atomic<uint32_t> count(0); 
+    pool->parallelFor(files.size(), [&files, &outDir, &pool, &count](size_t i) {
+        MusicDecoderflac decoder(files[i].c_str()); 
+        if (!decoder.isValid()) {
+            LOGW("skip invalid flac file"); 
+            return; 
+        }
+
+        // 取源文件名（不含目录与后缀）作为导出文件名前缀
+        std::wstring name = files[i]; 
+        size_t slash_pos = name.find_last_of(L"\\/"); 
+        if (slash_pos!=std::wstring::npos) {
+            name = name.substr(slash_pos+1); 
+        }
+        size_t dot_pos = name.find_last_of(L"."); 
+        if (dot_pos!=std::wstring::npos) {
+            name = name.substr(0, dot_pos); 
+        }
+
+        std::wstring prefix = outDir; 
+        if (!prefix.empty()&&prefix.back()!=L'\\'&&prefix.back()!=L'/') {
+            prefix+=L"\\"; 
+        }
+        count+=decoder.resaveCovers(prefix+name, pool); 
+    }); 
+
+    return count; 
+}
+
+bool MusicDecoderflac::verifyAudio(AudioVerifyResult* result, ThreadPool::ptr pool) const {
+    AudioVerifyResult tmp; 
+    AudioVerifyResult& ans = result==nullptr?tmp:*result; 
+    ans = AudioVerifyResult(); 
+    ans.path = m_file_path; 
+    if (m_streamInfo==nullptr||getAudioFrames()==nullptr) {
+        LOGE("no audio frames, verify termination"); 
+        return false; 
+    }
+
+    m_streamInfo->getUnencoderedMD5(ans.expectedMD5, STREAMINFO_MD5_SIZE); 
+    for (uint32_t i=0; i<STREAMINFO_MD5_SIZE; ++i) {
+        if (ans.expectedMD5[i]!=0) {
+            ans.hasMD5 = true; 
+            break; 
+        }
+    }
+
+    // 解码在线程池中进行，本线程按顺序把PCM送入MD5，两者流水线执行
+    uint32_t sampleBytes = (m_streamInfo->getSampleBits()+7)/8; 
+    std::vector<uint8_t> buffer; 
+    Md5 md5; 
+    FlacParallelDecoder decoder(*this, pool); 
+    bool finished = decoder.decode([&](const FlacParallelDecoder::Chunk& chunk) {
+        if (!chunk.badFrames.empty()) {
+            if (ans.badFrameNum==0) {
+                ans.firstBadFrame = chunk.badFrames.front(); 
+            }
+            ans.badFrameNum+=chunk.badFrames.size(); 
+        }
+        for (uint32_t i=0; i<chunk.blockNum; ++i) {
+            const FlacPcmBlock& block = chunk.blocks[i]; 
+            if (block.firstSample!=ans.decodedSamples&&ans.firstBadSample==UINT64_MAX) {
+                ans.firstBadSample = ans.decodedSamples; 
+            }
+            size_t length = (size_t)block.blockSize*block.channels*sampleBytes; 
+            if (buffer.size()<length) {
+                buffer.resize(length); 
+            }
+            block.interleave(buffer.data(), sampleBytes); 
+            md5.update(buffer.data(), length); 
+            ans.decodedSamples = block.firstSample+block.blockSize; 
+        }
+        return true; 
+    }); 
+    md5.finish(ans.actualMD5); 
+
+    uint64_t totalSamples = m_streamInfo->getSamplePerChannel(); 
+    if (totalSamples!=0&&ans.decodedSamples!=totalSamples&&ans.firstBadSample==UINT64_MAX) {
+        ans.firstBadSample = std::min(ans.decodedSamples, totalSamples); 
+    }
+    ans.md5Match = ans.hasMD5&&memcmp(ans.expectedMD5, ans.actualMD5, STREAMINFO_MD5_SIZE)==0; 
+    ans.success = finished&&ans.badFrameNum==0&&ans.firstBadSample==UINT64_MAX&&(!ans.hasMD5||ans.md5Match); 
+
+    if (ans.badFrameNum>0) {
+        LOGE("%d broken frames, first at offset %lld", ans.badFrameNum, (long long)ans.firstBadFrame); 
+    }
+    if (ans.firstBadSample!=UINT64_MAX) {
+        LOGE("decoded samples broken at sample %lld", (long long)ans.firstBadSample); 
+    }
+    if (!ans.hasMD5) {
+        LOGW("no md5 in stream info, only frames are checked"); 
+    } else if (!ans.md5Match) {
+        LOGE("audio md5 mismatch"); 
+    }
+    return ans.success; 
+}
+
+uint32_t MusicDecoderflac::VerifyAudio(const std::vector<std::wstring>& files, std::vector<AudioVerifyResult>& dest, ThreadPool::ptr pool) {
+    if (pool==nullptr) {
+        pool = DefaultThreadPool::GetInstance(); 
+    }
+
+    dest.clear(); 
+    dest.resize(files.size()); 
+    std::atomic<uint32_t> count(0); 
+    // 文件之间与文件内部都并行：每个文件的校验在线程池任务中再分段解码
+    pool->parallelFor(files.size(), [&files, &dest, &pool, &count](size_t i) {
+        MusicDecoderflac decoder(files[i].c_str()); 
+        if (!decoder.isValid()) {
+            LOGW("skip invalid flac file"); 
+            dest[i].path = files[i]; 
+            return; 
+        }
+        if (decoder.verifyAudio(&dest[i], pool)) {
+            ++count; 
+        }
+    }); 
+
+    return count; 
+}
+
+bool MusicDecoderflac::checkIntegrity(IntegrityCheckResult* result, ThreadPool::ptr pool) const {
+    IntegrityCheckResult tmp; 
+    IntegrityCheckResult& ans = result==nullptr?tmp:*result; 
+    ans = IntegrityCheckResult(); 
+    ans.path = m_file_path; 
+    if (m_streamInfo==nullptr||getAudioFrames()==nullptr) {
+        LOGE("no audio frames, integrity check termination"); 
+        return false; 
+    }
+    if (pool==nullptr) {
+        pool = DefaultThreadPool::GetInstance(); 
+    }
+
+    // 帧头扫描得到帧边界，下一帧起点即本帧终点，所以不需要解码subframe
+    uint64_t length = getAudioFramesLength(); 
+    FlacFrameScanner scanner(getAudioFrames(), length, m_streamInfo); 
+    std::vector<FlacFrameScanner::FrameInfo> frames; 
+    if (!scanner.scan(frames, pool)) {
+        LOGE("no frame found, integrity check termination"); 
+        ans.truncated = true; 
+        return false; 
+    }
+    ans.frameNum = frames.size(); 
+
+    // 各帧终点，UINT64_MAX表示CRC-16不一致；分组并行校验
+    std::vector<uint64_t> ends(frames.size(), UINT64_MAX); 
+    uint64_t totalSamples = m_streamInfo->getSamplePerChannel(); 
+    size_t groupNum = std::min<size_t>(frames.size(), pool->getThreadNum()*4); 
+    size_t groupSize = (frames.size()+groupNum-1)/groupNum; 
+    pool->parallelFor(groupNum, [&](size_t group) {
+        size_t last = std::min(frames.size(), (group+1)*groupSize); 
+        for (size_t i=group*groupSize; i<last; ++i) {
+            const FlacFrameScanner::FrameInfo& frame = frames[i]; 
+            uint64_t end = i+1<frames.size()?frames[i+1].offset:length; 
+            if (scanner.checkFrameCrc(frame.offset, end)) {
+                ends[i] = end; 
+                continue; 
+            }
+            // 与下一帧之间缺了采样（中间的帧头损坏）或者是最后一帧时，本帧可能在end之前就结束了
+            uint64_t sampleEnd = frame.firstSample+frame.blockSize; 
+            bool continuous = i+1<frames.size()&&frames[i+1].firstSample==sampleEnd; 
+            uint64_t frameEnd; 
+            if (!continuous&&scanner.findFrameEnd(frame.offset, end, frameEnd)) {
+                ends[i] = frameEnd; 
+            }
+        }
+    }); 
+
+    if (frames.front().offset!=0) {
+        ans.badFrames.emplace_back(0); 
+        ans.lostSamples+=frames.front().firstSample; 
+    }
+    for (size_t i=0; i<frames.size(); ++i) {
+        uint64_t end = i+1<frames.size()?frames[i+1].offset:length; 
+        if (ends[i]==UINT64_MAX) {
+            ans.badFrames.emplace_back(frames[i].offset); 
+        } else if (ends[i]<end) {
+            if (i+1<frames.size()) {
+                ans.badFrames.emplace_back(ends[i]); 
+            } else {
+                ans.trailingBytes = length-ends[i]; 
+            }
+        }
+        uint64_t sampleEnd = frames[i].firstSample+frames[i].blockSize; 
+        if (i+1<frames.size()&&frames[i+1].firstSample>sampleEnd) {
+            ans.lostSamples+=frames[i+1].firstSample-sampleEnd; 
+        }
+    }
+    const FlacFrameScanner::FrameInfo& lastFrame = frames.back(); 
+    ans.truncated = totalSamples!=0&&lastFrame.firstSample+lastFrame.blockSize<totalSamples; 
+    ans.success = ans.badFrames.empty()&&ans.lostSamples==0&&!ans.truncated&&ans.trailingBytes==0; 
+
+    if (!ans.badFrames.empty()) {
+        LOGE("%d broken frames, first at offset %lld", (int)ans.badFrames.size(), (long long)ans.badFrames.front()); 
+    }
+    if (ans.lostSamples>0) {
+        LOGE("%lld samples lost with broken frame headers", (long long)ans.lostSamples); 
+    }
+    if (ans.truncated) {
+        LOGE("audio frames truncated at sample %lld", (long long)(lastFrame.firstSample+lastFrame.blockSize)); 
+    }
+    if (ans.trailingBytes>0) {
+        LOGW("%lld bytes of garbage after the last frame", (long long)ans.trailingBytes); 
+    }
+    return ans.success; 
+}
+
+uint32_t MusicDecoderflac::CheckIntegrity(const std::vector<std::wstring>& files, std::vector<IntegrityCheckResult>& dest, ThreadPool::ptr pool) {
+    if (pool==nullptr) {
+        pool = DefaultThreadPool::GetInstance(); 
+    }
+
+    dest.clear(); 
+    dest.resize(files.size()); 
+    std::atomic<uint32_t> count(0); 
+    pool->parallelFor(files.size(), [&files, &dest, &pool, &count](size_t i) {
+        MusicDecoderflac decoder(files[i].c_str()); 
+        if (!decoder.isValid()) {
+            LOGW("skip invalid flac file"); 
+            dest[i].path = files[i]; 
+            return; 
+        }
+        if (decoder.checkIntegrity(&dest[i], pool)) {
+            ++count; 
+        }
+    }); 
+
+    return count; 
+}
+
+bool MusicDecoderflac::seekToSample(uint64_t sample, FlacSeekResult& dest, std::shared_ptr<FlacFrameIndex> index) const {
+    const uint8_t* audio = getAudioFrames(); 
+    if (m_streamInfo==nullptr||audio==nullptr) {
+        LOGE("no audio frames, seek termination"); 
+        return false; 
+    }
+    uint64_t totalSamples = m_streamInfo->getSamplePerChannel(); 
+    if (totalSamples!=0&&sample>=totalSamples) {
+        LOGE("sample %lld out of range, total %lld", (long long)sample, (long long)totalSamples); 
+        return false; 
+    }
+
+    FlacFrameScanner::FrameInfo frame; 
+    bool found = index!=nullptr&&!index->empty()&&index->find(sample, frame); 
+    if (!found) {
+        // 取sample前后最近的定位点作为查找范围，定位点可能已过期，帧头与采样号都对得上才采用
+        uint64_t begin = 0; 
+        uint64_t end = m_audioFramesLength; 
+        std::vector<SeekTableMetaBlock::SeekPoint> points; 
+        if (m_seekTable!=nullptr&&m_seekTable->getSeekPoints(points)) {
+            std::sort(points.begin(), points.end()); 
+            auto isValid = [this, audio](const SeekTableMetaBlock::SeekPoint& item) {
+                FlacFrameHeader header; 
+                return item.offsetFromFirst<m_audioFramesLength
+                    &&header.parse(audio+item.offsetFromFirst, m_audioFramesLength-item.offsetFromFirst)
+                    &&header.getFirstSample(m_streamInfo->getMaxBlockSize())==item.firstSampleNO; 
+            }; 
+            auto iter = std::upper_bound(points.begin(), points.end(), sample, [](uint64_t val, const SeekTableMetaBlock::SeekPoint& item) {
+                return val<item.firstSampleNO; 
+            }); 
+            for (auto prev = iter; prev!=points.begin(); ) {
+                --prev; 
+                if (isValid(*prev)) {
+                    begin = prev->offsetFromFirst; 
+                    break; 
+                }
+            }
+            for (; iter!=points.end(); ++iter) {
+                // 占位点排在最后，采样号为全1，不会通过校验
+                if (iter->offsetFromFirst>begin&&isValid(*iter)) {
+                    end = iter->offsetFromFirst; 
+                    break; 
+                }
+            }
+        }
+        FlacFrameScanner scanner(audio, m_audioFramesLength, m_streamInfo); 
+        found = scanner.locate(sample, begin, end, frame); 
+    }
+    if (!found) {
+        LOGE("no frame contains sample %lld", (long long)sample); 
+        return false; 
+    }
+
+    dest.decoder = std::make_shared<FlacAudioDecoder>(*this); 
+    uint32_t frameLength = 0; 
+    if (!dest.decoder->decodeFrame(frame.offset, dest.block, &frameLength)) {
+        LOGE("decode frame at offset %lld fail, seek termination", (long long)frame.offset); 
+        dest.decoder = nullptr; 
+        return false; 
+    }
+    dest.decoder->setPosition(frame.offset+frameLength); 
+    dest.block.skip(sample-frame.firstSample); 
+    dest.sample = sample; 
+    dest.frameOffset = frame.offset; 
+    dest.fileOffset = m_source->getSize()-m_audioFramesLength+frame.offset; 
+    dest.frameFirstSample = frame.firstSample; 
+    return true; 
+}
+
+std::wstring MusicDecoderflac::checkSuffix(const wchar_t* path) const {
+    std::wstring tmp_s(path); 
+    size_t t_size = tmp_s.size(); 
+    size_t dot_pos = tmp_s.find_last_of(L"."); 
+    if (dot_pos!=std::wstring::npos) {
         std::wstring suffix = tmp_s.substr(dot_pos, t_size-dot_pos); 
         if (suffix!=L".flac") {
             tmp_s = tmp_s.substr(0, dot_pos) + L".flac"; 
@@ -1985,79 +2857,475 @@ std::wstring MusicDecoderflac::checkSuffix(const wchar_t* path) const {
     return tmp_s; 
 }
 
-bool MusicDecoderflac::resave(const wchar_t* path, bool ifCheckSuffix) const {
+void MusicDecoderflac::getMetaBlocks(std::vector<Metadata_block::ptr>& dest) const {
+    getMetaBlocks(dest, m_padding); 
+}
+
+void MusicDecoderflac::getMetaBlocks(std::vector<Metadata_block::ptr>& dest, Metadata_block::ptr padding) const {
+    dest.clear(); 
+    dest.reserve(6+m_pictures.size()+m_unknownReservedData.size()+m_invalidData.size()); 
+
+    if (m_streamInfo!=nullptr) {
+        dest.emplace_back(m_streamInfo); 
+    }
+
+    if (m_layout==LAYOUT_STREAMING) {
+        // 只读取文件头部的客户端优先拿到seektable和标签，图片放到最后
+        if (m_seekTable!=nullptr) {
+            dest.emplace_back(m_seekTable); 
+        }
+        if (m_vorbisComment!=nullptr) {
+            dest.emplace_back(m_vorbisComment); 
+        }
+        if (m_cuesheet!=nullptr) {
+            dest.emplace_back(m_cuesheet); 
+        }
+        if (m_application!=nullptr) {
+            dest.emplace_back(m_application); 
+        }
+        for (auto& item: m_unknownReservedData) {
+            dest.emplace_back(item); 
+        }
+        for (auto& item:m_invalidData) {
+            dest.emplace_back(item); 
+        }
+        for (auto& item: m_pictures) {
+            dest.emplace_back(item); 
+        }
+    } else {
+        if (m_application!=nullptr) {
+            dest.emplace_back(m_application); 
+        }
+        if (m_seekTable!=nullptr) {
+            dest.emplace_back(m_seekTable); 
+        }
+        if (m_vorbisComment!=nullptr) {
+            dest.emplace_back(m_vorbisComment); 
+        }
+        if (m_cuesheet!=nullptr) {
+            dest.emplace_back(m_cuesheet); 
+        }
+        for (auto& item: m_pictures) {
+            dest.emplace_back(item); 
+        }
+        for (auto& item: m_unknownReservedData) {
+            dest.emplace_back(item); 
+        }
+        for (auto& item:m_invalidData) {
+            dest.emplace_back(item); 
+        }
+    }
+
+    if (padding!=nullptr) {
+        dest.emplace_back(padding); 
+    }
+}
+
+bool MusicDecoderflac::getMetaBlockLayout(std::vector<MetaBlockLayout>& dest) const {
+    dest.clear(); 
     if (m_streamInfo==nullptr) {
         LOGE("no stream info block"); 
         return false; 
     }
 
-    std::list<Metadata_block::ptr> allMetaBlock; 
+    std::vector<Metadata_block::ptr> blocks; 
+    getMetaBlocks(blocks); 
+    dest.reserve(blocks.size()); 
 
-    allMetaBlock.emplace_back(m_streamInfo); 
+    // "fLaC"之后依次排列
+    uint64_t offset = 4; 
+    for (auto& item: blocks) {
+        uint32_t blockSize = item->getCachedBlockSize(); 
+        if (!item->isDataValid()||blockSize>UINT24_MAX) {
+            LOGE("block not valid, layout termination"); 
+            dest.clear(); 
+            return false; 
+        }
+        MetaBlockLayout layout = {item->getBlockType(), offset, blockSize, offset+4+blockSize}; 
+        dest.emplace_back(layout); 
+        offset+=4+blockSize; 
+    }
 
-    if (m_application!=nullptr) {
-        allMetaBlock.emplace_back(m_application); 
+    return true; 
+}
+
+PaddingPolicy PaddingPolicy::Fixed(uint32_t size) {
+    PaddingPolicy ans; 
+    ans.mode = FIXED; 
+    ans.value = size; 
+    return ans; 
+}
+
+PaddingPolicy PaddingPolicy::Percent(uint32_t percent, uint32_t minSize, uint32_t maxSize) {
+    PaddingPolicy ans; 
+    ans.mode = PERCENT; 
+    ans.value = percent; 
+    ans.minSize = minSize; 
+    ans.maxSize = maxSize; 
+    return ans; 
+}
+
+PaddingPolicy PaddingPolicy::Range(uint32_t minSize, uint32_t maxSize) {
+    PaddingPolicy ans; 
+    ans.mode = RANGE; 
+    ans.minSize = minSize; 
+    ans.maxSize = maxSize; 
+    return ans; 
+}
+
+uint32_t PaddingPolicy::getPaddingSize(uint64_t metadataSize, uint32_t currentSize) const {
+    uint64_t size = currentSize; 
+    switch (mode) {
+        case FIXED: {
+            size = value; 
+            break; 
+        }
+        case PERCENT: {
+            size = metadataSize*value/100; 
+            break; 
+        }
+        default: {
+            break; 
+        }
     }
-    if (m_seekTable!=nullptr) {
-        allMetaBlock.emplace_back(m_seekTable); 
+    size = std::max<uint64_t>(size, minSize); 
+    size = std::min<uint64_t>(size, std::min(maxSize, UINT24_MAX)); 
+    return (uint32_t)size; 
+}
+
+uint32_t MusicDecoderflac::getPlannedPaddingSize(uint64_t metadataSize, uint64_t targetSize) const {
+    // KEEP保持现有padding大小：未修改时即源文件中的大小，修改过时为修改后的大小
+    uint32_t currentSize = m_padding==nullptr?0:m_padding->getCachedBlockSize(); 
+    uint32_t paddingSize = m_paddingPolicy.getPaddingSize(metadataSize, currentSize); 
+
+    // 允许原地保存时，能恰好填满原metadata区域就优先原地保存（不需要padding，或padding大小在策略范围内），
+    // 删除block空出的空间由此回收到padding；整体重写或padding大小被直接修改过时按策略计算
+    if (!m_ifAtomicSave&&(m_padding==nullptr||!m_padding->isDirty())&&targetSize!=0&&targetSize>=metadataSize) {
+        uint64_t space = targetSize-metadataSize; 
+        if (space==0) {
+            paddingSize = 0; 
+        } else if (space>4&&space-4<=UINT24_MAX&&m_paddingPolicy.accept(space-4)) {
+            paddingSize = space-4; 
+        }
     }
-    if (m_vorbisComment!=nullptr) {
-        allMetaBlock.emplace_back(m_vorbisComment);
+    return paddingSize; 
+}
+
+bool MusicDecoderflac::serializeMetadata(SerializedMetadata& dest, uint64_t targetSize) const {
+    dest.buffer.clear(); 
+    dest.segments.clear(); 
+    dest.blockOffsets.clear(); 
+    dest.pictureOffsets.clear(); 
+    dest.size = 0; 
+
+    if (m_streamInfo==nullptr) {
+        LOGE("no stream info block"); 
+        return false; 
     }
-    if (m_cuesheet!=nullptr) {
-        allMetaBlock.emplace_back(m_cuesheet);
+
+    // 按padding策略确定padding大小，与现有padding block不同时写出新建的block，解码器中的block不变
+    uint32_t paddingSize = getPlannedPaddingSize(getMetadataSizeWithoutPadding(), targetSize); 
+    dest.padding = m_padding; 
+    if (paddingSize==0) {
+        dest.padding = nullptr; 
+    } else if (m_padding==nullptr||m_padding->getCachedBlockSize()!=paddingSize) {
+        dest.padding = std::make_shared<PaddingMetaBlock>(paddingSize); 
     }
-    if (m_pictures.size()!=0) {
-        for (auto& item: m_pictures) {
-            allMetaBlock.emplace_back(item);
+    getMetaBlocks(dest.blocks, dest.padding); 
+
+    // 第一遍：计算metadata总长度及需要写入缓冲的长度，映射中的图片数据不计入缓冲
+    uint64_t bufferSize = 4; 
+    uint64_t totalSize = 4; 
+    uint32_t mappedNum = 0; 
+    for (auto& item: dest.blocks) {
+        uint32_t blockSize = item->getCachedBlockSize(); 
+        if (!item->isDataValid()||blockSize>UINT24_MAX) {
+            LOGE("block not valid, resave termination"); 
+            return false; 
+        }
+        totalSize+=4+blockSize; 
+        if (item->getBlockType()==Metadata_block::PICTURE) {
+            auto pic = std::static_pointer_cast<PictureMetaBlock>(item); 
+            if (pic->getMappedPictureData()!=nullptr) {
+                bufferSize+=4+pic->getPictureDataOffset(); 
+                ++mappedNum; 
+                continue; 
+            }
         }
+        bufferSize+=4+blockSize; 
     }
-    if (m_unknownReservedData.size()!=0) {
-        for (auto& item: m_unknownReservedData) {
-            allMetaBlock.emplace_back(item);
+
+    // 第二遍：各block直接写入缓冲
+    dest.buffer.resize(bufferSize); 
+    dest.segments.reserve(2*mappedNum+1); 
+    dest.blockOffsets.reserve(dest.blocks.size()); 
+    dest.pictureOffsets.reserve(m_pictures.size()); 
+
+    uint8_t* pin = dest.buffer.data(); 
+    uint8_t* segmentBegin = pin; 
+    memcpy(pin, s_label_flac, 4); 
+    pin+=4; 
+    uint64_t position = 4; 
+
+    for (size_t i=0; i<dest.blocks.size(); ++i) {
+        auto& item = dest.blocks[i]; 
+        bool ifLast = i+1==dest.blocks.size(); 
+        uint32_t blockSize = item->getCachedBlockSize(); 
+        dest.blockOffsets.emplace_back(position+4); 
+
+        if (item->getBlockType()==Metadata_block::PICTURE) {
+            auto pic = std::static_pointer_cast<PictureMetaBlock>(item); 
+            dest.pictureOffsets.emplace_back(position+4+pic->getPictureDataOffset()); 
+
+            // 映射中的图片数据只写出block头部分，数据段直接指向映射
+            const uint8_t* mapped = pic->getMappedPictureData(); 
+            if (mapped!=nullptr) {
+                uint32_t headerSize = pic->resaveHeader(pin, ifLast); 
+                if (headerSize==0) {
+                    LOGE("metablock %d resave fail!", pic->getBlockType()); 
+                    return false; 
+                }
+                pin+=headerSize; 
+                dest.segments.emplace_back(WriteSegment{segmentBegin, (uint64_t)(pin-segmentBegin)}); 
+                dest.segments.emplace_back(WriteSegment{mapped, pic->getPictureDataLength()}); 
+                segmentBegin = pin; 
+                position+=headerSize+pic->getPictureDataLength(); 
+                continue; 
+            }
         }
+
+        uint32_t ret = item->write(pin, ifLast); 
+        if (ret!=blockSize+4) {
+            LOGE("metablock %d resave fail!", item->getBlockType()); 
+            return false; 
+        }
+        pin+=ret; 
+        position+=ret; 
     }
-    if (m_invalidData.size()!=0) {
-        for (auto& item:m_invalidData) {
-            allMetaBlock.emplace_back(item);
+
+    if (pin>segmentBegin) {
+        dest.segments.emplace_back(WriteSegment{segmentBegin, (uint64_t)(pin-segmentBegin)}); 
+    }
+    dest.size = position; 
+
+    return position==totalSize; 
+}
+
+void MusicDecoderflac::rebindSource(const SerializedMetadata& meta) {
+    // 文件内容已与内存一致，所有block重新绑定到新位置并视为未修改
+    m_padding = meta.padding; 
+    size_t pictureIndex = 0; 
+    for (size_t i=0; i<meta.blocks.size(); ++i) {
+        auto& item = meta.blocks[i]; 
+        item->bindSource(m_source, meta.blockOffsets[i], item->getCachedBlockSize()); 
+        if (item->getBlockType()==Metadata_block::PICTURE) {
+            // metadata长度可能变化，映射中的图片数据位置需要更新；内存中的图片数据已写入文件，同样改为引用映射并释放
+            auto pic = std::static_pointer_cast<PictureMetaBlock>(item); 
+            pic->bindPictureData(m_source, meta.pictureOffsets[pictureIndex]); 
+            ++pictureIndex; 
         }
     }
-    if (m_padding!=nullptr) {
-        allMetaBlock.emplace_back(m_padding);
+}
+
+uint64_t MusicDecoderflac::getMetadataSizeWithoutPadding() const {
+    std::vector<Metadata_block::ptr> blocks; 
+    getMetaBlocks(blocks); 
+    uint64_t metadataSize = 4; 
+    for (auto& item: blocks) {
+        if (item!=m_padding) {
+            metadataSize+=4+item->getCachedBlockSize(); 
+        }
     }
+    return metadataSize; 
+}
 
-    ByteArray ba; 
+MusicDecoderflac::SaveStrategy MusicDecoderflac::getSaveStrategy() const {
+    if (m_source==nullptr||!m_source->isOpen()) {
+        return SAVE_FULL_REWRITE; 
+    }
 
-    ba.write(s_label_flac, 4); 
+    uint64_t targetSize = m_source->getSize()-m_audioFramesLength; 
+    SerializedMetadata meta; 
+    if (!serializeMetadata(meta, targetSize)) {
+        return SAVE_FULL_REWRITE; 
+    }
+    return planSave(meta, targetSize); 
+}
 
-    auto lastIt = allMetaBlock.end(); 
-    --lastIt; 
-    for (auto it=allMetaBlock.begin(); it!=allMetaBlock.end(); ++it) {
-        uint32_t blockSize = (*it)->getBlockSize(); 
-        if ((*it)->isDataValid()&&blockSize<=UINT24_MAX) {
-            void* pin = malloc(blockSize+4); 
-            bool ifLast = it==lastIt; 
-            uint32_t ret = (*it)->resave(pin, ifLast); 
+MusicDecoderflac::SaveStrategy MusicDecoderflac::planSave(const SerializedMetadata& meta, uint64_t targetSize) const {
+    if (meta.size!=targetSize) {
+        return SAVE_FULL_REWRITE; 
+    }
+    if (isSameAsSource(meta)) {
+        // 重复设置已有的值时不写文件，block仍在原位置，只需标记为未修改
+        return SAVE_UNCHANGED; 
+    }
+    if (m_ifAtomicSave) {
+        return SAVE_FULL_REWRITE; 
+    }
+    return meta.padding==m_padding?SAVE_IN_PLACE:SAVE_PADDING_RESIZE; 
+}
 
-            if (ret!=blockSize+4) {
-                LOGE("metablock %d resave fail!", (*it)->getBlockType()); 
-                return false; 
-            }
+bool MusicDecoderflac::isSameAsSource(const SerializedMetadata& meta) const {
+    if (m_source==nullptr||!m_source->contains(0, meta.size)) {
+        return false; 
+    }
+
+    const uint8_t* source = m_source->getData(); 
+    uint64_t offset = 0; 
+    for (auto& item: meta.segments) {
+        // 直接引用映射中原位置的数据段（未移动的图片数据）不需要比较
+        if (item.data!=source+offset&&memcmp(source+offset, item.data, item.length)!=0) {
+            return false; 
+        }
+        offset+=item.length; 
+    }
+    return offset==meta.size; 
+}
 
-            ba.write(pin, ret); 
+bool MusicDecoderflac::save(SaveStrategy* used) {
+    SaveStrategy strategy = SAVE_FULL_REWRITE; 
+    if (!beginSave(&strategy)) {
+        return false; 
+    }
+    if (used!=nullptr) {
+        *used = strategy; 
+    }
+    return endSave(); 
+}
 
-            free(pin); 
-        } else {
-            LOGE("block not valid, resave termination"); 
+bool MusicDecoderflac::beginSave(SaveStrategy* used) {
+    if (m_source==nullptr||!m_source->isOpen()) {
+        LOGE("no source file, save termination"); 
+        return false; 
+    }
+    if (m_pendingSave!=nullptr) {
+        LOGE("previous save not finished, save termination"); 
+        return false; 
+    }
+    if (isSourceShared()) {
+        // 保存会关闭并重新打开映射、重新绑定block，其他引用方会读到失效的数据
+        LOGE("source mapping is shared with other decoders or readers, save termination"); 
+        return false; 
+    }
+
+    uint64_t targetSize = m_source->getSize()-m_audioFramesLength; 
+    std::wstring path = m_source->getPath(); 
+
+    std::shared_ptr<PendingSave> pending = std::make_shared<PendingSave>(); 
+    SerializedMetadata& meta = pending->meta; 
+    if (!serializeMetadata(meta, targetSize)) {
+        LOGE("serialize metadata fail, save termination"); 
+        return false; 
+    }
+    SaveStrategy strategy = planSave(meta, targetSize); 
+    pending->strategy = strategy; 
+    if (used!=nullptr) {
+        *used = strategy; 
+    }
+
+    if (strategy==SAVE_UNCHANGED) {
+        m_pendingSave = pending; 
+        return true; 
+    }
+
+    if (strategy!=SAVE_FULL_REWRITE) {
+        // metadata长度不变时audio frames位置不变，只重写文件头部，原头部先写入日志，失败或崩溃后可以恢复；
+        // 写入前需要先解除映射，映射中的图片数据先复制出来
+        std::vector<uint8_t> flat(meta.size); 
+        uint8_t* pin = flat.data(); 
+        for (auto& item: meta.segments) {
+            memcpy(pin, item.data, item.length); 
+            pin+=item.length; 
+        }
+
+        m_source->close(); 
+        pending->writer = std::make_shared<FileWriter>(path.c_str(), FileWriter::OVERWRITE); 
+        std::vector<WriteSegment> segments(1, WriteSegment{flat.data(), flat.size()}); 
+        if (!pending->writer->write(segments)) {
+            LOGE("write file head fail, save termination"); 
+            // 先恢复原头部再重新映射
+            pending->writer->abort(); 
+            m_source->reopen(); 
             return false; 
         }
+    } else {
+        // 从映射直接写出到同目录的临时文件，提交时再替换源文件，写入中途失败或崩溃不会损坏源文件
+        std::vector<WriteSegment> segments = meta.segments; 
+        if (m_audioFramesLength>0) {
+            segments.emplace_back(WriteSegment{getAudioFrames(), m_audioFramesLength}); 
+        }
+        pending->writer = std::make_shared<FileWriter>(path.c_str(), FileWriter::REPLACE); 
+        if (!pending->writer->write(segments)) {
+            LOGE("write temp file fail, save termination"); 
+            return false; 
+        }
+    }
+
+    m_pendingSave = pending; 
+    return true; 
+}
+
+bool MusicDecoderflac::isSourceShared() const {
+    // 本解码器持有的引用：m_source本身，以及绑定到映射的block和图片数据
+    long ownRefs = 1; 
+    std::vector<Metadata_block::ptr> blocks; 
+    getMetaBlocks(blocks); 
+    for (auto& item: blocks) {
+        if (item->isBoundTo(m_source)) {
+            ++ownRefs; 
+        }
+        if (item->getBlockType()==Metadata_block::PICTURE
+            &&std::static_pointer_cast<PictureMetaBlock>(item)->isPictureDataIn(m_source)) {
+            ++ownRefs; 
+        }
+    }
+    return m_source.use_count()>ownRefs; 
+}
+
+bool MusicDecoderflac::flushSave() const {
+    if (m_pendingSave==nullptr) {
+        LOGE("no pending save"); 
+        return false; 
+    }
+    return m_pendingSave->writer==nullptr||m_pendingSave->writer->flush(); 
+}
+
+bool MusicDecoderflac::endSave() {
+    if (m_pendingSave==nullptr) {
+        LOGE("no pending save"); 
+        return false; 
+    }
+    std::shared_ptr<PendingSave> pending = m_pendingSave; 
+    m_pendingSave = nullptr; 
+
+    if (pending->strategy==SAVE_UNCHANGED) {
+        rebindSource(pending->meta); 
+        LOGD("metadata unchanged, skip write"); 
+        return true; 
+    }
+
+    // 替换源文件前需要先解除映射（原地保存时已解除）
+    m_source->close(); 
+    bool ifSuccess = pending->writer->commit(); 
+    if (ifSuccess) {
+        LOGD("write file successfully, %lld byte written%s", (long long)(pending->strategy==SAVE_FULL_REWRITE?pending->meta.size+m_audioFramesLength:pending->meta.size)
+            , pending->strategy==SAVE_FULL_REWRITE?"":" in place"); 
+    }
+
+    if (m_source->reopen()) {
+        if (ifSuccess) {
+            rebindSource(pending->meta); 
+        }
+    } else {
+        LOGE("reopen source file fail after save"); 
+        ifSuccess = false; 
     }
 
-    void* audioPin = malloc(m_audioFramesLength); 
-    m_audioFrames.getDataBuffers(audioPin, m_audioFramesLength); 
-    ba.write(audioPin, m_audioFramesLength); 
-    free(audioPin); 
+    return ifSuccess; 
+}
 
+bool MusicDecoderflac::resave(const wchar_t* path, bool ifCheckSuffix) const {
     std::wstring sfile; 
     if (ifCheckSuffix) {
         sfile = checkSuffix(path); 
@@ -2065,31 +3333,33 @@ bool MusicDecoderflac::resave(const wchar_t* path, bool ifCheckSuffix) const {
         sfile = std::wstring(path); 
     }
 
-    HANDLE hFile = CreateFileW(sfile.c_str(), GENERIC_READ|GENERIC_WRITE, FILE_SHARE_READ, NULL, OPEN_ALWAYS, 0, NULL);	
-    if (hFile==INVALID_HANDLE_VALUE) {
-        LOGE("file not exists, and create file fail \n"); 
+    // 另存不改变解码器；写回源文件要重新映射并重新绑定block，只能用save()
+    if (m_source!=nullptr&&m_source->isOpen()&&m_source->getPath()==sfile) {
+        LOGE("path is the source file, use save() instead, resave termination"); 
         return false; 
     }
 
-    bool ifSuccess = true; 
+    SerializedMetadata meta; 
+    if (!serializeMetadata(meta)) {
+        LOGE("serialize metadata fail, resave termination"); 
+        return false; 
+    }
 
-    //成功写入的数据大小
-    DWORD dwWritedDateSize;
-    
-    size_t dataSize = ba.getSize(); 
-    void* metaPin = malloc(dataSize); 
-    ba.getDataBuffers(metaPin, dataSize); 
-    SetFilePointer(hFile,0,0,FILE_BEGIN);
-    if(!WriteFile(hFile, metaPin, dataSize, &dwWritedDateSize,NULL)) {
-        LOGE("write metadata fail: %d\n", GetLastError()); 
-        ifSuccess = false; 
+    // 另存：metadata缓冲与映射中的图片、audio frames依次直接写出
+    std::vector<WriteSegment> segments = meta.segments; 
+    if (m_audioFramesLength>0) {
+        const uint8_t* audioPin = getAudioFrames(); 
+        if (audioPin==nullptr) {
+            LOGE("audio frames not available, resave termination"); 
+            return false; 
+        }
+        segments.emplace_back(WriteSegment{audioPin, m_audioFramesLength}); 
+    }
+
+    bool ifSuccess = WriteSegmentsToFile(sfile.c_str(), segments); 
+    if (ifSuccess) {
+        LOGD("write file successfully, %lld byte written", (long long)(meta.size+m_audioFramesLength)); 
     }
-    
-    SetEndOfFile(hFile); 
- 
-    CloseHandle(hFile); 
-    LOGD("write metadata successfully, %d byte written。\n", dwWritedDateSize);
-    
     return ifSuccess; 
 }
 
@@ -5,11 +5,14 @@
 #include "noncopyable.h"
 #include "bytearray.h"
 #include "image.h"
+#include "threadpool.h"
+#include "arena.h"
 
 #include <string>
 #include <stdint.h>
 #include <string.h>
 #include <set>
+#include <atomic>
 #include <vector>
 #include <list>
 #include <unordered_map>
@@ -25,6 +28,9 @@
 
 namespace music_data {
 
+struct FlacSeekResult; 
+class FlacFrameIndex; 
+
 /**
  * @brief metadata block类
 */
@@ -60,8 +66,11 @@ public:
     /**
      * @brief 构造函数
      * @param[in] length 数据字节长度
+     * @param[in] type block类型
+     * @param[in] dataValid 数据是否有效
+     * @param[in] arena 变长字段的内存来源，nullptr时使用new/delete；arena须比block存活更久
     */
-    Metadata_block(uint32_t length, MetadataBlockType type, bool dataValid = true); 
+    Metadata_block(uint32_t length, MetadataBlockType type, bool dataValid = true, Arena* arena = nullptr); 
 
     /**
      * @brief 析构函数
@@ -99,6 +108,64 @@ public:
     */
     virtual uint32_t resave(void* data, bool ifLast = false) = 0; 
 
+    /**
+     * @brief 自解析以来是否被修改过
+     * @retval 是否被修改过
+    */
+    bool isDirty() const { return m_dirty; }
+
+    /**
+     * @brief 标记block已被修改，同时使缓存的block size失效，所有修改数据的接口都需要调用
+    */
+    void setDirty() { m_dirty = true; m_blockSizeCached = false; }
+
+    /**
+     * @brief 标记block被fork出的解码器共享，之后所有修改接口都拒绝修改（共享的block可能正被其他线程读取）
+    */
+    void setShared() { m_shared = true; }
+
+    /**
+     * @brief 是否被多个解码器共享
+     * @retval 是否被共享
+    */
+    bool isShared() const { return m_shared; }
+
+    /**
+     * @brief 记录block数据在源文件映射中的原始位置，并标记为未修改
+     * @param[in] source 源文件映射
+     * @param[in] offset block数据（不含4 byte block头）在文件中的偏移
+     * @param[in] length block数据长度
+     * @retval 是否记录成功
+    */
+    bool bindSource(MappedFile::ptr source, uint64_t offset, uint32_t length); 
+
+    /**
+     * @brief 取得未修改block在源文件映射中的原始数据
+     * @retval 原始数据指针（不含4 byte block头），已修改或映射不可用时为nullptr
+    */
+    const uint8_t* getSourceData() const; 
+
+    /**
+     * @brief 原始数据是否记录在指定的源文件映射中
+     * @param[in] source 源文件映射
+     * @retval 是否记录在该映射中
+    */
+    bool isBoundTo(const MappedFile::ptr& source) const { return m_rawSource!=nullptr&&m_rawSource==source; }
+
+    /**
+     * @brief 取得block size，结果缓存到下次修改为止；未修改的block直接取原始长度
+     * @retval block size
+    */
+    uint32_t getCachedBlockSize() const; 
+
+    /**
+     * @brief 写出block，未修改的block直接复制源文件中的原始数据，否则调用resave重新序列化
+     * @param[in] data 写入目的指针，长度至少为getCachedBlockSize()+4
+     * @param[in] ifLast 是否为最后一个block
+     * @retval 写入字节数，失败为0
+    */
+    uint32_t write(void* data, bool ifLast = false); 
+
 protected: 
     /**
      * @brief 初始化block
@@ -107,12 +174,48 @@ protected:
     */
     virtual void initBlock(void* data, uint32_t length) = 0; 
 
+    /**
+     * @brief 修改接口在修改前调用，共享的block不能修改
+     * @retval 是否可以修改
+    */
+    bool checkWritable() const; 
+
+    /**
+     * @brief 为变长字段分配内存，有arena时从arena分配
+     * @param[in] length 长度(byte)
+     * @retval 内存首地址
+    */
+    char* allocField(size_t length); 
+
+    /**
+     * @brief 释放allocField分配的内存，arena分配的内存随arena整体释放
+     * @param[in] data 内存首地址
+    */
+    void freeField(char* data); 
 
 private: 
+    /// @brief 变长字段的内存来源，nullptr时使用new/delete
+    Arena* m_arena = nullptr; 
     /// @brief metablock类型
     MetadataBlockType m_type = MetadataBlockType::INVALID; 
     /// @brief block数据是否有效，true为有效
     bool m_dataValided; 
+    /// @brief 自解析以来是否被修改过，新建的block视为已修改
+    bool m_dirty = true; 
+    /// @brief 是否被多个解码器共享，fork后其他线程可能同时读取
+    std::atomic<bool> m_shared{false}; 
+    /// @brief 原始数据所在的源文件映射
+    MappedFile::ptr m_rawSource = nullptr; 
+    /// @brief 原始数据在文件中的偏移
+    uint64_t m_rawOffset = 0; 
+    /// @brief 原始数据长度
+    uint32_t m_rawLength = 0; 
+    /// @brief 原始block头中的类型号
+    uint8_t m_rawTypeNum = 0; 
+    /// @brief 缓存的block size
+    mutable uint32_t m_cachedBlockSize = 0; 
+    /// @brief block size缓存是否有效
+    mutable bool m_blockSizeCached = false; 
 }; 
 
 /**
@@ -195,13 +298,13 @@ public:
      * @brief 设置最小block size值
      * @param[in] val 设置值
     */
-    void setMinBlockSize(uint16_t val) { m_minBlockSize = val; }
+    void setMinBlockSize(uint16_t val) { if (checkWritable()) { m_minBlockSize = val; setDirty(); } }
 
     /**
      * @brief 设置最大block size值
      * @param[in] val 设置值
     */
-    void setMaxBlockSize(uint16_t val) { m_maxBlockSize = val; }
+    void setMaxBlockSize(uint16_t val) { if (checkWritable()) { m_maxBlockSize = val; setDirty(); } }
 
     /**
      * @brief 设置最小frame size值
@@ -301,13 +404,13 @@ public:
      * @brief 添加padding数量，自动限制0xFFFFFF以内
      * @param[in] val 添加值
     */
-    void addPaddingByte(uint32_t val) { m_blockSize=(0xFFFFFF-val>=m_blockSize)?(m_blockSize+val):0xFFFFFF; }
+    void addPaddingByte(uint32_t val) { if (checkWritable()) { m_blockSize=(0xFFFFFF-val>=m_blockSize)?(m_blockSize+val):0xFFFFFF; setDirty(); } }
 
     /**
      * @brief 减少padding数量，自动限制>=0
      * @param[in] val 减少值
     */
-    void delPaddingByte(uint32_t val) { m_blockSize=(val<=m_blockSize)?(m_blockSize-val):0; }
+    void delPaddingByte(uint32_t val) { if (checkWritable()) { m_blockSize=(val<=m_blockSize)?(m_blockSize-val):0; setDirty(); } }
 
     virtual uint32_t getBlockSize() const override; 
     virtual uint32_t resave(void* data, bool ifLast = false) override; 
@@ -357,7 +460,7 @@ public:
      * @brief 设置应用程序ID
      * @param[in] val 设置值
     */
-    void setAppId(uint32_t val) { m_appId = val; }
+    void setAppId(uint32_t val) { if (checkWritable()) { m_appId = val; setDirty(); } }
 
     /**
      * @brief 设置应用程序数据
@@ -417,6 +520,11 @@ public:
     */
     SeekTableMetaBlock(void* data, uint32_t length); 
 
+    /**
+     * @brief 构造函数，创建空的seektable
+    */
+    SeekTableMetaBlock(); 
+
     /**
      * @brief 析构函数
     */
@@ -467,6 +575,11 @@ public:
     */
     bool delSeekPoint(uint64_t fsn, uint64_t ofs, uint16_t sn); 
 
+    /**
+     * @brief 清空所有seekpoint
+    */
+    void clearSeekPoints() { if (checkWritable()) { m_seekPoints.clear(); setDirty(); } }
+
     virtual uint32_t getBlockSize() const override; 
     virtual uint32_t resave(void* data, bool ifLast = false) override; 
 
@@ -489,8 +602,9 @@ public:
      * @brief 构造函数
      * @param[in] data 数据指针
      * @param[in] length 数据字节长度
+     * @param[in] arena 变长字段的内存来源，nullptr时使用new/delete
     */
-    VorbisCommentMetaBlock(void* data, uint32_t length); 
+    VorbisCommentMetaBlock(void* data, uint32_t length, Arena* arena = nullptr); 
 
     /**
      * @brief 构造函数
@@ -545,6 +659,13 @@ public:
     */
     std::string getLabelWithKey(const std::string& key, uint32_t pos = 0) const; 
 
+    /**
+     * @brief 是否有key对应的标签
+     * @param[in] key key值
+     * @retval 是否存在
+    */
+    bool hasKey(const std::string& key) const { return m_infoLabels.find(key)!=m_infoLabels.end(); }
+
     /**
      * @brief 设置编码器标识的字符串
      * @param[in] val 设置值
@@ -577,6 +698,13 @@ public:
     */
     bool delInfoLabel(const std::string& key, uint32_t pos); 
 
+    /**
+     * @brief 删除key的全部标签值，key不存在时不做修改
+     * @param[in] key 标签key
+     * @retval 删除标签值数量
+    */
+    uint32_t delAllInfoLabel(const std::string& key); 
+
     /**
      * @brief 删除所有对应值标签
      * @param[in] key 标签key
@@ -590,7 +718,7 @@ public:
      * @param[in] key 标签key
      * @param[in] val 设置值
      * @param[in] pos 设置值所在位置，默认第一位
-     * @retval 是否修改成功: 0表示成功，1表示key不存在，2表示pos不合理，3表示val过长
+     * @retval 是否修改成功: 0表示成功，1表示key不存在，2表示pos不合理，3表示val过长，4表示block被共享不能修改
     */
     int8_t setLabelVal(const std::string& key, const std::string& val, uint32_t pos = 0); 
 
@@ -712,13 +840,13 @@ public:
      * @brief 是否对应一个Compact Disc
      * @retval 是否对应一个Compact Disc
     */
-    bool isCompactDisc() const { return (m_reserved[0]>>7)==1; }
+    bool isCompactDisc() const { return ((uint8_t)m_reserved[0]>>7)==1; }
 
     /**
      * @brief 设置是否对应一个Compact Disc
      * @param[in] val 设置值
     */
-    void setIsCompactDisc(bool val) { m_reserved[0]=val?(m_reserved[0]|0x80):(m_reserved[0]&0x7F); }
+    void setIsCompactDisc(bool val) { if (checkWritable()) { m_reserved[0]=val?(m_reserved[0]|0x80):(m_reserved[0]&0x7F); setDirty(); } }
 
     virtual uint32_t getBlockSize() const override; 
     virtual uint32_t resave(void* data, bool ifLast = false) override; 
@@ -776,8 +904,10 @@ public:
      * @brief 构造函数
      * @param[in] data 数据指针
      * @param[in] length 数据字节长度
+     * @param[in] source data所在的文件映射，不为nullptr时图片数据不复制，需要时再从映射中读取
+     * @param[in] arena 变长字段的内存来源，nullptr时使用new/delete
     */
-    PictureMetaBlock(void* data, uint32_t length); 
+    PictureMetaBlock(void* data, uint32_t length, MappedFile::ptr source = nullptr, Arena* arena = nullptr); 
 
     /**
      * @brief 构造函数
@@ -864,7 +994,7 @@ public:
      * @brief 取得图片数据长度
      * @retval 图片数据长度
     */
-    uint32_t getPictureDataLength() const { return m_pictureData.getSize(); }
+    uint32_t getPictureDataLength() const { return m_pictureDataLength; }
     
     /**
      * @brief 取得图片数据
@@ -874,11 +1004,50 @@ public:
     */
     bool getPictureData(void* dest, uint32_t length) const; 
 
+    /**
+     * @brief 图片数据是否已读入内存
+     * @retval false表示图片数据仍在源文件映射中
+    */
+    bool isPictureDataLoaded() const { return m_source==nullptr; }
+
+    /**
+     * @brief 图片数据是否在指定的文件映射中
+     * @param[in] source 文件映射
+     * @retval 是否在该映射中
+    */
+    bool isPictureDataIn(const MappedFile::ptr& source) const { return m_source!=nullptr&&m_source==source; }
+
+    /**
+     * @brief 取得源文件映射中的图片数据，不复制
+     * @retval 图片数据指针，图片数据已读入内存或映射不可用时为nullptr
+    */
+    const uint8_t* getMappedPictureData() const; 
+
+    /**
+     * @brief 将映射中的图片数据读入内存，之后不再依赖源文件
+     * @retval 是否成功
+    */
+    bool loadPictureData(); 
+
+    /**
+     * @brief 将图片数据绑定到文件映射中的指定位置，释放内存中的图片数据（源文件被改写后使用）
+     * @param[in] source 文件映射
+     * @param[in] offset 图片数据在文件中的偏移
+     * @retval 是否绑定成功
+    */
+    bool bindPictureData(MappedFile::ptr source, uint64_t offset); 
+
+    /**
+     * @brief 取得图片数据在block中的偏移（不含4 byte block头）
+     * @retval 图片数据偏移(byte)
+    */
+    uint32_t getPictureDataOffset() const { return 32+m_mimeLength+m_descriptorLength; }
+
     /**
      * @brief 设置图片类型
      * @param[in] val 设置值
     */
-    void setPictureType(PictureType val) { m_pictureType = val; }; 
+    void setPictureType(PictureType val) { if (checkWritable()) { m_pictureType = val; setDirty(); } }; 
 
     /**
      * @brief 设置描述符
@@ -894,6 +1063,14 @@ public:
     */
     bool setPicture(const Image& img); 
 
+    /**
+     * @brief 只写出block头及图片数据之前的部分
+     * @param[in] data 写入位置，长度至少为4+getPictureDataOffset()
+     * @param[in] ifLast 是否为最后一个block
+     * @retval 写入长度，失败为0
+    */
+    uint32_t resaveHeader(void* data, bool ifLast = false); 
+
     virtual uint32_t getBlockSize() const override; 
     virtual uint32_t resave(void* data, bool ifLast = false) override; 
 
@@ -919,8 +1096,14 @@ private:
     uint32_t m_pictureColorDepth; 
     /// @brief 索引图使用的颜色数目，0非索引图 (32 bit)
     uint32_t m_pictureIndexColorNum; 
-    /// @brief 图片数据 (数据长度占32bit, 具体数据N*8 bit)
+    /// @brief 图片数据长度 (32 bit)
+    uint32_t m_pictureDataLength = 0; 
+    /// @brief 图片数据 (N*8 bit)，图片数据在源文件映射中时为空
     ByteArray m_pictureData; 
+    /// @brief 图片数据所在的文件映射，nullptr表示图片数据已在m_pictureData中
+    MappedFile::ptr m_source = nullptr; 
+    /// @brief 图片数据在文件映射中的偏移
+    uint64_t m_sourceOffset = 0; 
 }; 
 
 /**
@@ -934,8 +1117,9 @@ public:
      * @brief 构造函数
      * @param[in] data 数据指针
      * @param[in] length 数据字节长度
+     * @param[in] arena 变长字段的内存来源，nullptr时使用new/delete
     */
-    UnknownMetaBlock(void* data, uint32_t length, uint8_t typeNum); 
+    UnknownMetaBlock(void* data, uint32_t length, uint8_t typeNum, Arena* arena = nullptr); 
 
     /**
      * @brief 析构函数
@@ -976,8 +1160,9 @@ public:
      * @brief 构造函数
      * @param[in] data 数据指针
      * @param[in] length 数据字节长度
+     * @param[in] arena 变长字段的内存来源，nullptr时使用new/delete
     */
-    InvalidMetaBlock(void* data, uint32_t length); 
+    InvalidMetaBlock(void* data, uint32_t length, Arena* arena = nullptr); 
 
     /**
      * @brief 析构函数
@@ -1005,6 +1190,228 @@ private:
     char* m_data = nullptr; 
 }; 
 
+/**
+ * @brief 保存时的padding策略，预留padding使之后的修改可以原地写回
+*/
+struct PaddingPolicy {
+    /**
+     * @brief padding大小的确定方式
+    */
+    enum Mode {
+        /// @brief 保持现有padding大小
+        KEEP = 0, 
+        /// @brief 固定大小
+        FIXED = 1, 
+        /// @brief metadata（不含padding）大小的百分比
+        PERCENT = 2, 
+        /// @brief 保持现有大小，但限制在[minSize, maxSize]之间
+        RANGE = 3
+    }; 
+
+    /// @brief 确定方式
+    Mode mode = KEEP; 
+    /// @brief FIXED为padding大小(byte)，PERCENT为百分比
+    uint32_t value = 0; 
+    /// @brief padding下限(byte)
+    uint32_t minSize = 0; 
+    /// @brief padding上限(byte)
+    uint32_t maxSize = UINT24_MAX; 
+
+    /**
+     * @brief 保持现有padding
+    */
+    static PaddingPolicy Keep() { return PaddingPolicy(); }
+
+    /**
+     * @brief 固定大小padding
+     * @param[in] size padding大小(byte)
+    */
+    static PaddingPolicy Fixed(uint32_t size); 
+
+    /**
+     * @brief 按metadata大小百分比预留padding
+     * @param[in] percent 百分比
+     * @param[in] minSize padding下限(byte)
+     * @param[in] maxSize padding上限(byte)
+    */
+    static PaddingPolicy Percent(uint32_t percent, uint32_t minSize = 0, uint32_t maxSize = UINT24_MAX); 
+
+    /**
+     * @brief 至少保留minSize，至多保留maxSize
+     * @param[in] minSize padding下限(byte)
+     * @param[in] maxSize padding上限(byte)
+    */
+    static PaddingPolicy Range(uint32_t minSize, uint32_t maxSize); 
+
+    /**
+     * @brief 计算padding大小
+     * @param[in] metadataSize metadata区域（不含padding block）大小(byte)
+     * @param[in] currentSize 现有padding大小(byte)
+     * @retval padding大小(byte)，0表示不需要padding block
+    */
+    uint32_t getPaddingSize(uint64_t metadataSize, uint32_t currentSize) const; 
+
+    /**
+     * @brief 原地保存时能否接受指定大小的padding
+     * @param[in] size padding大小(byte)
+     * @retval 是否在[minSize, maxSize]之间
+    */
+    bool accept(uint32_t size) const { return size>=minSize&&size<=maxSize; }
+}; 
+
+/**
+ * @brief 直接在文件数据上遍历metadata block头，只读取类型与长度，不解析block内容，不分配内存
+*/
+class MetaBlockIterator {
+public: 
+    /**
+     * @brief metadata block头信息
+    */
+    struct BlockInfo {
+        /// @brief block类型号（block头中的7 bit原始值）
+        uint8_t typeNum; 
+        /// @brief 是否为最后一个metadata block
+        bool isLast; 
+        /// @brief block数据（不含4 byte block头）在文件中的偏移
+        uint64_t offset; 
+        /// @brief block数据长度(byte)
+        uint32_t length; 
+
+        /**
+         * @brief 取得block类型，保留类型号统一为UNKNOWN_RESERVED
+         * @retval block类型
+        */
+        Metadata_block::MetadataBlockType getType() const { 
+            return (typeNum>=7&&typeNum<127)?Metadata_block::UNKNOWN_RESERVED:Metadata_block::MetadataBlockType(typeNum); 
+        }
+    }; 
+
+    /**
+     * @brief 构造函数
+     * @param[in] data 文件数据（从"fLaC"标记开始）
+     * @param[in] length 数据长度
+    */
+    MetaBlockIterator(const void* data, size_t length); 
+
+    /**
+     * @brief 取得下一个block
+     * @param[out] dest block头信息
+     * @retval 是否取得，已遍历到最后一个block、数据不是flac或block越界时返回false
+    */
+    bool next(BlockInfo& dest); 
+
+    /**
+     * @brief 数据是否以"fLaC"标记开头
+     * @retval 是否为flac
+    */
+    bool isFlac() const { return m_isFlac; }
+
+    /**
+     * @brief 是否已遍历到带last标记的block
+     * @retval 是否遍历完成
+    */
+    bool isFinished() const { return m_isFinished; }
+
+    /**
+     * @brief 是否有block超出数据范围
+     * @retval 是否损坏
+    */
+    bool isBroken() const { return m_isBroken; }
+
+    /**
+     * @brief 取得当前位置，遍历完成后即为audio frames起点
+     * @retval 当前位置(byte)
+    */
+    uint64_t getPosition() const { return m_position; }
+
+    /**
+     * @brief 取得block数据指针
+     * @param[in] info block头信息
+     * @retval block数据指针
+    */
+    const uint8_t* getBlockData(const BlockInfo& info) const { return m_data+info.offset; }
+
+private: 
+    /// @brief 文件数据
+    const uint8_t* m_data; 
+    /// @brief 数据长度
+    size_t m_length; 
+    /// @brief 下一个block头的位置
+    uint64_t m_position = 4; 
+    /// @brief 是否为flac
+    bool m_isFlac = false; 
+    /// @brief 是否已遍历到最后一个block
+    bool m_isFinished = false; 
+    /// @brief 是否有block超出数据范围
+    bool m_isBroken = false; 
+}; 
+
+/**
+ * @brief 序列化后的metadata区域（包括"fLaC"标记），block写入同一块缓冲，映射中的图片数据直接引用不复制
+*/
+struct SerializedMetadata {
+    /// @brief metadata缓冲，只分配一次
+    std::vector<uint8_t> buffer; 
+    /// @brief 按文件顺序排列的数据段，指向buffer或源文件映射
+    std::vector<WriteSegment> segments; 
+    /// @brief metadata区域总长度(byte)
+    uint64_t size = 0; 
+    /// @brief 按写出顺序排列的block
+    std::vector<Metadata_block::ptr> blocks; 
+    /// @brief 各block数据（不含4 byte block头）在文件中的偏移，与blocks一一对应
+    std::vector<uint64_t> blockOffsets; 
+    /// @brief 各picture图片数据在文件中的偏移，按写出顺序
+    std::vector<uint64_t> pictureOffsets; 
+    /// @brief 写出的padding block，大小与解码器现有的不同时为新建的block，不需要padding时为nullptr
+    PaddingMetaBlock::ptr padding = nullptr; 
+}; 
+
+/**
+ * @brief 音频校验结果
+*/
+struct AudioVerifyResult {
+    /// @brief 文件路径
+    std::wstring path; 
+    /// @brief 是否通过：全部帧解码成功，采样数与STREAMINFO一致，MD5一致（STREAMINFO中没有MD5时不比较）
+    bool success = false; 
+    /// @brief STREAMINFO中是否有MD5，全0表示编码时未计算
+    bool hasMD5 = false; 
+    /// @brief MD5是否一致
+    bool md5Match = false; 
+    /// @brief STREAMINFO中的MD5
+    uint8_t expectedMD5[STREAMINFO_MD5_SIZE] = {0}; 
+    /// @brief 解码得到的MD5
+    uint8_t actualMD5[STREAMINFO_MD5_SIZE] = {0}; 
+    /// @brief 解码出的每声道采样数
+    uint64_t decodedSamples = 0; 
+    /// @brief 解码失败的帧数
+    uint32_t badFrameNum = 0; 
+    /// @brief 第一个解码失败的帧起点（相对audio frames区域起点），没有时为UINT64_MAX
+    uint64_t firstBadFrame = UINT64_MAX; 
+    /// @brief 解码结果第一个不连续或缺失的采样号，没有时为UINT64_MAX；只有MD5不一致时无法定位
+    uint64_t firstBadSample = UINT64_MAX; 
+}; 
+
+/**
+ * @brief 完整性检查结果
+*/
+struct IntegrityCheckResult {
+    /// @brief 文件路径
+    std::wstring path; 
+    /// @brief 是否通过：全部帧CRC一致且首尾相接，采样数与STREAMINFO一致，最后一帧之后没有多余数据
+    bool success = false; 
+    /// @brief 找到的帧数
+    uint32_t frameNum = 0; 
+    /// @brief 损坏的帧起点（相对audio frames区域起点）；帧头也损坏时为前一个完好帧的终点
+    std::vector<uint64_t> badFrames; 
+    /// @brief 帧头损坏而无法计入的每声道采样数
+    uint64_t lostSamples = 0; 
+    /// @brief 是否被截断：最后一帧的采样没有到达STREAMINFO中的总采样数
+    bool truncated = false; 
+    /// @brief 最后一帧之后多余数据的长度(byte)
+    uint64_t trailingBytes = 0; 
+}; 
+
 /**
  * @brief flac文件解码数据类
 */
@@ -1012,6 +1419,52 @@ class MusicDecoderflac: public MusicDecoder {
 public: 
     typedef std::shared_ptr<MusicDecoderflac> ptr; 
 
+    /**
+     * @brief 生成seektable时seekpoint间隔的单位
+    */
+    enum SeekPointSpacing {
+        SPACING_SECONDS = 0, 
+        SPACING_SAMPLES = 1
+    }; 
+
+    /**
+     * @brief 保存时metadata block的排列方式
+    */
+    enum MetadataLayout {
+        /// @brief STREAMINFO, APPLICATION, SEEKTABLE, VORBIS_COMMENT, CUESHEET, pictures, unknown, invalid, padding
+        LAYOUT_DEFAULT = 0, 
+        /// @brief 小且播放前必需的block在前，图片在后：STREAMINFO, SEEKTABLE, VORBIS_COMMENT, CUESHEET, APPLICATION, unknown, invalid, pictures, padding
+        LAYOUT_STREAMING = 1
+    }; 
+
+    /**
+     * @brief 覆盖源文件时的保存方式，按开销从小到大排列
+    */
+    enum SaveStrategy {
+        /// @brief 序列化结果与源文件完全相同，不写文件
+        SAVE_UNCHANGED = 0, 
+        /// @brief metadata区域大小不变，只重写文件头部（setAtomicSave(true)时不使用）
+        SAVE_IN_PLACE = 1, 
+        /// @brief 调整padding大小使metadata区域大小不变，只重写文件头部（setAtomicSave(true)时不使用）
+        SAVE_PADDING_RESIZE = 2, 
+        /// @brief 写出完整的临时文件后替换源文件
+        SAVE_FULL_REWRITE = 3
+    }; 
+
+    /**
+     * @brief 保存后metadata block在文件中的位置
+    */
+    struct MetaBlockLayout {
+        /// @brief block类型
+        Metadata_block::MetadataBlockType type; 
+        /// @brief block头在文件中的偏移
+        uint64_t offset; 
+        /// @brief block数据长度（不含4 byte block头）
+        uint32_t length; 
+        /// @brief 完整读到该block需要读取的文件头部字节数
+        uint64_t prefixBytes; 
+    }; 
+
     /**
      * @brief 默认构造函数
     */
@@ -1102,6 +1555,200 @@ public:
     */
     bool setVorbisCommentLabel(const std::string& key, const std::string& val, uint32_t pos = 0); 
 
+    /**
+     * @brief 扫描audio frames帧头重建SeekTable（只解析帧头，分段并行），结果随resave写回
+     * @param[in] spacing seekpoint间隔
+     * @param[in] unit 间隔单位，默认秒
+     * @retval 是否成功
+    */
+    bool rebuildSeekTable(uint64_t spacing, SeekPointSpacing unit = SPACING_SECONDS); 
+
+    /**
+     * @brief 取得audio frames数据（直接指向源文件映射）
+     * @retval audio frames数据指针，未打开文件时为nullptr
+    */
+    const uint8_t* getAudioFrames() const; 
+
+    /**
+     * @brief 取得audio frames数据长度
+     * @retval audio frames数据长度(byte)
+    */
+    size_t getAudioFramesLength() const { return m_audioFramesLength; }
+
+    /**
+     * @brief 按保存顺序（由排列方式决定）取得全部metadata block
+     * @param[out] dest 赋值目标vector
+    */
+    void getMetaBlocks(std::vector<Metadata_block::ptr>& dest) const; 
+
+    /**
+     * @brief 序列化metadata区域：第一遍计算长度并确定last标记，第二遍各block直接写入同一块缓冲；
+     *        padding按策略计算大小后写出，不修改解码器中的block
+     * @param[out] dest 序列化结果
+     * @param[in] targetSize 期望的metadata区域大小，非0且允许原地保存时优先调整padding使结果恰好为该大小
+     * @retval 是否成功
+    */
+    bool serializeMetadata(SerializedMetadata& dest, uint64_t targetSize = 0) const; 
+
+    /**
+     * @brief 设置保存时metadata block的排列方式
+     * @param[in] val 排列方式
+    */
+    void setMetadataLayout(MetadataLayout val) { m_layout = val; }
+
+    /**
+     * @brief 取得保存时metadata block的排列方式
+     * @retval 排列方式
+    */
+    MetadataLayout getMetadataLayout() const { return m_layout; }
+
+    /**
+     * @brief 按当前排列方式计算各block保存后的位置，不做序列化
+     * @param[out] dest 按文件顺序排列的block位置
+     * @retval 是否成功
+    */
+    bool getMetaBlockLayout(std::vector<MetaBlockLayout>& dest) const; 
+
+    /**
+     * @brief 设置保存时的padding策略
+     * @param[in] val padding策略
+    */
+    void setPaddingPolicy(const PaddingPolicy& val) { m_paddingPolicy = val; }
+
+    /**
+     * @brief 取得保存时的padding策略
+     * @retval padding策略
+    */
+    const PaddingPolicy& getPaddingPolicy() const { return m_paddingPolicy; }
+
+    /**
+     * @brief 按当前修改与padding策略预测覆盖源文件时的保存方式，与save()的判断相同（需要序列化metadata，不写文件）
+     * @retval 保存方式，未打开源文件或序列化失败时为SAVE_FULL_REWRITE
+    */
+    SaveStrategy getSaveStrategy() const; 
+
+    /**
+     * @brief 将修改写回源文件：序列化结果与源文件相同时不写文件；metadata区域大小可以保持不变时只重写文件头部，
+     *        覆盖前原头部先写入日志文件，中途失败或崩溃后恢复原头部（见FileWriter::OVERWRITE）；否则写临时文件后一次替换源文件；
+     *        源文件映射还被其他解码器或读取方引用（fork、快照、音频解码等）时拒绝保存
+     * @param[out] used 实际使用的保存方式，可为nullptr
+     * @retval 是否成功
+    */
+    bool save(SaveStrategy* used = nullptr); 
+
+    /**
+     * @brief 分步保存第一步：序列化并写出数据，但不刷盘也不替换源文件（批量保存时统一刷盘）；
+     *        原地保存时源文件映射在此解除，直到endSave
+     * @param[out] used 实际使用的保存方式，可为nullptr
+     * @retval 是否成功
+    */
+    bool beginSave(SaveStrategy* used = nullptr); 
+
+    /**
+     * @brief 分步保存第二步（可省略）：将写出的数据刷到磁盘
+     * @retval 是否成功
+    */
+    bool flushSave() const; 
+
+    /**
+     * @brief 分步保存最后一步：未刷盘时先刷盘，替换源文件并重新映射
+     * @retval 是否成功
+    */
+    bool endSave(); 
+
+    /**
+     * @brief 设置是否总是写临时文件后替换源文件；默认false，metadata区域大小不变时只重写文件头部，不必复制audio frames。
+     *        两种方式中途失败或崩溃都不会损坏文件；设为true后删除block空出的空间不会转为padding，文件随之变小
+     * @param[in] val 设置值
+    */
+    void setAtomicSave(bool val) { m_ifAtomicSave = val; }
+
+    /**
+     * @brief 是否总是写临时文件后替换源文件
+     * @retval 是否总是替换
+    */
+    bool isAtomicSave() const { return m_ifAtomicSave; }
+
+    /**
+     * @brief 并行导出全部封面，文件名为 前缀_序号.后缀，后缀按图片文件头确定
+     * @param[in] pathPrefix 导出路径前缀
+     * @param[in] pool 线程池，nullptr使用默认线程池
+     * @retval 导出成功的封面数
+    */
+    uint32_t resaveCovers(const std::wstring& pathPrefix, ThreadPool::ptr pool = nullptr) const; 
+
+    /**
+     * @brief 并行导出多个flac文件的全部封面，文件名为 目录\源文件名_序号.后缀
+     * @param[in] files flac文件路径
+     * @param[in] outDir 导出目录
+     * @param[in] pool 线程池，nullptr使用默认线程池
+     * @retval 导出成功的封面数
+    */
+    static uint32_t ResaveCovers(const std::vector<std::wstring>& files, const std::wstring& outDir, ThreadPool::ptr pool = nullptr); 
+
+    /**
+     * @brief 只读取文件中各metadata block的类型与大小，不构造block对象（用于统计封面大小等）
+     * @param[in] file_path flac文件路径
+     * @param[out] dest 按文件顺序排列的block头信息
+     * @retval 是否为完整的flac metadata区域
+    */
+    static bool ListMetaBlocks(const wchar_t* file_path, std::vector<MetaBlockIterator::BlockInfo>& dest); 
+
+    /**
+     * @brief 解码全部音频并与STREAMINFO中的MD5比较（交错、小端、每个采样(采样位数+7)/8 byte），
+     *        各段在线程池中并行解码，按顺序计算MD5
+     * @param[out] result 校验结果，可为nullptr
+     * @param[in] pool 线程池，nullptr使用默认线程池
+     * @retval 是否通过
+    */
+    bool verifyAudio(AudioVerifyResult* result = nullptr, ThreadPool::ptr pool = nullptr) const; 
+
+    /**
+     * @brief 并行校验多个flac文件的音频
+     * @param[in] files flac文件路径
+     * @param[out] dest 各文件的校验结果，与files一一对应
+     * @param[in] pool 线程池，nullptr使用默认线程池
+     * @retval 通过的文件数
+    */
+    static uint32_t VerifyAudio(const std::vector<std::wstring>& files, std::vector<AudioVerifyResult>& dest, ThreadPool::ptr pool = nullptr); 
+
+    /**
+     * @brief 不解码音频的完整性检查：逐帧校验帧头CRC-8与帧尾CRC-16，比verifyAudio快得多，
+     *        但发现不了编码时就已出错的音频；帧扫描与CRC校验都按段并行
+     * @param[out] result 检查结果，可为nullptr
+     * @param[in] pool 线程池，nullptr使用默认线程池
+     * @retval 是否通过
+    */
+    bool checkIntegrity(IntegrityCheckResult* result = nullptr, ThreadPool::ptr pool = nullptr) const; 
+
+    /**
+     * @brief 并行检查多个flac文件的完整性
+     * @param[in] files flac文件路径
+     * @param[out] dest 各文件的检查结果，与files一一对应
+     * @param[in] pool 线程池，nullptr使用默认线程池
+     * @retval 通过的文件数
+    */
+    static uint32_t CheckIntegrity(const std::vector<std::wstring>& files, std::vector<IntegrityCheckResult>& dest, ThreadPool::ptr pool = nullptr); 
+
+    /**
+     * @brief 定位到指定采样：有帧索引时直接查找；否则用SEEKTABLE中前后两个定位点限定范围，
+     *        在范围内按帧头插值二分再逐帧查找，最后解码所在帧并裁掉目标采样之前的部分
+     * @param[in] sample 采样号
+     * @param[out] dest 定位结果
+     * @param[in] index 帧索引，可为nullptr
+     * @retval 是否成功
+    */
+    bool seekToSample(uint64_t sample, FlacSeekResult& dest, std::shared_ptr<FlacFrameIndex> index = nullptr) const; 
+
+    /**
+     * @brief 复制出新解码器（写时复制）：cloneMask以外的block与本解码器共享同一对象并标记为共享，之后任何一方修改共享的block都会失败；
+     *        cloneMask中的block重新解析一份，可以自由修改；padding block总是复制；源文件映射共享，
+     *        新解码器存活期间双方都不能save（会改写对方正在读的源文件），可以resave到其他文件
+     * @param[in] cloneMask 需要复制的block类型，按(1<<MetadataBlockType)组合
+     * @retval 新解码器，失败时为nullptr
+    */
+    MusicDecoderflac::ptr fork(uint32_t cloneMask = 0) const; 
+
 public: 
     virtual bool setbackTitle(const std::string& val) override; 
     virtual bool setbackAlbumArtist(const std::string& val) override; 
@@ -1129,10 +1776,105 @@ public:
     virtual bool resave(const wchar_t* path, bool ifCheckSuffix = false) const override; 
     virtual bool resave(const std::wstring& path, bool ifCheckSuffix = false) const override; 
 
+    /**
+     * @brief 清空全部block与文件状态，保留arena、picture vector等已分配的内存，
+     *        保存配置（padding策略、排列方式、是否总是替换）不变
+    */
+    virtual void reset() override; 
+
 protected: 
     virtual void initData(void* data, size_t length) override; 
 
 private: 
+    /**
+     * @brief 在本解码器的arena中创建block，对外仍为shared_ptr，全部block随arena一次释放
+     * @param[in] args block构造参数
+     * @retval block智能指针
+    */
+    template<class T, class... Args>
+    std::shared_ptr<T> createBlock(Args&&... args) {
+        if (m_arena==nullptr) {
+            m_arena = std::make_shared<Arena>(); 
+        }
+        return std::allocate_shared<T>(ArenaAllocator<T>(m_arena), std::forward<Args>(args)...); 
+    }
+
+    /**
+     * @brief beginSave后尚未完成的保存
+    */
+    struct PendingSave {
+        /// @brief 写入文件的metadata
+        SerializedMetadata meta; 
+        /// @brief 保存方式
+        SaveStrategy strategy = SAVE_FULL_REWRITE; 
+        /// @brief 文件写入器，SAVE_UNCHANGED时为nullptr
+        FileWriter::ptr writer = nullptr; 
+    }; 
+
+    /**
+     * @brief 记录block在源文件映射中的原始位置，data不在映射中时不记录
+     * @param[in] block metadata block
+     * @param[in] data block数据指针
+     * @param[in] length block数据长度
+    */
+    void bindBlockSource(Metadata_block::ptr block, void* data, uint32_t length); 
+
+    /**
+     * @brief 按类型放入block，不复制（fork用）
+     * @param[in] block metadata block
+    */
+    void shareBlock(Metadata_block::ptr block); 
+
+    /**
+     * @brief 按保存顺序取得全部metadata block，padding block用指定的代替
+     * @param[out] dest 赋值目标vector
+     * @param[in] padding 放在最后的padding block，nullptr表示没有
+    */
+    void getMetaBlocks(std::vector<Metadata_block::ptr>& dest, Metadata_block::ptr padding) const; 
+
+    /**
+     * @brief 源文件被改写后，将所有block与图片数据重新绑定到新文件中的位置，并改用写出的padding block
+     * @param[in] meta 写入新文件的metadata
+    */
+    void rebindSource(const SerializedMetadata& meta); 
+
+    /**
+     * @brief 源文件映射是否还被本解码器以外引用（fork出的解码器、快照、音频解码器等）。
+     *        fork出的解码器总是共享映射，所以共享block时映射也一定被共享；
+     *        被共享时不能改写源文件，否则对方的映射会被关闭，共享的block也会被重新绑定到错误的位置
+     * @retval 是否被共享
+    */
+    bool isSourceShared() const; 
+
+    /**
+     * @brief 计算不含padding block的metadata区域大小（包括"fLaC"标记）
+     * @retval metadata区域大小(byte)
+    */
+    uint64_t getMetadataSizeWithoutPadding() const; 
+
+    /**
+     * @brief 序列化结果是否与源文件映射中的metadata区域逐字节相同
+     * @param[in] meta 序列化结果
+     * @retval 是否相同
+    */
+    bool isSameAsSource(const SerializedMetadata& meta) const; 
+
+    /**
+     * @brief 按序列化结果确定覆盖源文件时的保存方式
+     * @param[in] meta 序列化结果
+     * @param[in] targetSize 源文件中metadata区域的大小
+     * @retval 保存方式
+    */
+    SaveStrategy planSave(const SerializedMetadata& meta, uint64_t targetSize) const; 
+
+    /**
+     * @brief 按padding策略计算保存时的padding大小，不修改padding block
+     * @param[in] metadataSize metadata区域（不含padding block）大小(byte)
+     * @param[in] targetSize 期望的metadata区域大小，0表示不限制；总是替换源文件时不起作用
+     * @retval padding大小(byte)，0表示不需要padding block
+    */
+    uint32_t getPlannedPaddingSize(uint64_t metadataSize, uint64_t targetSize) const; 
+
     /**
      * @brief 判断是否为flac文件标记
      * @retval 是否为flac文件标记
@@ -1145,7 +1887,7 @@ private:
 
     /// @brief STREAMINFO：包含整个比特流的一些信息，如采样率、声道数、采样总数等。他一定是第一个metadata而且必须有。
     StreamInfoMetaBlock::ptr m_streamInfo = nullptr; 
-    /// @brief 没有意义的东西，主要用来后期添加其他metadata。
+    /// @brief 没有意义的东西，主要用来后期添加其他metadata。保存到源文件后改为按padding策略写出的block
     PaddingMetaBlock::ptr m_padding = nullptr; 
     /// @brief 包含第三方应用软件信息，这个段里的32位识别码是flac维护组织提供的，是唯一的。
     ApplicationMetaBlock::ptr m_application = nullptr; 
@@ -1162,10 +1904,51 @@ private:
     /// @brief Invalid metablocks
     std::list<InvalidMetaBlock::ptr> m_invalidData; 
 
-    /// @brief 暂存flac的audio frames数据（无解码）（解码板有缘更新）
-    ByteArray m_audioFrames; 
-    /// @brief flac的audio frames数据（无解码）数据长度(byte)
-    size_t m_audioFramesLength; 
+    /// @brief 全部block对象及其变长字段的内存来源
+    Arena::ptr m_arena = nullptr; 
+    /// @brief 保存时的padding策略
+    PaddingPolicy m_paddingPolicy; 
+    /// @brief 保存时metadata block的排列方式
+    MetadataLayout m_layout = LAYOUT_DEFAULT; 
+    /// @brief 是否总是写临时文件后替换源文件
+    bool m_ifAtomicSave = false; 
+    /// @brief beginSave后尚未完成的保存
+    std::shared_ptr<PendingSave> m_pendingSave = nullptr; 
+
+    /// @brief flac的audio frames数据（无解码）数据长度(byte)，audio frames总在文件末尾，数据直接从源文件映射中读取
+    size_t m_audioFramesLength = 0; 
+}; 
+
+/**
+ * @brief 线程内的flac解码器对象池，归还的解码器reset后保留已分配的内存，之后打开文件几乎不再分配
+*/
+class MusicDecoderflacPool {
+public: 
+    /**
+     * @brief 从当前线程的池中取出解码器（池为空时新建）并打开文件
+     * @param[in] file_path 文件路径
+     * @retval 解码器，文件打开失败时为nullptr，解析结果需检查isValid()
+    */
+    static MusicDecoderflac::ptr Acquire(const wchar_t* file_path); 
+
+    /**
+     * @brief 将解码器归还到当前线程的池中，没有其他引用时才会复用
+     * @param[in] decoder 解码器，归还后置为nullptr
+    */
+    static void Release(MusicDecoderflac::ptr& decoder); 
+
+    /**
+     * @brief 取得当前线程池中空闲的解码器数量
+     * @retval 空闲解码器数量
+    */
+    static size_t GetIdleNum(); 
+
+private: 
+    /**
+     * @brief 取得当前线程的空闲解码器列表
+     * @retval 空闲解码器列表
+    */
+    static std::vector<MusicDecoderflac::ptr>& GetIdleList(); 
 }; 
 
 }
@@ -0,0 +1,297 @@
+#include "flacdecoder.h"
+#include "flacpredictor.h"
+#include "crc.h"
+#include "log.h"
+
+#include <algorithm>
+
+namespace music_data {
+
+INITONLYLOGGER(); 
+
+/// @brief FIXED预测最大阶数
+static const uint32_t s_maxFixedOrder = 4; 
+/// @brief LPC预测最大阶数
+static const uint32_t s_maxLpcOrder = 32; 
+
+/**
+ * @brief 读取subframe中的原始采样
+*/
+static inline int64_t ReadSample(FlacBitReader& reader, uint32_t bits) {
+    return bits<=32?reader.readSignedBits(bits):reader.readSignedBits64(bits); 
+}
+
+/**
+ * @brief 平面int32转交错小端PCM，每个采样BYTES byte
+*/
+template<uint32_t BYTES>
+static void InterleaveLE(const int32_t* samples, uint32_t blockSize, uint32_t channels, uint32_t shift, uint8_t* dest) {
+    for (uint32_t c=0; c<channels; ++c) {
+        const int32_t* pin = samples+(size_t)c*blockSize; 
+        uint8_t* pout = dest+c*BYTES; 
+        for (uint32_t i=0; i<blockSize; ++i, pout+=channels*BYTES) {
+            uint32_t val = (uint32_t)pin[i]<<shift; 
+            for (uint32_t j=0; j<BYTES; ++j) {
+                pout[j] = (uint8_t)(val>>(j*8)); 
+            }
+        }
+    }
+}
+
+void FlacPcmBlock::interleave(uint8_t* dest, uint32_t sampleBytes, uint32_t shift) const {
+    switch (sampleBytes) {
+    case 1:
+        InterleaveLE<1>(samples.data(), blockSize, channels, shift, dest); 
+        break; 
+    case 2:
+        InterleaveLE<2>(samples.data(), blockSize, channels, shift, dest); 
+        break; 
+    case 3:
+        InterleaveLE<3>(samples.data(), blockSize, channels, shift, dest); 
+        break; 
+    default:
+        InterleaveLE<4>(samples.data(), blockSize, channels, shift, dest); 
+        break; 
+    }
+}
+
+void FlacPcmBlock::skip(uint32_t num) {
+    num = std::min(num, blockSize); 
+    uint32_t rest = blockSize-num; 
+    // 各声道依次前移，目标位置总在源位置之前，不会覆盖未移动的数据
+    for (uint32_t i=0; i<channels; ++i) {
+        memmove(samples.data()+(size_t)i*rest, samples.data()+(size_t)i*blockSize+num, (size_t)rest*sizeof(int32_t)); 
+    }
+    firstSample+=num; 
+    blockSize = rest; 
+}
+
+FlacAudioDecoder::FlacAudioDecoder(const void* data, size_t length, StreamInfoMetaBlock::ptr streamInfo)
+    : m_data((const uint8_t*)data)
+    , m_length(data==nullptr?0:length)
+    , m_streamInfo(streamInfo) {
+}
+
+FlacAudioDecoder::FlacAudioDecoder(const MusicDecoderflac& decoder)
+    : m_data(decoder.getAudioFrames())
+    , m_length(m_data==nullptr?0:decoder.getAudioFramesLength())
+    , m_streamInfo(decoder.getStreamInfo())
+    , m_source(decoder.getSource()) {
+}
+
+template<class T>
+bool FlacAudioDecoder::decodeResidual(FlacBitReader& reader, uint32_t blockSize, uint32_t order, T* dest) {
+    uint32_t method = reader.readBits(2); 
+    if (method>1) {
+        LOGE("reserved residual coding method %d", method); 
+        return false; 
+    }
+    uint32_t paramBits = method==0?4:5; 
+    uint32_t escape = (1u<<paramBits)-1; 
+    uint32_t partitionOrder = reader.readBits(4); 
+    uint32_t partitionSize = blockSize>>partitionOrder; 
+    if ((partitionSize<<partitionOrder)!=blockSize||partitionSize<order) {
+        LOGE("invalid residual partition order %d for block size %d", partitionOrder, blockSize); 
+        return false; 
+    }
+
+    T* pout = dest+order; 
+    for (uint32_t i=0; i<(1u<<partitionOrder); ++i) {
+        uint32_t num = i==0?partitionSize-order:partitionSize; 
+        uint32_t param = reader.readBits(paramBits); 
+        if (param==escape) {
+            // 未编码分区：5 bit位数后直接存放
+            uint32_t bits = reader.readBits(5); 
+            for (uint32_t j=0; j<num; ++j) {
+                pout[j] = (T)ReadSample(reader, bits); 
+            }
+        } else {
+            for (uint32_t j=0; j<num; ++j) {
+                pout[j] = (T)reader.readRice(param); 
+            }
+        }
+        pout+=num; 
+        if (reader.isOverflow()) {
+            LOGE("residual out of frame"); 
+            return false; 
+        }
+    }
+    return true; 
+}
+
+template<class T>
+bool FlacAudioDecoder::decodeSubframe(FlacBitReader& reader, uint32_t blockSize, uint32_t sampleBits, T* dest) {
+    if (reader.readBits(1)!=0) {
+        LOGE("subframe padding bit is not 0"); 
+        return false; 
+    }
+    uint32_t type = reader.readBits(6); 
+    uint32_t wasted = 0; 
+    if (reader.readBits(1)!=0) {
+        wasted = reader.readUnary()+1; 
+        if (wasted>=sampleBits) {
+            LOGE("wasted bits %d >= sample bits %d", wasted, sampleBits); 
+            return false; 
+        }
+        sampleBits-=wasted; 
+    }
+
+    if (type==0) {
+        T val = (T)ReadSample(reader, sampleBits); 
+        std::fill(dest, dest+blockSize, val); 
+    } else if (type==1) {
+        for (uint32_t i=0; i<blockSize; ++i) {
+            dest[i] = (T)ReadSample(reader, sampleBits); 
+        }
+    } else if (type>=8&&type<=8+s_maxFixedOrder) {
+        uint32_t order = type-8; 
+        if (order>blockSize) {
+            LOGE("fixed order %d > block size %d", order, blockSize); 
+            return false; 
+        }
+        for (uint32_t i=0; i<order; ++i) {
+            dest[i] = (T)ReadSample(reader, sampleBits); 
+        }
+        if (!decodeResidual(reader, blockSize, order, dest)) {
+            return false; 
+        }
+        FlacPredictor::RestoreFixed(dest, blockSize, order); 
+    } else if (type>=32) {
+        uint32_t order = type-31; 
+        if (order>blockSize) {
+            LOGE("lpc order %d > block size %d", order, blockSize); 
+            return false; 
+        }
+        for (uint32_t i=0; i<order; ++i) {
+            dest[i] = (T)ReadSample(reader, sampleBits); 
+        }
+        uint32_t precision = reader.readBits(4)+1; 
+        int32_t shift = reader.readSignedBits(5); 
+        if (precision==16||shift<0) {
+            LOGE("invalid lpc precision %d or shift %d", precision, shift); 
+            return false; 
+        }
+        int32_t coefs[s_maxLpcOrder]; 
+        for (uint32_t i=0; i<order; ++i) {
+            coefs[i] = reader.readSignedBits(precision); 
+        }
+        if (!decodeResidual(reader, blockSize, order, dest)) {
+            return false; 
+        }
+        FlacPredictor::RestoreLpc(dest, blockSize, coefs, order, shift, precision, sampleBits); 
+    } else {
+        LOGE("reserved subframe type %d", type); 
+        return false; 
+    }
+
+    if (wasted>0) {
+        for (uint32_t i=0; i<blockSize; ++i) {
+            dest[i] = (T)((int64_t)dest[i]<<wasted); 
+        }
+    }
+    return !reader.isOverflow(); 
+}
+
+bool FlacAudioDecoder::decodeFrame(uint64_t offset, FlacPcmBlock& dest, uint32_t* frameLength) {
+    if (!isValid()||offset>=m_length) {
+        return false; 
+    }
+
+    FlacFrameHeader header; 
+    if (!header.parse(m_data+offset, m_length-offset)) {
+        LOGE("invalid frame header at offset %lld", (long long)offset); 
+        return false; 
+    }
+
+    uint32_t sampleBits = header.sampleBits==0?m_streamInfo->getSampleBits():header.sampleBits; 
+    if (sampleBits<4||sampleBits>32||header.channels!=m_streamInfo->getChannels()) {
+        LOGE("frame at offset %lld doesn't match stream info", (long long)offset); 
+        return false; 
+    }
+
+    uint32_t blockSize = header.blockSize; 
+    dest.firstSample = header.getFirstSample(m_streamInfo->getMaxBlockSize()); 
+    dest.blockSize = blockSize; 
+    dest.sampleRate = header.sampleRate==0?m_streamInfo->getSampleRate():header.sampleRate; 
+    dest.channels = header.channels; 
+    dest.sampleBits = sampleBits; 
+    dest.samples.resize((size_t)blockSize*header.channels); 
+
+    // side声道多1 bit：left/side为第二声道，side/right为第一声道，mid/side为第二声道
+    int sideChannel = -1; 
+    if (header.channelAssignment==8||header.channelAssignment==10) {
+        sideChannel = 1; 
+    } else if (header.channelAssignment==9) {
+        sideChannel = 0; 
+    }
+    bool wideSide = sideChannel>=0&&sampleBits==32; 
+    if (wideSide) {
+        m_wideSide.resize(blockSize); 
+    }
+
+    FlacBitReader reader(m_data+offset+header.headerLength, m_length-offset-header.headerLength); 
+    for (uint32_t i=0; i<header.channels; ++i) {
+        bool isSide = (int)i==sideChannel; 
+        bool res = isSide&&wideSide
+            ?decodeSubframe(reader, blockSize, sampleBits+1, m_wideSide.data())
+            :decodeSubframe(reader, blockSize, sampleBits+(isSide?1:0), dest.getChannel(i)); 
+        if (!res) {
+            LOGE("decode subframe %d fail at offset %lld", i, (long long)offset); 
+            return false; 
+        }
+    }
+
+    reader.alignToByte(); 
+    size_t bodyLength = header.headerLength+reader.getBytePosition(); 
+    uint16_t crc = reader.readBits(16); 
+    if (reader.isOverflow()||crc16(m_data+offset, bodyLength)!=crc) {
+        LOGE("frame crc-16 mismatch at offset %lld", (long long)offset); 
+        return false; 
+    }
+
+    if (sideChannel>=0) {
+        int32_t* left = dest.getChannel(0); 
+        int32_t* right = dest.getChannel(1); 
+        for (uint32_t i=0; i<blockSize; ++i) {
+            int64_t side = wideSide?m_wideSide[i]:(sideChannel==0?left[i]:right[i]); 
+            if (header.channelAssignment==8) {
+                right[i] = (int32_t)(left[i]-side); 
+            } else if (header.channelAssignment==9) {
+                left[i] = (int32_t)(side+right[i]); 
+            } else {
+                int64_t mid = ((int64_t)left[i]<<1)|(side&1); 
+                left[i] = (int32_t)((mid+side)>>1); 
+                right[i] = (int32_t)((mid-side)>>1); 
+            }
+        }
+    }
+
+    if (frameLength!=nullptr) {
+        *frameLength = bodyLength+2; 
+    }
+    return true; 
+}
+
+bool FlacAudioDecoder::decodeNext(FlacPcmBlock& dest) {
+    while (m_position<m_length) {
+        uint32_t frameLength = 0; 
+        if (decodeFrame(m_position, dest, &frameLength)) {
+            m_position+=frameLength; 
+            return true; 
+        }
+
+        // 帧损坏，跳到下一个帧头合法的位置
+        FlacFrameScanner scanner(m_data, m_length, m_streamInfo); 
+        FlacFrameHeader header; 
+        uint64_t offset = 0; 
+        if (!scanner.findFrame(m_position+1, m_length, header, offset)) {
+            m_position = m_length; 
+            return false; 
+        }
+        LOGW("skip broken frame, resync from offset %lld to %lld", (long long)m_position, (long long)offset); 
+        m_position = offset; 
+    }
+    return false; 
+}
+
+}
\ No newline at end of file
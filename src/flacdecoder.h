@@ -0,0 +1,381 @@
+#ifndef __MD_FLACDECODER_H_
+#define __MD_FLACDECODER_H_
+
+#include "decoderflac.h"
+#include "flacframe.h"
+#include "noncopyable.h"
+
+#include <memory>
+#include <vector>
+#include <stdint.h>
+#include <string.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace music_data {
+
+/**
+ * @brief 按位读取（高位在前），64 bit缓存，一次从内存装入8 byte；读过数据末尾时补0并记录溢出
+*/
+class FlacBitReader {
+public: 
+    /**
+     * @brief 构造函数
+     * @param[in] data 数据指针
+     * @param[in] length 数据长度
+    */
+    FlacBitReader(const void* data, size_t length)
+        : m_data((const uint8_t*)data)
+        , m_length(length) {
+        refill(); 
+    }
+
+    /**
+     * @brief 读取n bit无符号数
+     * @param[in] n 位数，0~32
+     * @retval 读取值
+    */
+    uint32_t readBits(uint32_t n) {
+        if (n==0) {
+            return 0; 
+        }
+        if (m_cacheBits<n) {
+            refill(); 
+            if (m_cacheBits<n) {
+                return readBitsSlow(n); 
+            }
+        }
+        uint32_t ans = (uint32_t)(m_cache>>(64-n)); 
+        m_cache<<=n; 
+        m_cacheBits-=n; 
+        return ans; 
+    }
+
+    /**
+     * @brief 读取n bit有符号数（补码）
+     * @param[in] n 位数，0~32
+     * @retval 读取值
+    */
+    int32_t readSignedBits(uint32_t n) {
+        if (n==0) {
+            return 0; 
+        }
+        uint32_t val = readBits(n); 
+        return (int32_t)(val<<(32-n))>>(32-n); 
+    }
+
+    /**
+     * @brief 读取n bit有符号数（补码），用于32 bit音频的side声道
+     * @param[in] n 位数，0~64
+     * @retval 读取值
+    */
+    int64_t readSignedBits64(uint32_t n) {
+        if (n<=32) {
+            return readSignedBits(n); 
+        }
+        uint64_t high = readBits(n-32); 
+        uint64_t val = (high<<32)|readBits(32); 
+        return (int64_t)(val<<(64-n))>>(64-n); 
+    }
+
+    /**
+     * @brief 读取一元编码：连续0的个数，跳过结尾的1
+     * @retval 0的个数
+    */
+    uint32_t readUnary() {
+        uint32_t ans = 0; 
+        while (true) {
+            if (m_cacheBits==0) {
+                refill(); 
+                if (m_cacheBits==0) {
+                    m_overflow = true; 
+                    return ans; 
+                }
+            }
+            uint64_t valid = m_cache&(~0ULL<<(64-m_cacheBits)); 
+            if (valid!=0) {
+                uint32_t zeros = CountLeadingZeros64(valid); 
+                ans+=zeros; 
+                m_cache<<=zeros; 
+                m_cache<<=1; 
+                m_cacheBits-=zeros+1; 
+                return ans; 
+            }
+            ans+=m_cacheBits; 
+            m_cache = 0; 
+            m_cacheBits = 0; 
+        }
+    }
+
+    /**
+     * @brief 读取rice编码的有符号数
+     * @param[in] k rice参数
+     * @retval 读取值
+    */
+    int64_t readRice(uint32_t k) {
+        uint64_t val = ((uint64_t)readUnary()<<k)|readBits(k); 
+        return (int64_t)(val>>1)^-(int64_t)(val&1); 
+    }
+
+    /**
+     * @brief 跳到下一个字节边界
+    */
+    void alignToByte() {
+        uint32_t n = m_cacheBits&7; 
+        m_cache<<=n; 
+        m_cacheBits-=n; 
+    }
+
+    /**
+     * @brief 取得当前位置(byte)，需先对齐
+     * @retval 当前位置
+    */
+    size_t getBytePosition() const { return m_pos-m_cacheBits/8; }
+
+    /**
+     * @brief 是否读过数据末尾
+     * @retval 是否溢出
+    */
+    bool isOverflow() const { return m_overflow; }
+
+    /**
+     * @brief 取得最高位1之前0的个数
+     * @param[in] val 非0值
+     * @retval 0的个数
+    */
+    static uint32_t CountLeadingZeros64(uint64_t val) {
+#ifdef _MSC_VER
+        unsigned long ans; 
+        _BitScanReverse64(&ans, val); 
+        return 63-ans; 
+#else
+        return __builtin_clzll(val); 
+#endif
+    }
+
+private: 
+    /**
+     * @brief 把缓存装满到至少57 bit（数据足够时）
+    */
+    void refill() {
+        if (m_pos+8<=m_length) {
+            // 一次装入8 byte，只前进完整装入的字节数，多装入的位与之后装入的相同
+            uint64_t val = 0; 
+            for (int i=0; i<8; ++i) {
+                val = (val<<8)|m_data[m_pos+i]; 
+            }
+            m_cache|=val>>m_cacheBits; 
+            uint32_t bytes = (63-m_cacheBits)>>3; 
+            m_pos+=bytes; 
+            m_cacheBits+=bytes*8; 
+            return; 
+        }
+        while (m_cacheBits<=56&&m_pos<m_length) {
+            m_cache|=(uint64_t)m_data[m_pos++]<<(56-m_cacheBits); 
+            m_cacheBits+=8; 
+        }
+    }
+
+    /**
+     * @brief 数据末尾不足n bit时逐位读取，不足部分补0
+    */
+    uint32_t readBitsSlow(uint32_t n) {
+        uint32_t ans = 0; 
+        for (uint32_t i=0; i<n; ++i) {
+            uint32_t bit = 0; 
+            if (m_cacheBits>0) {
+                bit = (uint32_t)(m_cache>>63); 
+                m_cache<<=1; 
+                --m_cacheBits; 
+            } else {
+                m_overflow = true; 
+            }
+            ans = (ans<<1)|bit; 
+        }
+        return ans; 
+    }
+
+private: 
+    /// @brief 数据
+    const uint8_t* m_data; 
+    /// @brief 数据长度
+    size_t m_length; 
+    /// @brief 下一个装入缓存的字节位置
+    size_t m_pos = 0; 
+    /// @brief 位缓存，有效位从最高位开始
+    uint64_t m_cache = 0; 
+    /// @brief 缓存中的有效位数
+    uint32_t m_cacheBits = 0; 
+    /// @brief 是否读过数据末尾
+    bool m_overflow = false; 
+}; 
+
+/**
+ * @brief 一帧解码后的PCM，int32平面排列
+*/
+struct FlacPcmBlock {
+    /// @brief 第一个采样的序号
+    uint64_t firstSample = 0; 
+    /// @brief 每个声道的采样数
+    uint32_t blockSize = 0; 
+    /// @brief 采样率(Hz)
+    uint32_t sampleRate = 0; 
+    /// @brief 声道数
+    uint8_t channels = 0; 
+    /// @brief 采样位数
+    uint8_t sampleBits = 0; 
+    /// @brief 采样数据，声道c位于[c*blockSize, (c+1)*blockSize)
+    std::vector<int32_t> samples; 
+
+    /**
+     * @brief 取得声道数据
+     * @param[in] channel 声道
+     * @retval 声道首个采样的指针
+    */
+    int32_t* getChannel(uint32_t channel) { return samples.data()+(size_t)channel*blockSize; }
+    const int32_t* getChannel(uint32_t channel) const { return samples.data()+(size_t)channel*blockSize; }
+
+    /**
+     * @brief 转为交错排列的小端PCM（flac计算MD5所用的格式），每个采样取低sampleBytes byte
+     * @param[out] dest 目标，长度至少blockSize*channels*sampleBytes
+     * @param[in] sampleBytes 每个采样的字节数，1~4
+     * @param[in] shift 采样先左移的位数，用于在容器中左对齐（如WAV中的20 bit采样）
+    */
+    void interleave(uint8_t* dest, uint32_t sampleBytes, uint32_t shift = 0) const; 
+
+    /**
+     * @brief 丢弃每个声道开头的若干采样
+     * @param[in] num 丢弃的采样数，超过blockSize时全部丢弃
+    */
+    void skip(uint32_t num); 
+}; 
+
+/**
+ * @brief flac音频帧解码器：CONSTANT、VERBATIM、FIXED、LPC subframe，rice/rice2残差，
+ *        wasted bits与left/right/mid-side声道去相关，支持4~32 bit，输出int32平面PCM
+*/
+class FlacAudioDecoder: Noncopyable {
+public: 
+    typedef std::shared_ptr<FlacAudioDecoder> ptr; 
+
+    /**
+     * @brief 构造函数
+     * @param[in] data audio frames数据指针
+     * @param[in] length audio frames数据长度
+     * @param[in] streamInfo 流信息
+    */
+    FlacAudioDecoder(const void* data, size_t length, StreamInfoMetaBlock::ptr streamInfo); 
+
+    /**
+     * @brief 构造函数，解码解码器源文件中的audio frames，并保持源文件映射
+     * @param[in] decoder flac解码器
+    */
+    FlacAudioDecoder(const MusicDecoderflac& decoder); 
+
+    /**
+     * @brief 数据与流信息是否可以解码
+     * @retval 是否有效
+    */
+    bool isValid() const { return m_data!=nullptr&&m_streamInfo!=nullptr; }
+
+    /**
+     * @brief 解码指定位置的帧
+     * @param[in] offset 帧起点，相对audio frames区域起点
+     * @param[out] dest PCM
+     * @param[out] frameLength 帧长(byte)，可为nullptr
+     * @retval 是否成功，帧头或CRC-16校验失败时为false
+    */
+    bool decodeFrame(uint64_t offset, FlacPcmBlock& dest, uint32_t* frameLength = nullptr); 
+
+    /**
+     * @brief 解码当前位置的帧并前进到下一帧，帧损坏时跳到下一个能解码的帧
+     * @param[out] dest PCM
+     * @retval 是否解码到帧，到达末尾时为false
+    */
+    bool decodeNext(FlacPcmBlock& dest); 
+
+    /**
+     * @brief 设置decodeNext的位置
+     * @param[in] offset 帧起点，相对audio frames区域起点
+    */
+    void setPosition(uint64_t offset) { m_position = offset; }
+
+    /**
+     * @brief 取得decodeNext的位置
+     * @retval 下一帧起点
+    */
+    uint64_t getPosition() const { return m_position; }
+
+    /**
+     * @brief 是否已解码到末尾
+     * @retval 是否到达末尾
+    */
+    bool isFinished() const { return m_position>=m_length; }
+
+    /**
+     * @brief 取得流信息
+     * @retval 流信息
+    */
+    StreamInfoMetaBlock::ptr getStreamInfo() const { return m_streamInfo; }
+
+private: 
+    /**
+     * @brief 解码一个subframe
+     * @param[in] reader 位读取器
+     * @param[in] blockSize 采样数
+     * @param[in] sampleBits subframe采样位数（side声道多1 bit）
+     * @param[out] dest 采样
+     * @retval 是否成功
+    */
+    template<class T>
+    bool decodeSubframe(FlacBitReader& reader, uint32_t blockSize, uint32_t sampleBits, T* dest); 
+
+    /**
+     * @brief 解码残差，写在dest[order]之后
+     * @param[in] reader 位读取器
+     * @param[in] blockSize 采样数
+     * @param[in] order 预测阶数
+     * @param[out] dest 采样
+     * @retval 是否成功
+    */
+    template<class T>
+    bool decodeResidual(FlacBitReader& reader, uint32_t blockSize, uint32_t order, T* dest); 
+
+private: 
+    /// @brief audio frames数据
+    const uint8_t* m_data; 
+    /// @brief audio frames数据长度
+    size_t m_length; 
+    /// @brief 流信息
+    StreamInfoMetaBlock::ptr m_streamInfo; 
+    /// @brief 源文件映射，保证数据有效
+    MappedFile::ptr m_source = nullptr; 
+    /// @brief decodeNext的位置
+    uint64_t m_position = 0; 
+    /// @brief 32 bit音频side声道需要33 bit
+    std::vector<int64_t> m_wideSide; 
+}; 
+
+/**
+ * @brief 按采样号定位的结果
+*/
+struct FlacSeekResult {
+    /// @brief 目标采样号
+    uint64_t sample = 0; 
+    /// @brief 包含目标采样的帧起点，相对audio frames区域起点
+    uint64_t frameOffset = 0; 
+    /// @brief 包含目标采样的帧在源文件中的偏移，可以从这里直接转发原始数据
+    uint64_t fileOffset = 0; 
+    /// @brief 包含目标采样的帧的首采样号，转发原始数据时接收方需丢弃sample-frameFirstSample个采样
+    uint64_t frameFirstSample = 0; 
+    /// @brief 包含目标采样的帧从目标采样开始的部分
+    FlacPcmBlock block; 
+    /// @brief 解码器，decodeNext从下一帧开始
+    FlacAudioDecoder::ptr decoder; 
+}; 
+
+}
+
+#endif
\ No newline at end of file
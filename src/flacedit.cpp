@@ -0,0 +1,250 @@
+#include "flacedit.h"
+#include "log.h"
+
+#include <algorithm>
+
+namespace music_data {
+
+INITONLYLOGGER(); 
+
+/// @brief 批量提交时每组文件数，组内统一刷盘
+static const size_t s_batchGroupSize = 64; 
+
+bool FlacEdit::CheckKey(const std::string& key) {
+    if (key.empty()) {
+        LOGE("vorbis comment key is empty"); 
+        return false; 
+    }
+    for (char c: key) {
+        if (c<0x20||c>0x7D||c=='=') {
+            LOGE("vorbis comment key contains invalid char 0x%02x, key = %s", (uint8_t)c, key.c_str()); 
+            return false; 
+        }
+    }
+    return true; 
+}
+
+bool FlacEdit::CheckImage(Image::ptr img) {
+    if (img==nullptr||!img->isValid()) {
+        LOGE("cover image is not valid"); 
+        return false; 
+    }
+    // picture block固定字段32 byte + MIME类型 + 图片数据（描述为空）
+    uint64_t blockSize = 32+Image::getMimeTyepFromImageType(img->getType()).size()+img->getDataSize(); 
+    if (blockSize>UINT24_MAX) {
+        LOGE("cover image is too large, picture block should <=%d, but got %lld", UINT24_MAX, (long long)blockSize); 
+        return false; 
+    }
+    return true; 
+}
+
+bool FlacEdit::addTagOp(const Op& op) {
+    if (!CheckKey(op.key)) {
+        return invalidate(); 
+    }
+    if (op.type==SET_TAG||op.type==ADD_TAG) {
+        // 每个标签占4 byte长度 + "key=val"
+        m_addedTagBytes+=4+op.key.size()+1+op.val.size(); 
+        if (m_addedTagBytes>UINT24_MAX) {
+            LOGE("tags are too long, vorbis comment block should <=%d, but added %lld", UINT24_MAX, (long long)m_addedTagBytes); 
+            return invalidate(); 
+        }
+    }
+    m_ops.emplace_back(op); 
+    return true; 
+}
+
+bool FlacEdit::setTag(const std::string& key, const std::string& val) {
+    return addTagOp(Op{SET_TAG, key, val, nullptr, 0}); 
+}
+
+bool FlacEdit::addTag(const std::string& key, const std::string& val) {
+    return addTagOp(Op{ADD_TAG, key, val, nullptr, 0}); 
+}
+
+bool FlacEdit::removeTag(const std::string& key) {
+    return addTagOp(Op{REMOVE_TAG, key, "", nullptr, 0}); 
+}
+
+bool FlacEdit::removeTag(const std::string& key, const std::string& val) {
+    return addTagOp(Op{REMOVE_TAG_VALUE, key, val, nullptr, 0}); 
+}
+
+bool FlacEdit::setCover(Image::ptr img, uint32_t pos) {
+    if (!CheckImage(img)) {
+        return invalidate(); 
+    }
+    m_ops.emplace_back(Op{SET_COVER, "", "", img, (int)pos}); 
+    return true; 
+}
+
+bool FlacEdit::addCover(Image::ptr img, int pos) {
+    if (!CheckImage(img)) {
+        return invalidate(); 
+    }
+    m_ops.emplace_back(Op{ADD_COVER, "", "", img, pos}); 
+    return true; 
+}
+
+bool FlacEdit::removeCover(uint32_t pos) {
+    m_ops.emplace_back(Op{REMOVE_COVER, "", "", nullptr, (int)pos}); 
+    return true; 
+}
+
+bool FlacEdit::removeAllCovers() {
+    m_ops.emplace_back(Op{REMOVE_ALL_COVERS, "", "", nullptr, 0}); 
+    return true; 
+}
+
+void FlacEdit::clear() {
+    m_ops.clear(); 
+    m_addedTagBytes = 0; 
+    m_isValid = true; 
+}
+
+bool FlacEdit::apply(MusicDecoderflac& decoder) const {
+    if (!m_isValid) {
+        LOGE("edit is not valid, apply termination"); 
+        return false; 
+    }
+    if (!decoder.isValid()) {
+        LOGE("decoder is not valid, apply termination"); 
+        return false; 
+    }
+
+    bool hasTagOp = false; 
+    for (auto& op: m_ops) {
+        hasTagOp = hasTagOp||op.type<=REMOVE_TAG_VALUE; 
+    }
+    if (hasTagOp&&decoder.getVorbisComment()==nullptr&&!decoder.addVorbisCommentMetaBlock()) {
+        LOGE("couldn't create VorbisCommentMetaBlock, apply termination"); 
+        return false; 
+    }
+
+    auto vorbis = decoder.getVorbisComment(); 
+    std::vector<PictureMetaBlock::ptr> pictures; 
+    std::vector<std::string> values; 
+    for (auto& op: m_ops) {
+        bool res = true; 
+        switch (op.type) {
+        case SET_TAG:
+            // 值已相同时不修改，保持block未修改状态
+            values.clear(); 
+            vorbis->getLabelListWithKey(op.key, values); 
+            if (values.size()==1&&values[0]==op.val) {
+                break; 
+            }
+            vorbis->delAllInfoLabel(op.key); 
+            res = vorbis->addInfoLabel(op.key, op.val); 
+            break; 
+        case ADD_TAG:
+            res = vorbis->addInfoLabel(op.key, op.val); 
+            break; 
+        case REMOVE_TAG:
+            vorbis->delAllInfoLabel(op.key); 
+            break; 
+        case REMOVE_TAG_VALUE:
+            vorbis->delAllMatchInfoLabel(op.key, op.val); 
+            break; 
+        case SET_COVER:
+            res = decoder.setbackCover(*op.image, op.pos); 
+            break; 
+        case ADD_COVER:
+            decoder.getPictures(pictures); 
+            res = decoder.addbackCover(*op.image, op.pos<0?(uint32_t)pictures.size():(uint32_t)op.pos); 
+            break; 
+        case REMOVE_COVER:
+            res = decoder.delbackCover(op.pos); 
+            break; 
+        case REMOVE_ALL_COVERS:
+            decoder.getPictures(pictures); 
+            for (size_t i=0; i<pictures.size(); ++i) {
+                decoder.delbackCover(0); 
+            }
+            break; 
+        }
+        if (!res) {
+            LOGE("apply edit op %d fail", op.type); 
+            return false; 
+        }
+    }
+
+    return true; 
+}
+
+bool FlacEdit::commit(const wchar_t* path, MusicDecoderflac::SaveStrategy* used) const {
+    if (!m_isValid) {
+        LOGE("edit is not valid, commit termination"); 
+        return false; 
+    }
+
+    MusicDecoderflac decoder(path); 
+    if (!decoder.isValid()) {
+        LOGE("open flac file fail, commit termination"); 
+        return false; 
+    }
+    decoder.setAtomicSave(m_ifAtomicSave); 
+    // 修改只在内存中进行，全部成功后才写文件
+    if (!apply(decoder)) {
+        return false; 
+    }
+    return decoder.save(used); 
+}
+
+uint32_t FlacEdit::commitBatch(const std::vector<std::wstring>& files, std::vector<Result>* results, ThreadPool::ptr pool) const {
+    if (pool==nullptr) {
+        pool = DefaultThreadPool::GetInstance(); 
+    }
+    if (results!=nullptr) {
+        results->assign(files.size(), Result()); 
+    }
+    if (!m_isValid) {
+        LOGE("edit is not valid, commit termination"); 
+        return 0; 
+    }
+
+    // 分组提交：组内先并行写出全部文件，再并行刷盘，最后依次替换，
+    // 刷盘等待在组内重叠，不必每个文件单独等待一次完整的刷盘
+    uint32_t successNum = 0; 
+    for (size_t groupBegin=0; groupBegin<files.size(); groupBegin+=s_batchGroupSize) {
+        size_t groupSize = std::min<size_t>(s_batchGroupSize, files.size()-groupBegin); 
+        std::vector<MusicDecoderflac::ptr> decoders(groupSize); 
+        std::vector<MusicDecoderflac::SaveStrategy> strategies(groupSize, MusicDecoderflac::SAVE_FULL_REWRITE); 
+
+        pool->parallelFor(groupSize, [this, &files, &decoders, &strategies, groupBegin](size_t i) {
+            auto decoder = std::make_shared<MusicDecoderflac>(files[groupBegin+i].c_str()); 
+            if (!decoder->isValid()) {
+                LOGE("open flac file fail, commit termination"); 
+                return; 
+            }
+            decoder->setAtomicSave(m_ifAtomicSave); 
+            if (apply(*decoder)&&decoder->beginSave(&strategies[i])) {
+                decoders[i] = decoder; 
+            }
+        }); 
+
+        pool->parallelFor(groupSize, [&decoders](size_t i) {
+            if (decoders[i]!=nullptr&&!decoders[i]->flushSave()) {
+                decoders[i]->endSave(); 
+                decoders[i] = nullptr; 
+            }
+        }); 
+
+        for (size_t i=0; i<groupSize; ++i) {
+            bool res = decoders[i]!=nullptr&&decoders[i]->endSave(); 
+            if (res) {
+                ++successNum; 
+            }
+            if (results!=nullptr) {
+                Result& item = (*results)[groupBegin+i]; 
+                item.path = files[groupBegin+i]; 
+                item.success = res; 
+                item.strategy = strategies[i]; 
+            }
+        }
+    }
+
+    return successNum; 
+}
+
+}
\ No newline at end of file
@@ -0,0 +1,227 @@
+#ifndef __MD_FLACEDIT_H_
+#define __MD_FLACEDIT_H_
+
+#include "decoderflac.h"
+#include "image.h"
+#include "threadpool.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+namespace music_data {
+
+/**
+ * @brief flac编辑事务：先收集标签与封面修改并检查长度限制，提交时一次性应用并只写一次文件，
+ *        同一事务可以作为模板提交到任意多个文件
+*/
+class FlacEdit {
+public: 
+    typedef std::shared_ptr<FlacEdit> ptr; 
+
+    /**
+     * @brief 修改操作类型
+    */
+    enum OpType {
+        /// @brief 设置标签，替换该key的全部值
+        SET_TAG = 0, 
+        /// @brief 添加标签值
+        ADD_TAG = 1, 
+        /// @brief 删除该key的全部值
+        REMOVE_TAG = 2, 
+        /// @brief 删除该key下与val相同的值
+        REMOVE_TAG_VALUE = 3, 
+        /// @brief 替换封面，没有封面时添加
+        SET_COVER = 4, 
+        /// @brief 添加封面
+        ADD_COVER = 5, 
+        /// @brief 删除封面
+        REMOVE_COVER = 6, 
+        /// @brief 删除全部封面
+        REMOVE_ALL_COVERS = 7
+    }; 
+
+    /**
+     * @brief 一个修改操作
+    */
+    struct Op {
+        /// @brief 操作类型
+        OpType type; 
+        /// @brief 标签key
+        std::string key; 
+        /// @brief 标签值
+        std::string val; 
+        /// @brief 封面图片
+        Image::ptr image; 
+        /// @brief 封面位置，-1表示末尾
+        int pos; 
+    }; 
+
+    /**
+     * @brief 单个文件的提交结果
+    */
+    struct Result {
+        /// @brief 文件路径
+        std::wstring path; 
+        /// @brief 是否成功
+        bool success = false; 
+        /// @brief 实际使用的保存方式
+        MusicDecoderflac::SaveStrategy strategy = MusicDecoderflac::SAVE_FULL_REWRITE; 
+    }; 
+
+    /**
+     * @brief 设置标签，替换该key的全部值
+     * @param[in] key 标签key
+     * @param[in] val 标签值
+     * @retval 是否通过检查，未通过时事务失效
+    */
+    bool setTag(const std::string& key, const std::string& val); 
+
+    /**
+     * @brief 在该key的值末尾添加标签值
+     * @param[in] key 标签key
+     * @param[in] val 标签值
+     * @retval 是否通过检查，未通过时事务失效
+    */
+    bool addTag(const std::string& key, const std::string& val); 
+
+    /**
+     * @brief 删除该key的全部值，key不存在时忽略
+     * @param[in] key 标签key
+     * @retval 是否通过检查，未通过时事务失效
+    */
+    bool removeTag(const std::string& key); 
+
+    /**
+     * @brief 删除该key下与val相同的全部值，不存在时忽略
+     * @param[in] key 标签key
+     * @param[in] val 标签值
+     * @retval 是否通过检查，未通过时事务失效
+    */
+    bool removeTag(const std::string& key, const std::string& val); 
+
+    /**
+     * @brief 替换封面，没有封面时添加
+     * @param[in] img 封面图片
+     * @param[in] pos 封面位置，默认为0
+     * @retval 是否通过检查，未通过时事务失效
+    */
+    bool setCover(Image::ptr img, uint32_t pos = 0); 
+
+    /**
+     * @brief 添加封面
+     * @param[in] img 封面图片
+     * @param[in] pos 添加位置，默认为-1，即加在末尾
+     * @retval 是否通过检查，未通过时事务失效
+    */
+    bool addCover(Image::ptr img, int pos = -1); 
+
+    /**
+     * @brief 删除封面
+     * @param[in] pos 封面位置
+     * @retval 是否通过检查，未通过时事务失效
+    */
+    bool removeCover(uint32_t pos = 0); 
+
+    /**
+     * @brief 删除全部封面
+     * @retval 是否通过检查，未通过时事务失效
+    */
+    bool removeAllCovers(); 
+
+    /**
+     * @brief 清空全部修改，事务恢复有效
+    */
+    void clear(); 
+
+    /**
+     * @brief 全部修改是否都通过检查
+     * @retval 是否有效
+    */
+    bool isValid() const { return m_isValid; }
+
+    /**
+     * @brief 是否没有修改
+     * @retval 是否没有修改
+    */
+    bool empty() const { return m_ops.empty(); }
+
+    /**
+     * @brief 设置提交时是否总是写临时文件后替换源文件，见MusicDecoderflac::setAtomicSave；默认false
+     * @param[in] val 设置值
+    */
+    void setAtomicSave(bool val) { m_ifAtomicSave = val; }
+
+    /**
+     * @brief 取得修改列表
+     * @retval 修改列表
+    */
+    const std::vector<Op>& getOps() const { return m_ops; }
+
+    /**
+     * @brief 将修改按顺序应用到解码器（只修改内存，不写文件）
+     * @param[in] decoder 解码器
+     * @retval 是否全部应用成功，失败时解码器可能只应用了部分修改
+    */
+    bool apply(MusicDecoderflac& decoder) const; 
+
+    /**
+     * @brief 打开文件，应用修改并写回，整个过程只写一次文件
+     * @param[in] path 文件路径
+     * @param[out] used 实际使用的保存方式，可为nullptr
+     * @retval 是否成功，失败时源文件保持不变
+    */
+    bool commit(const wchar_t* path, MusicDecoderflac::SaveStrategy* used = nullptr) const; 
+
+    /**
+     * @brief 并行地将修改提交到多个文件，按组写出后统一刷盘再替换
+     * @param[in] files 文件路径
+     * @param[out] results 各文件的提交结果，与files一一对应，可为nullptr
+     * @param[in] pool 线程池，nullptr使用默认线程池
+     * @retval 提交成功的文件数
+    */
+    uint32_t commitBatch(const std::vector<std::wstring>& files, std::vector<Result>* results = nullptr, ThreadPool::ptr pool = nullptr) const; 
+
+private: 
+    /**
+     * @brief 检查vorbis comment的key：非空，只含0x20~0x7D且不含'='
+     * @param[in] key 标签key
+     * @retval 是否合法
+    */
+    static bool CheckKey(const std::string& key); 
+
+    /**
+     * @brief 检查封面图片是否有效且picture block不超过UINT24_MAX
+     * @param[in] img 封面图片
+     * @retval 是否合法
+    */
+    static bool CheckImage(Image::ptr img); 
+
+    /**
+     * @brief 检查并记录标签修改
+     * @param[in] op 修改操作
+     * @retval 是否通过检查
+    */
+    bool addTagOp(const Op& op); 
+
+    /**
+     * @brief 记录修改失败，事务失效
+     * @retval 总为false
+    */
+    bool invalidate() { m_isValid = false; return false; }
+
+private: 
+    /// @brief 按添加顺序排列的修改
+    std::vector<Op> m_ops; 
+    /// @brief 添加的标签值总长度(byte)，单个vorbis comment block不能超过UINT24_MAX
+    uint64_t m_addedTagBytes = 0; 
+    /// @brief 全部修改是否都通过检查
+    bool m_isValid = true; 
+    /// @brief 提交时是否总是写临时文件后替换源文件
+    bool m_ifAtomicSave = false; 
+}; 
+
+}
+
+#endif
\ No newline at end of file
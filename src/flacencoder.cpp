@@ -0,0 +1,1349 @@
+#include "flacencoder.h"
+#include "flacparallel.h"
+#include "crc.h"
+#include "log.h"
+
+#include <Windows.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <atomic>
+
+#if defined(__x86_64__)||defined(__i386__)||defined(_M_X64)||defined(_M_IX86)
+#define MD_FLACENCODER_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#define MD_TARGET_SSE41
+#define MD_TARGET_AVX2
+#else
+#define MD_TARGET_SSE41 __attribute__((target("sse4.1")))
+#define MD_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+namespace music_data {
+
+INITONLYLOGGER(); 
+
+/// @brief LPC最大阶数
+static const uint32_t s_maxLpcOrder = 32; 
+/// @brief FIXED最大阶数
+static const uint32_t s_maxFixedOrder = 4; 
+/// @brief 分区阶数上限
+static const uint32_t s_maxPartitionOrder = 8; 
+/// @brief rice参数上限，超过时使用rice2
+static const uint32_t s_maxRiceParam = 14; 
+/// @brief rice2参数上限
+static const uint32_t s_maxRice2Param = 30; 
+/// @brief 系数位数上限，15（1111）是保留值
+static const uint32_t s_maxPrecision = 15; 
+/// @brief 量化位移上限（5 bit有符号数）
+static const int32_t s_maxLpcShift = 15; 
+/// @brief 每个线程每批编码的帧数
+static const uint32_t s_framesPerThread = 4; 
+/// @brief 圆周率
+static const double s_pi = 3.14159265358979323846; 
+/// @brief SEEKTABLE定位点间隔(s)，与flac命令行工具的默认值一致
+static const uint32_t s_seekPointSpacing = 10; 
+
+/**
+ * @brief 声道去相关方式
+*/
+enum StereoMode {
+    /// @brief 各声道独立编码
+    STEREO_INDEPENDENT = 0, 
+    /// @brief 用FIXED残差估计，只编码估计最好的一对
+    STEREO_ESTIMATE = 1, 
+    /// @brief 左、右、中、侧都编码，取最好的一对
+    STEREO_EXHAUSTIVE = 2
+}; 
+
+/**
+ * @brief 压缩级别对应的参数
+*/
+struct EncodeSettings {
+    /// @brief block size
+    uint32_t blockSize; 
+    /// @brief LPC最大阶数，0表示只用FIXED
+    uint32_t maxLpcOrder; 
+    /// @brief 最大分区阶数
+    uint32_t maxPartitionOrder; 
+    /// @brief 声道去相关方式
+    StereoMode stereo; 
+    /// @brief 窗函数组：0为tukey(0.5)，1再加partial_tukey(2)，2再加punchout_tukey(3)
+    uint32_t windowSet; 
+}; 
+
+/// @brief 各压缩级别的参数，与libFLAC同名级别相近
+static const EncodeSettings s_levels[FlacEncoder::MAX_LEVEL+1] = {
+    {1152, 0, 3, STEREO_INDEPENDENT, 0},
+    {1152, 0, 3, STEREO_ESTIMATE, 0},
+    {1152, 0, 3, STEREO_EXHAUSTIVE, 0},
+    {4096, 6, 4, STEREO_INDEPENDENT, 0},
+    {4096, 8, 4, STEREO_ESTIMATE, 0},
+    {4096, 8, 5, STEREO_EXHAUSTIVE, 0},
+    {4096, 8, 6, STEREO_EXHAUSTIVE, 1},
+    {4096, 12, 6, STEREO_EXHAUSTIVE, 1},
+    {4096, 12, 6, STEREO_EXHAUSTIVE, 2}
+}; 
+
+/**
+ * @brief subframe类型
+*/
+enum SubframeType {
+    SUBFRAME_CONSTANT = 0, 
+    SUBFRAME_VERBATIM = 1, 
+    SUBFRAME_FIXED = 2, 
+    SUBFRAME_LPC = 3
+}; 
+
+/**
+ * @brief 残差的分区rice编码参数
+*/
+struct RicePlan {
+    /// @brief 分区阶数
+    uint32_t partitionOrder = 0; 
+    /// @brief 是否使用rice2（5 bit参数）
+    bool rice2 = false; 
+    /// @brief 各分区的rice参数
+    uint32_t params[1<<s_maxPartitionOrder]; 
+}; 
+
+/**
+ * @brief 一个subframe的编码方案
+*/
+struct SubframePlan {
+    /// @brief 类型
+    SubframeType type = SUBFRAME_VERBATIM; 
+    /// @brief 预测阶数
+    uint32_t order = 0; 
+    /// @brief wasted bits
+    uint32_t wasted = 0; 
+    /// @brief 去掉wasted bits后的采样位数
+    uint32_t sampleBits = 0; 
+    /// @brief 去掉wasted bits后的信号
+    const int32_t* signal = nullptr; 
+    /// @brief LPC量化系数
+    int32_t coefs[s_maxLpcOrder]; 
+    /// @brief LPC系数位数
+    uint32_t precision = 0; 
+    /// @brief LPC量化位移
+    int32_t shift = 0; 
+    /// @brief 残差，从第order个采样开始
+    std::vector<int32_t> residual; 
+    /// @brief 残差编码参数
+    RicePlan rice; 
+    /// @brief 估计的长度(bit)
+    uint64_t bits = UINT64_MAX; 
+}; 
+
+/**
+ * @brief 编码工作区，每个编码线程一份，帧之间复用
+*/
+struct EncodeWorkspace {
+    /// @brief 中、侧声道
+    std::vector<int32_t> stereo[2]; 
+    /// @brief 去掉wasted bits的信号，对应4个候选
+    std::vector<int32_t> shifted[4]; 
+    /// @brief 候选方案：独立编码时只用第0个，双声道时为左、右、中、侧
+    SubframePlan plans[4]; 
+    /// @brief 尝试中的方案
+    SubframePlan trial; 
+    /// @brief 加窗后的信号
+    std::vector<double> windowed; 
+    /// @brief 窗函数
+    std::vector<std::vector<double>> windows; 
+    /// @brief 窗函数对应的长度
+    uint32_t windowLength = 0; 
+    /// @brief 分区残差和
+    std::vector<uint64_t> sums; 
+    /// @brief 各阶LPC系数
+    double lpc[s_maxLpcOrder][s_maxLpcOrder]; 
+    /// @brief 各阶预测误差
+    double lpcError[s_maxLpcOrder]; 
+}; 
+
+struct FlacEncoder::Context: public EncodeWorkspace {
+}; 
+
+/**
+ * @brief 当前使用的指令集，首次使用时取CPU支持的指令集
+*/
+static FlacPredictor::Isa& CurrentIsa() {
+    static FlacPredictor::Isa isa = FlacPredictor::GetSupportedIsa(); 
+    return isa; 
+}
+
+void FlacBitWriter::writeUtf8(uint32_t val) {
+    if (val<0x80) {
+        writeBits(val, 8); 
+        return; 
+    }
+    // 首字节的前导1个数为总字节数，之后每字节10xxxxxx
+    uint32_t bytes = 2; 
+    while (bytes<6&&val>=(1U<<(5*bytes+1))) {
+        ++bytes; 
+    }
+    uint32_t lead = (0xFF00>>bytes)&0xFF; 
+    writeBits(lead|(val>>(6*(bytes-1))), 8); 
+    for (uint32_t i=bytes-1; i>0; --i) {
+        writeBits(0x80|((val>>(6*(i-1)))&0x3F), 8); 
+    }
+}
+
+void FlacBitWriter::alignToByte() {
+    if (m_cacheBits&7) {
+        writeBits(0, 8-(m_cacheBits&7)); 
+    }
+    if (m_length+4>m_buffer.size()) {
+        m_buffer.resize(m_buffer.size()*2+64); 
+    }
+    while (m_cacheBits>0) {
+        m_cacheBits-=8; 
+        m_buffer[m_length++] = (uint8_t)(m_cache>>m_cacheBits); 
+    }
+}
+
+/**
+ * @brief 残差折叠为无符号数：0, -1, 1, -2, ... -> 0, 1, 2, 3, ...
+*/
+static inline uint32_t FoldResidual(int32_t val) {
+    return ((uint32_t)val<<1)^(uint32_t)(val>>31); 
+}
+
+/**
+ * @brief 自相关，标量版本；按4路分别累加后合并，与SIMD版本的累加顺序相同，结果逐位一致
+*/
+static void AutocorrelationScalar(const double* data, uint32_t length, uint32_t lags, double* autoc) {
+    for (uint32_t lag=0; lag<lags; ++lag) {
+        const double* pa = data+lag; 
+        uint32_t num = length-lag; 
+        double s0 = 0, s1 = 0, s2 = 0, s3 = 0; 
+        uint32_t i = 0; 
+        for (; i+4<=num; i+=4) {
+            s0+=pa[i]*data[i]; 
+            s1+=pa[i+1]*data[i+1]; 
+            s2+=pa[i+2]*data[i+2]; 
+            s3+=pa[i+3]*data[i+3]; 
+        }
+        double tail = 0; 
+        for (; i<num; ++i) {
+            tail+=pa[i]*data[i]; 
+        }
+        autoc[lag] = ((s0+s1)+(s2+s3))+tail; 
+    }
+}
+
+#ifdef MD_FLACENCODER_X86
+MD_TARGET_SSE41 static void AutocorrelationSse41(const double* data, uint32_t length, uint32_t lags, double* autoc) {
+    for (uint32_t lag=0; lag<lags; ++lag) {
+        const double* pa = data+lag; 
+        uint32_t num = length-lag; 
+        __m128d acc01 = _mm_setzero_pd(); 
+        __m128d acc23 = _mm_setzero_pd(); 
+        uint32_t i = 0; 
+        for (; i+4<=num; i+=4) {
+            acc01 = _mm_add_pd(acc01, _mm_mul_pd(_mm_loadu_pd(pa+i), _mm_loadu_pd(data+i))); 
+            acc23 = _mm_add_pd(acc23, _mm_mul_pd(_mm_loadu_pd(pa+i+2), _mm_loadu_pd(data+i+2))); 
+        }
+        double tail = 0; 
+        for (; i<num; ++i) {
+            tail+=pa[i]*data[i]; 
+        }
+        double s[4]; 
+        _mm_storeu_pd(s, acc01); 
+        _mm_storeu_pd(s+2, acc23); 
+        autoc[lag] = ((s[0]+s[1])+(s[2]+s[3]))+tail; 
+    }
+}
+
+MD_TARGET_AVX2 static void AutocorrelationAvx2(const double* data, uint32_t length, uint32_t lags, double* autoc) {
+    for (uint32_t lag=0; lag<lags; ++lag) {
+        const double* pa = data+lag; 
+        uint32_t num = length-lag; 
+        // 乘与加分开，不用FMA，保证与其他实现的舍入相同
+        __m256d acc = _mm256_setzero_pd(); 
+        uint32_t i = 0; 
+        for (; i+4<=num; i+=4) {
+            acc = _mm256_add_pd(acc, _mm256_mul_pd(_mm256_loadu_pd(pa+i), _mm256_loadu_pd(data+i))); 
+        }
+        double tail = 0; 
+        for (; i<num; ++i) {
+            tail+=pa[i]*data[i]; 
+        }
+        double s[4]; 
+        _mm256_storeu_pd(s, acc); 
+        autoc[lag] = ((s[0]+s[1])+(s[2]+s[3]))+tail; 
+    }
+}
+#endif
+
+/**
+ * @brief 计算加窗信号的自相关
+ * @param[in] data 加窗信号
+ * @param[in] length 长度
+ * @param[in] lags 计算的延迟数（最大阶数+1），小于等于length
+ * @param[out] autoc 自相关
+*/
+static void Autocorrelation(const double* data, uint32_t length, uint32_t lags, double* autoc) {
+#ifdef MD_FLACENCODER_X86
+    if (CurrentIsa()==FlacPredictor::ISA_AVX2) {
+        AutocorrelationAvx2(data, length, lags, autoc); 
+        return; 
+    }
+    if (CurrentIsa()==FlacPredictor::ISA_SSE41) {
+        AutocorrelationSse41(data, length, lags, autoc); 
+        return; 
+    }
+#endif
+    AutocorrelationScalar(data, length, lags, autoc); 
+}
+
+/**
+ * @brief Levinson-Durbin递推，由自相关求1~maxOrder阶的预测系数
+ * @retval 可用的最大阶数，预测误差为0时提前结束
+*/
+static uint32_t ComputeLpc(const double* autoc, uint32_t maxOrder, double lpc[][s_maxLpcOrder], double* error) {
+    double coefs[s_maxLpcOrder]; 
+    double err = autoc[0]; 
+    for (uint32_t i=0; i<maxOrder; ++i) {
+        double r = -autoc[i+1]; 
+        for (uint32_t j=0; j<i; ++j) {
+            r-=coefs[j]*autoc[i-j]; 
+        }
+        r/=err; 
+
+        coefs[i] = r; 
+        uint32_t j = 0; 
+        for (; j<(i>>1); ++j) {
+            double tmp = coefs[j]; 
+            coefs[j]+=r*coefs[i-1-j]; 
+            coefs[i-1-j]+=r*tmp; 
+        }
+        if (i&1) {
+            coefs[j]+=coefs[j]*r; 
+        }
+        err*=1.0-r*r; 
+
+        // 滤波器系数取反即为预测系数
+        for (j=0; j<=i; ++j) {
+            lpc[i][j] = -coefs[j]; 
+        }
+        error[i] = err; 
+        if (err==0.0) {
+            return i+1; 
+        }
+    }
+    return maxOrder; 
+}
+
+/**
+ * @brief 量化LPC系数，误差反馈到下一个系数
+ * @retval 是否成功，需要负的位移时失败
+*/
+static bool QuantizeLpc(const double* lpc, uint32_t order, uint32_t precision, int32_t* dest, int32_t* shift) {
+    int32_t qmax = (1<<(precision-1))-1; 
+    int32_t qmin = -(1<<(precision-1)); 
+    double cmax = 0; 
+    for (uint32_t i=0; i<order; ++i) {
+        cmax = std::max(cmax, fabs(lpc[i])); 
+    }
+    if (!(cmax>0)) {
+        return false; 
+    }
+
+    int log2cmax = 0; 
+    frexp(cmax, &log2cmax); 
+    int32_t qshift = (int32_t)precision-log2cmax-1; 
+    if (qshift<0) {
+        return false; 
+    }
+    qshift = std::min(qshift, s_maxLpcShift); 
+
+    double error = 0; 
+    for (uint32_t i=0; i<order; ++i) {
+        error+=lpc[i]*(1<<qshift); 
+        long val = lround(error); 
+        val = std::min<long>(std::max<long>(val, qmin), qmax); 
+        error-=val; 
+        dest[i] = val; 
+    }
+    *shift = qshift; 
+    return true; 
+}
+
+/**
+ * @brief 计算LPC残差
+ * @retval 是否成功，残差超出32 bit时失败
+*/
+static bool ComputeLpcResidual(const int32_t* data, uint32_t length, const int32_t* coefs, uint32_t order, int32_t shift,
+    uint32_t precision, uint32_t sampleBits, int32_t* dest) {
+    if (FlacPredictor::CanAccumulate32(order, precision, sampleBits)) {
+        // 累加不会超出32 bit，残差也不会
+        for (uint32_t i=order; i<length; ++i) {
+            int32_t sum = 0; 
+            for (uint32_t j=0; j<order; ++j) {
+                sum+=coefs[j]*data[i-1-j]; 
+            }
+            dest[i-order] = data[i]-(sum>>shift); 
+        }
+        return true; 
+    }
+    for (uint32_t i=order; i<length; ++i) {
+        int64_t sum = 0; 
+        for (uint32_t j=0; j<order; ++j) {
+            sum+=(int64_t)coefs[j]*data[i-1-j]; 
+        }
+        int64_t val = data[i]-(sum>>shift); 
+        if (val!=(int32_t)val) {
+            return false; 
+        }
+        dest[i-order] = (int32_t)val; 
+    }
+    return true; 
+}
+
+/**
+ * @brief 同时计算0~4阶FIXED残差的绝对值和，取和最小的阶数
+ * @retval 阶数
+*/
+static uint32_t ChooseFixedOrder(const int32_t* data, uint32_t length, uint64_t* bestSum) {
+    uint64_t sums[s_maxFixedOrder+1] = {0}; 
+    int64_t last0 = data[3]; 
+    int64_t last1 = (int64_t)data[3]-data[2]; 
+    int64_t last2 = last1-((int64_t)data[2]-data[1]); 
+    int64_t last3 = last2-((int64_t)data[2]-2*(int64_t)data[1]+data[0]); 
+    for (uint32_t i=s_maxFixedOrder; i<length; ++i) {
+        int64_t e0 = data[i]; 
+        int64_t e1 = e0-last0; 
+        int64_t e2 = e1-last1; 
+        int64_t e3 = e2-last2; 
+        int64_t e4 = e3-last3; 
+        sums[0]+=e0<0?-e0:e0; 
+        sums[1]+=e1<0?-e1:e1; 
+        sums[2]+=e2<0?-e2:e2; 
+        sums[3]+=e3<0?-e3:e3; 
+        sums[4]+=e4<0?-e4:e4; 
+        last0 = e0; 
+        last1 = e1; 
+        last2 = e2; 
+        last3 = e3; 
+    }
+
+    uint32_t order = 0; 
+    for (uint32_t i=1; i<=s_maxFixedOrder; ++i) {
+        if (sums[i]<sums[order]) {
+            order = i; 
+        }
+    }
+    *bestSum = sums[order]; 
+    return order; 
+}
+
+/**
+ * @brief 计算FIXED残差
+ * @retval 是否成功，残差超出32 bit时失败
+*/
+static bool ComputeFixedResidual(const int32_t* data, uint32_t length, uint32_t order, int32_t* dest) {
+    for (uint32_t i=order; i<length; ++i) {
+        int64_t val = data[i]; 
+        switch (order) {
+        case 1:
+            val-=data[i-1]; 
+            break; 
+        case 2:
+            val+=-2*(int64_t)data[i-1]+data[i-2]; 
+            break; 
+        case 3:
+            val+=-3*(int64_t)data[i-1]+3*(int64_t)data[i-2]-data[i-3]; 
+            break; 
+        case 4:
+            val+=-4*(int64_t)data[i-1]+6*(int64_t)data[i-2]-4*(int64_t)data[i-3]+data[i-4]; 
+            break; 
+        default:
+            break; 
+        }
+        if (val!=(int32_t)val) {
+            return false; 
+        }
+        dest[i-order] = (int32_t)val; 
+    }
+    return true; 
+}
+
+/**
+ * @brief 由分区残差和选rice参数：在均值的log2附近比较估计长度 (k+1)*n + sum>>k
+ * @param[in] sum 折叠后残差的和
+ * @param[in] num 采样数
+ * @param[out] bits 估计长度(bit)
+ * @retval rice参数
+*/
+static uint32_t ChooseRiceParam(uint64_t sum, uint32_t num, uint64_t* bits) {
+    if (num==0) {
+        *bits = 0; 
+        return 0; 
+    }
+    uint32_t k = 0; 
+    while (k<s_maxRice2Param&&((uint64_t)num<<(k+1))<=sum) {
+        ++k; 
+    }
+    uint32_t best = k; 
+    *bits = UINT64_MAX; 
+    for (uint32_t i=k==0?0:k-1; i<=std::min(k+1, s_maxRice2Param); ++i) {
+        uint64_t cost = (uint64_t)(i+1)*num+(sum>>i); 
+        if (cost<*bits) {
+            *bits = cost; 
+            best = i; 
+        }
+    }
+    return best; 
+}
+
+/**
+ * @brief 选择分区阶数与各分区的rice参数：先算最大阶数下各分区的和，再两两合并得到低阶的和
+ * @retval 残差部分的估计长度(bit)
+*/
+static uint64_t ChooseRice(const int32_t* residual, uint32_t blockSize, uint32_t order, uint32_t maxPartitionOrder,
+    std::vector<uint64_t>& sums, RicePlan& dest) {
+    // 各分区等长，第一个分区去掉预热采样后不能为空
+    uint32_t maxOrder = std::min(maxPartitionOrder, s_maxPartitionOrder); 
+    while (maxOrder>0&&((blockSize&((1U<<maxOrder)-1))!=0||(blockSize>>maxOrder)<=order)) {
+        --maxOrder; 
+    }
+
+    uint32_t parts = 1U<<maxOrder; 
+    uint32_t partSize = blockSize>>maxOrder; 
+    sums.resize(parts); 
+    const int32_t* pin = residual; 
+    for (uint32_t i=0; i<parts; ++i) {
+        uint32_t num = i==0?partSize-order:partSize; 
+        uint64_t sum = 0; 
+        for (uint32_t j=0; j<num; ++j) {
+            sum+=FoldResidual(pin[j]); 
+        }
+        sums[i] = sum; 
+        pin+=num; 
+    }
+
+    uint64_t best = UINT64_MAX; 
+    uint32_t params[1<<s_maxPartitionOrder]; 
+    for (int32_t po=maxOrder; po>=0; --po) {
+        parts = 1U<<po; 
+        partSize = blockSize>>po; 
+        uint64_t total = 6; 
+        bool rice2 = false; 
+        for (uint32_t i=0; i<parts; ++i) {
+            uint64_t bits = 0; 
+            params[i] = ChooseRiceParam(sums[i], i==0?partSize-order:partSize, &bits); 
+            rice2 = rice2||params[i]>s_maxRiceParam; 
+            total+=bits; 
+        }
+        total+=(uint64_t)parts*(rice2?5:4); 
+        if (total<best) {
+            best = total; 
+            dest.partitionOrder = po; 
+            dest.rice2 = rice2; 
+            memcpy(dest.params, params, parts*sizeof(uint32_t)); 
+        }
+        for (uint32_t i=0; i<parts/2; ++i) {
+            sums[i] = sums[2*i]+sums[2*i+1]; 
+        }
+    }
+    return best; 
+}
+
+/**
+ * @brief tukey窗：[start, end)两端各p/2为余弦过渡，中间为1
+*/
+static void TukeyWindow(double* dest, uint32_t start, uint32_t end, double p) {
+    uint32_t length = end-start; 
+    for (uint32_t i=start; i<end; ++i) {
+        dest[i] = 1.0; 
+    }
+    int32_t np = (int32_t)(p/2*length)-1; 
+    if (np>0) {
+        for (int32_t i=0; i<=np; ++i) {
+            dest[start+i] = 0.5-0.5*cos(s_pi*i/np); 
+            dest[start+length-np-1+i] = 0.5-0.5*cos(s_pi*(i+np)/np); 
+        }
+    }
+}
+
+/**
+ * @brief 生成窗函数组
+*/
+static void BuildWindows(uint32_t length, uint32_t windowSet, std::vector<std::vector<double>>& dest) {
+    dest.clear(); 
+    std::vector<double> full(length); 
+    TukeyWindow(full.data(), 0, length, 0.5); 
+    dest.push_back(full); 
+    // partial_tukey(2)：前后两半各自加窗，另一半为0，适合前后变化较大的帧
+    if (windowSet>=1) {
+        for (uint32_t i=0; i<2; ++i) {
+            std::vector<double> win(length, 0.0); 
+            TukeyWindow(win.data(), length*i/2, length*(i+1)/2, 0.5); 
+            dest.push_back(win); 
+        }
+    }
+    // punchout_tukey(3)：挖掉三分之一（带过渡），适合帧内有瞬态的情况
+    if (windowSet>=2) {
+        for (uint32_t i=0; i<3; ++i) {
+            std::vector<double> hole(length, 0.0); 
+            TukeyWindow(hole.data(), length*i/3, length*(i+1)/3, 0.5); 
+            std::vector<double> win(length); 
+            for (uint32_t j=0; j<length; ++j) {
+                win[j] = full[j]*(1.0-hole[j]); 
+            }
+            dest.push_back(win); 
+        }
+    }
+}
+
+/**
+ * @brief 系数位数，与libFLAC相同：16 bit按block size取值，更高位数取更多位
+*/
+static uint32_t LpcPrecision(uint32_t sampleBits, uint32_t blockSize) {
+    if (sampleBits<16) {
+        return std::max<uint32_t>(5, 2+sampleBits/2); 
+    }
+    if (sampleBits==16) {
+        static const uint32_t s_limits[] = {192, 384, 576, 1152, 2304, 4608}; 
+        uint32_t precision = 7; 
+        for (uint32_t limit: s_limits) {
+            if (blockSize<=limit) {
+                return precision; 
+            }
+            ++precision; 
+        }
+        return precision; 
+    }
+    return blockSize<=384?s_maxPrecision-2:(blockSize<=1152?s_maxPrecision-1:s_maxPrecision); 
+}
+
+/**
+ * @brief subframe头的长度：类型与wasted bits标志8 bit，wasted bits一元码
+*/
+static inline uint64_t SubframeHeaderBits(uint32_t wasted) {
+    return 8+wasted; 
+}
+
+/**
+ * @brief 为一个声道的信号选择编码方案：CONSTANT、VERBATIM、FIXED、各窗函数下的LPC中估计长度最短的
+ * @param[in,out] ws 工作区
+ * @param[in] settings 参数
+ * @param[in] data 信号
+ * @param[in] length 采样数
+ * @param[in] sampleBits 采样位数
+ * @param[in] streamBits 流的采样位数，决定LPC系数位数
+ * @param[out] shifted 去掉wasted bits的信号的存放处
+ * @param[out] best 编码方案
+*/
+static void AnalyzeSubframe(EncodeWorkspace& ws, const EncodeSettings& settings, const int32_t* data, uint32_t length,
+    uint32_t sampleBits, uint32_t streamBits, std::vector<int32_t>& shifted, SubframePlan& best) {
+    best.order = 0; 
+    best.wasted = 0; 
+    best.sampleBits = sampleBits; 
+    best.signal = data; 
+    int32_t bitsOr = 0; 
+    bool constant = true; 
+    for (uint32_t i=0; i<length; ++i) {
+        bitsOr|=data[i]; 
+        constant = constant&&data[i]==data[0]; 
+    }
+    if (constant) {
+        best.type = SUBFRAME_CONSTANT; 
+        best.bits = SubframeHeaderBits(0)+sampleBits; 
+        return; 
+    }
+
+    // 全部采样低位都是0时去掉这些位
+    uint32_t wasted = 0; 
+    while (((bitsOr>>wasted)&1)==0) {
+        ++wasted; 
+    }
+    if (wasted>0) {
+        shifted.resize(length); 
+        for (uint32_t i=0; i<length; ++i) {
+            shifted[i] = data[i]>>wasted; 
+        }
+        best.signal = shifted.data(); 
+        best.wasted = wasted; 
+        best.sampleBits = sampleBits-wasted; 
+    }
+    const int32_t* signal = best.signal; 
+    uint32_t bits = best.sampleBits; 
+    uint64_t headerBits = SubframeHeaderBits(wasted); 
+    best.type = SUBFRAME_VERBATIM; 
+    best.bits = headerBits+(uint64_t)length*bits; 
+
+    SubframePlan& trial = ws.trial; 
+    trial.signal = signal; 
+    trial.wasted = wasted; 
+    trial.sampleBits = bits; 
+    if (length<=s_maxFixedOrder) {
+        return; 
+    }
+    trial.residual.resize(length); 
+
+    uint64_t fixedSum = 0; 
+    uint32_t fixedOrder = ChooseFixedOrder(signal, length, &fixedSum); 
+    if (ComputeFixedResidual(signal, length, fixedOrder, trial.residual.data())) {
+        trial.type = SUBFRAME_FIXED; 
+        trial.order = fixedOrder; 
+        trial.bits = headerBits+(uint64_t)fixedOrder*bits
+            +ChooseRice(trial.residual.data(), length, fixedOrder, settings.maxPartitionOrder, ws.sums, trial.rice); 
+        if (trial.bits<best.bits) {
+            std::swap(best, trial); 
+            trial.residual.resize(length); 
+        }
+    }
+
+    uint32_t maxOrder = std::min(settings.maxLpcOrder, length-1); 
+    if (maxOrder==0) {
+        return; 
+    }
+    if (ws.windowLength!=length) {
+        BuildWindows(length, settings.windowSet, ws.windows); 
+        ws.windowLength = length; 
+    }
+    ws.windowed.resize(length); 
+    uint32_t precision = LpcPrecision(streamBits, length); 
+    double errorScale = 0.5/length; 
+    for (const std::vector<double>& window: ws.windows) {
+        double* windowed = ws.windowed.data(); 
+        for (uint32_t i=0; i<length; ++i) {
+            windowed[i] = signal[i]*window[i]; 
+        }
+        double autoc[s_maxLpcOrder+1]; 
+        Autocorrelation(windowed, length, maxOrder+1, autoc); 
+        if (!(autoc[0]>0)) {
+            continue; 
+        }
+        uint32_t orders = ComputeLpc(autoc, maxOrder, ws.lpc, ws.lpcError); 
+
+        // 按预测误差估计各阶数的长度，取最短的
+        uint32_t order = 1; 
+        double minBits = 1e300; 
+        for (uint32_t i=0; i<orders; ++i) {
+            double error = ws.lpcError[i]; 
+            double perSample = 0; 
+            if (error>0) {
+                perSample = std::max(0.0, 0.5*log(errorScale*error)/log(2.0)); 
+            } else if (error<0) {
+                perSample = 1e32; 
+            }
+            double estimate = perSample*(length-i-1)+(double)(i+1)*(precision+bits); 
+            if (estimate<minBits) {
+                minBits = estimate; 
+                order = i+1; 
+            }
+        }
+
+        int32_t shift = 0; 
+        if (!QuantizeLpc(ws.lpc[order-1], order, precision, trial.coefs, &shift)) {
+            continue; 
+        }
+        if (!ComputeLpcResidual(signal, length, trial.coefs, order, shift, precision, bits, trial.residual.data())) {
+            continue; 
+        }
+        trial.type = SUBFRAME_LPC; 
+        trial.order = order; 
+        trial.precision = precision; 
+        trial.shift = shift; 
+        trial.bits = headerBits+(uint64_t)order*bits+4+5+(uint64_t)order*precision
+            +ChooseRice(trial.residual.data(), length, order, settings.maxPartitionOrder, ws.sums, trial.rice); 
+        if (trial.bits<best.bits) {
+            std::swap(best, trial); 
+            trial.residual.resize(length); 
+        }
+    }
+}
+
+/**
+ * @brief 写出subframe
+*/
+static void WriteSubframe(FlacBitWriter& writer, const SubframePlan& plan, uint32_t length) {
+    uint32_t code = 1; 
+    switch (plan.type) {
+    case SUBFRAME_CONSTANT:
+        code = 0; 
+        break; 
+    case SUBFRAME_FIXED:
+        code = 8|plan.order; 
+        break; 
+    case SUBFRAME_LPC:
+        code = 32|(plan.order-1); 
+        break; 
+    default:
+        break; 
+    }
+    // 1 bit补0，6 bit类型，1 bit wasted bits标志；wasted bits数为一元码
+    writer.writeBits((code<<1)|(plan.wasted>0?1:0), 8); 
+    if (plan.wasted>0) {
+        writer.writeZeros(plan.wasted-1); 
+        writer.writeBits(1, 1); 
+    }
+    if (plan.type==SUBFRAME_CONSTANT) {
+        writer.writeBits((uint32_t)plan.signal[0], plan.sampleBits); 
+        return; 
+    }
+    uint32_t warmup = plan.type==SUBFRAME_VERBATIM?length:plan.order; 
+    for (uint32_t i=0; i<warmup; ++i) {
+        writer.writeBits((uint32_t)plan.signal[i], plan.sampleBits); 
+    }
+    if (plan.type==SUBFRAME_VERBATIM) {
+        return; 
+    }
+    if (plan.type==SUBFRAME_LPC) {
+        writer.writeBits(plan.precision-1, 4); 
+        writer.writeBits((uint32_t)plan.shift, 5); 
+        for (uint32_t i=0; i<plan.order; ++i) {
+            writer.writeBits((uint32_t)plan.coefs[i], plan.precision); 
+        }
+    }
+
+    const RicePlan& rice = plan.rice; 
+    writer.writeBits(rice.rice2?1:0, 2); 
+    writer.writeBits(rice.partitionOrder, 4); 
+    uint32_t parts = 1U<<rice.partitionOrder; 
+    uint32_t partSize = length>>rice.partitionOrder; 
+    const int32_t* pin = plan.residual.data(); 
+    for (uint32_t i=0; i<parts; ++i) {
+        uint32_t k = rice.params[i]; 
+        uint32_t num = i==0?partSize-plan.order:partSize; 
+        writer.writeBits(k, rice.rice2?5:4); 
+        for (uint32_t j=0; j<num; ++j) {
+            writer.writeRice(FoldResidual(pin[j]), k); 
+        }
+        pin+=num; 
+    }
+}
+
+/**
+ * @brief 写出帧头（含CRC-8），写出后对齐到整字节
+ * @param[out] writer 输出
+ * @param[in] blockSize 帧的采样数
+ * @param[in] sampleRate 采样率
+ * @param[in] assignment 声道编码：声道数-1，或8（左/侧）、9（侧/右）、10（中/侧）
+ * @param[in] sampleBits 采样位数
+ * @param[in] frameNumber 帧号
+*/
+static void WriteFrameHeader(FlacBitWriter& writer, uint32_t blockSize, uint32_t sampleRate, uint32_t assignment,
+    uint32_t sampleBits, uint32_t frameNumber) {
+    // block size：192、576*2^n、256*2^n有专用编码，其他在帧号之后以8或16 bit给出
+    uint32_t blockCode = blockSize<=256?6:7; 
+    if (blockSize==192) {
+        blockCode = 1; 
+    }
+    for (uint32_t i=0; i<4; ++i) {
+        if (blockSize==(576U<<i)) {
+            blockCode = 2+i; 
+        }
+    }
+    for (uint32_t i=0; i<8; ++i) {
+        if (blockSize==(256U<<i)) {
+            blockCode = 8+i; 
+        }
+    }
+
+    // 采样率：常用值有专用编码，其他能表示为kHz、Hz、10 Hz的在block size之后给出，都不能时取STREAMINFO
+    static const uint32_t s_rates[] = {0, 88200, 176400, 192000, 8000, 16000, 22050, 24000, 32000, 44100, 48000, 96000}; 
+    uint32_t rateCode = 0; 
+    for (uint32_t i=1; i<sizeof(s_rates)/sizeof(s_rates[0]); ++i) {
+        if (sampleRate==s_rates[i]) {
+            rateCode = i; 
+        }
+    }
+    if (rateCode==0) {
+        if (sampleRate%1000==0&&sampleRate/1000<=0xFF) {
+            rateCode = 12; 
+        } else if (sampleRate<=0xFFFF) {
+            rateCode = 13; 
+        } else if (sampleRate%10==0&&sampleRate/10<=0xFFFF) {
+            rateCode = 14; 
+        }
+    }
+
+    uint32_t bitsCode = 0; 
+    switch (sampleBits) {
+    case 8: bitsCode = 1; break; 
+    case 12: bitsCode = 2; break; 
+    case 16: bitsCode = 4; break; 
+    case 20: bitsCode = 5; break; 
+    case 24: bitsCode = 6; break; 
+    case 32: bitsCode = 7; break; 
+    default: break; 
+    }
+
+    // 同步码14 bit，保留位0，固定block size
+    writer.writeBits(0xFFF8, 16); 
+    writer.writeBits(blockCode, 4); 
+    writer.writeBits(rateCode, 4); 
+    writer.writeBits(assignment, 4); 
+    writer.writeBits(bitsCode, 3); 
+    writer.writeBits(0, 1); 
+    writer.writeUtf8(frameNumber); 
+    if (blockCode==6) {
+        writer.writeBits(blockSize-1, 8); 
+    } else if (blockCode==7) {
+        writer.writeBits(blockSize-1, 16); 
+    }
+    if (rateCode==12) {
+        writer.writeBits(sampleRate/1000, 8); 
+    } else if (rateCode==13) {
+        writer.writeBits(sampleRate, 16); 
+    } else if (rateCode==14) {
+        writer.writeBits(sampleRate/10, 16); 
+    }
+    writer.alignToByte(); 
+    writer.writeBits(crc8(writer.getData(), writer.getLength()), 8); 
+}
+
+FlacEncoder::FlacEncoder(uint32_t sampleRate, uint32_t channels, uint32_t sampleBits, uint32_t level, ThreadPool::ptr pool)
+    : m_sampleRate(sampleRate)
+    , m_channels(channels)
+    , m_sampleBits(sampleBits)
+    , m_level(std::min(level, MAX_LEVEL))
+    , m_blockSize(s_levels[m_level].blockSize)
+    , m_pool(pool==nullptr?DefaultThreadPool::GetInstance():pool) {
+    memset(m_digest, 0, sizeof(m_digest)); 
+    if (sampleRate==0||sampleRate>655350||channels==0||channels>8||sampleBits<4||sampleBits>32) {
+        LOGE("unsupported pcm format, rate %u, channels %u, bits %u", sampleRate, channels, sampleBits); 
+        return; 
+    }
+
+    // 调用线程也参与编码，所以工作区比线程数多一份
+    uint32_t taskNum = m_pool->getThreadNum()+1; 
+    m_frames.resize(taskNum*s_framesPerThread); 
+    for (FlacPcmBlock& frame: m_frames) {
+        frame.blockSize = m_blockSize; 
+        frame.sampleRate = sampleRate; 
+        frame.channels = channels; 
+        frame.sampleBits = sampleBits; 
+        frame.samples.resize((size_t)m_blockSize*channels); 
+    }
+    m_outputs.resize(m_frames.size()); 
+    for (uint32_t i=0; i<taskNum; ++i) {
+        m_contexts.emplace_back(new Context()); 
+    }
+    m_md5Buffer.resize((size_t)m_blockSize*channels*((sampleBits+7)/8)); 
+    m_isValid = true; 
+}
+
+FlacEncoder::~FlacEncoder() {
+}
+
+bool FlacEncoder::write(const int32_t* const* data, uint32_t frames) {
+    if (!m_isValid||m_finished||m_isFailed) {
+        LOGE("encoder is not writable"); 
+        return false; 
+    }
+
+    uint32_t done = 0; 
+    while (done<frames) {
+        FlacPcmBlock& frame = m_frames[m_filled]; 
+        uint32_t num = std::min(frames-done, m_blockSize-m_position); 
+        for (uint32_t c=0; c<m_channels; ++c) {
+            memcpy(frame.getChannel(c)+m_position, data[c]+done, num*sizeof(int32_t)); 
+        }
+        done+=num; 
+        m_position+=num; 
+        if (m_position==m_blockSize) {
+            m_position = 0; 
+            if (++m_filled==m_frames.size()&&!encodeBatch()) {
+                return false; 
+            }
+        }
+    }
+    return true; 
+}
+
+bool FlacEncoder::write(const FlacPcmBlock& block) {
+    if (block.channels!=m_channels) {
+        LOGE("channel number mismatch, %d != %d", block.channels, m_channels); 
+        return false; 
+    }
+    const int32_t* data[8]; 
+    for (uint32_t c=0; c<m_channels; ++c) {
+        data[c] = block.getChannel(c); 
+    }
+    return write(data, block.blockSize); 
+}
+
+bool FlacEncoder::finish() {
+    if (!m_isValid||m_finished||m_isFailed) {
+        LOGE("encoder is not writable"); 
+        return false; 
+    }
+
+    // 不满的最后一帧：各声道数据前移，紧密排列
+    if (m_position>0) {
+        FlacPcmBlock& frame = m_frames[m_filled]; 
+        for (uint32_t c=1; c<m_channels; ++c) {
+            memmove(frame.samples.data()+(size_t)c*m_position, frame.getChannel(c), m_position*sizeof(int32_t)); 
+        }
+        frame.blockSize = m_position; 
+        m_position = 0; 
+        ++m_filled; 
+    }
+    if (!encodeBatch()) {
+        return false; 
+    }
+    m_md5.finish(m_digest); 
+    m_finished = true; 
+    return true; 
+}
+
+bool FlacEncoder::encodeBatch() {
+    if (m_filled==0) {
+        return true; 
+    }
+
+    // 各任务从同一计数器取帧，第一个任务先计算整批的MD5
+    uint32_t taskNum = m_contexts.size(); 
+    std::atomic<uint32_t> next(0); 
+    m_pool->parallelFor(taskNum, [this, &next](size_t t) {
+        if (t==0) {
+            uint32_t sampleBytes = (m_sampleBits+7)/8; 
+            for (uint32_t f=0; f<m_filled; ++f) {
+                const FlacPcmBlock& frame = m_frames[f]; 
+                frame.interleave(m_md5Buffer.data(), sampleBytes); 
+                m_md5.update(m_md5Buffer.data(), (size_t)frame.blockSize*m_channels*sampleBytes); 
+            }
+        }
+        for (uint32_t f=next.fetch_add(1); f<m_filled; f=next.fetch_add(1)) {
+            encodeFrame(*m_contexts[t], m_frames[f], m_frameNum+f, m_outputs[f]); 
+        }
+    }); 
+
+    std::vector<WriteSegment> segments; 
+    segments.reserve(m_filled); 
+    for (uint32_t f=0; f<m_filled; ++f) {
+        uint32_t length = m_outputs[f].getLength(); 
+        m_frameOffsets.push_back(m_encodedLength); 
+        m_minFrameSize = m_frameNum+f==0?length:std::min(m_minFrameSize, length); 
+        m_maxFrameSize = std::max(m_maxFrameSize, length); 
+        m_encodedLength+=length; 
+        m_sampleNum+=m_frames[f].blockSize; 
+        segments.push_back({m_outputs[f].getData(), length}); 
+    }
+    m_frameNum+=m_filled; 
+    m_filled = 0; 
+    if (m_sink&&!m_sink(segments)) {
+        LOGE("frame sink failed, stop encoding"); 
+        m_isFailed = true; 
+        return false; 
+    }
+    return true; 
+}
+
+void FlacEncoder::encodeFrame(Context& ctx, const FlacPcmBlock& block, uint32_t frameNumber, FlacBitWriter& writer) const {
+    const EncodeSettings& settings = s_levels[m_level]; 
+    uint32_t length = block.blockSize; 
+    writer.reset(); 
+
+    // 双声道：从左、右、中、侧中选总长度最短的一对；侧声道多1 bit，32 bit时无法去相关
+    if (m_channels==2&&m_sampleBits<32&&settings.stereo!=STEREO_INDEPENDENT) {
+        const int32_t* left = block.getChannel(0); 
+        const int32_t* right = block.getChannel(1); 
+        ctx.stereo[0].resize(length); 
+        ctx.stereo[1].resize(length); 
+        int32_t* mid = ctx.stereo[0].data(); 
+        int32_t* side = ctx.stereo[1].data(); 
+        for (uint32_t i=0; i<length; ++i) {
+            mid[i] = (int32_t)(((int64_t)left[i]+right[i])>>1); 
+            side[i] = left[i]-right[i]; 
+        }
+        const int32_t* signals[4] = {left, right, mid, side}; 
+        uint32_t bits[4] = {m_sampleBits, m_sampleBits, m_sampleBits, m_sampleBits+1}; 
+
+        // 组合：左右、左侧、侧右、中侧
+        static const uint32_t s_pairs[4][2] = {{0, 1}, {0, 3}, {3, 1}, {2, 3}}; 
+        uint32_t best = 0; 
+        if (settings.stereo==STEREO_ESTIMATE&&length>s_maxFixedOrder) {
+            // 用最好的FIXED残差和估计，只分析选中的一对
+            uint64_t sums[4]; 
+            for (uint32_t i=0; i<4; ++i) {
+                ChooseFixedOrder(signals[i], length, &sums[i]); 
+            }
+            for (uint32_t p=1; p<4; ++p) {
+                if (sums[s_pairs[p][0]]+sums[s_pairs[p][1]]<sums[s_pairs[best][0]]+sums[s_pairs[best][1]]) {
+                    best = p; 
+                }
+            }
+            for (uint32_t i: s_pairs[best]) {
+                AnalyzeSubframe(ctx, settings, signals[i], length, bits[i], m_sampleBits, ctx.shifted[i], ctx.plans[i]); 
+            }
+        } else {
+            for (uint32_t i=0; i<4; ++i) {
+                AnalyzeSubframe(ctx, settings, signals[i], length, bits[i], m_sampleBits, ctx.shifted[i], ctx.plans[i]); 
+            }
+            for (uint32_t p=1; p<4; ++p) {
+                if (ctx.plans[s_pairs[p][0]].bits+ctx.plans[s_pairs[p][1]].bits
+                    <ctx.plans[s_pairs[best][0]].bits+ctx.plans[s_pairs[best][1]].bits) {
+                    best = p; 
+                }
+            }
+        }
+
+        static const uint32_t s_assignments[4] = {1, 8, 9, 10}; 
+        WriteFrameHeader(writer, length, m_sampleRate, s_assignments[best], m_sampleBits, frameNumber); 
+        for (uint32_t i: s_pairs[best]) {
+            WriteSubframe(writer, ctx.plans[i], length); 
+        }
+    } else {
+        WriteFrameHeader(writer, length, m_sampleRate, m_channels-1, m_sampleBits, frameNumber); 
+        for (uint32_t c=0; c<m_channels; ++c) {
+            AnalyzeSubframe(ctx, settings, block.getChannel(c), length, m_sampleBits, m_sampleBits, ctx.shifted[0], ctx.plans[0]); 
+            WriteSubframe(writer, ctx.plans[0], length); 
+        }
+    }
+
+    writer.alignToByte(); 
+    writer.writeBits(crc16(writer.getData(), writer.getLength()), 16); 
+    writer.alignToByte(); 
+}
+
+bool FlacEncoder::fillStreamInfo(StreamInfoMetaBlock& streamInfo) const {
+    if (!m_finished) {
+        LOGE("encoding is not finished"); 
+        return false; 
+    }
+    streamInfo.setMinBlockSize(m_blockSize); 
+    streamInfo.setMaxBlockSize(m_blockSize); 
+    // frame size为24 bit，超出时按未知（0）处理
+    if (!streamInfo.setMinFrameSize(m_minFrameSize)||!streamInfo.setMaxFrameSize(m_maxFrameSize)) {
+        streamInfo.setMinFrameSize(0); 
+        streamInfo.setMaxFrameSize(0); 
+    }
+    uint8_t digest[Md5::DIGEST_SIZE]; 
+    memcpy(digest, m_digest, sizeof(digest)); 
+    return streamInfo.setSampleRate(m_sampleRate)&&streamInfo.setChannels(m_channels)&&streamInfo.setSampleBits(m_sampleBits)
+        &&streamInfo.setSamplePerChannel(m_sampleNum)&&streamInfo.setUnencoderedMD5(digest, sizeof(digest)); 
+}
+
+void FlacEncoder::getMD5(void* dest) const {
+    memcpy(dest, m_digest, sizeof(m_digest)); 
+}
+
+bool FlacEncoder::Reencode(const MusicDecoderflac& source, const std::wstring& path, uint32_t level,
+    RecompressResult* result, ThreadPool::ptr pool) {
+    RecompressResult tmp; 
+    RecompressResult& ans = result==nullptr?tmp:*result; 
+    FileWriter writer(path.c_str()); 
+    if (!Reencode(source, writer, level, &ans, pool)) {
+        return false; 
+    }
+    if (!writer.commit()) {
+        LOGE("finish flac file fail"); 
+        return false; 
+    }
+    ans.success = true; 
+    return true; 
+}
+
+bool FlacEncoder::Reencode(const MusicDecoderflac& source, FileWriter& writer, uint32_t level,
+    RecompressResult* result, ThreadPool::ptr pool) {
+    RecompressResult tmp; 
+    RecompressResult& ans = result==nullptr?tmp:*result; 
+    ans = RecompressResult(); 
+    ans.path = writer.getPath(); 
+    if (pool==nullptr) {
+        pool = DefaultThreadPool::GetInstance(); 
+    }
+    // STREAMINFO与SEEKTABLE要改写，复制一份；其他block与源文件共享
+    MusicDecoderflac::ptr decoder = source.fork((1<<Metadata_block::STREAM_INFO)|(1<<Metadata_block::SEEKTABLE)); 
+    if (decoder==nullptr||decoder->getStreamInfo()==nullptr||decoder->getAudioFrames()==nullptr) {
+        LOGE("no audio frames, reencode termination"); 
+        return false; 
+    }
+    if (source.getSource()!=nullptr) {
+        ans.originalSize = source.getSource()->getSize(); 
+    }
+
+    StreamInfoMetaBlock::ptr streamInfo = decoder->getStreamInfo(); 
+    uint64_t totalSamples = streamInfo->getSamplePerChannel(); 
+    uint8_t sourceMD5[Md5::DIGEST_SIZE]; 
+    streamInfo->getUnencoderedMD5(sourceMD5, sizeof(sourceMD5)); 
+    bool hasMD5 = false; 
+    for (uint8_t val: sourceMD5) {
+        hasMD5 = hasMD5||val!=0; 
+    }
+
+    FlacEncoder encoder(streamInfo->getSampleRate(), streamInfo->getChannels(), streamInfo->getSampleBits(), level, pool); 
+    if (!encoder.isValid()) {
+        return false; 
+    }
+
+    // 帧偏移要编码后才知道，SEEKTABLE先按定位点数占位，编码后原地回填，metadata长度不变
+    uint64_t spacing = std::max<uint64_t>((uint64_t)s_seekPointSpacing*streamInfo->getSampleRate(), encoder.getBlockSize()); 
+    SeekTableMetaBlock::ptr seekTable = decoder->getSeekTable(); 
+    if (seekTable!=nullptr) {
+        seekTable->clearSeekPoints(); 
+        for (uint64_t sample=0; sample<totalSamples; sample+=spacing) {
+            seekTable->addSeekPoint(sample, 0, 0); 
+        }
+    }
+
+    SerializedMetadata meta; 
+    if (!decoder->serializeMetadata(meta)) {
+        LOGE("serialize metadata fail"); 
+        return false; 
+    }
+    if (!writer.write(meta.segments)) {
+        LOGE("write metadata fail"); 
+        return false; 
+    }
+    encoder.setSink([&writer](const std::vector<WriteSegment>& frames) {
+        return writer.write(frames); 
+    }); 
+
+    uint32_t badFrameNum = 0; 
+    uint64_t decodedSamples = 0; 
+    bool isBroken = false; 
+    // 按源文件的SEEKTABLE分段，副本中的SEEKTABLE已是占位
+    FlacParallelDecoder input(source, pool); 
+    bool decoded = input.decode([&](const FlacParallelDecoder::Chunk& chunk) {
+        badFrameNum+=chunk.badFrames.size(); 
+        for (uint32_t i=0; i<chunk.blockNum&&badFrameNum==0; ++i) {
+            const FlacPcmBlock& block = chunk.blocks[i]; 
+            if (block.firstSample!=decodedSamples||!encoder.write(block)) {
+                LOGE("decoded samples broken at sample %lld", (long long)decodedSamples); 
+                isBroken = true; 
+                return false; 
+            }
+            decodedSamples+=block.blockSize; 
+        }
+        return badFrameNum==0; 
+    }); 
+    if (!decoded||isBroken||badFrameNum>0||!encoder.finish()) {
+        if (badFrameNum>0) {
+            LOGE("%d broken frames, reencode termination", badFrameNum); 
+        }
+        return false; 
+    }
+
+    ans.samples = encoder.getSampleNum(); 
+    if (totalSamples!=0&&ans.samples!=totalSamples) {
+        LOGE("decoded %lld samples, stream info says %lld", (long long)ans.samples, (long long)totalSamples); 
+        return false; 
+    }
+    uint8_t digest[Md5::DIGEST_SIZE]; 
+    encoder.getMD5(digest); 
+    if (hasMD5&&memcmp(digest, sourceMD5, sizeof(digest))!=0) {
+        LOGE("decoded audio md5 mismatch, reencode termination"); 
+        return false; 
+    }
+
+    // 回填STREAMINFO与SEEKTABLE：每个定位点指向其所在的帧
+    if (!encoder.fillStreamInfo(*streamInfo)) {
+        return false; 
+    }
+    if (seekTable!=nullptr) {
+        const std::vector<uint64_t>& offsets = encoder.getFrameOffsets(); 
+        uint32_t blockSize = encoder.getBlockSize(); 
+        seekTable->clearSeekPoints(); 
+        for (uint64_t sample=0; sample<totalSamples; sample+=spacing) {
+            uint64_t frame = sample/blockSize; 
+            uint64_t first = frame*blockSize; 
+            seekTable->addSeekPoint(first, offsets[frame], (uint16_t)std::min<uint64_t>(blockSize, totalSamples-first)); 
+        }
+    }
+    for (size_t i=0; i<meta.blocks.size(); ++i) {
+        Metadata_block* block = meta.blocks[i].get(); 
+        if (block!=streamInfo.get()&&block!=seekTable.get()) {
+            continue; 
+        }
+        std::vector<uint8_t> data(4+block->getBlockSize()); 
+        block->resave(data.data(), i+1==meta.blocks.size()); 
+        if (!writer.writeAt(meta.blockOffsets[i]-4, data.data(), data.size())) {
+            LOGE("update metadata fail"); 
+            return false; 
+        }
+    }
+    if (!writer.finish()) {
+        LOGE("finish flac file fail"); 
+        return false; 
+    }
+
+    ans.newSize = meta.size+encoder.getEncodedLength(); 
+    ans.md5Verified = hasMD5; 
+    return true; 
+}
+
+bool FlacEncoder::Recompress(const std::wstring& path, uint32_t level, RecompressResult* result, ThreadPool::ptr pool) {
+    RecompressResult tmp; 
+    RecompressResult& ans = result==nullptr?tmp:*result; 
+    ans = RecompressResult(); 
+    if (pool==nullptr) {
+        pool = DefaultThreadPool::GetInstance(); 
+    }
+
+    // 写入器持有临时文件直到校验结束，失败或析构时删除；源文件映射在重新编码后释放，之后才能替换
+    FileWriter writer(path.c_str()); 
+    {
+        MusicDecoderflac source(path.c_str()); 
+        if (!source.isValid()) {
+            LOGE("invalid flac file, recompress termination"); 
+            ans.path = path; 
+            return false; 
+        }
+        if (!Reencode(source, writer, level, &ans, pool)) {
+            return false; 
+        }
+    }
+
+    // 解码新文件，MD5与采样数都一致才替换；Reencode中已确认编码输入与原文件的MD5一致
+    AudioVerifyResult verify; 
+    {
+        MusicDecoderflac check(writer.getTempPath().c_str()); 
+        check.verifyAudio(&verify, pool); 
+    }
+    ans.md5Verified = verify.success&&verify.md5Match&&verify.decodedSamples==ans.samples; 
+    if (!ans.md5Verified) {
+        LOGE("recompressed file verify fail, keep original file"); 
+        writer.abort(); 
+        return false; 
+    }
+
+    if (ans.newSize>=ans.originalSize) {
+        LOGI("recompressed file is not smaller, keep original file"); 
+        writer.abort(); 
+        ans.success = true; 
+        return true; 
+    }
+    if (!writer.commit()) {
+        LOGE("replace original file fail"); 
+        return false; 
+    }
+    ans.replaced = true; 
+    ans.success = true; 
+    return true; 
+}
+
+uint32_t FlacEncoder::RecompressFiles(const std::vector<std::wstring>& files, uint32_t level, std::vector<RecompressResult>& dest, ThreadPool::ptr pool) {
+    if (pool==nullptr) {
+        pool = DefaultThreadPool::GetInstance(); 
+    }
+
+    dest.clear(); 
+    dest.resize(files.size()); 
+    std::atomic<uint32_t> count(0); 
+    pool->parallelFor(files.size(), [&files, level, &dest, &pool, &count](size_t i) {
+        if (Recompress(files[i], level, &dest[i], pool)) {
+            ++count; 
+        }
+    }); 
+    return count; 
+}
+
+FlacPredictor::Isa FlacEncoder::GetIsa() {
+    return CurrentIsa(); 
+}
+
+void FlacEncoder::SetIsa(FlacPredictor::Isa isa) {
+    FlacPredictor::Isa supported = FlacPredictor::GetSupportedIsa(); 
+    CurrentIsa() = isa>supported?supported:isa; 
+}
+
+}
\ No newline at end of file
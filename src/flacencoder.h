@@ -0,0 +1,380 @@
+#ifndef __MD_FLACENCODER_H_
+#define __MD_FLACENCODER_H_
+
+#include "decoderflac.h"
+#include "flacdecoder.h"
+#include "flacpredictor.h"
+#include "mappedfile.h"
+#include "md5.h"
+#include "threadpool.h"
+#include "noncopyable.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <functional>
+#include <stdint.h>
+
+namespace music_data {
+
+/**
+ * @brief flac比特流写入，高位在前；64 bit缓存，满32 bit写出一次
+*/
+class FlacBitWriter {
+public: 
+    /**
+     * @brief 清空，保留已分配的缓冲
+    */
+    void reset() {
+        m_length = 0; 
+        m_cache = 0; 
+        m_cacheBits = 0; 
+    }
+
+    /**
+     * @brief 写入n bit无符号数
+     * @param[in] val 值，只取低n bit
+     * @param[in] n 位数，0~32
+    */
+    void writeBits(uint32_t val, uint32_t n) {
+        m_cache = (m_cache<<n)|(val&(uint32_t)(0xFFFFFFFFULL>>(32-n))); 
+        m_cacheBits+=n; 
+        if (m_cacheBits>=32) {
+            m_cacheBits-=32; 
+            put32((uint32_t)(m_cache>>m_cacheBits)); 
+        }
+    }
+
+    /**
+     * @brief 写入n个0
+     * @param[in] n 位数
+    */
+    void writeZeros(uint32_t n) {
+        for (; n>32; n-=32) {
+            writeBits(0, 32); 
+        }
+        writeBits(0, n); 
+    }
+
+    /**
+     * @brief 写入一个rice编码的数：商的一元码（q个0和一个1）与余数的低k bit
+     * @param[in] val 折叠后的无符号残差
+     * @param[in] k rice参数，0~30
+    */
+    void writeRice(uint32_t val, uint32_t k) {
+        uint32_t q = val>>k; 
+        uint32_t low = (1U<<k)|(val&((1U<<k)-1)); 
+        if (q+1+k<=32) {
+            writeBits(low, q+1+k); 
+        } else {
+            writeZeros(q); 
+            writeBits(low, k+1); 
+        }
+    }
+
+    /**
+     * @brief 写入帧头中UTF-8方式编码的帧号
+     * @param[in] val 帧号，31 bit以内
+    */
+    void writeUtf8(uint32_t val); 
+
+    /**
+     * @brief 补0到整字节，并把缓存中的数据全部写出
+    */
+    void alignToByte(); 
+
+    /**
+     * @brief 取得已写出的数据，alignToByte之后包含全部数据
+     * @retval 数据指针
+    */
+    const uint8_t* getData() const { return m_buffer.data(); }
+
+    /**
+     * @brief 取得已写出的长度
+     * @retval 长度(byte)
+    */
+    size_t getLength() const { return m_length; }
+
+private: 
+    /**
+     * @brief 写出32 bit，缓冲不足时扩大
+     * @param[in] val 值
+    */
+    void put32(uint32_t val) {
+        if (m_length+4>m_buffer.size()) {
+            m_buffer.resize(m_buffer.size()*2+64); 
+        }
+        uint8_t* pout = m_buffer.data()+m_length; 
+        pout[0] = (uint8_t)(val>>24); 
+        pout[1] = (uint8_t)(val>>16); 
+        pout[2] = (uint8_t)(val>>8); 
+        pout[3] = (uint8_t)val; 
+        m_length+=4; 
+    }
+
+private: 
+    /// @brief 输出缓冲
+    std::vector<uint8_t> m_buffer; 
+    /// @brief 已写出的长度(byte)
+    size_t m_length = 0; 
+    /// @brief 未写出的位，在低m_cacheBits位
+    uint64_t m_cache = 0; 
+    /// @brief 未写出的位数，写入之间总小于32
+    uint32_t m_cacheBits = 0; 
+}; 
+
+/**
+ * @brief flac编码器：固定block size，FIXED与LPC预测（加窗自相关用SIMD计算，Levinson-Durbin求系数），
+ *        分区rice编码残差，左右/中侧声道去相关；帧在线程池中并行编码，按顺序交给输出回调。
+ *        压缩级别0~8，参数与libFLAC的同名级别相近
+*/
+class FlacEncoder: Noncopyable {
+public: 
+    typedef std::shared_ptr<FlacEncoder> ptr; 
+
+    /// @brief 最高压缩级别
+    static const uint32_t MAX_LEVEL = 8; 
+
+    /**
+     * @brief 输出回调，按顺序收到编码好的帧，每次若干帧，回调返回后数据失效
+     * @retval 是否继续
+    */
+    typedef std::function<bool(const std::vector<WriteSegment>& frames)> FrameSink; 
+
+    /**
+     * @brief 重新压缩结果
+    */
+    struct RecompressResult {
+        /// @brief 文件路径
+        std::wstring path; 
+        /// @brief 是否成功：新文件的MD5已校验，并且已替换或因为没有变小而保留原文件
+        bool success = false; 
+        /// @brief 是否替换了原文件
+        bool replaced = false; 
+        /// @brief 原文件长度(byte)
+        uint64_t originalSize = 0; 
+        /// @brief 新文件长度(byte)
+        uint64_t newSize = 0; 
+        /// @brief 采样数（每声道）
+        uint64_t samples = 0; 
+        /// @brief 新文件解码后的MD5是否与原音频一致
+        bool md5Verified = false; 
+    }; 
+
+    /**
+     * @brief 构造函数
+     * @param[in] sampleRate 采样率(Hz)
+     * @param[in] channels 声道数，1~8
+     * @param[in] sampleBits 采样位数，4~32
+     * @param[in] level 压缩级别，0~8，超出时取8
+     * @param[in] pool 线程池，nullptr使用默认线程池
+    */
+    FlacEncoder(uint32_t sampleRate, uint32_t channels, uint32_t sampleBits, uint32_t level = 5, ThreadPool::ptr pool = nullptr); 
+
+    /**
+     * @brief 析构函数
+    */
+    ~FlacEncoder(); 
+
+    /**
+     * @brief 参数是否有效
+     * @retval 是否有效
+    */
+    bool isValid() const { return m_isValid; }
+
+    /**
+     * @brief 设置输出回调，开始写入前设置
+     * @param[in] sink 输出回调
+    */
+    void setSink(FrameSink sink) { m_sink = sink; }
+
+    /**
+     * @brief 写入PCM，攒够一批帧后并行编码并输出
+     * @param[in] data 各声道数据，data[c]为声道c的第一个采样
+     * @param[in] frames 每个声道的采样数
+     * @retval 是否成功
+    */
+    bool write(const int32_t* const* data, uint32_t frames); 
+
+    /**
+     * @brief 写入解码出的帧
+     * @param[in] block 帧，声道数须一致
+     * @retval 是否成功
+    */
+    bool write(const FlacPcmBlock& block); 
+
+    /**
+     * @brief 编码剩余的采样并结束，之后不能再写入
+     * @retval 是否成功
+    */
+    bool finish(); 
+
+    /**
+     * @brief 把编码结果（block size、frame size、采样数、MD5）写入STREAMINFO，finish之后调用
+     * @param[in,out] streamInfo 流信息
+     * @retval 是否成功
+    */
+    bool fillStreamInfo(StreamInfoMetaBlock& streamInfo) const; 
+
+    /**
+     * @brief 取得block size
+     * @retval block size
+    */
+    uint32_t getBlockSize() const { return m_blockSize; }
+
+    /**
+     * @brief 取得已编码的采样数（每声道）
+     * @retval 采样数
+    */
+    uint64_t getSampleNum() const { return m_sampleNum; }
+
+    /**
+     * @brief 取得已输出的长度
+     * @retval 长度(byte)
+    */
+    uint64_t getEncodedLength() const { return m_encodedLength; }
+
+    /**
+     * @brief 取得各帧相对第一帧的偏移，用于生成SEEKTABLE
+     * @retval 各帧偏移
+    */
+    const std::vector<uint64_t>& getFrameOffsets() const { return m_frameOffsets; }
+
+    /**
+     * @brief 取得输入PCM的MD5，finish之后有效
+     * @param[out] dest 摘要，Md5::DIGEST_SIZE byte
+    */
+    void getMD5(void* dest) const; 
+
+    /**
+     * @brief 重新编码为新文件：metadata沿用源文件（序列化后写出，STREAMINFO与SEEKTABLE在编码结束后回填），
+     *        源文件边解码边编码；源文件有帧损坏、采样数或MD5与STREAMINFO不一致时失败
+     * @param[in] source 源文件解码器
+     * @param[in] path 输出文件路径，写临时文件后替换
+     * @param[in] level 压缩级别
+     * @param[out] result 结果，可为nullptr
+     * @param[in] pool 线程池，nullptr使用默认线程池
+     * @retval 是否成功
+    */
+    static bool Reencode(const MusicDecoderflac& source, const std::wstring& path, uint32_t level,
+        RecompressResult* result = nullptr, ThreadPool::ptr pool = nullptr); 
+
+    /**
+     * @brief 重新编码到写入器：与按路径重新编码相同，但写完后只结束写入（FileWriter::finish）不提交，
+     *        由调用方校验后commit或abort；失败时未提交的写入在写入器析构时放弃
+     * @param[in] source 源文件解码器
+     * @param[in] writer 写入器，还未写入
+     * @param[in] level 压缩级别
+     * @param[out] result 结果，可为nullptr，success在提交后由调用方设置
+     * @param[in] pool 线程池，nullptr使用默认线程池
+     * @retval 是否成功
+    */
+    static bool Reencode(const MusicDecoderflac& source, FileWriter& writer, uint32_t level,
+        RecompressResult* result = nullptr, ThreadPool::ptr pool = nullptr); 
+
+    /**
+     * @brief 重新压缩文件：用REPLACE方式的写入器编码到同目录的临时文件，解码校验MD5后提交替换原文件；
+     *        校验失败或新文件没有变小时放弃写入，保留原文件
+     * @param[in] path 文件路径
+     * @param[in] level 压缩级别
+     * @param[out] result 结果，可为nullptr
+     * @param[in] pool 线程池，nullptr使用默认线程池
+     * @retval 是否成功
+    */
+    static bool Recompress(const std::wstring& path, uint32_t level = MAX_LEVEL, RecompressResult* result = nullptr, ThreadPool::ptr pool = nullptr); 
+
+    /**
+     * @brief 并行重新压缩多个文件，文件之间与文件内部都并行
+     * @param[in] files 文件路径
+     * @param[in] level 压缩级别
+     * @param[out] dest 各文件的结果
+     * @param[in] pool 线程池，nullptr使用默认线程池
+     * @retval 成功的文件数
+    */
+    static uint32_t RecompressFiles(const std::vector<std::wstring>& files, uint32_t level, std::vector<RecompressResult>& dest, ThreadPool::ptr pool = nullptr); 
+
+    /**
+     * @brief 取得当前使用的指令集
+     * @retval 指令集
+    */
+    static FlacPredictor::Isa GetIsa(); 
+
+    /**
+     * @brief 设置自相关计算使用的指令集，超出CPU支持时使用CPU支持的指令集（测试与性能对比用）；
+     *        各实现的累加顺序相同，编码结果与指令集无关
+     * @param[in] isa 指令集
+    */
+    static void SetIsa(FlacPredictor::Isa isa); 
+
+private: 
+    struct Context; 
+
+    /**
+     * @brief 并行编码已攒下的帧并输出
+     * @retval 是否成功
+    */
+    bool encodeBatch(); 
+
+    /**
+     * @brief 编码一帧
+     * @param[in,out] ctx 线程的工作区
+     * @param[in] block 帧
+     * @param[in] frameNumber 帧号
+     * @param[out] writer 输出
+    */
+    void encodeFrame(Context& ctx, const FlacPcmBlock& block, uint32_t frameNumber, FlacBitWriter& writer) const; 
+
+private: 
+    /// @brief 参数是否有效
+    bool m_isValid = false; 
+    /// @brief 采样率
+    uint32_t m_sampleRate; 
+    /// @brief 声道数
+    uint32_t m_channels; 
+    /// @brief 采样位数
+    uint32_t m_sampleBits; 
+    /// @brief 压缩级别
+    uint32_t m_level; 
+    /// @brief block size
+    uint32_t m_blockSize; 
+    /// @brief 线程池
+    ThreadPool::ptr m_pool; 
+    /// @brief 输出回调
+    FrameSink m_sink; 
+    /// @brief 一批的帧，m_filled之前的已满
+    std::vector<FlacPcmBlock> m_frames; 
+    /// @brief 一批中已满的帧数
+    uint32_t m_filled = 0; 
+    /// @brief 当前帧中已写入的采样数
+    uint32_t m_position = 0; 
+    /// @brief 各帧的编码输出
+    std::vector<FlacBitWriter> m_outputs; 
+    /// @brief 各编码线程的工作区
+    std::vector<std::unique_ptr<Context>> m_contexts; 
+    /// @brief MD5计算用的交错缓冲
+    std::vector<uint8_t> m_md5Buffer; 
+    /// @brief 输入PCM的MD5
+    Md5 m_md5; 
+    /// @brief MD5结果
+    uint8_t m_digest[Md5::DIGEST_SIZE]; 
+    /// @brief 已编码的帧数
+    uint32_t m_frameNum = 0; 
+    /// @brief 已编码的采样数
+    uint64_t m_sampleNum = 0; 
+    /// @brief 已输出的长度
+    uint64_t m_encodedLength = 0; 
+    /// @brief 最小帧长
+    uint32_t m_minFrameSize = 0; 
+    /// @brief 最大帧长
+    uint32_t m_maxFrameSize = 0; 
+    /// @brief 各帧相对第一帧的偏移
+    std::vector<uint64_t> m_frameOffsets; 
+    /// @brief 是否已结束
+    bool m_finished = false; 
+    /// @brief 是否失败
+    bool m_isFailed = false; 
+}; 
+
+}
+
+#endif
\ No newline at end of file
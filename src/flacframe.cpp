@@ -0,0 +1,688 @@
+#include "flacframe.h"
+#include "crc.h"
+#include "log.h"
+
+#include <string.h>
+#include <algorithm>
+
+#if defined(__SSE2__)||defined(_M_X64)||(defined(_M_IX86_FP)&&_M_IX86_FP>=2)
+#define MD_FLACFRAME_SSE2
+#include <emmintrin.h>
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace music_data {
+
+INITONLYLOGGER(); 
+
+/// @brief 帧头中sample rate编码对应的采样率，0表示取STREAMINFO或在帧头末尾另行给出
+static const uint32_t s_sampleRateTable[12] = {
+    0, 88200, 176400, 192000, 8000, 16000, 22050, 24000, 32000, 44100, 48000, 96000
+}; 
+
+/// @brief 帧头中sample size编码对应的采样位数，0表示取STREAMINFO，3为保留
+static const uint8_t s_sampleBitsTable[8] = {
+    0, 8, 12, 0, 16, 20, 24, 32
+}; 
+
+/// @brief 最短帧头长度：sync 2 byte + 2 byte + 1 byte帧号 + CRC-8
+static const uint32_t s_minHeaderLength = 6; 
+
+/// @brief 单个分段最小长度，过小的分段同步开销比扫描本身还大
+static const uint64_t s_minScanChunkSize = 1<<20; 
+
+/// @brief 按采样号定位时，二分到这个长度以内就逐帧查找
+static const uint64_t s_minLocateRange = 64<<10; 
+
+/**
+ * @brief 取得最低位1的位置
+ * @param[in] val 非0值
+ * @retval 位置
+*/
+static inline uint32_t CountTrailingZeros(uint32_t val) {
+#ifdef _MSC_VER
+    unsigned long ans; 
+    _BitScanForward(&ans, val); 
+    return ans; 
+#else
+    return __builtin_ctz(val); 
+#endif
+}
+
+/**
+ * @brief 查找同步码0xFFF8/0xFFF9（第二个字节只比较高7 bit）
+ * @param[in] data 查找起点
+ * @param[in] length 同步码起点的查找范围
+ * @param[in] available data之后可读的长度，不小于length
+ * @retval 同步码起点，未找到为nullptr
+*/
+static const uint8_t* FindSyncCode(const uint8_t* data, size_t length, size_t available) {
+    const uint8_t* pin = data; 
+    const uint8_t* end = data+length; 
+#ifdef MD_FLACFRAME_SSE2
+    // 一次比较16个位置：本字节为0xFF且下一字节&0xFE为0xF8，比逐个0xFF再解析帧头少很多分支
+    const __m128i ff = _mm_set1_epi8((char)0xFF); 
+    const __m128i fe = _mm_set1_epi8((char)0xFE); 
+    const __m128i f8 = _mm_set1_epi8((char)0xF8); 
+    while (pin+16<=end&&pin+17<=data+available) {
+        __m128i first = _mm_loadu_si128((const __m128i*)pin); 
+        __m128i second = _mm_loadu_si128((const __m128i*)(pin+1)); 
+        __m128i match = _mm_and_si128(_mm_cmpeq_epi8(first, ff), _mm_cmpeq_epi8(_mm_and_si128(second, fe), f8)); 
+        uint32_t mask = (uint32_t)_mm_movemask_epi8(match); 
+        if (mask!=0) {
+            return pin+CountTrailingZeros(mask); 
+        }
+        pin+=16; 
+    }
+#endif
+    while (pin<end) {
+        pin = (const uint8_t*)memchr(pin, 0xFF, end-pin); 
+        if (pin==nullptr) {
+            return nullptr; 
+        }
+        if (pin+1<data+available&&(pin[1]&0xFE)==0xF8) {
+            return pin; 
+        }
+        ++pin; 
+    }
+    return nullptr; 
+}
+
+bool FlacFrameHeader::parse(const void* data, size_t length) {
+    const uint8_t* pin = (const uint8_t*)data; 
+    if (length<s_minHeaderLength) {
+        return false; 
+    }
+
+    // 14 bit同步码 11111111111110 + 1 bit保留位(必须为0)
+    if (pin[0]!=0xFF||(pin[1]&0xFE)!=0xF8) {
+        return false; 
+    }
+    variableBlockSize = (pin[1]&0x01)==1; 
+
+    uint8_t blockSizeCode = pin[2]>>4; 
+    uint8_t sampleRateCode = pin[2]&0x0F; 
+    channelAssignment = pin[3]>>4; 
+    uint8_t sampleBitsCode = (pin[3]>>1)&0x07; 
+
+    if (blockSizeCode==0||sampleRateCode==15||channelAssignment>10||sampleBitsCode==3||(pin[3]&0x01)!=0) {
+        return false; 
+    }
+
+    channels = channelAssignment<8?channelAssignment+1:2; 
+    sampleBits = s_sampleBitsTable[sampleBitsCode]; 
+
+    // UTF-8编码的帧号(最多31 bit)或采样号(最多36 bit)
+    size_t pos = 4; 
+    uint8_t first = pin[pos++]; 
+    uint32_t extraBytes = 0; 
+    if ((first&0x80)==0) {
+        codedNumber = first; 
+    } else if ((first&0xE0)==0xC0) {
+        codedNumber = first&0x1F; 
+        extraBytes = 1; 
+    } else if ((first&0xF0)==0xE0) {
+        codedNumber = first&0x0F; 
+        extraBytes = 2; 
+    } else if ((first&0xF8)==0xF0) {
+        codedNumber = first&0x07; 
+        extraBytes = 3; 
+    } else if ((first&0xFC)==0xF8) {
+        codedNumber = first&0x03; 
+        extraBytes = 4; 
+    } else if ((first&0xFE)==0xFC) {
+        codedNumber = first&0x01; 
+        extraBytes = 5; 
+    } else if (first==0xFE&&variableBlockSize) {
+        codedNumber = 0; 
+        extraBytes = 6; 
+    } else {
+        return false; 
+    }
+
+    if (pos+extraBytes+1>length) {
+        return false; 
+    }
+    for (uint32_t i=0; i<extraBytes; ++i) {
+        uint8_t item = pin[pos++]; 
+        if ((item&0xC0)!=0x80) {
+            return false; 
+        }
+        codedNumber = (codedNumber<<6)|(item&0x3F); 
+    }
+
+    // block size
+    if (blockSizeCode==1) {
+        blockSize = 192; 
+    } else if (blockSizeCode<=5) {
+        blockSize = 576<<(blockSizeCode-2); 
+    } else if (blockSizeCode==6) {
+        if (pos+2>length) {
+            return false; 
+        }
+        blockSize = (uint32_t)pin[pos++]+1; 
+    } else if (blockSizeCode==7) {
+        if (pos+3>length) {
+            return false; 
+        }
+        blockSize = (((uint32_t)pin[pos]<<8)|pin[pos+1])+1; 
+        pos+=2; 
+    } else {
+        blockSize = 256<<(blockSizeCode-8); 
+    }
+
+    // sample rate
+    if (sampleRateCode<12) {
+        sampleRate = s_sampleRateTable[sampleRateCode]; 
+    } else if (sampleRateCode==12) {
+        if (pos+2>length) {
+            return false; 
+        }
+        sampleRate = (uint32_t)pin[pos++]*1000; 
+    } else {
+        if (pos+3>length) {
+            return false; 
+        }
+        sampleRate = ((uint32_t)pin[pos]<<8)|pin[pos+1]; 
+        if (sampleRateCode==14) {
+            sampleRate*=10; 
+        }
+        pos+=2; 
+    }
+
+    crc8 = pin[pos]; 
+    headerLength = pos+1; 
+
+    return music_data::crc8(pin, pos)==crc8; 
+}
+
+FlacFrameScanner::FlacFrameScanner(const void* data, size_t length, StreamInfoMetaBlock::ptr streamInfo)
+    : m_data((const uint8_t*)data)
+    , m_length(data==nullptr?0:length)
+    , m_sampleRate(streamInfo->getSampleRate())
+    , m_channels(streamInfo->getChannels())
+    , m_sampleBits(streamInfo->getSampleBits())
+    , m_fixedBlockSize(streamInfo->getMaxBlockSize())
+    , m_maxBlockSize(streamInfo->getMaxBlockSize())
+    , m_minFrameSize(streamInfo->getMinFrameSize())
+    , m_maxFrameSize(streamInfo->getMaxFrameSize())
+    , m_totalSamples(streamInfo->getSamplePerChannel()) {
+}
+
+bool FlacFrameScanner::isConsistent(const FlacFrameHeader& header) const {
+    if (header.sampleRate!=0&&m_sampleRate!=0&&header.sampleRate!=m_sampleRate) {
+        return false; 
+    }
+    if (header.sampleBits!=0&&header.sampleBits!=m_sampleBits) {
+        return false; 
+    }
+    if (header.channels!=m_channels) {
+        return false; 
+    }
+    if (m_maxBlockSize>=16&&header.blockSize>m_maxBlockSize) {
+        return false; 
+    }
+    return true; 
+}
+
+bool FlacFrameScanner::findFrame(uint64_t from, uint64_t end, FlacFrameHeader& header, uint64_t& offset) const {
+    end = std::min<uint64_t>(end, m_length); 
+    uint64_t pos = from; 
+    while (pos<end) {
+        const uint8_t* pin = FindSyncCode(m_data+pos, end-pos, m_length-pos); 
+        if (pin==nullptr) {
+            return false; 
+        }
+        pos = pin-m_data; 
+        if (header.parse(pin, m_length-pos)&&isConsistent(header)) {
+            offset = pos; 
+            return true; 
+        }
+        ++pos; 
+    }
+    return false; 
+}
+
+bool FlacFrameScanner::checkFrameCrc(uint64_t offset, uint64_t end) const {
+    end = std::min<uint64_t>(end, m_length); 
+    if (offset+s_minHeaderLength+2>end) {
+        return false; 
+    }
+    // 帧尾CRC-16高字节在前，连同它一起计算时结果为0
+    return crc16(m_data+offset, end-offset)==0; 
+}
+
+bool FlacFrameScanner::findFrameEnd(uint64_t offset, uint64_t end, uint64_t& frameEnd) const {
+    end = std::min<uint64_t>(end, m_length); 
+    FlacFrameHeader header; 
+    if (!header.parse(m_data+offset, m_length-offset)) {
+        return false; 
+    }
+
+    uint64_t pos = offset+std::max<uint64_t>(header.headerLength+3, m_minFrameSize); 
+    if (pos>end) {
+        return false; 
+    }
+    // 帧内数据每个位置都有1/65536的概率使CRC-16恰好为0，优先取其后紧跟同步码首字节的位置
+    bool found = false; 
+    uint16_t crc = crc16(m_data+offset, pos-offset); 
+    while (true) {
+        if (crc==0) {
+            if (pos<m_length&&m_data[pos]==0xFF) {
+                frameEnd = pos; 
+                return true; 
+            }
+            if (!found) {
+                frameEnd = pos; 
+                found = true; 
+            }
+        }
+        if (pos==end||(m_maxFrameSize!=0&&pos-offset>=m_maxFrameSize)) {
+            return found; 
+        }
+        crc = crc16(m_data+pos, 1, crc); 
+        ++pos; 
+    }
+}
+
+bool FlacFrameScanner::findNextFrame(uint64_t offset, const FlacFrameHeader& header, FlacFrameHeader& next, uint64_t& nextOffset) const {
+    uint64_t expected = header.getFirstSample(m_fixedBlockSize)+header.blockSize; 
+
+    // 帧至少包含帧头、一个subframe头与CRC-16
+    uint64_t from = offset+std::max<uint64_t>(header.headerLength+3, m_minFrameSize); 
+    uint64_t end = m_length; 
+    if (m_maxFrameSize!=0) {
+        end = std::min<uint64_t>(end, offset+m_maxFrameSize+1); 
+    }
+
+    while (findFrame(from, end, next, nextOffset)) {
+        if (next.variableBlockSize==header.variableBlockSize&&next.getFirstSample(m_fixedBlockSize)==expected) {
+            return true; 
+        }
+        from = nextOffset+1; 
+    }
+    return false; 
+}
+
+bool FlacFrameScanner::confirmFrame(uint64_t offset, const FlacFrameHeader& header) const {
+    FlacFrameHeader next; 
+    uint64_t nextOffset; 
+    if (findNextFrame(offset, header, next, nextOffset)) {
+        return true; 
+    }
+    // 最后一帧之后没有下一帧
+    return isLastFrame(offset, header); 
+}
+
+bool FlacFrameScanner::isLastFrame(uint64_t offset, const FlacFrameHeader& header) const {
+    if (m_totalSamples!=0) {
+        return header.getFirstSample(m_fixedBlockSize)+header.blockSize==m_totalSamples; 
+    }
+    if (m_maxFrameSize!=0&&m_length-offset>m_maxFrameSize) {
+        return false; 
+    }
+    return checkFrameCrc(offset, m_length); 
+}
+
+bool FlacFrameScanner::locate(uint64_t sample, uint64_t begin, uint64_t end, FrameInfo& dest) const {
+    end = std::min<uint64_t>(end, m_length); 
+    FlacFrameHeader header; 
+    uint64_t offset = 0; 
+
+    // lo之后第一帧不晚于目标帧，目标帧起点小于hi；loSample、hiSample用于插值
+    uint64_t lo = begin; 
+    uint64_t hi = end; 
+    uint64_t loSample = 0; 
+    uint64_t hiSample = end==m_length?m_totalSamples:0; 
+    if (lo<m_length&&header.parse(m_data+lo, m_length-lo)) {
+        loSample = header.getFirstSample(m_fixedBlockSize); 
+    }
+    if (hi<m_length&&header.parse(m_data+hi, m_length-hi)) {
+        hiSample = header.getFirstSample(m_fixedBlockSize); 
+    }
+    uint64_t linearRange = std::max<uint64_t>(s_minLocateRange, (uint64_t)m_maxFrameSize*2); 
+    while (hi-lo>linearRange) {
+        // 按采样号插值，夹在区间的1/8~7/8之间保证每次至少缩小1/8
+        uint64_t mid = lo+(hi-lo)/2; 
+        if (hiSample>loSample&&sample>=loSample) {
+            mid = lo+(uint64_t)((double)(hi-lo)*(sample-loSample)/(hiSample-loSample)); 
+            mid = std::min(std::max(mid, lo+(hi-lo)/8), hi-(hi-lo)/8); 
+        }
+
+        bool synced = false; 
+        uint64_t pos = mid; 
+        while (findFrame(pos, hi, header, offset)) {
+            if (confirmFrame(offset, header)) {
+                synced = true; 
+                break; 
+            }
+            pos = offset+1; 
+        }
+        uint64_t firstSample = header.getFirstSample(m_fixedBlockSize); 
+        if (!synced||firstSample>sample) {
+            hi = mid; 
+            hiSample = synced?firstSample:hiSample; 
+        } else if (sample<firstSample+header.blockSize) {
+            dest = {firstSample, offset, header.blockSize}; 
+            return true; 
+        } else {
+            lo = offset; 
+            loSample = firstSample; 
+        }
+    }
+
+    // 逐帧查找，帧损坏时重新同步
+    uint64_t pos = lo; 
+    while (findFrame(pos, m_length, header, offset)) {
+        if (!confirmFrame(offset, header)) {
+            pos = offset+1; 
+            continue; 
+        }
+        while (true) {
+            uint64_t firstSample = header.getFirstSample(m_fixedBlockSize); 
+            if (firstSample>sample) {
+                return false; 
+            }
+            if (sample<firstSample+header.blockSize) {
+                dest = {firstSample, offset, header.blockSize}; 
+                return true; 
+            }
+            FlacFrameHeader next; 
+            uint64_t nextOffset; 
+            if (!findNextFrame(offset, header, next, nextOffset)) {
+                break; 
+            }
+            header = next; 
+            offset = nextOffset; 
+        }
+        pos = offset+1; 
+    }
+    return false; 
+}
+
+void FlacFrameScanner::scanRange(uint64_t begin, uint64_t end, std::vector<FrameInfo>& dest) const {
+    end = std::min<uint64_t>(end, m_length); 
+
+    FlacFrameHeader header; 
+    uint64_t offset = 0; 
+    uint64_t pos = begin; 
+    bool synced = false; 
+
+    while (pos<end) {
+        // 分段起点不一定是帧起点，候选帧需要能衔接下一帧才算同步成功
+        synced = false; 
+        while (findFrame(pos, end, header, offset)) {
+            if (confirmFrame(offset, header)) {
+                synced = true; 
+                break; 
+            }
+            pos = offset+1; 
+        }
+        if (!synced) {
+            return; 
+        }
+
+        while (offset<end) {
+            FrameInfo info = {header.getFirstSample(m_fixedBlockSize), offset, header.blockSize}; 
+            dest.emplace_back(info); 
+
+            FlacFrameHeader next; 
+            uint64_t nextOffset; 
+            if (!findNextFrame(offset, header, next, nextOffset)) {
+                break; 
+            }
+            header = next; 
+            offset = nextOffset; 
+        }
+
+        // 到达分段末尾或数据末尾都是正常结束
+        if (offset>=end||isLastFrame(offset, header)) {
+            return; 
+        }
+
+        // 帧损坏，跳过后重新同步
+        LOGW("lost frame sync at offset %lld, resync", (long long)offset); 
+        pos = offset+1; 
+    }
+}
+
+bool FlacFrameScanner::scan(std::vector<FrameInfo>& dest, ThreadPool::ptr pool) const {
+    dest.clear(); 
+    if (m_data==nullptr||m_length==0) {
+        LOGW("no audio frames to scan"); 
+        return false; 
+    }
+
+    if (pool==nullptr) {
+        pool = DefaultThreadPool::GetInstance(); 
+    }
+
+    uint64_t chunkNum = std::max<uint64_t>(1, std::min<uint64_t>(pool->getThreadNum()*4, m_length/s_minScanChunkSize)); 
+    uint64_t chunkSize = (m_length+chunkNum-1)/chunkNum; 
+
+    std::vector<std::vector<FrameInfo>> parts(chunkNum); 
+    pool->parallelFor(chunkNum, [this, chunkSize, &parts](size_t i) {
+        scanRange(i*chunkSize, (i+1)*chunkSize, parts[i]); 
+    }); 
+
+    size_t frameNum = 0; 
+    for (auto& item: parts) {
+        frameNum+=item.size(); 
+    }
+    dest.reserve(frameNum); 
+    for (auto& item: parts) {
+        dest.insert(dest.end(), item.begin(), item.end()); 
+    }
+
+    // 检查分段衔接处采样号是否连续，不连续说明某个分段同步到了伪帧，退回单线程扫描
+    for (size_t i=1; i<dest.size(); ++i) {
+        if (dest[i].firstSample!=dest[i-1].firstSample+dest[i-1].blockSize) {
+            LOGW("frame sequence broken at offset %lld, rescan sequentially", (long long)dest[i].offset); 
+            dest.clear(); 
+            scanRange(0, m_length, dest); 
+            break; 
+        }
+    }
+
+    return !dest.empty(); 
+}
+
+bool FlacFrameIndex::build(const MusicDecoderflac& decoder, ThreadPool::ptr pool) {
+    m_frames.clear(); 
+    m_fingerprint = 0; 
+    if (decoder.getStreamInfo()==nullptr||decoder.getAudioFrames()==nullptr) {
+        LOGE("no audio frames, build frame index termination"); 
+        return false; 
+    }
+
+    FlacFrameScanner scanner(decoder.getAudioFrames(), decoder.getAudioFramesLength(), decoder.getStreamInfo()); 
+    if (!scanner.scan(m_frames, pool)) {
+        LOGE("no frame found, build frame index termination"); 
+        return false; 
+    }
+    m_frames.shrink_to_fit(); 
+    m_fingerprint = Fingerprint(decoder); 
+    return true; 
+}
+
+bool FlacFrameIndex::find(uint64_t sample, FrameInfo& dest) const {
+    // 第一个首采样号大于sample的帧的前一帧
+    auto iter = std::upper_bound(m_frames.begin(), m_frames.end(), sample, [](uint64_t val, const FrameInfo& item) {
+        return val<item.firstSample; 
+    }); 
+    if (iter==m_frames.begin()) {
+        return false; 
+    }
+    --iter; 
+    if (sample>=iter->firstSample+iter->blockSize) {
+        return false; 
+    }
+    dest = *iter; 
+    return true; 
+}
+
+/// @brief 索引文件标记
+static const char s_frameIndexMagic[4] = {'M', 'D', 'F', 'I'}; 
+/// @brief 索引文件格式版本
+static const uint8_t s_frameIndexVersion = 1; 
+/// @brief 索引文件头长度：标记4 + 版本1 + 指纹8
+static const size_t s_frameIndexHeaderSize = 13; 
+
+/**
+ * @brief 写入变长无符号整数，每byte低7 bit为数据，最高位表示后面还有
+*/
+static void WriteVarint(std::vector<uint8_t>& dest, uint64_t val) {
+    while (val>=0x80) {
+        dest.emplace_back((uint8_t)(val|0x80)); 
+        val>>=7; 
+    }
+    dest.emplace_back((uint8_t)val); 
+}
+
+/**
+ * @brief 读取变长无符号整数
+ * @retval 是否成功，数据不足或超过64 bit时为false
+*/
+static bool ReadVarint(const uint8_t*& pin, const uint8_t* end, uint64_t& val) {
+    val = 0; 
+    for (uint32_t shift=0; shift<64&&pin<end; shift+=7) {
+        uint8_t item = *pin++; 
+        val|=(uint64_t)(item&0x7F)<<shift; 
+        if ((item&0x80)==0) {
+            return true; 
+        }
+    }
+    return false; 
+}
+
+uint64_t FlacFrameIndex::Fingerprint(const MusicDecoderflac& decoder) {
+    // FNV-1a 64
+    uint64_t hash = 0xCBF29CE484222325ULL; 
+    auto update = [&hash](const void* data, size_t length) {
+        const uint8_t* pin = (const uint8_t*)data; 
+        for (size_t i=0; i<length; ++i) {
+            hash = (hash^pin[i])*0x100000001B3ULL; 
+        }
+    }; 
+
+    uint64_t length = decoder.getAudioFramesLength(); 
+    uint64_t totalSamples = decoder.getStreamInfo()->getSamplePerChannel(); 
+    uint8_t md5[STREAMINFO_MD5_SIZE] = {0}; 
+    decoder.getStreamInfo()->getUnencoderedMD5(md5, STREAMINFO_MD5_SIZE); 
+    update(&length, sizeof(length)); 
+    update(&totalSamples, sizeof(totalSamples)); 
+    update(md5, sizeof(md5)); 
+
+    const uint8_t* audio = decoder.getAudioFrames(); 
+    size_t sampleSize = std::min<uint64_t>(length, 4096); 
+    update(audio, sampleSize); 
+    update(audio+length-sampleSize, sampleSize); 
+    return hash; 
+}
+
+bool FlacFrameIndex::save(const wchar_t* file_path) const {
+    if (m_frames.empty()) {
+        LOGE("frame index is empty, save termination"); 
+        return false; 
+    }
+
+    std::vector<uint8_t> buffer(s_frameIndexHeaderSize); 
+    buffer.reserve(s_frameIndexHeaderSize+10+m_frames.size()*6); 
+    memcpy(buffer.data(), s_frameIndexMagic, 4); 
+    buffer[4] = s_frameIndexVersion; 
+    for (int i=0; i<8; ++i) {
+        buffer[5+i] = (uint8_t)(m_fingerprint>>(8*i)); 
+    }
+
+    // 帧连续时采样号差值为0，偏移差值即帧长
+    WriteVarint(buffer, m_frames.size()); 
+    uint64_t expectedSample = 0; 
+    uint64_t lastOffset = 0; 
+    for (auto& item: m_frames) {
+        WriteVarint(buffer, item.firstSample-expectedSample); 
+        WriteVarint(buffer, item.offset-lastOffset); 
+        WriteVarint(buffer, item.blockSize); 
+        expectedSample = item.firstSample+item.blockSize; 
+        lastOffset = item.offset; 
+    }
+
+    return WriteDataToFile(file_path, buffer.data(), buffer.size()); 
+}
+
+bool FlacFrameIndex::load(const wchar_t* file_path, const MusicDecoderflac& decoder) {
+    m_frames.clear(); 
+    m_fingerprint = 0; 
+    if (decoder.getStreamInfo()==nullptr||decoder.getAudioFrames()==nullptr) {
+        LOGE("no audio frames, load frame index termination"); 
+        return false; 
+    }
+
+    MappedFile file; 
+    if (!file.open(file_path)) {
+        return false; 
+    }
+    const uint8_t* pin = file.getData(); 
+    const uint8_t* end = pin+file.getSize(); 
+    if (file.getSize()<s_frameIndexHeaderSize||memcmp(pin, s_frameIndexMagic, 4)!=0||pin[4]!=s_frameIndexVersion) {
+        LOGW("not a frame index file or version mismatch"); 
+        return false; 
+    }
+    uint64_t fingerprint = 0; 
+    for (int i=0; i<8; ++i) {
+        fingerprint|=(uint64_t)pin[5+i]<<(8*i); 
+    }
+    if (fingerprint!=Fingerprint(decoder)) {
+        LOGW("frame index is out of date"); 
+        return false; 
+    }
+    pin+=s_frameIndexHeaderSize; 
+
+    uint64_t frameNum = 0; 
+    // 每帧至少3 byte
+    if (!ReadVarint(pin, end, frameNum)||frameNum>(uint64_t)(end-pin)/3) {
+        LOGW("frame index broken"); 
+        return false; 
+    }
+    std::vector<FrameInfo> frames(frameNum); 
+    uint64_t expectedSample = 0; 
+    uint64_t lastOffset = 0; 
+    for (auto& item: frames) {
+        uint64_t sampleDelta, offsetDelta, blockSize; 
+        if (!ReadVarint(pin, end, sampleDelta)||!ReadVarint(pin, end, offsetDelta)||!ReadVarint(pin, end, blockSize)) {
+            LOGW("frame index broken"); 
+            return false; 
+        }
+        item.firstSample = expectedSample+sampleDelta; 
+        item.offset = lastOffset+offsetDelta; 
+        item.blockSize = (uint32_t)blockSize; 
+        if (item.offset>=decoder.getAudioFramesLength()) {
+            LOGW("frame index broken, frame out of audio frames"); 
+            return false; 
+        }
+        expectedSample = item.firstSample+item.blockSize; 
+        lastOffset = item.offset; 
+    }
+
+    m_frames.swap(frames); 
+    m_fingerprint = fingerprint; 
+    return true; 
+}
+
+bool FlacFrameIndex::loadOrBuild(const MusicDecoderflac& decoder, ThreadPool::ptr pool) {
+    std::wstring path = GetSidecarPath(decoder.getFileName()); 
+    // 第一次打开时没有索引文件，直接扫描
+    if (!decoder.getFileName().empty()&&MappedFile::Exists(path.c_str())&&load(path.c_str(), decoder)) {
+        return true; 
+    }
+    if (!build(decoder, pool)) {
+        return false; 
+    }
+    if (!decoder.getFileName().empty()&&!save(path.c_str())) {
+        LOGW("save frame index fail"); 
+    }
+    return true; 
+}
+
+}
\ No newline at end of file
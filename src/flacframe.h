@@ -0,0 +1,276 @@
+#ifndef __MD_FLACFRAME_H_
+#define __MD_FLACFRAME_H_
+
+#include "decoderflac.h"
+#include "threadpool.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+namespace music_data {
+
+/**
+ * @brief flac音频帧头，只解析帧头，不涉及subframe
+*/
+struct FlacFrameHeader {
+    /// @brief blocking strategy，true为可变block size（帧头中为采样号），false为固定block size（帧头中为帧号）
+    bool variableBlockSize = false; 
+    /// @brief 本帧每个声道的采样数
+    uint32_t blockSize = 0; 
+    /// @brief 采样率(Hz)，0表示取STREAMINFO中的值
+    uint32_t sampleRate = 0; 
+    /// @brief 声道分配方式：0~7为独立声道(声道数-1)，8 left/side，9 side/right，10 mid/side
+    uint8_t channelAssignment = 0; 
+    /// @brief 声道数
+    uint8_t channels = 0; 
+    /// @brief 采样位数，0表示取STREAMINFO中的值
+    uint8_t sampleBits = 0; 
+    /// @brief 帧头中UTF-8编码的帧号或采样号
+    uint64_t codedNumber = 0; 
+    /// @brief 帧头长度，包括CRC-8 (byte)
+    uint32_t headerLength = 0; 
+    /// @brief 帧头CRC-8
+    uint8_t crc8 = 0; 
+
+    /**
+     * @brief 解析帧头并校验CRC-8
+     * @param[in] data 帧起始位置
+     * @param[in] length 可读数据长度
+     * @retval 是否为合法帧头
+    */
+    bool parse(const void* data, size_t length); 
+
+    /**
+     * @brief 取得本帧第一个采样的序号
+     * @param[in] fixedBlockSize 固定block size流的block size
+     * @retval 本帧第一个采样的序号
+    */
+    uint64_t getFirstSample(uint32_t fixedBlockSize) const { return variableBlockSize?codedNumber:codedNumber*fixedBlockSize; }
+}; 
+
+/**
+ * @brief flac音频帧扫描器，只解析帧头，按分段并行扫描audio frames区域
+*/
+class FlacFrameScanner {
+public: 
+    typedef std::shared_ptr<FlacFrameScanner> ptr; 
+
+    /**
+     * @brief 帧位置信息
+    */
+    struct FrameInfo {
+        /// @brief 帧中第一个sample的序号
+        uint64_t firstSample; 
+        /// @brief 相对audio frames区域起点的偏移(byte)
+        uint64_t offset; 
+        /// @brief 帧中的采样数
+        uint32_t blockSize; 
+    }; 
+
+    /**
+     * @brief 构造函数
+     * @param[in] data audio frames数据指针
+     * @param[in] length audio frames数据长度
+     * @param[in] streamInfo 流信息，用于校验帧头及换算帧号
+    */
+    FlacFrameScanner(const void* data, size_t length, StreamInfoMetaBlock::ptr streamInfo); 
+
+    /**
+     * @brief 扫描全部帧，分段并行
+     * @param[out] dest 按位置排序的帧信息
+     * @param[in] pool 线程池，nullptr使用默认线程池
+     * @retval 是否扫描到帧
+    */
+    bool scan(std::vector<FrameInfo>& dest, ThreadPool::ptr pool = nullptr) const; 
+
+    /**
+     * @brief 扫描起点位于[begin, end)中的帧
+     * @param[in] begin 区间起点（不要求是帧起点）
+     * @param[in] end 区间终点
+     * @param[out] dest 帧信息追加目标
+    */
+    void scanRange(uint64_t begin, uint64_t end, std::vector<FrameInfo>& dest) const; 
+
+    /**
+     * @brief 从指定位置开始查找下一个帧头合法的位置（不保证一定是帧，需配合采样号校验）
+     * @param[in] from 查找起点
+     * @param[in] end 帧起点上限
+     * @param[out] header 帧头
+     * @param[out] offset 帧起点
+     * @retval 是否找到
+    */
+    bool findFrame(uint64_t from, uint64_t end, FlacFrameHeader& header, uint64_t& offset) const; 
+
+    /**
+     * @brief 校验帧尾的CRC-16，不解码subframe
+     * @param[in] offset 帧起点
+     * @param[in] end 帧终点（下一帧起点）
+     * @retval 是否一致
+    */
+    bool checkFrameCrc(uint64_t offset, uint64_t end) const; 
+
+    /**
+     * @brief 下一帧起点未知时（帧头损坏、最后一帧之后有多余数据）逐字节查找帧终点：
+     *        帧连同帧尾CRC-16的CRC-16为0，优先取其后是0xFF的位置，没有时取第一个
+     * @param[in] offset 帧起点
+     * @param[in] end 查找上限
+     * @param[out] frameEnd 帧终点
+     * @retval 是否找到
+    */
+    bool findFrameEnd(uint64_t offset, uint64_t end, uint64_t& frameEnd) const; 
+
+    /**
+     * @brief 查找包含指定采样的帧：在[begin, end)中按采样号插值二分，范围足够小后逐帧查找
+     * @param[in] sample 采样号
+     * @param[in] begin 查找起点，其后第一帧的首采样号不大于sample
+     * @param[in] end 查找终点，包含sample的帧起点小于end
+     * @param[out] dest 帧信息
+     * @retval 是否找到
+    */
+    bool locate(uint64_t sample, uint64_t begin, uint64_t end, FrameInfo& dest) const; 
+
+private: 
+    /**
+     * @brief 查找紧接在指定帧之后的帧（采样号必须衔接）
+     * @param[in] offset 当前帧起点
+     * @param[in] header 当前帧头
+     * @param[out] next 下一帧帧头
+     * @param[out] nextOffset 下一帧起点
+     * @retval 是否找到
+    */
+    bool findNextFrame(uint64_t offset, const FlacFrameHeader& header, FlacFrameHeader& next, uint64_t& nextOffset) const; 
+
+    /**
+     * @brief 确认候选帧是真正的帧：其后能衔接下一帧，或是流的最后一帧
+     * @param[in] offset 候选帧起点
+     * @param[in] header 候选帧帧头
+     * @retval 是否确认
+    */
+    bool confirmFrame(uint64_t offset, const FlacFrameHeader& header) const; 
+
+    /**
+     * @brief 是否是流的最后一帧：总采样数已知时用总采样数判断，未知（为0）时判断帧是否恰好延伸到audio frames末尾
+     * @param[in] offset 帧起点
+     * @param[in] header 帧头
+     * @retval 是否是最后一帧
+    */
+    bool isLastFrame(uint64_t offset, const FlacFrameHeader& header) const; 
+
+    /**
+     * @brief 帧头与STREAMINFO是否一致
+     * @param[in] header 帧头
+     * @retval 是否一致
+    */
+    bool isConsistent(const FlacFrameHeader& header) const; 
+
+private: 
+    /// @brief audio frames数据
+    const uint8_t* m_data; 
+    /// @brief audio frames数据长度
+    size_t m_length; 
+    /// @brief 采样率
+    uint32_t m_sampleRate; 
+    /// @brief 声道数
+    uint8_t m_channels; 
+    /// @brief 采样位数
+    uint8_t m_sampleBits; 
+    /// @brief 固定block size流的block size
+    uint32_t m_fixedBlockSize; 
+    /// @brief 最大block size
+    uint32_t m_maxBlockSize; 
+    /// @brief 最小帧长，0表示未知
+    uint32_t m_minFrameSize; 
+    /// @brief 最大帧长，0表示未知
+    uint32_t m_maxFrameSize; 
+    /// @brief 一个声道的总采样数，0表示未知
+    uint64_t m_totalSamples; 
+}; 
+
+/**
+ * @brief 帧索引：按位置排列的(首采样号, 偏移, block size)，用于按采样号定位帧；
+ *        可以保存为旁路文件（差分+变长编码，每帧约4~6 byte），之后直接加载不必重新扫描。
+ *        偏移相对audio frames区域起点，修改metadata后索引仍然有效
+*/
+class FlacFrameIndex {
+public: 
+    typedef std::shared_ptr<FlacFrameIndex> ptr; 
+    typedef FlacFrameScanner::FrameInfo FrameInfo; 
+
+    /**
+     * @brief 扫描解码器的audio frames区域建立索引
+     * @param[in] decoder 解码器
+     * @param[in] pool 线程池，nullptr使用默认线程池
+     * @retval 是否成功
+    */
+    bool build(const MusicDecoderflac& decoder, ThreadPool::ptr pool = nullptr); 
+
+    /**
+     * @brief 查找包含指定采样的帧
+     * @param[in] sample 采样号
+     * @param[out] dest 帧信息
+     * @retval 是否找到
+    */
+    bool find(uint64_t sample, FrameInfo& dest) const; 
+
+    /**
+     * @brief 取得全部帧信息
+     * @retval 按位置排列的帧信息
+    */
+    const std::vector<FrameInfo>& getFrames() const { return m_frames; }
+
+    /**
+     * @brief 是否没有帧
+     * @retval 是否为空
+    */
+    bool empty() const { return m_frames.empty(); }
+
+    /**
+     * @brief 保存为旁路文件
+     * @param[in] file_path 文件路径
+     * @retval 是否成功
+    */
+    bool save(const wchar_t* file_path) const; 
+
+    /**
+     * @brief 加载旁路文件，并检查是否与解码器的audio frames一致
+     * @param[in] file_path 文件路径
+     * @param[in] decoder 解码器
+     * @retval 是否成功，文件损坏或已过期时为false
+    */
+    bool load(const wchar_t* file_path, const MusicDecoderflac& decoder); 
+
+    /**
+     * @brief 优先加载源文件旁的索引文件，不存在或过期时重新扫描并保存
+     * @param[in] decoder 解码器
+     * @param[in] pool 线程池，nullptr使用默认线程池
+     * @retval 是否成功
+    */
+    bool loadOrBuild(const MusicDecoderflac& decoder, ThreadPool::ptr pool = nullptr); 
+
+    /**
+     * @brief 取得源文件对应的索引文件路径
+     * @param[in] file_path 源文件路径
+     * @retval 索引文件路径
+    */
+    static std::wstring GetSidecarPath(const std::wstring& file_path) { return file_path+L".mdfi"; }
+
+private: 
+    /**
+     * @brief 计算audio frames区域的指纹：长度、总采样数、MD5及首尾各4KB数据
+     * @param[in] decoder 解码器
+     * @retval 指纹
+    */
+    static uint64_t Fingerprint(const MusicDecoderflac& decoder); 
+
+private: 
+    /// @brief 按位置排列的帧信息
+    std::vector<FrameInfo> m_frames; 
+    /// @brief 建立索引时audio frames区域的指纹
+    uint64_t m_fingerprint = 0; 
+}; 
+
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,246 @@
+#include "flacparallel.h"
+#include "log.h"
+
+#include <algorithm>
+#include <mutex>
+#include <condition_variable>
+
+namespace music_data {
+
+INITONLYLOGGER(); 
+
+/// @brief 每段最大长度
+static const uint64_t s_maxChunkSize = 1<<20; 
+/// @brief 每段最小长度，过小的分段调度开销比解码本身还大
+static const uint64_t s_minChunkSize = 64<<10; 
+/// @brief seektable中占位点的采样号
+static const uint64_t s_placeholderSample = 0xFFFFFFFFFFFFFFFFULL; 
+
+FlacParallelDecoder::FlacParallelDecoder(const MusicDecoderflac& decoder, ThreadPool::ptr pool, uint32_t maxPending)
+    : m_data(decoder.getAudioFrames())
+    , m_length(m_data==nullptr?0:decoder.getAudioFramesLength())
+    , m_streamInfo(decoder.getStreamInfo())
+    , m_seekTable(decoder.getSeekTable())
+    , m_source(decoder.getSource())
+    , m_pool(pool==nullptr?DefaultThreadPool::GetInstance():pool)
+    , m_maxPending(maxPending==0?m_pool->getThreadNum()*2:maxPending) {
+}
+
+bool FlacParallelDecoder::splitBySeekTable(uint64_t chunkSize) {
+    std::vector<SeekTableMetaBlock::SeekPoint> points; 
+    if (m_seekTable==nullptr||!m_seekTable->getSeekPoints(points)) {
+        return false; 
+    }
+    std::sort(points.begin(), points.end()); 
+
+    m_bounds.clear(); 
+    m_bounds.push_back(0); 
+    for (auto& item: points) {
+        if (item.firstSampleNO==s_placeholderSample||item.offsetFromFirst>=m_length
+            ||item.offsetFromFirst<m_bounds.back()+chunkSize) {
+            continue; 
+        }
+        // 定位点可能已过期（例如音频被重新编码而seektable未更新），帧头与采样号都对得上才采用
+        FlacFrameHeader header; 
+        if (!header.parse(m_data+item.offsetFromFirst, m_length-item.offsetFromFirst)
+            ||header.getFirstSample(m_streamInfo->getMaxBlockSize())!=item.firstSampleNO) {
+            LOGW("seek point at offset %lld doesn't match a frame, ignore it", (long long)item.offsetFromFirst); 
+            continue; 
+        }
+        m_bounds.push_back(item.offsetFromFirst); 
+    }
+    m_bounds.push_back(m_length); 
+    if (m_bounds.size()>2||m_length<=chunkSize) {
+        return true; 
+    }
+    // 没有可用的定位点，清掉边界，由调用者改为扫描帧
+    m_bounds.clear(); 
+    return false; 
+}
+
+bool FlacParallelDecoder::split() {
+    m_bounds.clear(); 
+    if (m_data==nullptr||m_length==0||m_streamInfo==nullptr) {
+        LOGE("no audio frames to decode"); 
+        return false; 
+    }
+
+    uint64_t chunkSize = m_chunkSize; 
+    if (chunkSize==0) {
+        chunkSize = std::min(s_maxChunkSize, std::max<uint64_t>(s_minChunkSize, m_length/(m_pool->getThreadNum()*4))); 
+    }
+
+    std::vector<FlacFrameScanner::FrameInfo> scanned; 
+    if (m_index==nullptr||m_index->empty()) {
+        if (splitBySeekTable(chunkSize)) {
+            return true; 
+        }
+        FlacFrameScanner scanner(m_data, m_length, m_streamInfo); 
+        if (!scanner.scan(scanned, m_pool)) {
+            LOGE("no frame found, parallel decode termination"); 
+            return false; 
+        }
+    }
+    const std::vector<FlacFrameScanner::FrameInfo>& frames = scanned.empty()?m_index->getFrames():scanned; 
+
+    m_bounds.push_back(frames.front().offset); 
+    for (auto& item: frames) {
+        if (item.offset>=m_bounds.back()+chunkSize) {
+            m_bounds.push_back(item.offset); 
+        }
+    }
+    m_bounds.push_back(m_length); 
+    return true; 
+}
+
+void FlacParallelDecoder::decodeChunk(Chunk& chunk) const {
+    chunk.blockNum = 0; 
+    chunk.badFrames.clear(); 
+
+    FlacAudioDecoder decoder(m_data, m_length, m_streamInfo); 
+    uint64_t pos = chunk.offset; 
+    while (pos<chunk.end) {
+        if (chunk.blockNum==chunk.blocks.size()) {
+            chunk.blocks.emplace_back(); 
+        }
+        uint32_t frameLength = 0; 
+        if (decoder.decodeFrame(pos, chunk.blocks[chunk.blockNum], &frameLength)) {
+            ++chunk.blockNum; 
+            pos+=frameLength; 
+            continue; 
+        }
+
+        // 帧损坏，跳到本段中下一个帧头合法的位置
+        chunk.badFrames.push_back(pos); 
+        FlacFrameScanner scanner(m_data, m_length, m_streamInfo); 
+        FlacFrameHeader header; 
+        if (!scanner.findFrame(pos+1, chunk.end, header, pos)) {
+            break; 
+        }
+        LOGW("skip broken frame, resync to offset %lld", (long long)pos); 
+    }
+}
+
+/**
+ * @brief 一次decode的共享状态：线程池中的辅助任务可能在decode返回后才开始执行，
+ *        所以状态由shared_ptr持有，辅助任务发现没有可领取的段时直接退出
+*/
+struct FlacParallelState {
+    /// @brief 段数
+    uint32_t chunkNum = 0; 
+    /// @brief 重排窗口大小
+    uint32_t window = 0; 
+    /// @brief 下一个领取的段
+    uint32_t nextClaim = 0; 
+    /// @brief 下一个交付的段
+    uint32_t nextDeliver = 0; 
+    /// @brief 正在解码的段数
+    uint32_t decoding = 0; 
+    /// @brief 是否中止
+    bool stop = false; 
+    /// @brief 已解码未交付的段，第i段位于slots[i%window]
+    std::vector<std::unique_ptr<FlacParallelDecoder::Chunk>> slots; 
+    /// @brief 已交付的段，缓冲区留给之后的段重用
+    std::vector<std::unique_ptr<FlacParallelDecoder::Chunk>> idle; 
+    std::mutex mutex; 
+    std::condition_variable cond; 
+
+    /**
+     * @brief 是否可以领取新的段（需持有锁）
+    */
+    bool canClaim() const { return !stop&&nextClaim<chunkNum&&nextClaim<nextDeliver+window; }
+
+    /**
+     * @brief 领取一段（需持有锁且canClaim()为true）
+    */
+    std::unique_ptr<FlacParallelDecoder::Chunk> claim(const std::vector<uint64_t>& bounds) {
+        std::unique_ptr<FlacParallelDecoder::Chunk> ans; 
+        if (!idle.empty()) {
+            ans = std::move(idle.back()); 
+            idle.pop_back(); 
+        } else {
+            ans.reset(new FlacParallelDecoder::Chunk()); 
+        }
+        ans->index = nextClaim++; 
+        ans->offset = bounds[ans->index]; 
+        ans->end = bounds[ans->index+1]; 
+        ++decoding; 
+        return ans; 
+    }
+
+    /**
+     * @brief 放入解码完成的段（需持有锁）
+    */
+    void finish(std::unique_ptr<FlacParallelDecoder::Chunk> chunk) {
+        --decoding; 
+        slots[chunk->index%window] = std::move(chunk); 
+        cond.notify_all(); 
+    }
+}; 
+
+bool FlacParallelDecoder::decode(ChunkCallback cb) {
+    if (!split()) {
+        return false; 
+    }
+
+    auto state = std::make_shared<FlacParallelState>(); 
+    state->chunkNum = getChunkNum(); 
+    state->window = std::max<uint32_t>(1, m_maxPending); 
+    state->slots.resize(state->window); 
+
+    // 辅助任务只在领取到段时访问this，decode返回前全部段都已交付或停止领取
+    auto worker = [this, state]() {
+        std::unique_lock<std::mutex> lock(state->mutex); 
+        while (true) {
+            state->cond.wait(lock, [&state]() {
+                return state->stop||state->nextClaim>=state->chunkNum||state->canClaim(); 
+            }); 
+            if (!state->canClaim()) {
+                return; 
+            }
+            auto chunk = state->claim(m_bounds); 
+            lock.unlock(); 
+            decodeChunk(*chunk); 
+            lock.lock(); 
+            state->finish(std::move(chunk)); 
+        }
+    }; 
+    uint32_t helperNum = std::min<uint32_t>(m_pool->getThreadNum(), state->chunkNum-1); 
+    for (uint32_t i=0; i<helperNum; ++i) {
+        m_pool->submit(worker); 
+    }
+
+    // 调用线程按顺序交付，下一段未完成时自己也领取段解码
+    std::unique_lock<std::mutex> lock(state->mutex); 
+    while (state->nextDeliver<state->chunkNum&&!state->stop) {
+        auto& slot = state->slots[state->nextDeliver%state->window]; 
+        if (slot!=nullptr) {
+            std::unique_ptr<Chunk> chunk = std::move(slot); 
+            lock.unlock(); 
+            bool res = cb(*chunk); 
+            lock.lock(); 
+            state->idle.emplace_back(std::move(chunk)); 
+            ++state->nextDeliver; 
+            if (!res) {
+                state->stop = true; 
+            }
+            state->cond.notify_all(); 
+        } else if (state->canClaim()) {
+            auto chunk = state->claim(m_bounds); 
+            lock.unlock(); 
+            decodeChunk(*chunk); 
+            lock.lock(); 
+            state->finish(std::move(chunk)); 
+        } else {
+            state->cond.wait(lock); 
+        }
+    }
+
+    // 中止时等正在解码的段结束，之后辅助任务不会再访问this
+    state->stop = true; 
+    state->cond.notify_all(); 
+    state->cond.wait(lock, [&state]() { return state->decoding==0; }); 
+    return state->nextDeliver==state->chunkNum; 
+}
+
+}
\ No newline at end of file
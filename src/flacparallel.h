@@ -0,0 +1,132 @@
+#ifndef __MD_FLACPARALLEL_H_
+#define __MD_FLACPARALLEL_H_
+
+#include "flacdecoder.h"
+#include "flacframe.h"
+#include "threadpool.h"
+#include "noncopyable.h"
+
+#include <memory>
+#include <vector>
+#include <functional>
+#include <stdint.h>
+
+namespace music_data {
+
+/**
+ * @brief flac并行解码：按帧索引或SEEKTABLE把audio frames分成若干段，各段在线程池中解码，
+ *        解码结果经有界的重排窗口按顺序交付给调用线程
+*/
+class FlacParallelDecoder: Noncopyable {
+public: 
+    typedef std::shared_ptr<FlacParallelDecoder> ptr; 
+
+    /**
+     * @brief 一段的解码结果，交付后缓冲区会被之后的段重用
+    */
+    struct Chunk {
+        /// @brief 段序号
+        uint32_t index = 0; 
+        /// @brief 段起点，相对audio frames区域起点
+        uint64_t offset = 0; 
+        /// @brief 段终点，起点在[offset, end)中的帧属于本段
+        uint64_t end = 0; 
+        /// @brief 解码出的帧数
+        uint32_t blockNum = 0; 
+        /// @brief 解码出的帧，只有前blockNum个有效
+        std::vector<FlacPcmBlock> blocks; 
+        /// @brief 解码失败的帧起点
+        std::vector<uint64_t> badFrames; 
+    }; 
+
+    /**
+     * @brief 交付回调，在调用decode的线程中按段序号依次调用
+     * @retval 是否继续解码
+    */
+    typedef std::function<bool(const Chunk&)> ChunkCallback; 
+
+    /**
+     * @brief 构造函数，保持解码器源文件映射
+     * @param[in] decoder flac解码器
+     * @param[in] pool 线程池，nullptr使用默认线程池
+     * @param[in] maxPending 已解码未交付的段数上限，0表示线程数的2倍
+    */
+    FlacParallelDecoder(const MusicDecoderflac& decoder, ThreadPool::ptr pool = nullptr, uint32_t maxPending = 0); 
+
+    /**
+     * @brief 设置用于分段的帧索引，不设置时使用SEEKTABLE，都没有时扫描建立帧索引
+     * @param[in] index 帧索引
+    */
+    void setFrameIndex(FlacFrameIndex::ptr index) { m_index = index; }
+
+    /**
+     * @brief 设置每段的目标长度
+     * @param[in] size 每段长度(byte)，0表示按文件长度与线程数决定
+    */
+    void setChunkSize(uint64_t size) { m_chunkSize = size; }
+
+    /**
+     * @brief 解码全部audio frames，调用线程同样参与解码，在线程池任务中调用也不会死锁
+     * @param[in] cb 交付回调
+     * @retval 是否解码到结尾，无法分段或回调中止时为false
+    */
+    bool decode(ChunkCallback cb); 
+
+    /**
+     * @brief 取得上次decode的分段数
+     * @retval 分段数
+    */
+    uint32_t getChunkNum() const { return m_bounds.empty()?0:m_bounds.size()-1; }
+
+    /**
+     * @brief 取得流信息
+     * @retval 流信息
+    */
+    StreamInfoMetaBlock::ptr getStreamInfo() const { return m_streamInfo; }
+
+private: 
+    /**
+     * @brief 计算分段边界，边界均为帧起点
+     * @retval 是否成功
+    */
+    bool split(); 
+
+    /**
+     * @brief 按SEEKTABLE计算分段边界，只采用能解析出对应帧头的定位点
+     * @param[in] chunkSize 每段目标长度
+     * @retval 是否成功
+    */
+    bool splitBySeekTable(uint64_t chunkSize); 
+
+    /**
+     * @brief 解码一段
+     * @param[in,out] chunk 段，index、offset、end已设置
+    */
+    void decodeChunk(Chunk& chunk) const; 
+
+private: 
+    /// @brief audio frames数据
+    const uint8_t* m_data; 
+    /// @brief audio frames数据长度
+    size_t m_length; 
+    /// @brief 流信息
+    StreamInfoMetaBlock::ptr m_streamInfo; 
+    /// @brief seektable
+    SeekTableMetaBlock::ptr m_seekTable; 
+    /// @brief 源文件映射，保证数据有效
+    MappedFile::ptr m_source; 
+    /// @brief 线程池
+    ThreadPool::ptr m_pool; 
+    /// @brief 已解码未交付的段数上限
+    uint32_t m_maxPending; 
+    /// @brief 每段目标长度，0表示自动
+    uint64_t m_chunkSize = 0; 
+    /// @brief 帧索引
+    FlacFrameIndex::ptr m_index = nullptr; 
+    /// @brief 分段边界，第i段为[m_bounds[i], m_bounds[i+1])
+    std::vector<uint64_t> m_bounds; 
+}; 
+
+}
+
+#endif
\ No newline at end of file
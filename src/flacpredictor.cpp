@@ -0,0 +1,471 @@
+#include "flacpredictor.h"
+
+#include <type_traits>
+
+#if defined(__x86_64__)||defined(__i386__)||defined(_M_X64)||defined(_M_IX86)
+#define MD_FLACPREDICTOR_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define MD_TARGET_SSE41
+#define MD_TARGET_AVX2
+#else
+#include <cpuid.h>
+#define MD_TARGET_SSE41 __attribute__((target("sse4.1")))
+#define MD_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+namespace music_data {
+
+/// @brief LPC预测最大阶数
+static const uint32_t s_maxLpcOrder = 32; 
+
+/// @brief 向量LPC内核的最小阶数，不超过8阶时展开的标量循环更快（块内逐个补算的开销超过向量化的收益）
+static const uint32_t s_minVectorLpcOrder = 9; 
+
+/**
+ * @brief 检测CPU支持的指令集，AVX2还需要操作系统保存ymm寄存器
+*/
+static FlacPredictor::Isa DetectIsa() {
+#ifdef MD_FLACPREDICTOR_X86
+    uint32_t regs[4] = {0}; 
+#ifdef _MSC_VER
+    int info[4]; 
+    __cpuid(info, 0); 
+    uint32_t maxLeaf = info[0]; 
+    __cpuidex(info, 1, 0); 
+    regs[2] = info[2]; 
+#else
+    uint32_t maxLeaf = __get_cpuid_max(0, nullptr); 
+    __cpuid_count(1, 0, regs[0], regs[1], regs[2], regs[3]); 
+#endif
+    if ((regs[2]&(1u<<19))==0) {
+        return FlacPredictor::ISA_SCALAR; 
+    }
+    // OSXSAVE与AVX
+    if ((regs[2]&(1u<<27))==0||(regs[2]&(1u<<28))==0||maxLeaf<7) {
+        return FlacPredictor::ISA_SSE41; 
+    }
+#ifdef _MSC_VER
+    uint64_t xcr0 = _xgetbv(0); 
+    __cpuidex(info, 7, 0); 
+    regs[1] = info[1]; 
+#else
+    uint32_t xcr0Low = 0, xcr0High = 0; 
+    __asm__ volatile("xgetbv" : "=a"(xcr0Low), "=d"(xcr0High) : "c"(0)); 
+    uint64_t xcr0 = ((uint64_t)xcr0High<<32)|xcr0Low; 
+    __cpuid_count(7, 0, regs[0], regs[1], regs[2], regs[3]); 
+#endif
+    if ((xcr0&6)!=6||(regs[1]&(1u<<5))==0) {
+        return FlacPredictor::ISA_SSE41; 
+    }
+    return FlacPredictor::ISA_AVX2; 
+#else
+    return FlacPredictor::ISA_SCALAR; 
+#endif
+}
+
+static const FlacPredictor::Isa s_supportedIsa = DetectIsa(); 
+static FlacPredictor::Isa s_isa = s_supportedIsa; 
+
+/**
+ * @brief 从begin开始逐个恢复FIXED采样，32 bit回绕运算（FIXED只有加减乘，回绕后结果与64 bit运算相同）
+*/
+static void RestoreFixedRange(int32_t* data, uint32_t begin, uint32_t length, uint32_t order) {
+    uint32_t* pd = (uint32_t*)data; 
+    switch (order) {
+    case 1:
+        for (uint32_t i=begin; i<length; ++i) {
+            pd[i]+=pd[i-1]; 
+        }
+        break; 
+    case 2:
+        for (uint32_t i=begin; i<length; ++i) {
+            pd[i]+=2*pd[i-1]-pd[i-2]; 
+        }
+        break; 
+    case 3:
+        for (uint32_t i=begin; i<length; ++i) {
+            pd[i]+=3*(pd[i-1]-pd[i-2])+pd[i-3]; 
+        }
+        break; 
+    case 4:
+        for (uint32_t i=begin; i<length; ++i) {
+            pd[i]+=4*(pd[i-1]+pd[i-3])-6*pd[i-2]-pd[i-4]; 
+        }
+        break; 
+    default:
+        break; 
+    }
+}
+
+/**
+ * @brief 从begin开始逐个恢复LPC采样，32 bit累加
+*/
+static void RestoreLpc32Range(int32_t* data, uint32_t begin, uint32_t length, const int32_t* coefs, uint32_t order, int32_t shift) {
+    for (uint32_t i=begin; i<length; ++i) {
+        uint32_t sum = 0; 
+        for (uint32_t j=0; j<order; ++j) {
+            sum+=(uint32_t)coefs[j]*(uint32_t)data[i-1-j]; 
+        }
+        data[i] = (int32_t)((uint32_t)data[i]+(uint32_t)((int32_t)sum>>shift)); 
+    }
+}
+
+/**
+ * @brief 阶数为编译期常量的LPC恢复，循环可以完全展开，低阶时比向量内核快
+*/
+template<uint32_t ORDER, class Acc>
+static void RestoreLpcFixedOrder(int32_t* data, uint32_t begin, uint32_t length, const int32_t* coefs, int32_t shift) {
+    Acc coef[ORDER]; 
+    for (uint32_t j=0; j<ORDER; ++j) {
+        coef[j] = (Acc)coefs[j]; 
+    }
+    for (uint32_t i=begin; i<length; ++i) {
+        Acc sum = 0; 
+        for (uint32_t j=0; j<ORDER; ++j) {
+            sum+=coef[j]*(Acc)data[i-1-j]; 
+        }
+        data[i] = (int32_t)((uint32_t)data[i]+(uint32_t)((typename std::make_signed<Acc>::type)sum>>shift)); 
+    }
+}
+
+template<class Acc>
+static bool RestoreLpcLowOrder(int32_t* data, uint32_t length, const int32_t* coefs, uint32_t order, int32_t shift) {
+    switch (order) {
+#define XX(n) case n: RestoreLpcFixedOrder<n, Acc>(data, n, length, coefs, shift); return true; 
+    XX(1) XX(2) XX(3) XX(4) XX(5) XX(6) XX(7) XX(8)
+#undef XX
+    default:
+        return false; 
+    }
+}
+
+/**
+ * @brief 从begin开始逐个恢复LPC采样，64 bit累加
+*/
+static void RestoreLpc64Range(int32_t* data, uint32_t begin, uint32_t length, const int32_t* coefs, uint32_t order, int32_t shift) {
+    for (uint32_t i=begin; i<length; ++i) {
+        int64_t sum = 0; 
+        for (uint32_t j=0; j<order; ++j) {
+            sum+=(int64_t)coefs[j]*data[i-1-j]; 
+        }
+        data[i] = (int32_t)(data[i]+(sum>>shift)); 
+    }
+}
+
+/**
+ * @brief 完成一块LPC采样：part[m]已包含全部已知采样的乘积，只补上同一块中前面刚恢复的采样
+ * @param[in,out] data 块起点
+ * @param[in] part 各采样已累加的部分和
+ * @param[in] width 块长度
+*/
+template<class Sum>
+static inline void FinishLpcBlock(int32_t* data, const Sum* part, const int32_t* coefs, uint32_t order, int32_t shift, uint32_t width) {
+    typedef typename std::conditional<sizeof(Sum)==4, uint32_t, int64_t>::type Acc; 
+    for (uint32_t m=0; m<width; ++m) {
+        Acc sum = (Acc)part[m]; 
+        uint32_t taps = m<order?m:order; 
+        for (uint32_t j=0; j<taps; ++j) {
+            sum+=(Acc)coefs[j]*(Acc)data[m-1-j]; 
+        }
+        data[m] = (int32_t)((uint32_t)data[m]+(uint32_t)((Sum)sum>>shift)); 
+    }
+}
+
+#ifdef MD_FLACPREDICTOR_X86
+
+// FIXED恢复是order次前缀和：第l级差分d_l[i] = d_(l-1)[i]-d_(l-1)[i-1]，残差为第order级差分。
+// 向量内做前缀和，再加上一块末尾的值（进位），每级保留一个进位向量
+
+/**
+ * @brief 由预热采样计算各级差分在order-1处的值
+*/
+static void FixedCarries(const int32_t* data, uint32_t order, int32_t* carries) {
+    uint32_t diff[4]; 
+    for (uint32_t i=0; i<order; ++i) {
+        diff[i] = (uint32_t)data[i]; 
+    }
+    for (uint32_t l=0; l<order; ++l) {
+        carries[l] = (int32_t)diff[order-1]; 
+        for (uint32_t n=order-1; n>l; --n) {
+            diff[n]-=diff[n-1]; 
+        }
+    }
+}
+
+MD_TARGET_SSE41 static void RestoreFixedSse41(int32_t* data, uint32_t length, uint32_t order) {
+    int32_t carries[4]; 
+    FixedCarries(data, order, carries); 
+    __m128i carry[4]; 
+    for (uint32_t l=0; l<order; ++l) {
+        carry[l] = _mm_set1_epi32(carries[l]); 
+    }
+    uint32_t i = order; 
+    for (; i+4<=length; i+=4) {
+        __m128i val = _mm_loadu_si128((const __m128i*)(data+i)); 
+        for (uint32_t l=order; l-->0; ) {
+            val = _mm_add_epi32(val, _mm_slli_si128(val, 4)); 
+            val = _mm_add_epi32(val, _mm_slli_si128(val, 8)); 
+            val = _mm_add_epi32(val, carry[l]); 
+            carry[l] = _mm_shuffle_epi32(val, 0xFF); 
+        }
+        _mm_storeu_si128((__m128i*)(data+i), val); 
+    }
+    RestoreFixedRange(data, i, length, order); 
+}
+
+MD_TARGET_AVX2 static void RestoreFixedAvx2(int32_t* data, uint32_t length, uint32_t order) {
+    int32_t carries[4]; 
+    FixedCarries(data, order, carries); 
+    __m256i carry[4]; 
+    for (uint32_t l=0; l<order; ++l) {
+        carry[l] = _mm256_set1_epi32(carries[l]); 
+    }
+    const __m256i last = _mm256_set1_epi32(7); 
+    uint32_t i = order; 
+    for (; i+8<=length; i+=8) {
+        __m256i val = _mm256_loadu_si256((const __m256i*)(data+i)); 
+        for (uint32_t l=order; l-->0; ) {
+            // 两个128 bit内各自做前缀和，再把低半部分的和加到高半部分
+            val = _mm256_add_epi32(val, _mm256_slli_si256(val, 4)); 
+            val = _mm256_add_epi32(val, _mm256_slli_si256(val, 8)); 
+            __m256i low = _mm256_shuffle_epi32(val, 0xFF); 
+            val = _mm256_add_epi32(val, _mm256_permute2x128_si256(low, low, 0x08)); 
+            val = _mm256_add_epi32(val, carry[l]); 
+            carry[l] = _mm256_permutevar8x32_epi32(val, last); 
+        }
+        _mm256_storeu_si256((__m256i*)(data+i), val); 
+    }
+    RestoreFixedRange(data, i, length, order); 
+}
+
+// LPC一次计算一块（4或8个）采样：先用向量累加全部已知采样的乘积，
+// 系数按lane屏蔽掉块内尚未恢复的位置，再逐个补上块内前面刚恢复的采样
+
+MD_TARGET_SSE41 static void RestoreLpc32Sse41(int32_t* data, uint32_t length, const int32_t* coefs, uint32_t order, int32_t shift) {
+    __m128i coef[s_maxLpcOrder]; 
+    for (uint32_t j=0; j<order; ++j) {
+        int32_t c = coefs[j]; 
+        coef[j] = _mm_setr_epi32(c, j>=1?c:0, j>=2?c:0, j>=3?c:0); 
+    }
+    alignas(16) int32_t part[4]; 
+    uint32_t i = order; 
+    for (; i+4<=length; i+=4) {
+        __m128i sum = _mm_setzero_si128(); 
+        for (uint32_t j=0; j<order; ++j) {
+            __m128i val = _mm_loadu_si128((const __m128i*)(data+i-1-j)); 
+            sum = _mm_add_epi32(sum, _mm_mullo_epi32(coef[j], val)); 
+        }
+        _mm_store_si128((__m128i*)part, sum); 
+        FinishLpcBlock(data+i, part, coefs, order, shift, 4); 
+    }
+    RestoreLpc32Range(data, i, length, coefs, order, shift); 
+}
+
+MD_TARGET_AVX2 static void RestoreLpc32Avx2(int32_t* data, uint32_t length, const int32_t* coefs, uint32_t order, int32_t shift) {
+    __m256i coef[s_maxLpcOrder]; 
+    for (uint32_t j=0; j<order; ++j) {
+        int32_t c = coefs[j]; 
+        coef[j] = _mm256_setr_epi32(c, j>=1?c:0, j>=2?c:0, j>=3?c:0, j>=4?c:0, j>=5?c:0, j>=6?c:0, j>=7?c:0); 
+    }
+    alignas(32) int32_t part[8]; 
+    uint32_t i = order; 
+    for (; i+8<=length; i+=8) {
+        __m256i sum = _mm256_setzero_si256(); 
+        for (uint32_t j=0; j<order; ++j) {
+            __m256i val = _mm256_loadu_si256((const __m256i*)(data+i-1-j)); 
+            sum = _mm256_add_epi32(sum, _mm256_mullo_epi32(coef[j], val)); 
+        }
+        _mm256_store_si256((__m256i*)part, sum); 
+        FinishLpcBlock(data+i, part, coefs, order, shift, 8); 
+    }
+    RestoreLpc32Range(data, i, length, coefs, order, shift); 
+}
+
+MD_TARGET_SSE41 static void RestoreLpc64Sse41(int32_t* data, uint32_t length, const int32_t* coefs, uint32_t order, int32_t shift) {
+    // _mm_mul_epi32取每个64 bit lane的低32 bit做有符号乘法
+    __m128i coef[s_maxLpcOrder]; 
+    for (uint32_t j=0; j<order; ++j) {
+        int32_t c = coefs[j]; 
+        coef[j] = _mm_set_epi64x(j>=1?c:0, c); 
+    }
+    alignas(16) int64_t part[2]; 
+    uint32_t i = order; 
+    for (; i+2<=length; i+=2) {
+        __m128i sum = _mm_setzero_si128(); 
+        for (uint32_t j=0; j<order; ++j) {
+            __m128i val = _mm_cvtepi32_epi64(_mm_loadl_epi64((const __m128i*)(data+i-1-j))); 
+            sum = _mm_add_epi64(sum, _mm_mul_epi32(coef[j], val)); 
+        }
+        _mm_store_si128((__m128i*)part, sum); 
+        FinishLpcBlock(data+i, part, coefs, order, shift, 2); 
+    }
+    RestoreLpc64Range(data, i, length, coefs, order, shift); 
+}
+
+MD_TARGET_AVX2 static void RestoreLpc64Avx2(int32_t* data, uint32_t length, const int32_t* coefs, uint32_t order, int32_t shift) {
+    __m256i coef[s_maxLpcOrder]; 
+    for (uint32_t j=0; j<order; ++j) {
+        int32_t c = coefs[j]; 
+        coef[j] = _mm256_set_epi64x(j>=3?c:0, j>=2?c:0, j>=1?c:0, c); 
+    }
+    alignas(32) int64_t part[4]; 
+    uint32_t i = order; 
+    for (; i+4<=length; i+=4) {
+        __m256i sum = _mm256_setzero_si256(); 
+        for (uint32_t j=0; j<order; ++j) {
+            __m256i val = _mm256_cvtepi32_epi64(_mm_loadu_si128((const __m128i*)(data+i-1-j))); 
+            sum = _mm256_add_epi64(sum, _mm256_mul_epi32(coef[j], val)); 
+        }
+        _mm256_store_si256((__m256i*)part, sum); 
+        FinishLpcBlock(data+i, part, coefs, order, shift, 4); 
+    }
+    RestoreLpc64Range(data, i, length, coefs, order, shift); 
+}
+
+#endif
+
+void FlacPredictor::RestoreFixedScalar(int32_t* data, uint32_t length, uint32_t order) {
+    RestoreFixedRange(data, order, length, order); 
+}
+
+void FlacPredictor::RestoreLpc32Scalar(int32_t* data, uint32_t length, const int32_t* coefs, uint32_t order, int32_t shift) {
+    RestoreLpc32Range(data, order, length, coefs, order, shift); 
+}
+
+void FlacPredictor::RestoreLpc64Scalar(int32_t* data, uint32_t length, const int32_t* coefs, uint32_t order, int32_t shift) {
+    RestoreLpc64Range(data, order, length, coefs, order, shift); 
+}
+
+void FlacPredictor::RestoreFixed(int32_t* data, uint32_t length, uint32_t order) {
+    if (order==0||order>4||length<=order) {
+        return; 
+    }
+#ifdef MD_FLACPREDICTOR_X86
+    if (s_isa==ISA_AVX2) {
+        RestoreFixedAvx2(data, length, order); 
+        return; 
+    }
+    if (s_isa==ISA_SSE41) {
+        RestoreFixedSse41(data, length, order); 
+        return; 
+    }
+#endif
+    RestoreFixedScalar(data, length, order); 
+}
+
+void FlacPredictor::RestoreFixed(int64_t* data, uint32_t length, uint32_t order) {
+    // 只有32 bit音频的side声道需要64 bit采样，不做向量化
+    switch (order) {
+    case 1:
+        for (uint32_t i=1; i<length; ++i) {
+            data[i]+=data[i-1]; 
+        }
+        break; 
+    case 2:
+        for (uint32_t i=2; i<length; ++i) {
+            data[i]+=2*data[i-1]-data[i-2]; 
+        }
+        break; 
+    case 3:
+        for (uint32_t i=3; i<length; ++i) {
+            data[i]+=3*(data[i-1]-data[i-2])+data[i-3]; 
+        }
+        break; 
+    case 4:
+        for (uint32_t i=4; i<length; ++i) {
+            data[i]+=4*(data[i-1]+data[i-3])-6*data[i-2]-data[i-4]; 
+        }
+        break; 
+    default:
+        break; 
+    }
+}
+
+void FlacPredictor::RestoreLpc32(int32_t* data, uint32_t length, const int32_t* coefs, uint32_t order, int32_t shift) {
+    if (order==0||order>s_maxLpcOrder||length<=order) {
+        return; 
+    }
+    if (RestoreLpcLowOrder<uint32_t>(data, length, coefs, order, shift)) {
+        return; 
+    }
+#ifdef MD_FLACPREDICTOR_X86
+    if (order>=s_minVectorLpcOrder) {
+        if (s_isa==ISA_AVX2) {
+            RestoreLpc32Avx2(data, length, coefs, order, shift); 
+            return; 
+        }
+        if (s_isa==ISA_SSE41) {
+            RestoreLpc32Sse41(data, length, coefs, order, shift); 
+            return; 
+        }
+    }
+#endif
+    RestoreLpc32Scalar(data, length, coefs, order, shift); 
+}
+
+void FlacPredictor::RestoreLpc64(int32_t* data, uint32_t length, const int32_t* coefs, uint32_t order, int32_t shift) {
+    if (order==0||order>s_maxLpcOrder||length<=order) {
+        return; 
+    }
+    if (RestoreLpcLowOrder<int64_t>(data, length, coefs, order, shift)) {
+        return; 
+    }
+#ifdef MD_FLACPREDICTOR_X86
+    if (order>=s_minVectorLpcOrder) {
+        if (s_isa==ISA_AVX2) {
+            RestoreLpc64Avx2(data, length, coefs, order, shift); 
+            return; 
+        }
+        if (s_isa==ISA_SSE41) {
+            RestoreLpc64Sse41(data, length, coefs, order, shift); 
+            return; 
+        }
+    }
+#endif
+    RestoreLpc64Scalar(data, length, coefs, order, shift); 
+}
+
+void FlacPredictor::RestoreLpc(int32_t* data, uint32_t length, const int32_t* coefs, uint32_t order, int32_t shift, uint32_t precision, uint32_t sampleBits) {
+    if (CanAccumulate32(order, precision, sampleBits)) {
+        RestoreLpc32(data, length, coefs, order, shift); 
+    } else {
+        RestoreLpc64(data, length, coefs, order, shift); 
+    }
+}
+
+void FlacPredictor::RestoreLpc(int64_t* data, uint32_t length, const int32_t* coefs, uint32_t order, int32_t shift, uint32_t /*precision*/, uint32_t /*sampleBits*/) {
+    // 33 bit采样总是64 bit累加，不需要按位数选择
+    for (uint32_t i=order; i<length; ++i) {
+        int64_t sum = 0; 
+        for (uint32_t j=0; j<order; ++j) {
+            sum+=(int64_t)coefs[j]*data[i-1-j]; 
+        }
+        data[i]+=sum>>shift; 
+    }
+}
+
+bool FlacPredictor::CanAccumulate32(uint32_t order, uint32_t precision, uint32_t sampleBits) {
+    // |采样|<2^(sampleBits-1)，|系数|<2^(precision-1)，order项之和不超过2^(sampleBits+precision-2+ceil(log2(order)))
+    uint32_t orderBits = 0; 
+    while ((1u<<orderBits)<order) {
+        ++orderBits; 
+    }
+    return sampleBits+precision+orderBits<=32; 
+}
+
+FlacPredictor::Isa FlacPredictor::GetSupportedIsa() {
+    return s_supportedIsa; 
+}
+
+FlacPredictor::Isa FlacPredictor::GetIsa() {
+    return s_isa; 
+}
+
+void FlacPredictor::SetIsa(Isa isa) {
+    s_isa = isa>s_supportedIsa?s_supportedIsa:isa; 
+}
+
+}
\ No newline at end of file
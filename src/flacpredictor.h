@@ -0,0 +1,96 @@
+#ifndef __MD_FLACPREDICTOR_H_
+#define __MD_FLACPREDICTOR_H_
+
+#include <stdint.h>
+
+namespace music_data {
+
+/**
+ * @brief flac预测恢复：由预热采样与残差恢复FIXED、LPC subframe的采样。
+ *        int32数据按CPU（SSE4.1/AVX2）与阶数在运行时选择实现，各实现与标量版本结果逐位相同
+*/
+class FlacPredictor {
+public: 
+    /**
+     * @brief 可用的指令集
+    */
+    enum Isa {
+        /// @brief 标量
+        ISA_SCALAR = 0, 
+        /// @brief SSE4.1
+        ISA_SSE41 = 1, 
+        /// @brief AVX2
+        ISA_AVX2 = 2
+    }; 
+
+    /**
+     * @brief 恢复FIXED subframe
+     * @param[in,out] data 前order个为预热采样，之后为残差，原地恢复
+     * @param[in] length 采样数
+     * @param[in] order 阶数，0~4
+    */
+    static void RestoreFixed(int32_t* data, uint32_t length, uint32_t order); 
+    static void RestoreFixed(int64_t* data, uint32_t length, uint32_t order); 
+
+    /**
+     * @brief 恢复LPC subframe，累加不会超出32 bit时用32 bit累加，否则用64 bit累加；
+     *        int64_t版本用于33 bit的侧声道，总是64 bit累加，precision与sampleBits不使用
+     * @param[in,out] data 前order个为预热采样，之后为残差，原地恢复
+     * @param[in] length 采样数
+     * @param[in] coefs 系数，coefs[j]对应data[i-1-j]
+     * @param[in] order 阶数，1~32
+     * @param[in] shift 量化位移
+     * @param[in] precision 系数位数
+     * @param[in] sampleBits 采样位数
+    */
+    static void RestoreLpc(int32_t* data, uint32_t length, const int32_t* coefs, uint32_t order, int32_t shift, uint32_t precision, uint32_t sampleBits); 
+    static void RestoreLpc(int64_t* data, uint32_t length, const int32_t* coefs, uint32_t order, int32_t shift, uint32_t precision, uint32_t sampleBits); 
+
+    /**
+     * @brief 恢复LPC subframe，32 bit累加（按32 bit回绕，调用者保证不会溢出）
+    */
+    static void RestoreLpc32(int32_t* data, uint32_t length, const int32_t* coefs, uint32_t order, int32_t shift); 
+
+    /**
+     * @brief 恢复LPC subframe，64 bit累加
+    */
+    static void RestoreLpc64(int32_t* data, uint32_t length, const int32_t* coefs, uint32_t order, int32_t shift); 
+
+    /**
+     * @brief LPC预测值的累加是否一定在32 bit以内
+     * @param[in] order 阶数
+     * @param[in] precision 系数位数
+     * @param[in] sampleBits 采样位数
+     * @retval 是否可以32 bit累加
+    */
+    static bool CanAccumulate32(uint32_t order, uint32_t precision, uint32_t sampleBits); 
+
+    /**
+     * @brief 标量版本，作为其他实现的参照
+    */
+    static void RestoreFixedScalar(int32_t* data, uint32_t length, uint32_t order); 
+    static void RestoreLpc32Scalar(int32_t* data, uint32_t length, const int32_t* coefs, uint32_t order, int32_t shift); 
+    static void RestoreLpc64Scalar(int32_t* data, uint32_t length, const int32_t* coefs, uint32_t order, int32_t shift); 
+
+    /**
+     * @brief 取得CPU支持的指令集
+     * @retval 指令集
+    */
+    static Isa GetSupportedIsa(); 
+
+    /**
+     * @brief 取得当前使用的指令集
+     * @retval 指令集
+    */
+    static Isa GetIsa(); 
+
+    /**
+     * @brief 设置使用的指令集，超出CPU支持时使用CPU支持的指令集（测试与性能对比用）
+     * @param[in] isa 指令集
+    */
+    static void SetIsa(Isa isa); 
+}; 
+
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,120 @@
+#include "flacsnapshot.h"
+#include "log.h"
+
+#include <atomic>
+
+namespace music_data {
+
+INITONLYLOGGER(); 
+
+FlacSnapshot::ptr FlacSnapshot::Create(const wchar_t* file_path) {
+    MusicDecoderflac::ptr decoder = std::make_shared<MusicDecoderflac>(); 
+    if (!decoder->openFile(file_path)||!decoder->isValid()) {
+        LOGE("open flac file fail, create snapshot termination"); 
+        return nullptr; 
+    }
+    return std::make_shared<FlacSnapshot>(PrivateTag(), decoder); 
+}
+
+FlacSnapshot::FlacSnapshot(PrivateTag tag, MusicDecoderflac::ptr decoder, uint64_t version)
+    : m_decoder(decoder)
+    , m_version(version) {
+    // 预先计算并缓存全部block size，之后并发读取时不再写入缓存
+    std::vector<MusicDecoderflac::MetaBlockLayout> layout; 
+    m_decoder->getMetaBlockLayout(layout); 
+}
+
+FlacSnapshot::ptr FlacSnapshot::apply(const FlacEdit& edit) const {
+    if (!edit.isValid()) {
+        LOGE("edit is not valid, apply termination"); 
+        return nullptr; 
+    }
+
+    // 只复制会被原地修改的block：标签修改vorbis comment，替换封面修改picture，其余操作只改变block列表
+    uint32_t cloneMask = 0; 
+    for (auto& op: edit.getOps()) {
+        if (op.type<=FlacEdit::REMOVE_TAG_VALUE) {
+            cloneMask|=1u<<Metadata_block::VORBIS_COMMEN; 
+        } else if (op.type==FlacEdit::SET_COVER) {
+            cloneMask|=1u<<Metadata_block::PICTURE; 
+        }
+    }
+
+    MusicDecoderflac::ptr decoder = m_decoder->fork(cloneMask); 
+    if (decoder==nullptr||!edit.apply(*decoder)) {
+        LOGE("apply edit to snapshot fail"); 
+        return nullptr; 
+    }
+    return std::make_shared<FlacSnapshot>(PrivateTag(), decoder, m_version+1); 
+}
+
+std::string FlacSnapshot::getTag(const std::string& key, uint32_t pos) const {
+    auto vorbis = m_decoder->getVorbisComment(); 
+    if (vorbis==nullptr) {
+        return ""; 
+    }
+    return vorbis->getLabelWithKey(key, pos); 
+}
+
+bool FlacSnapshot::getTagList(const std::string& key, std::vector<std::string>& dest) const {
+    auto vorbis = m_decoder->getVorbisComment(); 
+    if (vorbis==nullptr) {
+        dest.clear(); 
+        return false; 
+    }
+    return vorbis->getLabelListWithKey(key, dest); 
+}
+
+uint32_t FlacSnapshot::getCoverNum() const {
+    std::vector<PictureMetaBlock::ptr> pictures; 
+    m_decoder->getPictures(pictures); 
+    return pictures.size(); 
+}
+
+void FlacSnapshot::getPictures(std::vector<std::shared_ptr<const PictureMetaBlock>>& dest) const {
+    std::vector<PictureMetaBlock::ptr> pictures; 
+    m_decoder->getPictures(pictures); 
+    dest.assign(pictures.begin(), pictures.end()); 
+}
+
+bool FlacSnapshot::resave(const wchar_t* file_path) const {
+    if (m_decoder->getFileName()==file_path) {
+        LOGE("snapshot couldn't overwrite its source file, resave termination"); 
+        return false; 
+    }
+    std::lock_guard<std::mutex> lock(m_saveMutex); 
+    return m_decoder->resave(file_path); 
+}
+
+FlacSnapshotHolder::FlacSnapshotHolder(FlacSnapshot::ptr snapshot)
+    : m_current(snapshot) {
+}
+
+FlacSnapshot::ptr FlacSnapshotHolder::load() const {
+    return std::atomic_load(&m_current); 
+}
+
+void FlacSnapshotHolder::store(FlacSnapshot::ptr snapshot) {
+    std::atomic_store(&m_current, snapshot); 
+}
+
+bool FlacSnapshotHolder::compareExchange(FlacSnapshot::ptr& expected, FlacSnapshot::ptr desired) {
+    return std::atomic_compare_exchange_strong(&m_current, &expected, desired); 
+}
+
+FlacSnapshot::ptr FlacSnapshotHolder::update(const FlacEdit& edit) {
+    FlacSnapshot::ptr current = load(); 
+    while (current!=nullptr) {
+        FlacSnapshot::ptr next = current->apply(edit); 
+        if (next==nullptr) {
+            return nullptr; 
+        }
+        if (compareExchange(current, next)) {
+            return next; 
+        }
+    }
+    LOGE("no snapshot to update"); 
+    return nullptr; 
+}
+
+}
\ No newline at end of file
@@ -0,0 +1,180 @@
+#ifndef __MD_FLACSNAPSHOT_H_
+#define __MD_FLACSNAPSHOT_H_
+
+#include "decoderflac.h"
+#include "flacedit.h"
+#include "noncopyable.h"
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+namespace music_data {
+
+/**
+ * @brief flac metadata的不可变快照：创建后不再修改，多个线程可以不加锁同时读取；
+ *        修改通过apply生成新快照，未修改的block与旧快照共享，修改的block复制一份
+*/
+class FlacSnapshot: Noncopyable {
+public: 
+    typedef std::shared_ptr<const FlacSnapshot> ptr; 
+
+    /**
+     * @brief 打开文件并创建快照
+     * @param[in] file_path 文件路径
+     * @retval 快照，打开或解析失败时为nullptr
+    */
+    static FlacSnapshot::ptr Create(const wchar_t* file_path); 
+
+private: 
+    /**
+     * @brief 限制构造函数只能由Create与apply调用
+    */
+    struct PrivateTag { explicit PrivateTag() = default; }; 
+
+public: 
+    /**
+     * @brief 构造函数，快照接管解码器，只能由Create与apply调用（解码器不被其他地方持有，之后不再修改）
+     * @param[in] tag 私有标记
+     * @param[in] decoder 解码器
+     * @param[in] version 版本号
+    */
+    FlacSnapshot(PrivateTag tag, MusicDecoderflac::ptr decoder, uint64_t version = 0); 
+
+    /**
+     * @brief 应用修改生成新快照，本快照不变
+     * @param[in] edit 修改事务
+     * @retval 新快照，版本号加1；修改失败时为nullptr
+    */
+    FlacSnapshot::ptr apply(const FlacEdit& edit) const; 
+
+    /**
+     * @brief 取得版本号，每次apply加1
+     * @retval 版本号
+    */
+    uint64_t getVersion() const { return m_version; }
+
+    /**
+     * @brief 取得源文件路径
+     * @retval 源文件路径
+    */
+    std::wstring getFileName() const { return m_decoder->getFileName(); }
+
+    /**
+     * @brief 取得标签值
+     * @param[in] key 标签key
+     * @param[in] pos 同一key下的位置
+     * @retval 标签值，不存在时为空字符串
+    */
+    std::string getTag(const std::string& key, uint32_t pos = 0) const; 
+
+    /**
+     * @brief 取得该key下的全部标签值
+     * @param[in] key 标签key
+     * @param[out] dest 标签值
+     * @retval 是否存在
+    */
+    bool getTagList(const std::string& key, std::vector<std::string>& dest) const; 
+
+    std::string getTitle() const { return getTag("TITLE"); }
+    std::string getAlbumArtist() const { return getTag("ALBUMARTIST"); }
+    std::string getAlbum() const { return getTag("ALBUM"); }
+    bool getArtists(std::vector<std::string>& dest) const { return getTagList("ARTIST", dest); }
+
+    /**
+     * @brief 取得封面数量
+     * @retval 封面数量
+    */
+    uint32_t getCoverNum() const; 
+
+    /**
+     * @brief 取得全部封面
+     * @param[out] dest 封面图片
+     * @retval 是否有封面
+    */
+    bool getCovers(std::vector<Image::ptr>& dest) const { return m_decoder->getCovers(dest); }
+
+    /**
+     * @brief 取得stream info block
+     * @retval stream info block
+    */
+    std::shared_ptr<const StreamInfoMetaBlock> getStreamInfo() const { return m_decoder->getStreamInfo(); }
+
+    /**
+     * @brief 取得vorbis comment block
+     * @retval vorbis comment block，没有时为nullptr
+    */
+    std::shared_ptr<const VorbisCommentMetaBlock> getVorbisComment() const { return m_decoder->getVorbisComment(); }
+
+    /**
+     * @brief 取得全部picture block
+     * @param[out] dest picture block
+    */
+    void getPictures(std::vector<std::shared_ptr<const PictureMetaBlock>>& dest) const; 
+
+    /**
+     * @brief 将快照写到另一个文件（不能是源文件，源文件映射被快照共享）
+     * @param[in] file_path 文件路径
+     * @retval 是否成功
+    */
+    bool resave(const wchar_t* file_path) const; 
+
+private: 
+    /// @brief 快照数据，创建后只读
+    MusicDecoderflac::ptr m_decoder; 
+    /// @brief 版本号
+    uint64_t m_version; 
+    /// @brief 写文件时会调整padding block，多个线程同时写出时串行
+    mutable std::mutex m_saveMutex; 
+}; 
+
+/**
+ * @brief 当前快照的发布点：读者取得快照后不加锁读取，写者生成新快照后原子替换
+*/
+class FlacSnapshotHolder: Noncopyable {
+public: 
+    typedef std::shared_ptr<FlacSnapshotHolder> ptr; 
+
+    /**
+     * @brief 构造函数
+     * @param[in] snapshot 初始快照
+    */
+    FlacSnapshotHolder(FlacSnapshot::ptr snapshot = nullptr); 
+
+    /**
+     * @brief 取得当前快照
+     * @retval 当前快照
+    */
+    FlacSnapshot::ptr load() const; 
+
+    /**
+     * @brief 替换当前快照
+     * @param[in] snapshot 新快照
+    */
+    void store(FlacSnapshot::ptr snapshot); 
+
+    /**
+     * @brief 当前快照仍为expected时替换为desired
+     * @param[in,out] expected 期望的当前快照，失败时更新为实际的当前快照
+     * @param[in] desired 新快照
+     * @retval 是否替换
+    */
+    bool compareExchange(FlacSnapshot::ptr& expected, FlacSnapshot::ptr desired); 
+
+    /**
+     * @brief 在当前快照上应用修改并发布，期间被其他写者抢先时在新的当前快照上重试
+     * @param[in] edit 修改事务
+     * @retval 发布的新快照，修改失败时为nullptr
+    */
+    FlacSnapshot::ptr update(const FlacEdit& edit); 
+
+private: 
+    /// @brief 当前快照，只通过std::atomic_load/atomic_store访问
+    FlacSnapshot::ptr m_current; 
+}; 
+
+}
+
+#endif
\ No newline at end of file
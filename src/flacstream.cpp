@@ -0,0 +1,137 @@
+#include "flacstream.h"
+#include "log.h"
+
+#include <string.h>
+#include <algorithm>
+
+namespace music_data {
+
+INITONLYLOGGER(); 
+
+/// @brief 默认缓冲区容量（每声道采样数）
+static const uint32_t s_defaultBufferFrames = 16384; 
+/// @brief flac允许的最大block size
+static const uint32_t s_maxBlockSize = 65535; 
+
+FlacPcmStream::FlacPcmStream(const MusicDecoderflac& decoder, PcmConverter::SampleFormat format, PcmConverter::Dither dither, uint32_t bufferFrames)
+    : m_converter(format, decoder.getStreamInfo()==nullptr?16:decoder.getStreamInfo()->getSampleBits(),
+        decoder.getStreamInfo()==nullptr?0:decoder.getStreamInfo()->getChannels(), dither) {
+    StreamInfoMetaBlock::ptr streamInfo = decoder.getStreamInfo(); 
+    if (streamInfo==nullptr||decoder.getAudioFrames()==nullptr) {
+        LOGE("no audio frames, open pcm stream termination"); 
+        return; 
+    }
+    m_source = decoder.fork(); 
+    if (m_source==nullptr) {
+        LOGE("fork decoder fail, open pcm stream termination"); 
+        return; 
+    }
+
+    m_channels = streamInfo->getChannels(); 
+    m_sampleRate = streamInfo->getSampleRate(); 
+    // 至少能放下一个最大的帧，STREAMINFO中的值不可信时按flac允许的最大值
+    uint32_t maxBlockSize = streamInfo->getMaxBlockSize(); 
+    if (maxBlockSize<16) {
+        maxBlockSize = s_maxBlockSize; 
+    }
+    m_capacity = std::max(bufferFrames==0?s_defaultBufferFrames:bufferFrames, maxBlockSize); 
+    m_ring.resize((size_t)m_capacity*m_channels); 
+    m_channelData.resize(m_channels); 
+    m_block.samples.reserve((size_t)maxBlockSize*m_channels); 
+    m_output.resize((size_t)m_capacity*getFrameBytes()); 
+    m_decoder = std::make_shared<FlacAudioDecoder>(*m_source); 
+}
+
+void FlacPcmStream::append(const FlacPcmBlock& block) {
+    uint32_t tail = (m_head+m_size)%m_capacity; 
+    uint32_t first = std::min(block.blockSize, m_capacity-tail); 
+    for (uint32_t i=0; i<m_channels; ++i) {
+        int32_t* ring = m_ring.data()+(size_t)i*m_capacity; 
+        const int32_t* pin = block.getChannel(i); 
+        memcpy(ring+tail, pin, (size_t)first*sizeof(int32_t)); 
+        memcpy(ring, pin+first, (size_t)(block.blockSize-first)*sizeof(int32_t)); 
+    }
+    m_size+=block.blockSize; 
+}
+
+bool FlacPcmStream::fill() {
+    while (true) {
+        if (!m_pending) {
+            if (m_finished||!m_decoder->decodeNext(m_block)) {
+                m_finished = true; 
+                break; 
+            }
+            if (m_block.channels!=m_channels||m_block.blockSize>m_capacity) {
+                LOGW("frame doesn't match stream info, skip it"); 
+                continue; 
+            }
+            m_pending = true; 
+        }
+        if (m_block.blockSize>m_capacity-m_size) {
+            break; 
+        }
+        append(m_block); 
+        m_pending = false; 
+    }
+    return m_size>0; 
+}
+
+uint32_t FlacPcmStream::read(void* dest, uint32_t frames) {
+    if (m_decoder==nullptr) {
+        return 0; 
+    }
+
+    uint8_t* pout = (uint8_t*)dest; 
+    uint32_t done = 0; 
+    while (done<frames) {
+        if (m_size==0&&!fill()) {
+            break; 
+        }
+        // 环形缓冲区回绕处分两次转换
+        uint32_t num = std::min(std::min(frames-done, m_size), m_capacity-m_head); 
+        for (uint32_t i=0; i<m_channels; ++i) {
+            m_channelData[i] = m_ring.data()+(size_t)i*m_capacity+m_head; 
+        }
+        m_converter.convert(m_channelData.data(), num, pout); 
+        pout+=(size_t)num*getFrameBytes(); 
+        m_head = (m_head+num)%m_capacity; 
+        m_size-=num; 
+        done+=num; 
+    }
+    m_position+=done; 
+    return done; 
+}
+
+bool FlacPcmStream::pump(PcmSink sink) {
+    while (true) {
+        uint32_t frames = read(m_output.data(), m_capacity); 
+        if (frames==0) {
+            return m_finished; 
+        }
+        if (!sink(m_output.data(), frames)) {
+            return false; 
+        }
+    }
+}
+
+bool FlacPcmStream::seek(uint64_t sample) {
+    if (m_source==nullptr) {
+        return false; 
+    }
+    FlacSeekResult result; 
+    if (!m_source->seekToSample(sample, result)||result.block.blockSize>m_capacity) {
+        return false; 
+    }
+
+    m_decoder = result.decoder; 
+    m_head = 0; 
+    m_size = 0; 
+    m_pending = false; 
+    m_finished = false; 
+    append(result.block); 
+    m_position = sample; 
+    m_converter.setPosition(sample); 
+    return true; 
+}
+
+}
\ No newline at end of file
@@ -0,0 +1,141 @@
+#ifndef __MD_FLACSTREAM_H_
+#define __MD_FLACSTREAM_H_
+
+#include "flacdecoder.h"
+#include "pcmconvert.h"
+#include "noncopyable.h"
+
+#include <memory>
+#include <vector>
+#include <functional>
+#include <stdint.h>
+
+namespace music_data {
+
+/**
+ * @brief flac PCM流：逐帧解码到固定大小的环形缓冲区（int32平面排列），读出时转换为交错的目标格式。
+ *        缓冲区在构造时分配，之后读取、推送都不再分配内存，内存占用与文件长度无关
+*/
+class FlacPcmStream: Noncopyable {
+public: 
+    typedef std::shared_ptr<FlacPcmStream> ptr; 
+
+    /**
+     * @brief 推送回调
+     * @param[in] data 交错排列的PCM，回调返回后失效
+     * @param[in] frames 帧数（每帧各声道一个采样）
+     * @retval 是否继续
+    */
+    typedef std::function<bool(const void* data, uint32_t frames)> PcmSink; 
+
+    /**
+     * @brief 构造函数，共享解码器的metadata与源文件映射（fork），之后解码器可以释放
+     * @param[in] decoder flac解码器
+     * @param[in] format 输出格式
+     * @param[in] dither 抖动方式
+     * @param[in] bufferFrames 环形缓冲区容量（每声道采样数），0使用默认值，不小于最大block size
+    */
+    FlacPcmStream(const MusicDecoderflac& decoder, PcmConverter::SampleFormat format,
+        PcmConverter::Dither dither = PcmConverter::DITHER_TRIANGULAR, uint32_t bufferFrames = 0); 
+
+    /**
+     * @brief 是否可以解码
+     * @retval 是否有效
+    */
+    bool isValid() const { return m_decoder!=nullptr; }
+
+    /**
+     * @brief 从缓冲区读出PCM，缓冲区空时解码后续的帧
+     * @param[out] dest 目标，长度至少frames*getFrameBytes()
+     * @param[in] frames 帧数
+     * @retval 读出的帧数，只有到达结尾时才小于frames
+    */
+    uint32_t read(void* dest, uint32_t frames); 
+
+    /**
+     * @brief 把之后的PCM全部推送给回调，每次最多一个缓冲区的量
+     * @param[in] sink 推送回调
+     * @retval 是否推送到结尾，回调中止时为false
+    */
+    bool pump(PcmSink sink); 
+
+    /**
+     * @brief 定位到指定采样，之后从该采样开始读出
+     * @param[in] sample 采样号
+     * @retval 是否成功，失败时位置不变
+    */
+    bool seek(uint64_t sample); 
+
+    /**
+     * @brief 取得下一个读出的采样号
+     * @retval 采样号
+    */
+    uint64_t getPosition() const { return m_position; }
+
+    /**
+     * @brief 取得一帧的输出长度
+     * @retval 长度(byte)
+    */
+    uint32_t getFrameBytes() const { return m_converter.getFrameBytes(); }
+
+    /**
+     * @brief 取得声道数
+     * @retval 声道数
+    */
+    uint32_t getChannels() const { return m_channels; }
+
+    /**
+     * @brief 取得采样率
+     * @retval 采样率(Hz)
+    */
+    uint32_t getSampleRate() const { return m_sampleRate; }
+
+private: 
+    /**
+     * @brief 解码后续的帧填充缓冲区，直到放不下下一帧或到达结尾
+     * @retval 缓冲区中是否有数据
+    */
+    bool fill(); 
+
+    /**
+     * @brief 把帧追加到缓冲区，调用者保证放得下
+     * @param[in] block 帧
+    */
+    void append(const FlacPcmBlock& block); 
+
+private: 
+    /// @brief 共享metadata与源文件映射的解码器，用于定位
+    MusicDecoderflac::ptr m_source; 
+    /// @brief 音频帧解码器
+    FlacAudioDecoder::ptr m_decoder; 
+    /// @brief 格式转换
+    PcmConverter m_converter; 
+    /// @brief 声道数
+    uint32_t m_channels = 0; 
+    /// @brief 采样率
+    uint32_t m_sampleRate = 0; 
+    /// @brief 环形缓冲区，声道c位于[c*m_capacity, (c+1)*m_capacity)
+    std::vector<int32_t> m_ring; 
+    /// @brief 缓冲区容量（每声道采样数）
+    uint32_t m_capacity = 0; 
+    /// @brief 缓冲区中第一个采样的位置
+    uint32_t m_head = 0; 
+    /// @brief 缓冲区中的采样数（每声道）
+    uint32_t m_size = 0; 
+    /// @brief 转换时各声道的起点
+    std::vector<const int32_t*> m_channelData; 
+    /// @brief 解码用的帧，缓冲区放不下时暂存在这里
+    FlacPcmBlock m_block; 
+    /// @brief m_block中是否有未放入缓冲区的帧
+    bool m_pending = false; 
+    /// @brief 是否已解码到结尾
+    bool m_finished = false; 
+    /// @brief 下一个读出的采样号
+    uint64_t m_position = 0; 
+    /// @brief 推送用的输出缓冲区
+    std::vector<uint8_t> m_output; 
+}; 
+
+}
+
+#endif
\ No newline at end of file
@@ -1,10 +1,12 @@
 #include "image.h"
 #include "log.h"
 #include "utils.h"
+#include "mappedfile.h"
 
 #include <Windows.h>
 #include <string>
 #include <functional>
+#include <vector>
 
 namespace music_data {
 
@@ -54,6 +56,38 @@ Image::ptr Image::TryCreateImage(void* data, size_t length, const std::string& m
     return nullptr; 
 }
 
+ImageType Image::ProbeImageType(const void* data, size_t length) {
+    if (PngImage::IsPng(data, length)) {
+        return PNG; 
+    }
+    if (JpegImage::IsJpeg(data, length)) {
+        return JPEG; 
+    }
+    return UNKNOW; 
+}
+
+std::wstring Image::CheckSuffix(const wchar_t* path, ImageType type) {
+    std::wstring tmp_s(path); 
+    if (s_suffixStr.find(type)==s_suffixStr.end()) {
+        return tmp_s; 
+    }
+
+    const std::wstring& expected = s_suffixStr.at(type); 
+    size_t dot_pos = tmp_s.find_last_of(L"."); 
+    if (dot_pos!=std::wstring::npos) {
+        std::wstring suffix = tmp_s.substr(dot_pos); 
+        if (suffix!=expected&&!(type==JPEG&&suffix==L".jpg")) {
+            tmp_s = tmp_s.substr(0, dot_pos) + expected; 
+            LOGI("suffix \"%ls\" is adjusted", expected.c_str()); 
+        }
+    } else {
+        tmp_s+=expected; 
+        LOGI("suffix \"%ls\" is added", expected.c_str()); 
+    }
+
+    return tmp_s; 
+}
+
 Image::Image() {
 }
 
@@ -141,30 +175,14 @@ bool Image::resave(const wchar_t* path, bool ifCheckSuffix) const {
         sfile = std::wstring(path); 
     }
 
-    HANDLE hFile = CreateFileW(sfile.c_str(), GENERIC_READ|GENERIC_WRITE, FILE_SHARE_READ, NULL, OPEN_ALWAYS, 0, NULL);	
-    if (hFile==INVALID_HANDLE_VALUE) {
-        LOGE("file not exists, and create file fail \n"); 
-        return false; 
-    }
-
-    bool ifSuccess = true; 
-
-    //成功写入的数据大小
-    DWORD dwWritedDateSize;
-    
+    // 写临时文件后替换目标文件，写入中途失败不会留下不完整的图片
     size_t dataSize = m_data.getSize(); 
-    void* metaPin = malloc(dataSize); 
-    m_data.getDataBuffers(metaPin, dataSize); 
-    SetFilePointer(hFile,0,0,FILE_BEGIN);
-    if(!WriteFile(hFile, metaPin, dataSize, &dwWritedDateSize,NULL)) {
-        LOGE("write metadata fail: %d\n", GetLastError()); 
-        ifSuccess = false; 
+    std::vector<uint8_t> buf(dataSize); 
+    m_data.getDataBuffers(buf.data(), dataSize); 
+    bool ifSuccess = WriteDataToFile(sfile.c_str(), buf.data(), dataSize); 
+    if (ifSuccess) {
+        LOGD("write image successfully, %lld byte written", (long long)dataSize); 
     }
-    
-    SetEndOfFile(hFile); 
- 
-    CloseHandle(hFile); 
-    LOGD("write metadata successfully, %d byte written。\n", dwWritedDateSize);
 
     return ifSuccess; 
 }
@@ -199,7 +217,7 @@ PngImage::~PngImage(){
 }
 
 void PngImage::initImage(void* data, size_t length) {
-    bool isPngRes = isPng(data); 
+    bool isPngRes = IsPng(data, length); 
     if (!isPngRes) {
         setIsValid(false); 
         LOGE("not png!"); 
@@ -222,21 +240,7 @@ void PngImage::initImage(void* data, size_t length) {
 }
 
 std::wstring PngImage::checkSuffix(const wchar_t* path) const {
-    std::wstring tmp_s(path); 
-    size_t t_size = tmp_s.size(); 
-    size_t dot_pos = tmp_s.find_last_of(L"."); 
-    if (dot_pos!=std::wstring::npos) {
-        std::wstring suffix = tmp_s.substr(dot_pos, t_size-dot_pos); 
-        if (suffix!=L".png") {
-            tmp_s = tmp_s.substr(0, dot_pos) + L".png"; 
-            LOGI("suffix \".png\" is adjusted"); 
-        }
-    } else {
-        tmp_s+=L".png"; 
-        LOGI("suffix \".png\" is added"); 
-    }
-
-    return tmp_s; 
+    return CheckSuffix(path, PNG); 
 }
 
 JpegImage::JpegImage(void* data, size_t length) {
@@ -267,7 +271,7 @@ JpegImage::~JpegImage(){
 }
 
 void JpegImage::initImage(void* data, size_t length) {
-    bool isJpegRes = isJpeg(data); 
+    bool isJpegRes = IsJpeg(data, length); 
     if (!isJpegRes) {
         setIsValid(false); 
         LOGE("not jpeg!"); 
@@ -306,21 +310,7 @@ void JpegImage::initImage(void* data, size_t length) {
 }
 
 std::wstring JpegImage::checkSuffix(const wchar_t* path) const {
-    std::wstring tmp_s(path); 
-    size_t t_size = tmp_s.size(); 
-    size_t dot_pos = tmp_s.find_last_of(L"."); 
-    if (dot_pos!=std::wstring::npos) {
-        std::wstring suffix = tmp_s.substr(dot_pos, t_size-dot_pos); 
-        if (suffix!=L".jpeg"&&suffix!=L".jpg") {
-            tmp_s = tmp_s.substr(0, dot_pos) + L".jpeg"; 
-            LOGI("suffix \".jpeg\" is adjusted"); 
-        }
-    } else {
-        tmp_s+=L".jpeg"; 
-        LOGI("suffix \".png\" is added"); 
-    }
-
-    return tmp_s; 
+    return CheckSuffix(path, JPEG); 
 }
 
 }
\ No newline at end of file
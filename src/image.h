@@ -34,6 +34,12 @@ static const std::unordered_map<ImageType, std::string, EnumClassHash> s_mimeStr
     {JPEG, "image/jpeg"} 
 }; 
 
+// image type对应的文件后缀
+static const std::unordered_map<ImageType, std::wstring, EnumClassHash> s_suffixStr = {
+    {PNG, L".png"},
+    {JPEG, L".jpeg"} 
+}; 
+
 /**
  * @brief 图像数据（能用就行，功能不多）
 */
@@ -57,6 +63,22 @@ public:
     */
     static std::string getMimeTyepFromImageType(ImageType type) { return s_mimeStr.at(type); }
 
+    /**
+     * @brief 只根据文件头判断图片类型，不解析也不复制图片数据
+     * @param[in] data 源数据
+     * @param[in] length 数据长度
+     * @retval 图片类型，无法识别返回UNKNOW
+    */
+    static ImageType ProbeImageType(const void* data, size_t length); 
+
+    /**
+     * @brief 按图片类型添加或修改路径后缀（jpeg也接受.jpg），各图片类的checkSuffix都由此实现
+     * @param[in] path 路径字符串
+     * @param[in] type 图片类型，UNKNOW时不修改
+     * @retval 检验后结果
+    */
+    static std::wstring CheckSuffix(const wchar_t* path, ImageType type); 
+
     /**
      * @brief 构造函数
     */
@@ -223,8 +245,15 @@ public:
     virtual void initImage(void* data, size_t length) override; 
     virtual std::wstring checkSuffix(const wchar_t* path) const override; 
 
-private: 
-    bool isPng(void* label) const { return memcmp(label, s_png_label, 8)==0; }
+    /**
+     * @brief 根据文件头判断是否为png
+     * @param[in] data 源数据
+     * @param[in] length 数据长度
+     * @retval 是否为png
+    */
+    static bool IsPng(const void* data, size_t length) {
+        return data!=nullptr&&length>=sizeof(s_png_label)&&memcmp(data, s_png_label, sizeof(s_png_label))==0; 
+    }
 
 private: 
     /// @brief png文件标识
@@ -267,8 +296,15 @@ public:
     virtual void initImage(void* data, size_t length) override; 
     virtual std::wstring checkSuffix(const wchar_t* path) const override; 
 
-private: 
-    bool isJpeg(void* label) const { return memcmp(label, s_jpeg_label, 2)==0; }; 
+    /**
+     * @brief 根据文件头判断是否为jpeg
+     * @param[in] data 源数据
+     * @param[in] length 数据长度
+     * @retval 是否为jpeg
+    */
+    static bool IsJpeg(const void* data, size_t length) {
+        return data!=nullptr&&length>=sizeof(s_jpeg_label)&&memcmp(data, s_jpeg_label, sizeof(s_jpeg_label))==0; 
+    }
 
 private: 
     /// @brief png文件标识
@@ -0,0 +1,433 @@
+#include "mappedfile.h"
+#include "log.h"
+
+#include <fileapi.h>
+#include <Windows.h>
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <string.h>
+
+namespace music_data {
+
+INITONLYLOGGER(); 
+
+MappedFile::MappedFile() {
+}
+
+MappedFile::MappedFile(const wchar_t* file_path) {
+    open(file_path); 
+}
+
+MappedFile::~MappedFile() {
+    close(); 
+}
+
+bool MappedFile::Exists(const wchar_t* file_path) {
+    DWORD attributes = GetFileAttributesW(file_path); 
+    return attributes!=INVALID_FILE_ATTRIBUTES&&(attributes&FILE_ATTRIBUTE_DIRECTORY)==0; 
+}
+
+bool MappedFile::open(const wchar_t* file_path) {
+    close(); 
+
+    // 允许其他进程读取与重命名，保存时可以用临时文件替换
+    HANDLE hFile = CreateFileW(file_path, GENERIC_READ, FILE_SHARE_READ|FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL); 
+    if (hFile==INVALID_HANDLE_VALUE) {
+        LOGE("file not exists \n"); 
+        return false; 
+    }
+
+    LARGE_INTEGER fileSize; 
+    if (!GetFileSizeEx(hFile, &fileSize)||fileSize.QuadPart==0) {
+        LOGE("get file size fail or file is empty \n"); 
+        CloseHandle(hFile); 
+        return false; 
+    }
+
+    HANDLE hFileMapping = CreateFileMappingW(hFile, NULL, PAGE_READONLY, 0, 0, NULL); 
+    if (hFileMapping==NULL||hFileMapping==INVALID_HANDLE_VALUE) {
+        LOGE("CreateFileMappingW fail \n"); 
+        CloseHandle(hFile); 
+        return false; 
+    }
+
+    LPVOID hViewOfFile = MapViewOfFile(hFileMapping, FILE_MAP_READ, 0, 0, 0); 
+    if (hViewOfFile==NULL) {
+        LOGE("MapViewOfFile fail \n"); 
+        CloseHandle(hFileMapping); 
+        CloseHandle(hFile); 
+        return false; 
+    }
+
+    m_path = std::wstring(file_path); 
+    m_hFile = hFile; 
+    m_hFileMapping = hFileMapping; 
+    m_data = (const uint8_t*)hViewOfFile; 
+    m_size = (size_t)fileSize.QuadPart; 
+
+    LOGD("map file successfully, %lld byte mapped", (long long)m_size); 
+
+    return true; 
+}
+
+bool MappedFile::reopen() {
+    std::wstring path = m_path; 
+    if (path.empty()) {
+        LOGE("reopen fail, no file path"); 
+        return false; 
+    }
+    return open(path.c_str()); 
+}
+
+bool MappedFile::exportRange(uint64_t offset, uint64_t length, const wchar_t* file_path) const {
+    if (!contains(offset, length)) {
+        LOGE("exportRange fail, range out of file"); 
+        return false; 
+    }
+    // 直接从映射写出，数据由系统从页缓存复制到目标文件
+    return WriteDataToFile(file_path, m_data+offset, length); 
+}
+
+void MappedFile::close() {
+    if (m_data!=nullptr) {
+        UnmapViewOfFile((LPVOID)m_data); 
+        m_data = nullptr; 
+    }
+    if (m_hFileMapping!=nullptr) {
+        CloseHandle(m_hFileMapping); 
+        m_hFileMapping = nullptr; 
+    }
+    if (m_hFile!=nullptr) {
+        CloseHandle(m_hFile); 
+        m_hFile = nullptr; 
+    }
+    m_size = 0; 
+}
+
+/// @brief 临时文件序号，同一进程中并行保存同一目录的文件时避免重名
+static std::atomic<uint32_t> s_tempFileIndex(0); 
+/// @brief 覆盖写入日志的标记
+static const char s_journalLabel[4] = {'F', 'W', 'J', '1'}; 
+/// @brief 日志头长度：标记与写入前的文件大小
+static const size_t s_journalHeaderSize = 4+8; 
+/// @brief 日志中每段记录头长度：偏移与长度
+static const size_t s_journalRecordSize = 8+4; 
+
+FileWriter::FileWriter(const wchar_t* file_path, Mode mode)
+    : m_path(file_path)
+    , m_mode(mode) {
+    if (m_mode==REPLACE) {
+        // 临时文件与目标文件在同一目录（同一卷），重命名才是原子的
+        m_tempPath = m_path+L"."+std::to_wstring(GetCurrentProcessId())+L"_"+std::to_wstring(s_tempFileIndex++)+L".tmp"; 
+    }
+}
+
+FileWriter::~FileWriter() {
+    abort(); 
+}
+
+bool FileWriter::write(const std::vector<WriteSegment>& segments) {
+    if (m_isFailed||m_isFinished) {
+        return false; 
+    }
+    if (m_hFile==nullptr) {
+        // 覆盖写入需要先读出原数据写入日志
+        HANDLE hFile = m_mode==REPLACE
+            ?CreateFileW(m_tempPath.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_FLAG_SEQUENTIAL_SCAN, NULL)
+            :CreateFileW(m_path.c_str(), GENERIC_READ|GENERIC_WRITE, 0, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL); 
+        if (hFile==INVALID_HANDLE_VALUE) {
+            LOGE("open file for write fail: %d", GetLastError()); 
+            m_isFailed = true; 
+            return false; 
+        }
+        m_hFile = hFile; 
+    }
+
+    if (m_mode==OVERWRITE) {
+        uint64_t length = 0; 
+        for (auto& item: segments) {
+            length+=item.length; 
+        }
+        LARGE_INTEGER zero, current; 
+        zero.QuadPart = 0; 
+        if (!SetFilePointerEx(m_hFile, zero, &current, FILE_CURRENT)||!backup(current.QuadPart, length)) {
+            m_isFailed = true; 
+            return false; 
+        }
+    }
+
+    // WriteFile单次长度为32 bit，按块写出
+    static const uint64_t s_maxWriteSize = 1<<30; 
+    for (auto& item: segments) {
+        const uint8_t* pin = (const uint8_t*)item.data; 
+        uint64_t length = item.length; 
+        while (length>0) {
+            DWORD toWrite = (DWORD)std::min<uint64_t>(length, s_maxWriteSize); 
+            DWORD written = 0; 
+            if (!WriteFile(m_hFile, pin, toWrite, &written, NULL)||written!=toWrite) {
+                LOGE("write file fail: %d", GetLastError()); 
+                m_isFailed = true; 
+                return false; 
+            }
+            pin+=written; 
+            length-=written; 
+        }
+    }
+    m_isFlushed = false; 
+    return true; 
+}
+
+bool FileWriter::writeAt(uint64_t offset, const void* data, uint32_t length) {
+    if (m_isFailed||m_hFile==nullptr) {
+        return false; 
+    }
+    if (m_mode==OVERWRITE&&!backup(offset, length)) {
+        m_isFailed = true; 
+        return false; 
+    }
+    // 同步句柄上按OVERLAPPED指定位置写入会移动文件指针，写完后恢复
+    LARGE_INTEGER zero, current; 
+    zero.QuadPart = 0; 
+    if (!SetFilePointerEx(m_hFile, zero, &current, FILE_CURRENT)) {
+        LOGE("get file pointer fail: %d", GetLastError()); 
+        m_isFailed = true; 
+        return false; 
+    }
+    OVERLAPPED overlapped; 
+    memset(&overlapped, 0, sizeof(overlapped)); 
+    overlapped.Offset = (DWORD)offset; 
+    overlapped.OffsetHigh = (DWORD)(offset>>32); 
+    DWORD written = 0; 
+    if (!WriteFile(m_hFile, data, length, &written, &overlapped)||written!=length
+        ||!SetFilePointerEx(m_hFile, current, NULL, FILE_BEGIN)) {
+        LOGE("write file at offset fail: %d", GetLastError()); 
+        m_isFailed = true; 
+        return false; 
+    }
+    m_isFlushed = false; 
+    return true; 
+}
+
+bool FileWriter::flush() {
+    if (m_isFailed||m_hFile==nullptr) {
+        return false; 
+    }
+    if (!m_isFlushed) {
+        if (!FlushFileBuffers(m_hFile)) {
+            LOGE("flush file fail: %d", GetLastError()); 
+            m_isFailed = true; 
+            return false; 
+        }
+        m_isFlushed = true; 
+    }
+    return true; 
+}
+
+bool FileWriter::finish() {
+    if (!flush()) {
+        return false; 
+    }
+    CloseHandle(m_hFile); 
+    m_hFile = nullptr; 
+    m_isFinished = true; 
+    return true; 
+}
+
+bool FileWriter::commit() {
+    if (!m_isFinished&&!finish()) {
+        abort(); 
+        return false; 
+    }
+    m_isFinished = false; 
+
+    if (m_mode==REPLACE) {
+        // WRITE_THROUGH保证重命名本身落盘后才返回
+        if (!MoveFileExW(m_tempPath.c_str(), m_path.c_str(), MOVEFILE_REPLACE_EXISTING|MOVEFILE_WRITE_THROUGH)) {
+            LOGE("replace file fail: %d", GetLastError()); 
+            abort(); 
+            return false; 
+        }
+        m_tempPath.clear(); 
+    } else if (!m_journal.empty()) {
+        // 新数据已落盘，删除日志后写入才算完成；删除失败时恢复原数据，避免之后打开时被回退
+        if (!DeleteFileW(GetJournalPath(m_path).c_str())) {
+            LOGE("delete journal fail: %d", GetLastError()); 
+            abort(); 
+            return false; 
+        }
+        m_journal.clear(); 
+    }
+    return true; 
+}
+
+void FileWriter::abort() {
+    if (m_hFile!=nullptr) {
+        CloseHandle(m_hFile); 
+        m_hFile = nullptr; 
+    }
+    if (!m_tempPath.empty()) {
+        DeleteFileW(m_tempPath.c_str()); 
+        m_tempPath.clear(); 
+    }
+    if (!m_journal.empty()) {
+        Recover(m_path.c_str()); 
+        m_journal.clear(); 
+    }
+    m_isFinished = false; 
+    m_isFailed = true; 
+}
+
+bool FileWriter::backup(uint64_t offset, uint64_t length) {
+    if (m_journal.empty()) {
+        LARGE_INTEGER fileSize; 
+        if (!GetFileSizeEx(m_hFile, &fileSize)) {
+            LOGE("get file size fail: %d", GetLastError()); 
+            return false; 
+        }
+        m_originalSize = fileSize.QuadPart; 
+        m_journal.resize(s_journalHeaderSize); 
+        memcpy(m_journal.data(), s_journalLabel, 4); 
+        memcpy(m_journal.data()+4, &m_originalSize, 8); 
+    }
+
+    // 只需记录写入前就有的数据，超出部分恢复时截断
+    if (offset>=m_originalSize||length==0) {
+        return true; 
+    }
+    length = std::min(length, m_originalSize-offset); 
+    if (length>UINT32_MAX-s_journalRecordSize-m_journal.size()) {
+        LOGE("overwrite range too large for journal"); 
+        return false; 
+    }
+
+    // 同步句柄上按OVERLAPPED指定位置读取会移动文件指针，读完后恢复
+    LARGE_INTEGER zero, current; 
+    zero.QuadPart = 0; 
+    if (!SetFilePointerEx(m_hFile, zero, &current, FILE_CURRENT)) {
+        LOGE("get file pointer fail: %d", GetLastError()); 
+        return false; 
+    }
+    size_t recordBegin = m_journal.size(); 
+    uint32_t recordLength = (uint32_t)length; 
+    m_journal.resize(recordBegin+s_journalRecordSize+recordLength); 
+    memcpy(m_journal.data()+recordBegin, &offset, 8); 
+    memcpy(m_journal.data()+recordBegin+8, &recordLength, 4); 
+    OVERLAPPED overlapped; 
+    memset(&overlapped, 0, sizeof(overlapped)); 
+    overlapped.Offset = (DWORD)offset; 
+    overlapped.OffsetHigh = (DWORD)(offset>>32); 
+    DWORD read = 0; 
+    if (!ReadFile(m_hFile, m_journal.data()+recordBegin+s_journalRecordSize, recordLength, &read, &overlapped)||read!=recordLength
+        ||!SetFilePointerEx(m_hFile, current, NULL, FILE_BEGIN)) {
+        LOGE("read original data fail: %d", GetLastError()); 
+        m_journal.resize(recordBegin); 
+        return false; 
+    }
+
+    // 日志本身也是写临时文件后替换，磁盘上的日志总是完整的
+    FileWriter journal(GetJournalPath(m_path).c_str(), REPLACE); 
+    std::vector<WriteSegment> segments(1, WriteSegment{m_journal.data(), m_journal.size()}); 
+    if (!journal.write(segments)||!journal.commit()) {
+        LOGE("write journal fail"); 
+        m_journal.resize(recordBegin); 
+        return false; 
+    }
+    return true; 
+}
+
+bool FileWriter::Recover(const wchar_t* file_path) {
+    std::wstring journalPath = GetJournalPath(file_path); 
+    HANDLE hJournal = CreateFileW(journalPath.c_str(), GENERIC_READ, 0, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL); 
+    if (hJournal==INVALID_HANDLE_VALUE) {
+        // 没有未完成的覆盖写入
+        return true; 
+    }
+
+    std::vector<uint8_t> journal; 
+    LARGE_INTEGER journalSize; 
+    DWORD read = 0; 
+    bool isValid = GetFileSizeEx(hJournal, &journalSize)&&(uint64_t)journalSize.QuadPart>=s_journalHeaderSize&&(uint64_t)journalSize.QuadPart<=UINT32_MAX; 
+    if (isValid) {
+        journal.resize(journalSize.QuadPart); 
+        isValid = ReadFile(hJournal, journal.data(), journal.size(), &read, NULL)&&read==journal.size()
+            &&memcmp(journal.data(), s_journalLabel, 4)==0; 
+    }
+    CloseHandle(hJournal); 
+    if (!isValid) {
+        LOGE("invalid journal, recover termination"); 
+        return false; 
+    }
+
+    // 逐段检查长度，之后按记录的逆序写回：同一位置被多次覆盖时最早记录的才是原数据
+    uint64_t originalSize = 0; 
+    memcpy(&originalSize, journal.data()+4, 8); 
+    std::vector<size_t> records; 
+    for (size_t pos=s_journalHeaderSize; pos<journal.size(); ) {
+        uint64_t offset = 0; 
+        uint32_t length = 0; 
+        if (journal.size()-pos<s_journalRecordSize) {
+            isValid = false; 
+            break; 
+        }
+        memcpy(&offset, journal.data()+pos, 8); 
+        memcpy(&length, journal.data()+pos+8, 4); 
+        if (journal.size()-pos-s_journalRecordSize<length||offset>originalSize||originalSize-offset<length) {
+            isValid = false; 
+            break; 
+        }
+        records.emplace_back(pos); 
+        pos+=s_journalRecordSize+length; 
+    }
+    if (!isValid) {
+        LOGE("invalid journal record, recover termination"); 
+        return false; 
+    }
+
+    HANDLE hFile = CreateFileW(file_path, GENERIC_WRITE, 0, NULL, OPEN_EXISTING, 0, NULL); 
+    if (hFile==INVALID_HANDLE_VALUE) {
+        LOGE("open file for recover fail: %d", GetLastError()); 
+        return false; 
+    }
+    bool ifSuccess = true; 
+    for (auto it=records.rbegin(); it!=records.rend()&&ifSuccess; ++it) {
+        uint64_t offset = 0; 
+        uint32_t length = 0; 
+        memcpy(&offset, journal.data()+*it, 8); 
+        memcpy(&length, journal.data()+*it+8, 4); 
+        OVERLAPPED overlapped; 
+        memset(&overlapped, 0, sizeof(overlapped)); 
+        overlapped.Offset = (DWORD)offset; 
+        overlapped.OffsetHigh = (DWORD)(offset>>32); 
+        DWORD written = 0; 
+        ifSuccess = WriteFile(hFile, journal.data()+*it+s_journalRecordSize, length, &written, &overlapped)&&written==length; 
+    }
+    // 覆盖写入时追加的部分截断
+    LARGE_INTEGER size; 
+    size.QuadPart = originalSize; 
+    ifSuccess = ifSuccess&&SetFilePointerEx(hFile, size, NULL, FILE_BEGIN)&&SetEndOfFile(hFile)&&FlushFileBuffers(hFile); 
+    CloseHandle(hFile); 
+    if (!ifSuccess) {
+        LOGE("restore file from journal fail: %d", GetLastError()); 
+        return false; 
+    }
+
+    if (!DeleteFileW(journalPath.c_str())) {
+        LOGE("delete journal fail: %d", GetLastError()); 
+        return false; 
+    }
+    LOGW("interrupted overwrite rolled back from journal"); 
+    return true; 
+}
+
+bool WriteSegmentsToFile(const wchar_t* file_path, const std::vector<WriteSegment>& segments, bool ifTruncate) {
+    FileWriter writer(file_path, ifTruncate?FileWriter::REPLACE:FileWriter::OVERWRITE); 
+    return writer.write(segments)&&writer.commit(); 
+}
+
+bool WriteDataToFile(const wchar_t* file_path, const void* data, uint64_t length, bool ifTruncate) {
+    std::vector<WriteSegment> segments(1, WriteSegment{data, length}); 
+    return WriteSegmentsToFile(file_path, segments, ifTruncate); 
+}
+
+}
\ No newline at end of file
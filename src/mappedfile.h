@@ -0,0 +1,279 @@
+#ifndef __MD_MAPPEDFILE_H_
+#define __MD_MAPPEDFILE_H_
+
+#include "noncopyable.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+namespace music_data {
+
+/**
+ * @brief 只读文件映射，解码器在整个生命周期内持有，需要时再从映射中取数据
+*/
+class MappedFile: Noncopyable {
+public: 
+    typedef std::shared_ptr<MappedFile> ptr; 
+
+    /**
+     * @brief 默认构造函数
+    */
+    MappedFile(); 
+
+    /**
+     * @brief 带路径参数构造函数
+     * @param[in] file_path 文件路径
+    */
+    MappedFile(const wchar_t* file_path); 
+
+    /**
+     * @brief 析构函数，自动解除映射
+    */
+    ~MappedFile(); 
+
+    /**
+     * @brief 打开并映射文件，已打开的映射会先关闭
+     * @param[in] file_path 文件路径
+     * @retval 是否成功
+    */
+    bool open(const wchar_t* file_path); 
+
+    /**
+     * @brief 文件是否存在（不是目录）
+     * @param[in] file_path 文件路径
+     * @retval 是否存在
+    */
+    static bool Exists(const wchar_t* file_path); 
+
+    /**
+     * @brief 重新映射当前路径的文件（文件被改写后使用）
+     * @retval 是否成功
+    */
+    bool reopen(); 
+
+    /**
+     * @brief 解除映射并关闭文件
+    */
+    void close(); 
+
+    /**
+     * @brief 是否已映射
+     * @retval 是否已映射
+    */
+    bool isOpen() const { return m_data!=nullptr; }
+
+    /**
+     * @brief 取得映射数据首地址
+     * @retval 映射数据首地址，未映射时为nullptr
+    */
+    const uint8_t* getData() const { return m_data; }
+
+    /**
+     * @brief 取得映射数据长度
+     * @retval 映射数据长度(byte)
+    */
+    size_t getSize() const { return m_size; }
+
+    /**
+     * @brief 取得文件路径
+     * @retval 文件路径wstring
+    */
+    std::wstring getPath() const { return m_path; }
+
+    /**
+     * @brief 判断指定区间是否在映射范围内
+     * @param[in] offset 区间起点
+     * @param[in] length 区间长度
+     * @retval 是否在映射范围内
+    */
+    bool contains(uint64_t offset, uint64_t length) const { return m_data!=nullptr&&offset<=m_size&&length<=m_size-offset; }
+
+    /**
+     * @brief 将映射中的一段数据直接写到新文件，不经过额外的用户态缓冲
+     * @param[in] offset 区间起点
+     * @param[in] length 区间长度
+     * @param[in] file_path 目标文件路径，已存在则覆盖
+     * @retval 是否成功
+    */
+    bool exportRange(uint64_t offset, uint64_t length, const wchar_t* file_path) const; 
+
+private: 
+    /// @brief 文件路径
+    std::wstring m_path = L""; 
+    /// @brief 文件句柄
+    void* m_hFile = nullptr; 
+    /// @brief 文件映射句柄
+    void* m_hFileMapping = nullptr; 
+    /// @brief 映射数据首地址
+    const uint8_t* m_data = nullptr; 
+    /// @brief 映射数据长度
+    size_t m_size = 0; 
+}; 
+
+/**
+ * @brief 待写出的一段连续数据
+*/
+struct WriteSegment {
+    /// @brief 数据指针
+    const void* data; 
+    /// @brief 数据长度
+    uint64_t length; 
+}; 
+
+/**
+ * @brief 文件写入器，写入、刷盘与提交分开进行，批量保存时可以先写出全部文件再统一刷盘；
+ *        两种写入方式在中途失败或崩溃后都能回到写入前的文件内容
+*/
+class FileWriter: Noncopyable {
+public: 
+    typedef std::shared_ptr<FileWriter> ptr; 
+
+    /**
+     * @brief 写入方式
+    */
+    enum Mode {
+        /// @brief 写到同目录的临时文件，提交时一次重命名替换目标文件，中途失败或崩溃不影响原文件
+        REPLACE = 0, 
+        /// @brief 从已存在文件的开头覆盖写入，保留其后的数据；覆盖前先把原数据写入同目录的日志文件，
+        ///        提交后删除日志，放弃写入或崩溃后由日志恢复（见Recover）
+        OVERWRITE = 1
+    }; 
+
+    /**
+     * @brief 构造函数
+     * @param[in] file_path 目标文件路径
+     * @param[in] mode 写入方式
+    */
+    FileWriter(const wchar_t* file_path, Mode mode = REPLACE); 
+
+    /**
+     * @brief 析构函数，未提交时放弃写入并删除临时文件
+    */
+    ~FileWriter(); 
+
+    /**
+     * @brief 依次写出若干段数据，可多次调用
+     * @param[in] segments 数据段，按顺序写出
+     * @retval 是否写入成功
+    */
+    bool write(const std::vector<WriteSegment>& segments); 
+
+    /**
+     * @brief 在指定位置写入数据（如回填文件头），不改变之后write的写入位置；须在write之后调用
+     * @param[in] offset 写入位置，相对文件开头
+     * @param[in] data 数据指针
+     * @param[in] length 数据长度
+     * @retval 是否写入成功
+    */
+    bool writeAt(uint64_t offset, const void* data, uint32_t length); 
+
+    /**
+     * @brief 将已写入的数据刷到磁盘
+     * @retval 是否成功
+    */
+    bool flush(); 
+
+    /**
+     * @brief 结束写入：刷盘并关闭文件，之后不能再写入；REPLACE方式的临时文件仍归写入器所有，
+     *        可以按getTempPath读取（如校验），再commit替换或abort删除
+     * @retval 是否成功
+    */
+    bool finish(); 
+
+    /**
+     * @brief 提交：未结束写入时先结束写入，REPLACE方式再用临时文件替换目标文件
+     * @retval 是否成功，失败时目标文件保持不变（OVERWRITE方式除外）
+    */
+    bool commit(); 
+
+    /**
+     * @brief 放弃写入，关闭文件并删除临时文件；OVERWRITE方式用日志恢复被覆盖的数据
+    */
+    void abort(); 
+
+    /**
+     * @brief 文件有未完成的OVERWRITE写入（日志文件还在）时，用日志恢复写入前的数据并删除日志；打开文件前调用
+     * @param[in] file_path 文件路径
+     * @retval 是否成功，没有日志时为true
+    */
+    static bool Recover(const wchar_t* file_path); 
+
+    /**
+     * @brief 取得目标文件路径
+     * @retval 目标文件路径
+    */
+    std::wstring getPath() const { return m_path; }
+
+    /**
+     * @brief 取得写入方式
+     * @retval 写入方式
+    */
+    Mode getMode() const { return m_mode; }
+
+    /**
+     * @brief 取得临时文件路径
+     * @retval 临时文件路径，OVERWRITE方式、已提交或已放弃时为空
+    */
+    std::wstring getTempPath() const { return m_tempPath; }
+
+private: 
+    /**
+     * @brief OVERWRITE方式覆盖前，把[offset, offset+length)中写入前就有的数据追加到日志，并将日志整体替换写入磁盘
+     * @param[in] offset 覆盖位置，相对文件开头
+     * @param[in] length 覆盖长度
+     * @retval 是否成功
+    */
+    bool backup(uint64_t offset, uint64_t length); 
+
+    /**
+     * @brief 取得日志文件路径
+     * @param[in] file_path 目标文件路径
+     * @retval 日志文件路径
+    */
+    static std::wstring GetJournalPath(const std::wstring& file_path) { return file_path+L".journal"; }
+
+private: 
+    /// @brief 目标文件路径
+    std::wstring m_path; 
+    /// @brief 临时文件路径，OVERWRITE方式为空
+    std::wstring m_tempPath; 
+    /// @brief OVERWRITE方式的日志内容：标记、写入前的文件大小，以及依次记录的 偏移、长度、原数据；为空表示还没有覆盖
+    std::vector<uint8_t> m_journal; 
+    /// @brief 写入前的文件大小，之后追加的部分不需要记录
+    uint64_t m_originalSize = 0; 
+    /// @brief 写入方式
+    Mode m_mode; 
+    /// @brief 文件句柄
+    void* m_hFile = nullptr; 
+    /// @brief 写入后是否已刷盘
+    bool m_isFlushed = true; 
+    /// @brief 是否已结束写入
+    bool m_isFinished = false; 
+    /// @brief 是否有写入失败
+    bool m_isFailed = false; 
+}; 
+
+/**
+ * @brief 将若干段数据依次写入文件
+ * @param[in] file_path 文件路径
+ * @param[in] segments 数据段，按顺序写出
+ * @param[in] ifTruncate true则写临时文件后替换（新建）目标文件，false则从文件开头覆盖写入并保留其后的数据（文件必须已存在）
+ * @retval 是否写入成功
+*/
+bool WriteSegmentsToFile(const wchar_t* file_path, const std::vector<WriteSegment>& segments, bool ifTruncate = true); 
+
+/**
+ * @brief 将数据写入文件，文件已存在则替换
+ * @param[in] file_path 文件路径
+ * @param[in] data 数据指针
+ * @param[in] length 数据长度
+ * @param[in] ifTruncate true则写临时文件后替换（新建）目标文件，false则从文件开头覆盖写入并保留其后的数据（文件必须已存在）
+ * @retval 是否写入成功
+*/
+bool WriteDataToFile(const wchar_t* file_path, const void* data, uint64_t length, bool ifTruncate = true); 
+
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,59 @@
+#ifndef __MD_MD5_H_
+#define __MD_MD5_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace music_data {
+
+/**
+ * @brief MD5摘要（RFC 1321），可分段输入
+*/
+class Md5 {
+public: 
+    /// @brief 摘要长度(byte)
+    static const size_t DIGEST_SIZE = 16; 
+
+    /**
+     * @brief 构造函数
+    */
+    Md5() { reset(); }
+
+    /**
+     * @brief 重新开始计算
+    */
+    void reset(); 
+
+    /**
+     * @brief 输入数据
+     * @param[in] data 数据指针
+     * @param[in] length 数据长度
+    */
+    void update(const void* data, size_t length); 
+
+    /**
+     * @brief 结束计算并取得摘要，之后需reset才能再次使用
+     * @param[out] dest 摘要，DIGEST_SIZE byte
+    */
+    void finish(void* dest); 
+
+private: 
+    /**
+     * @brief 处理若干个64 byte分组
+     * @param[in] data 分组起点
+     * @param[in] blockNum 分组数
+    */
+    void transform(const uint8_t* data, size_t blockNum); 
+
+private: 
+    /// @brief 链接变量
+    uint32_t m_state[4]; 
+    /// @brief 已输入的总长度(byte)
+    uint64_t m_length; 
+    /// @brief 不足一个分组的剩余数据
+    uint8_t m_buffer[64]; 
+}; 
+
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,288 @@
+#include "pcmconvert.h"
+
+#include <string.h>
+#include <algorithm>
+
+#if defined(__x86_64__)||defined(__i386__)||defined(_M_X64)||defined(_M_IX86)
+#define MD_PCMCONVERT_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#define MD_TARGET_SSE41
+#else
+#define MD_TARGET_SSE41 __attribute__((target("sse4.1")))
+#endif
+#endif
+
+namespace music_data {
+
+/**
+ * @brief 当前使用的指令集，首次使用时取CPU支持的指令集（不在静态初始化时取，避免依赖其他编译单元的初始化顺序）
+*/
+static FlacPredictor::Isa& CurrentIsa() {
+    static FlacPredictor::Isa isa = FlacPredictor::GetSupportedIsa(); 
+    return isa; 
+}
+
+/**
+ * @brief 量化参数：v = (x>>shift) + (((x&mask) + (h&noiseMask) - ((h>>16)&noiseMask2) + bias)>>shift)，
+ *        h为采样序号的哈希；shift<=0时v = x<<(-shift)
+*/
+struct QuantParams {
+    /// @brief 右移位数，<=0表示左移
+    int32_t shift; 
+    /// @brief 被移出的低位
+    int32_t mask; 
+    /// @brief 第一个噪声分量的掩码
+    int32_t noiseMask; 
+    /// @brief 第二个噪声分量的掩码（三角分布）
+    int32_t noiseMask2; 
+    /// @brief 偏置，含四舍五入的半个LSB
+    int32_t bias; 
+    /// @brief 是否需要生成噪声
+    bool dither; 
+    /// @brief 噪声种子
+    uint32_t seed; 
+    /// @brief 输出下限
+    int32_t minVal; 
+    /// @brief 输出上限
+    int32_t maxVal; 
+    /// @brief float输出的缩放系数
+    float scale; 
+}; 
+
+/**
+ * @brief 采样序号的哈希（lowbias32），作为抖动噪声源
+*/
+static inline uint32_t HashIndex(uint32_t x) {
+    x^=x>>16; 
+    x*=0x7FEB352D; 
+    x^=x>>15; 
+    x*=0x846CA68B; 
+    x^=x>>16; 
+    return x; 
+}
+
+static inline int32_t Quantize(int32_t x, uint32_t index, const QuantParams& p) {
+    if (p.shift<=0) {
+        return (int32_t)((uint32_t)x<<(-p.shift)); 
+    }
+    int32_t add = p.bias; 
+    if (p.dither) {
+        uint32_t h = HashIndex(index^p.seed); 
+        add+=(int32_t)(h&p.noiseMask)-(int32_t)((h>>16)&p.noiseMask2); 
+    }
+    // 拆成高低两部分再相加，x接近32 bit上限时也不会溢出
+    int32_t val = (x>>p.shift)+(((x&p.mask)+add)>>p.shift); 
+    return std::min(std::max(val, p.minVal), p.maxVal); 
+}
+
+static inline void StoreSample(uint8_t* dest, int32_t val, PcmConverter::SampleFormat format) {
+    dest[0] = (uint8_t)val; 
+    dest[1] = (uint8_t)(val>>8); 
+    if (format==PcmConverter::FORMAT_INT24) {
+        dest[2] = (uint8_t)(val>>16); 
+    }
+}
+
+/**
+ * @brief 标量转换第begin~frames-1帧，dest与index都对应第0帧
+*/
+static void ConvertScalar(const int32_t* const* src, uint32_t channels, uint32_t begin, uint32_t frames,
+    const QuantParams& p, PcmConverter::SampleFormat format, uint32_t index, uint8_t* dest) {
+    uint32_t sampleBytes = PcmConverter::GetSampleBytes(format); 
+    for (uint32_t i=begin; i<frames; ++i) {
+        uint8_t* pout = dest+(size_t)i*channels*sampleBytes; 
+        for (uint32_t c=0; c<channels; ++c, pout+=sampleBytes) {
+            if (format==PcmConverter::FORMAT_FLOAT32) {
+                float val = (float)src[c][i]*p.scale; 
+                memcpy(pout, &val, sizeof(val)); 
+            } else {
+                StoreSample(pout, Quantize(src[c][i], index+i*channels+c, p), format); 
+            }
+        }
+    }
+}
+
+#ifdef MD_PCMCONVERT_X86
+/**
+ * @brief 向量化的量化参数
+*/
+struct QuantVectors {
+    __m128i shift; 
+    __m128i leftShift; 
+    __m128i mask; 
+    __m128i noiseMask; 
+    __m128i noiseMask2; 
+    __m128i bias; 
+    __m128i seed; 
+    __m128i minVal; 
+    __m128i maxVal; 
+    __m128 scale; 
+}; 
+
+MD_TARGET_SSE41 static inline void InitQuantVectors(const QuantParams& p, QuantVectors& v) {
+    v.shift = _mm_cvtsi32_si128(std::max(p.shift, 0)); 
+    v.leftShift = _mm_cvtsi32_si128(std::max(-p.shift, 0)); 
+    v.mask = _mm_set1_epi32(p.mask); 
+    v.noiseMask = _mm_set1_epi32(p.noiseMask); 
+    v.noiseMask2 = _mm_set1_epi32(p.noiseMask2); 
+    v.bias = _mm_set1_epi32(p.bias); 
+    v.seed = _mm_set1_epi32((int32_t)p.seed); 
+    v.minVal = _mm_set1_epi32(p.minVal); 
+    v.maxVal = _mm_set1_epi32(p.maxVal); 
+    v.scale = _mm_set1_ps(p.scale); 
+}
+
+MD_TARGET_SSE41 static inline __m128i QuantizeSse41(__m128i x, __m128i index, const QuantParams& p, const QuantVectors& v) {
+    if (p.shift<=0) {
+        return _mm_sll_epi32(x, v.leftShift); 
+    }
+    __m128i add = v.bias; 
+    if (p.dither) {
+        __m128i h = _mm_xor_si128(index, v.seed); 
+        h = _mm_xor_si128(h, _mm_srli_epi32(h, 16)); 
+        h = _mm_mullo_epi32(h, _mm_set1_epi32(0x7FEB352D)); 
+        h = _mm_xor_si128(h, _mm_srli_epi32(h, 15)); 
+        h = _mm_mullo_epi32(h, _mm_set1_epi32((int32_t)0x846CA68B)); 
+        h = _mm_xor_si128(h, _mm_srli_epi32(h, 16)); 
+        add = _mm_add_epi32(add, _mm_sub_epi32(_mm_and_si128(h, v.noiseMask), _mm_and_si128(_mm_srli_epi32(h, 16), v.noiseMask2))); 
+    }
+    __m128i low = _mm_add_epi32(_mm_and_si128(x, v.mask), add); 
+    __m128i val = _mm_add_epi32(_mm_sra_epi32(x, v.shift), _mm_sra_epi32(low, v.shift)); 
+    return _mm_min_epi32(_mm_max_epi32(val, v.minVal), v.maxVal); 
+}
+
+/**
+ * @brief 4个int32的低3 byte依次写出，共12 byte
+*/
+MD_TARGET_SSE41 static inline void Store24(uint8_t* dest, __m128i val) {
+    const __m128i pack = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1); 
+    __m128i packed = _mm_shuffle_epi8(val, pack); 
+    _mm_storel_epi64((__m128i*)dest, packed); 
+    int32_t tail = _mm_cvtsi128_si32(_mm_srli_si128(packed, 8)); 
+    memcpy(dest+8, &tail, sizeof(tail)); 
+}
+
+/**
+ * @brief 单声道、双声道每次处理4帧，其余声道数与剩余的帧用标量版本
+*/
+MD_TARGET_SSE41 static void ConvertSse41(const int32_t* const* src, uint32_t channels, uint32_t frames,
+    const QuantParams& p, PcmConverter::SampleFormat format, uint32_t index, uint8_t* dest) {
+    if (channels>2) {
+        ConvertScalar(src, channels, 0, frames, p, format, index, dest); 
+        return; 
+    }
+
+    QuantVectors v; 
+    InitQuantVectors(p, v); 
+    uint32_t sampleBytes = PcmConverter::GetSampleBytes(format); 
+    uint32_t blockFrames = frames&~3u; 
+    uint8_t* pout = dest; 
+
+    if (channels==1) {
+        const __m128i step = _mm_set1_epi32(4); 
+        __m128i idx = _mm_add_epi32(_mm_set1_epi32((int32_t)index), _mm_setr_epi32(0, 1, 2, 3)); 
+        for (uint32_t i=0; i<blockFrames; i+=4, pout+=4*sampleBytes) {
+            __m128i x = _mm_loadu_si128((const __m128i*)(src[0]+i)); 
+            if (format==PcmConverter::FORMAT_FLOAT32) {
+                _mm_storeu_ps((float*)pout, _mm_mul_ps(_mm_cvtepi32_ps(x), v.scale)); 
+            } else if (format==PcmConverter::FORMAT_INT16) {
+                __m128i q = QuantizeSse41(x, idx, p, v); 
+                _mm_storel_epi64((__m128i*)pout, _mm_packs_epi32(q, q)); 
+            } else {
+                Store24(pout, QuantizeSse41(x, idx, p, v)); 
+            }
+            idx = _mm_add_epi32(idx, step); 
+        }
+    } else {
+        // 左声道序号为偶数，右声道为奇数
+        const __m128i step = _mm_set1_epi32(8); 
+        const __m128i one = _mm_set1_epi32(1); 
+        __m128i idx = _mm_add_epi32(_mm_set1_epi32((int32_t)index), _mm_setr_epi32(0, 2, 4, 6)); 
+        for (uint32_t i=0; i<blockFrames; i+=4, pout+=8*sampleBytes) {
+            __m128i left = _mm_loadu_si128((const __m128i*)(src[0]+i)); 
+            __m128i right = _mm_loadu_si128((const __m128i*)(src[1]+i)); 
+            if (format==PcmConverter::FORMAT_FLOAT32) {
+                __m128 fl = _mm_mul_ps(_mm_cvtepi32_ps(left), v.scale); 
+                __m128 fr = _mm_mul_ps(_mm_cvtepi32_ps(right), v.scale); 
+                _mm_storeu_ps((float*)pout, _mm_unpacklo_ps(fl, fr)); 
+                _mm_storeu_ps((float*)pout+4, _mm_unpackhi_ps(fl, fr)); 
+            } else {
+                __m128i ql = QuantizeSse41(left, idx, p, v); 
+                __m128i qr = QuantizeSse41(right, _mm_add_epi32(idx, one), p, v); 
+                __m128i lo = _mm_unpacklo_epi32(ql, qr); 
+                __m128i hi = _mm_unpackhi_epi32(ql, qr); 
+                if (format==PcmConverter::FORMAT_INT16) {
+                    _mm_storeu_si128((__m128i*)pout, _mm_packs_epi32(lo, hi)); 
+                } else {
+                    Store24(pout, lo); 
+                    Store24(pout+12, hi); 
+                }
+            }
+            idx = _mm_add_epi32(idx, step); 
+        }
+    }
+    ConvertScalar(src, channels, blockFrames, frames, p, format, index, dest); 
+}
+#endif
+
+PcmConverter::PcmConverter(SampleFormat format, uint32_t sampleBits, uint32_t channels, Dither dither, uint32_t seed)
+    : m_format(format)
+    , m_sampleBits(std::min<uint32_t>(std::max<uint32_t>(sampleBits, 4), 32))
+    , m_channels(channels)
+    , m_dither(dither)
+    , m_seed(seed) {
+}
+
+void PcmConverter::convert(const int32_t* const* src, uint32_t frames, void* dest) {
+    QuantParams p; 
+    memset(&p, 0, sizeof(p)); 
+    uint32_t targetBits = m_format==FORMAT_INT16?16:24; 
+    p.shift = (int32_t)m_sampleBits-(int32_t)targetBits; 
+    p.scale = 1.0f/(float)(1ULL<<(m_sampleBits-1)); 
+    if (m_format!=FORMAT_FLOAT32&&p.shift>0) {
+        p.mask = (int32_t)((1u<<p.shift)-1); 
+        p.minVal = -(1<<(targetBits-1)); 
+        p.maxVal = (1<<(targetBits-1))-1; 
+        p.seed = m_seed; 
+        int32_t half = 1<<(p.shift-1); 
+        switch (m_dither) {
+        case DITHER_RECTANGULAR:
+            // 噪声[-half, half)，再加half四舍五入
+            p.dither = true; 
+            p.noiseMask = p.mask; 
+            break; 
+        case DITHER_TRIANGULAR:
+            // 两个均匀分布相减，噪声(-2*half, 2*half)
+            p.dither = true; 
+            p.noiseMask = p.mask; 
+            p.noiseMask2 = p.mask; 
+            p.bias = half; 
+            break; 
+        default:
+            p.bias = half; 
+            break; 
+        }
+    }
+
+#ifdef MD_PCMCONVERT_X86
+    if (CurrentIsa()>=FlacPredictor::ISA_SSE41) {
+        ConvertSse41(src, m_channels, frames, p, m_format, m_index, (uint8_t*)dest); 
+        m_index+=frames*m_channels; 
+        return; 
+    }
+#endif
+    ConvertScalar(src, m_channels, 0, frames, p, m_format, m_index, (uint8_t*)dest); 
+    m_index+=frames*m_channels; 
+}
+
+FlacPredictor::Isa PcmConverter::GetIsa() {
+    return CurrentIsa(); 
+}
+
+void PcmConverter::SetIsa(FlacPredictor::Isa isa) {
+    FlacPredictor::Isa supported = FlacPredictor::GetSupportedIsa(); 
+    CurrentIsa() = isa>supported?supported:isa; 
+}
+
+}
\ No newline at end of file
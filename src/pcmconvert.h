@@ -0,0 +1,118 @@
+#ifndef __MD_PCMCONVERT_H_
+#define __MD_PCMCONVERT_H_
+
+#include "flacpredictor.h"
+
+#include <stdint.h>
+
+namespace music_data {
+
+/**
+ * @brief PCM格式转换：int32平面排列转为交错排列的int16、int24（3 byte小端）或float32。
+ *        降低位数时可以加抖动，抖动噪声由采样序号哈希得到，与分段方式及指令集无关，结果逐位相同
+*/
+class PcmConverter {
+public: 
+    /**
+     * @brief 输出采样格式
+    */
+    enum SampleFormat {
+        /// @brief 16 bit有符号整数
+        FORMAT_INT16 = 0, 
+        /// @brief 24 bit有符号整数，3 byte小端
+        FORMAT_INT24 = 1, 
+        /// @brief 32 bit浮点，范围[-1, 1)
+        FORMAT_FLOAT32 = 2
+    }; 
+
+    /**
+     * @brief 降低位数时的抖动方式
+    */
+    enum Dither {
+        /// @brief 不加抖动，四舍五入
+        DITHER_NONE = 0, 
+        /// @brief 均匀分布噪声，幅度1 LSB
+        DITHER_RECTANGULAR = 1, 
+        /// @brief 三角分布噪声（TPDF），幅度2 LSB
+        DITHER_TRIANGULAR = 2
+    }; 
+
+    /**
+     * @brief 构造函数
+     * @param[in] format 输出格式
+     * @param[in] sampleBits 输入采样位数，4~32
+     * @param[in] channels 声道数
+     * @param[in] dither 抖动方式，不降低位数时不起作用
+     * @param[in] seed 抖动噪声种子
+    */
+    PcmConverter(SampleFormat format, uint32_t sampleBits, uint32_t channels, Dither dither = DITHER_TRIANGULAR, uint32_t seed = 0); 
+
+    /**
+     * @brief 转换并交错，抖动噪声序号随之前进
+     * @param[in] src 各声道数据，src[c]为声道c的第一个采样
+     * @param[in] frames 每个声道的采样数
+     * @param[out] dest 目标，长度至少frames*getFrameBytes()
+    */
+    void convert(const int32_t* const* src, uint32_t frames, void* dest); 
+
+    /**
+     * @brief 重新开始抖动噪声序列
+    */
+    void reset() { m_index = 0; }
+
+    /**
+     * @brief 把抖动噪声序列移到指定帧，定位后的输出与从头连续输出的同一位置相同
+     * @param[in] frame 帧序号（每帧各声道一个采样）
+    */
+    void setPosition(uint64_t frame) { m_index = (uint32_t)(frame*m_channels); }
+
+    /**
+     * @brief 取得一帧（各声道一个采样）的输出长度
+     * @retval 长度(byte)
+    */
+    uint32_t getFrameBytes() const { return GetSampleBytes(m_format)*m_channels; }
+
+    /**
+     * @brief 取得输出格式
+     * @retval 输出格式
+    */
+    SampleFormat getFormat() const { return m_format; }
+
+    /**
+     * @brief 取得采样格式的长度
+     * @param[in] format 采样格式
+     * @retval 长度(byte)
+    */
+    static uint32_t GetSampleBytes(SampleFormat format) { return format==FORMAT_INT16?2:(format==FORMAT_INT24?3:4); }
+
+    /**
+     * @brief 取得当前使用的指令集
+     * @retval 指令集
+    */
+    static FlacPredictor::Isa GetIsa(); 
+
+    /**
+     * @brief 设置使用的指令集，超出CPU支持时使用CPU支持的指令集（测试与性能对比用）；
+     *        转换是内存带宽受限的，AVX2与SSE4.1使用同一实现
+     * @param[in] isa 指令集
+    */
+    static void SetIsa(FlacPredictor::Isa isa); 
+
+private: 
+    /// @brief 输出格式
+    SampleFormat m_format; 
+    /// @brief 输入采样位数
+    uint32_t m_sampleBits; 
+    /// @brief 声道数
+    uint32_t m_channels; 
+    /// @brief 抖动方式
+    Dither m_dither; 
+    /// @brief 抖动噪声种子
+    uint32_t m_seed; 
+    /// @brief 下一个输出采样的序号，用于生成抖动噪声
+    uint32_t m_index = 0; 
+}; 
+
+}
+
+#endif
\ No newline at end of file
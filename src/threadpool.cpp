@@ -0,0 +1,92 @@
+#include "threadpool.h"
+
+#include <atomic>
+
+namespace music_data {
+
+ThreadPool::ThreadPool(uint32_t threadNum) {
+    if (threadNum==0) {
+        threadNum = std::thread::hardware_concurrency(); 
+        if (threadNum==0) {
+            threadNum = 1; 
+        }
+    }
+    m_threads.reserve(threadNum); 
+    for (uint32_t i=0; i<threadNum; ++i) {
+        m_threads.emplace_back(&ThreadPool::run, this); 
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::unique_lock<std::mutex> lock(m_mutex); 
+        m_stop = true; 
+    }
+    m_cond.notify_all(); 
+    for (auto& item: m_threads) {
+        if (item.joinable()) {
+            item.join(); 
+        }
+    }
+}
+
+void ThreadPool::parallelFor(size_t count, const std::function<void(size_t)>& func) {
+    if (count==0) {
+        return; 
+    }
+    if (count==1) {
+        func(0); 
+        return; 
+    }
+
+    struct ForState {
+        std::atomic<size_t> next{0}; 
+        size_t done = 0; 
+        std::mutex mutex; 
+        std::condition_variable cond; 
+    }; 
+    auto state = std::make_shared<ForState>(); 
+
+    auto worker = [state, count, &func]() {
+        size_t num = 0; 
+        for (size_t i = state->next.fetch_add(1); i<count; i = state->next.fetch_add(1)) {
+            func(i); 
+            ++num; 
+        }
+        if (num>0) {
+            std::unique_lock<std::mutex> lock(state->mutex); 
+            state->done+=num; 
+            if (state->done==count) {
+                state->cond.notify_all(); 
+            }
+        }
+    }; 
+
+    // 工作线程领到任务时func仍然有效：领取序号<count的任务一定发生在调用线程返回前
+    size_t helperNum = std::min<size_t>(m_threads.size(), count-1); 
+    for (size_t i=0; i<helperNum; ++i) {
+        submit(worker); 
+    }
+    worker(); 
+
+    std::unique_lock<std::mutex> lock(state->mutex); 
+    state->cond.wait(lock, [&state, count]() { return state->done==count; }); 
+}
+
+void ThreadPool::run() {
+    while (true) {
+        std::function<void()> task; 
+        {
+            std::unique_lock<std::mutex> lock(m_mutex); 
+            m_cond.wait(lock, [this]() { return m_stop||!m_tasks.empty(); }); 
+            if (m_stop&&m_tasks.empty()) {
+                return; 
+            }
+            task = std::move(m_tasks.front()); 
+            m_tasks.pop(); 
+        }
+        task(); 
+    }
+}
+
+}
\ No newline at end of file
@@ -0,0 +1,93 @@
+#ifndef __MD_THREADPOOL_H_
+#define __MD_THREADPOOL_H_
+
+#include "noncopyable.h"
+#include "singleton.h"
+
+#include <memory>
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <stdint.h>
+
+namespace music_data {
+
+/**
+ * @brief 固定线程数的线程池，用于按文件或按数据分段并行处理
+*/
+class ThreadPool: Noncopyable {
+public: 
+    typedef std::shared_ptr<ThreadPool> ptr; 
+
+    /**
+     * @brief 构造函数
+     * @param[in] threadNum 线程数，0表示使用硬件线程数
+    */
+    ThreadPool(uint32_t threadNum = 0); 
+
+    /**
+     * @brief 析构函数，等待已提交的任务执行完毕
+    */
+    ~ThreadPool(); 
+
+    /**
+     * @brief 取得线程数
+     * @retval 线程数
+    */
+    uint32_t getThreadNum() const { return m_threads.size(); }
+
+    /**
+     * @brief 提交任务
+     * @param[in] func 任务
+     * @retval 任务结果future
+    */
+    template<class F>
+    std::future<decltype(std::declval<F&>()())> submit(F&& func) {
+        typedef decltype(std::declval<F&>()()) ResultType; 
+        auto task = std::make_shared<std::packaged_task<ResultType()>>(std::forward<F>(func)); 
+        std::future<ResultType> ans = task->get_future(); 
+        {
+            std::unique_lock<std::mutex> lock(m_mutex); 
+            m_tasks.emplace([task]() { (*task)(); }); 
+        }
+        m_cond.notify_one(); 
+        return ans; 
+    }
+
+    /**
+     * @brief 并行执行func(0)~func(count-1)，调用线程同样参与执行，阻塞到全部完成。
+     * 调用线程自己也会领取任务，所以在线程池任务中嵌套调用也不会死锁
+     * @param[in] count 任务数
+     * @param[in] func 任务函数，参数为任务序号
+    */
+    void parallelFor(size_t count, const std::function<void(size_t)>& func); 
+
+private: 
+    /**
+     * @brief 工作线程主循环
+    */
+    void run(); 
+
+private: 
+    /// @brief 工作线程
+    std::vector<std::thread> m_threads; 
+    /// @brief 待执行任务
+    std::queue<std::function<void()>> m_tasks; 
+    /// @brief 任务队列锁
+    std::mutex m_mutex; 
+    /// @brief 任务队列条件变量
+    std::condition_variable m_cond; 
+    /// @brief 是否停止
+    bool m_stop = false; 
+}; 
+
+/// @brief 全局默认线程池
+typedef SingletonPtr<ThreadPool> DefaultThreadPool; 
+
+}
+
+#endif
\ No newline at end of file
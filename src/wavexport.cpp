@@ -0,0 +1,412 @@
+#include "wavexport.h"
+#include "flacparallel.h"
+#include "mappedfile.h"
+#include "arena.h"
+#include "log.h"
+
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <future>
+
+namespace music_data {
+
+INITONLYLOGGER(); 
+
+/// @brief 默认写出缓冲区大小
+static const size_t s_defaultBufferSize = 4<<20; 
+/// @brief flac允许的最大block size，缓冲区至少放得下一帧
+static const uint32_t s_maxBlockSize = 65535; 
+/// @brief 缓冲区对齐，与页大小、扇区大小一致
+static const size_t s_bufferAlign = 4096; 
+/// @brief ds64 chunk数据长度：RIFF长度、data长度、采样数各8 byte，表项数4 byte
+static const uint32_t s_ds64Size = 28; 
+/// @brief WAVE_FORMAT_PCM
+static const uint16_t s_formatPcm = 1; 
+/// @brief WAVE_FORMAT_EXTENSIBLE
+static const uint16_t s_formatExtensible = 0xFFFE; 
+/// @brief KSDATAFORMAT_SUBTYPE_PCM
+static const uint8_t s_subtypePcm[16] = {
+    0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x80, 0x00, 0x00, 0xAA, 0x00, 0x38, 0x9B, 0x71
+}; 
+/// @brief flac各声道数的默认声道布局对应的WAVEFORMATEXTENSIBLE声道掩码（与flac命令行工具一致）
+static const uint32_t s_channelMasks[8] = {
+    0x0001, 0x0003, 0x0007, 0x0033, 0x0607, 0x060F, 0x070F, 0x063F
+}; 
+
+/**
+ * @brief INFO子chunk与vorbis comment key的对应
+*/
+struct InfoField {
+    /// @brief INFO子chunk id
+    const char* id; 
+    /// @brief vorbis comment key
+    const char* key; 
+}; 
+
+/// @brief 写入LIST/INFO的标签
+static const InfoField s_infoFields[] = {
+    {"INAM", "TITLE"},
+    {"IART", "ARTIST"},
+    {"IPRD", "ALBUM"},
+    {"ICRD", "DATE"},
+    {"IGNR", "GENRE"},
+    {"ITRK", "TRACKNUMBER"},
+    {"ICMT", "COMMENT"},
+    {"ICOP", "COPYRIGHT"},
+}; 
+
+static inline void PutTag(std::vector<uint8_t>& dest, const char* tag) {
+    dest.insert(dest.end(), tag, tag+4); 
+}
+
+static inline void PutLE16(std::vector<uint8_t>& dest, uint16_t val) {
+    dest.push_back((uint8_t)val); 
+    dest.push_back((uint8_t)(val>>8)); 
+}
+
+static inline void PutLE32(std::vector<uint8_t>& dest, uint32_t val) {
+    for (int i=0; i<4; ++i) {
+        dest.push_back((uint8_t)(val>>(i*8))); 
+    }
+}
+
+static inline void PutLE64(std::vector<uint8_t>& dest, uint64_t val) {
+    PutLE32(dest, (uint32_t)val); 
+    PutLE32(dest, (uint32_t)(val>>32)); 
+}
+
+/**
+ * @brief 双缓冲写出：写满的缓冲区交给写线程，同时填充另一个缓冲区
+*/
+class PipelinedWriter: Noncopyable {
+public: 
+    /**
+     * @brief 构造函数
+     * @param[in] writer 文件写入器
+     * @param[in] bufferSize 每个缓冲区大小，4 KB的整数倍
+    */
+    PipelinedWriter(FileWriter& writer, size_t bufferSize)
+        : m_writer(writer)
+        , m_arena(bufferSize*2+s_bufferAlign)
+        , m_bufferSize(bufferSize) {
+        m_buffers[0] = (uint8_t*)m_arena.allocate(bufferSize, s_bufferAlign); 
+        m_buffers[1] = (uint8_t*)m_arena.allocate(bufferSize, s_bufferAlign); 
+    }
+
+    /**
+     * @brief 析构函数，等待写线程结束
+    */
+    ~PipelinedWriter() {
+        wait(); 
+    }
+
+    /**
+     * @brief 取得可以连续写入length byte的位置，当前缓冲区不够时先提交
+     * @param[in] length 长度，不超过缓冲区大小
+     * @retval 写入位置，之前的写出失败时为nullptr
+    */
+    uint8_t* reserve(size_t length) {
+        if (m_used+length>m_bufferSize&&!submit()) {
+            return nullptr; 
+        }
+        uint8_t* pos = m_buffers[m_current]+m_used; 
+        m_used+=length; 
+        return pos; 
+    }
+
+    /**
+     * @brief 提交剩余数据并等待全部写出
+     * @retval 是否全部写出成功
+    */
+    bool finish() {
+        return submit()&&wait(); 
+    }
+
+private: 
+    /**
+     * @brief 等待上一次提交的缓冲区写出，再把当前缓冲区交给写线程
+     * @retval 上一次写出是否成功
+    */
+    bool submit() {
+        if (!wait()) {
+            return false; 
+        }
+        if (m_used>0) {
+            std::vector<WriteSegment> segments(1, WriteSegment{m_buffers[m_current], m_used}); 
+            FileWriter* writer = &m_writer; 
+            m_pending = std::async(std::launch::async, [writer, segments]() {
+                return writer->write(segments); 
+            }); 
+            m_current^=1; 
+            m_used = 0; 
+        }
+        return true; 
+    }
+
+    /**
+     * @brief 等待写线程
+     * @retval 写出是否成功
+    */
+    bool wait() {
+        if (m_pending.valid()) {
+            m_isOk = m_pending.get()&&m_isOk; 
+        }
+        return m_isOk; 
+    }
+
+private: 
+    /// @brief 文件写入器
+    FileWriter& m_writer; 
+    /// @brief 缓冲区内存
+    Arena m_arena; 
+    /// @brief 每个缓冲区大小
+    size_t m_bufferSize; 
+    /// @brief 两个缓冲区
+    uint8_t* m_buffers[2]; 
+    /// @brief 正在填充的缓冲区
+    uint32_t m_current = 0; 
+    /// @brief 正在填充的缓冲区已用长度
+    size_t m_used = 0; 
+    /// @brief 写线程的结果
+    std::future<bool> m_pending; 
+    /// @brief 之前的写出是否都成功
+    bool m_isOk = true; 
+}; 
+
+WavExporter::WavExporter(const MusicDecoderflac& decoder, ThreadPool::ptr pool)
+    : m_decoder(decoder.fork())
+    , m_pool(pool==nullptr?DefaultThreadPool::GetInstance():pool)
+    , m_bufferSize(s_defaultBufferSize) {
+    buildInfoList(m_infoList); 
+}
+
+void WavExporter::buildInfoList(std::vector<uint8_t>& dest) const {
+    dest.clear(); 
+    VorbisCommentMetaBlock::ptr comment = m_decoder==nullptr?nullptr:m_decoder->getVorbisComment(); 
+    if (comment==nullptr) {
+        return; 
+    }
+
+    std::vector<uint8_t> fields; 
+    for (auto& field: s_infoFields) {
+        std::vector<std::string> vals; 
+        if (!comment->hasKey(field.key)||!comment->getLabelListWithKey(field.key, vals)) {
+            continue; 
+        }
+        // INFO没有多值，同key的多个值合并
+        std::string text; 
+        for (auto& val: vals) {
+            if (val.empty()) {
+                continue; 
+            }
+            if (!text.empty()) {
+                text+="; "; 
+            }
+            text+=val; 
+        }
+        if (text.empty()) {
+            continue; 
+        }
+        // 文本以NUL结尾，chunk按偶数长度对齐，对齐字节不计入长度
+        uint32_t length = text.size()+1; 
+        PutTag(fields, field.id); 
+        PutLE32(fields, length); 
+        fields.insert(fields.end(), text.begin(), text.end()); 
+        fields.push_back(0); 
+        if (length&1) {
+            fields.push_back(0); 
+        }
+    }
+    if (fields.empty()) {
+        return; 
+    }
+
+    PutTag(dest, "LIST"); 
+    PutLE32(dest, 4+fields.size()); 
+    PutTag(dest, "INFO"); 
+    dest.insert(dest.end(), fields.begin(), fields.end()); 
+}
+
+void WavExporter::buildHeader(uint64_t dataSize, uint64_t samples, bool rf64, std::vector<uint8_t>& dest) const {
+    StreamInfoMetaBlock::ptr streamInfo = m_decoder->getStreamInfo(); 
+    uint32_t channels = streamInfo->getChannels(); 
+    uint32_t bits = streamInfo->getSampleBits(); 
+    uint32_t sampleBytes = (bits+7)/8; 
+    uint32_t blockAlign = channels*sampleBytes; 
+    // 多于2声道、多于16 bit或有效位数不是整字节时必须用WAVE_FORMAT_EXTENSIBLE
+    bool extensible = channels>2||bits>16||bits!=sampleBytes*8; 
+
+    uint32_t fmtSize = extensible?40:16; 
+    // data chunk的数据之后可能有一个对齐字节
+    uint64_t riffSize = 4+(8+s_ds64Size)+(8+fmtSize)+m_infoList.size()+8+dataSize+(dataSize&1); 
+
+    dest.clear(); 
+    PutTag(dest, rf64?"RF64":"RIFF"); 
+    PutLE32(dest, rf64?0xFFFFFFFF:(uint32_t)riffSize); 
+    PutTag(dest, "WAVE"); 
+
+    // RIFF时ds64的位置写为JUNK占位，同样长度，回填时可以就地改为ds64
+    PutTag(dest, rf64?"ds64":"JUNK"); 
+    PutLE32(dest, s_ds64Size); 
+    if (rf64) {
+        PutLE64(dest, riffSize); 
+        PutLE64(dest, dataSize); 
+        PutLE64(dest, samples); 
+        PutLE32(dest, 0); 
+    } else {
+        dest.resize(dest.size()+s_ds64Size, 0); 
+    }
+
+    PutTag(dest, "fmt "); 
+    PutLE32(dest, fmtSize); 
+    PutLE16(dest, extensible?s_formatExtensible:s_formatPcm); 
+    PutLE16(dest, channels); 
+    PutLE32(dest, streamInfo->getSampleRate()); 
+    PutLE32(dest, streamInfo->getSampleRate()*blockAlign); 
+    PutLE16(dest, blockAlign); 
+    PutLE16(dest, sampleBytes*8); 
+    if (extensible) {
+        PutLE16(dest, 22); 
+        PutLE16(dest, bits); 
+        PutLE32(dest, s_channelMasks[std::min<uint32_t>(channels, 8)-1]); 
+        dest.insert(dest.end(), s_subtypePcm, s_subtypePcm+16); 
+    }
+
+    dest.insert(dest.end(), m_infoList.begin(), m_infoList.end()); 
+
+    PutTag(dest, "data"); 
+    PutLE32(dest, rf64?0xFFFFFFFF:(uint32_t)dataSize); 
+}
+
+bool WavExporter::save(const std::wstring& path, Result* result) {
+    Result tmp; 
+    Result& ans = result==nullptr?tmp:*result; 
+    ans = Result(); 
+    ans.path = path; 
+    if (m_decoder==nullptr||m_decoder->getStreamInfo()==nullptr||m_decoder->getAudioFrames()==nullptr) {
+        LOGE("no audio frames, export wav termination"); 
+        return false; 
+    }
+
+    StreamInfoMetaBlock::ptr streamInfo = m_decoder->getStreamInfo(); 
+    uint32_t channels = streamInfo->getChannels(); 
+    uint32_t bits = streamInfo->getSampleBits(); 
+    uint32_t sampleBytes = (bits+7)/8; 
+    // WAV中采样在容器内左对齐，8 bit为无符号数
+    uint32_t shift = sampleBytes*8-bits; 
+    size_t bufferSize = std::max<size_t>(m_bufferSize, (size_t)s_maxBlockSize*channels*sampleBytes); 
+    bufferSize = (bufferSize+s_bufferAlign-1)&~(s_bufferAlign-1); 
+
+    bool rf64 = m_rf64Mode==RF64_ALWAYS; 
+    std::vector<uint8_t> header; 
+    buildHeader(0, 0, rf64, header); 
+
+    FileWriter writer(path.c_str()); 
+    if (!writer.write(std::vector<WriteSegment>(1, WriteSegment{header.data(), header.size()}))) {
+        LOGE("write wav header fail"); 
+        return false; 
+    }
+
+    // 解码（线程池）、交错（本线程）、写出（写线程）三级流水线
+    PipelinedWriter output(writer, bufferSize); 
+    uint64_t dataSize = 0; 
+    bool isBroken = false; 
+    FlacParallelDecoder decoder(*m_decoder, m_pool); 
+    bool finished = decoder.decode([&](const FlacParallelDecoder::Chunk& chunk) {
+        ans.badFrameNum+=chunk.badFrames.size(); 
+        for (uint32_t i=0; i<chunk.blockNum; ++i) {
+            const FlacPcmBlock& block = chunk.blocks[i]; 
+            if (block.channels!=channels||block.firstSample!=ans.samples) {
+                LOGE("decoded samples broken at sample %lld", (long long)ans.samples); 
+                isBroken = true; 
+                return false; 
+            }
+            size_t length = (size_t)block.blockSize*channels*sampleBytes; 
+            uint8_t* pout = output.reserve(length); 
+            if (pout==nullptr) {
+                isBroken = true; 
+                return false; 
+            }
+            block.interleave(pout, sampleBytes, shift); 
+            if (sampleBytes==1) {
+                for (size_t j=0; j<length; ++j) {
+                    pout[j]^=0x80; 
+                }
+            }
+            ans.samples+=block.blockSize; 
+            dataSize+=length; 
+        }
+        return ans.badFrameNum==0; 
+    }); 
+    if (!output.finish()||!finished||isBroken||ans.badFrameNum>0) {
+        if (ans.badFrameNum>0) {
+            LOGE("%d broken frames, export wav termination", ans.badFrameNum); 
+        }
+        return false; 
+    }
+    uint64_t totalSamples = streamInfo->getSamplePerChannel(); 
+    if (totalSamples!=0&&ans.samples!=totalSamples) {
+        LOGW("decoded %lld samples, stream info says %lld", (long long)ans.samples, (long long)totalSamples); 
+    }
+
+    if (dataSize&1) {
+        uint8_t pad = 0; 
+        if (!writer.write(std::vector<WriteSegment>(1, WriteSegment{&pad, 1}))) {
+            return false; 
+        }
+    }
+    // 长度确定后回填文件头，超过RIFF的32 bit长度时改为RF64
+    ans.fileSize = header.size()+dataSize+(dataSize&1); 
+    rf64 = rf64||ans.fileSize-8>0xFFFFFFFFULL; 
+    buildHeader(dataSize, ans.samples, rf64, header); 
+    if (!writer.writeAt(0, header.data(), header.size())||!writer.commit()) {
+        LOGE("finish wav file fail"); 
+        return false; 
+    }
+    ans.rf64 = rf64; 
+    ans.success = true; 
+    return true; 
+}
+
+uint32_t WavExporter::ExportFiles(const std::vector<std::wstring>& files, const std::wstring& outDir, ThreadPool::ptr pool) {
+    if (pool==nullptr) {
+        pool = DefaultThreadPool::GetInstance(); 
+    }
+
+    std::atomic<uint32_t> count(0); 
+    pool->parallelFor(files.size(), [&files, &outDir, &pool, &count](size_t i) {
+        MusicDecoderflac decoder(files[i].c_str()); 
+        if (!decoder.isValid()) {
+            LOGW("skip invalid flac file"); 
+            return; 
+        }
+
+        // 源文件名换成.wav后缀，指定了目录时放到该目录下
+        std::wstring name = files[i]; 
+        size_t slash_pos = name.find_last_of(L"\\/"); 
+        std::wstring dir = slash_pos==std::wstring::npos?L"":name.substr(0, slash_pos+1); 
+        if (slash_pos!=std::wstring::npos) {
+            name = name.substr(slash_pos+1); 
+        }
+        size_t dot_pos = name.find_last_of(L"."); 
+        if (dot_pos!=std::wstring::npos) {
+            name = name.substr(0, dot_pos); 
+        }
+        if (!outDir.empty()) {
+            dir = outDir; 
+            if (dir.back()!=L'\\'&&dir.back()!=L'/') {
+                dir+=L"\\"; 
+            }
+        }
+
+        WavExporter exporter(decoder, pool); 
+        if (exporter.save(dir+name+L".wav")) {
+            ++count; 
+        }
+    }); 
+
+    return count; 
+}
+
+}
\ No newline at end of file
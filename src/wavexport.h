@@ -0,0 +1,119 @@
+#ifndef __MD_WAVEXPORT_H_
+#define __MD_WAVEXPORT_H_
+
+#include "decoderflac.h"
+#include "threadpool.h"
+#include "noncopyable.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+namespace music_data {
+
+/**
+ * @brief flac无损导出为WAV：解码在线程池中分段并行进行，本线程把PCM交错到对齐的大缓冲区，
+ *        写满的缓冲区交给写线程写出，三者流水线执行；数据超过4 GB时写为RF64，
+ *        TITLE、ARTIST等常用标签写入LIST/INFO chunk
+*/
+class WavExporter: Noncopyable {
+public: 
+    typedef std::shared_ptr<WavExporter> ptr; 
+
+    /**
+     * @brief RF64使用方式
+    */
+    enum Rf64Mode {
+        /// @brief 超过RIFF的4 GB上限时才使用RF64
+        RF64_AUTO = 0, 
+        /// @brief 总是使用RF64
+        RF64_ALWAYS = 1
+    }; 
+
+    /**
+     * @brief 导出结果
+    */
+    struct Result {
+        /// @brief 输出文件路径
+        std::wstring path; 
+        /// @brief 是否成功
+        bool success = false; 
+        /// @brief 写出的采样数（每声道）
+        uint64_t samples = 0; 
+        /// @brief 文件长度(byte)
+        uint64_t fileSize = 0; 
+        /// @brief 是否写为RF64
+        bool rf64 = false; 
+        /// @brief 解码失败的帧数，不为0时导出失败
+        uint32_t badFrameNum = 0; 
+    }; 
+
+    /**
+     * @brief 构造函数，保持解码器源文件映射
+     * @param[in] decoder flac解码器
+     * @param[in] pool 解码用的线程池，nullptr使用默认线程池
+    */
+    WavExporter(const MusicDecoderflac& decoder, ThreadPool::ptr pool = nullptr); 
+
+    /**
+     * @brief 设置写出缓冲区大小，共两个缓冲区交替使用
+     * @param[in] size 每个缓冲区大小(byte)，按4 KB向上取整，不小于一帧PCM的长度
+    */
+    void setBufferSize(size_t size) { m_bufferSize = size; }
+
+    /**
+     * @brief 设置RF64使用方式
+     * @param[in] mode RF64使用方式
+    */
+    void setRf64Mode(Rf64Mode mode) { m_rf64Mode = mode; }
+
+    /**
+     * @brief 导出到文件，写临时文件后替换，失败时不留下不完整的文件
+     * @param[in] path 输出文件路径
+     * @param[out] result 导出结果，可为nullptr
+     * @retval 是否成功
+    */
+    bool save(const std::wstring& path, Result* result = nullptr); 
+
+    /**
+     * @brief 并行导出多个flac文件，文件之间与文件内部都并行
+     * @param[in] files flac文件路径
+     * @param[in] outDir 输出目录，为空时输出到源文件所在目录；文件名为 源文件名.wav
+     * @param[in] pool 线程池，nullptr使用默认线程池
+     * @retval 导出成功的文件数
+    */
+    static uint32_t ExportFiles(const std::vector<std::wstring>& files, const std::wstring& outDir, ThreadPool::ptr pool = nullptr); 
+
+private: 
+    /**
+     * @brief 生成WAV头（到data chunk头为止），长度与参数无关，所以可以先写占位再回填
+     * @param[in] dataSize data chunk长度(byte)
+     * @param[in] samples 采样数（每声道）
+     * @param[in] rf64 是否写为RF64
+     * @param[out] dest 目标
+    */
+    void buildHeader(uint64_t dataSize, uint64_t samples, bool rf64, std::vector<uint8_t>& dest) const; 
+
+    /**
+     * @brief 生成LIST/INFO chunk，没有可写的标签时为空
+     * @param[out] dest 目标
+    */
+    void buildInfoList(std::vector<uint8_t>& dest) const; 
+
+private: 
+    /// @brief flac解码器，共享metadata与源文件映射
+    MusicDecoderflac::ptr m_decoder; 
+    /// @brief 线程池
+    ThreadPool::ptr m_pool; 
+    /// @brief 每个写出缓冲区的大小
+    size_t m_bufferSize; 
+    /// @brief RF64使用方式
+    Rf64Mode m_rf64Mode = RF64_AUTO; 
+    /// @brief LIST/INFO chunk，构造时生成
+    std::vector<uint8_t> m_infoList; 
+}; 
+
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,521 @@
+#ifndef __MD_TESTS_FLACTESTFILE_H_
+#define __MD_TESTS_FLACTESTFILE_H_
+
+#include "decoderflac.h"
+#include "flacdecoder.h"
+#include "mappedfile.h"
+#include "crc.h"
+#include "md5.h"
+#include "image.h"
+#include "log.h"
+
+#include <windows.h>
+#include <vector>
+#include <string>
+#include <random>
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+#include <stdint.h>
+
+/**
+ * @brief 测试用flac文件：生成信号、编码写文件、整体解码与比较，测试不依赖外部文件；
+ *        编码只用于产生测试数据，不依赖库中的编码器，逐帧轮换声道编码与subframe类型
+*/
+
+/// @brief 声道编码：独立、左/侧、侧/右、中/侧
+enum {
+    ASSIGN_INDEPENDENT = 1, 
+    ASSIGN_LEFT_SIDE = 8, 
+    ASSIGN_SIDE_RIGHT = 9, 
+    ASSIGN_MID_SIDE = 10
+}; 
+
+/**
+ * @brief 按位写出，高位在前
+*/
+class TestBitWriter {
+public: 
+    /**
+     * @brief 写出val的低n bit，n不超过32
+    */
+    void writeBits(uint32_t val, uint32_t n) {
+        for (uint32_t i=n; i>0; --i) {
+            writeBit((val>>(i-1))&1); 
+        }
+    }
+
+    /**
+     * @brief 写出n bit有符号数，n可以是33（32 bit音频的侧声道）
+    */
+    void writeSigned(int64_t val, uint32_t n) {
+        if (n>32) {
+            writeBits((uint32_t)(val>>32), n-32); 
+            n = 32; 
+        }
+        if (n>0) {
+            writeBits((uint32_t)val, n); 
+        }
+    }
+
+    /**
+     * @brief 写出rice编码：商为一元码，余数k bit
+    */
+    void writeRice(uint64_t folded, uint32_t k) {
+        for (uint64_t q=folded>>k; q>0; --q) {
+            writeBit(0); 
+        }
+        writeBit(1); 
+        writeBits((uint32_t)folded, k); 
+    }
+
+    /**
+     * @brief 写出帧头中UTF-8方式编码的帧号
+    */
+    void writeUtf8(uint64_t val) {
+        if (val<0x80) {
+            writeBits((uint32_t)val, 8); 
+            return; 
+        }
+        uint32_t bytes = 2; 
+        while (bytes<7&&val>=(1ull<<(5*bytes+1))) {
+            ++bytes; 
+        }
+        uint32_t shift = 6*(bytes-1); 
+        writeBits(((0xFF00>>bytes)&0xFF)|(uint32_t)(val>>shift), 8); 
+        while (shift>0) {
+            shift-=6; 
+            writeBits(0x80|((uint32_t)(val>>shift)&0x3F), 8); 
+        }
+    }
+
+    /**
+     * @brief 补0到整字节
+    */
+    void alignToByte() {
+        while (m_bits!=0) {
+            writeBit(0); 
+        }
+    }
+
+    void reset() { m_data.clear(); m_bits = 0; }
+    const uint8_t* getData() const { return m_data.data(); }
+    size_t getLength() const { return m_data.size(); }
+private: 
+    void writeBit(uint32_t bit) {
+        if (m_bits==0) {
+            m_data.push_back(0); 
+        }
+        m_data.back()|=(uint8_t)(bit<<(7-m_bits)); 
+        m_bits = (m_bits+1)&7; 
+    }
+private: 
+    /// @brief 已写出的数据，最后一个字节可能未写满
+    std::vector<uint8_t> m_data; 
+    /// @brief 最后一个字节已写的位数
+    uint32_t m_bits = 0; 
+}; 
+
+/**
+ * @brief 生成测试信号：各声道频率不同的正弦叠加少量噪声，幅度接近满幅
+ * @param[in] samples 每个声道的采样数
+ * @param[in] sampleRate 采样率(Hz)
+ * @param[in] channels 声道数
+ * @param[in] sampleBits 采样位数
+ * @param[in] seed 噪声种子
+ * @param[in] wastedBits 低位补0的位数
+ * @retval PCM
+*/
+static music_data::FlacPcmBlock MakeSignal(uint32_t samples, uint32_t sampleRate, uint32_t channels, uint32_t sampleBits, uint32_t seed, uint32_t wastedBits = 0) {
+    music_data::FlacPcmBlock ans; 
+    ans.blockSize = samples; 
+    ans.sampleRate = sampleRate; 
+    ans.channels = (uint8_t)channels; 
+    ans.sampleBits = (uint8_t)sampleBits; 
+    ans.samples.resize((size_t)samples*channels); 
+
+    std::mt19937 rng(seed); 
+    std::uniform_real_distribution<double> noise(-0.02, 0.02); 
+    double peak = (double)(1ull<<(sampleBits-1))-1; 
+    for (uint32_t c=0; c<channels; ++c) {
+        int32_t* dest = ans.getChannel(c); 
+        double freq = 220.0*(c+1)/sampleRate; 
+        for (uint32_t i=0; i<samples; ++i) {
+            double val = 0.6*sin(2*3.14159265358979*freq*i)+0.3*sin(2*3.14159265358979*freq*3.01*i)+noise(rng); 
+            int64_t sample = (int64_t)(val*peak); 
+            dest[i] = (int32_t)((sample>>wastedBits)<<wastedBits); 
+        }
+    }
+    return ans; 
+}
+
+/**
+ * @brief 计算PCM的MD5（flac的STREAMINFO所用的格式）
+ * @param[in] pcm PCM
+ * @param[out] dest 摘要，Md5::DIGEST_SIZE byte
+*/
+static void PcmMD5(const music_data::FlacPcmBlock& pcm, uint8_t* dest) {
+    uint32_t sampleBytes = (pcm.sampleBits+7)/8; 
+    std::vector<uint8_t> buffer((size_t)pcm.blockSize*pcm.channels*sampleBytes); 
+    pcm.interleave(buffer.data(), sampleBytes); 
+    music_data::Md5 md5; 
+    md5.update(buffer.data(), buffer.size()); 
+    md5.finish(dest); 
+}
+
+/**
+ * @brief 把数据写成文件（已存在时替换）
+ * @param[in] path 文件路径
+ * @param[in] data 数据
+ * @retval 是否成功
+*/
+static bool WriteBytes(const std::wstring& path, const std::vector<uint8_t>& data) {
+    music_data::FileWriter writer(path.c_str()); 
+    std::vector<music_data::WriteSegment> segments(1, music_data::WriteSegment{data.data(), data.size()}); 
+    return writer.write(segments)&&writer.commit(); 
+}
+
+/**
+ * @brief 读取整个文件
+ * @param[in] path 文件路径
+ * @param[out] dest 数据
+ * @retval 是否成功
+*/
+static bool ReadBytes(const std::wstring& path, std::vector<uint8_t>& dest) {
+    music_data::MappedFile file(path.c_str()); 
+    if (!file.isOpen()) {
+        return false; 
+    }
+    dest.assign(file.getData(), file.getData()+file.getSize()); 
+    return true; 
+}
+
+/**
+ * @brief 同目录下是否残留本进程的FileWriter临时文件（路径.进程号_序号.tmp）
+ * @param[in] path 目标文件路径
+ * @retval 是否有残留
+*/
+static bool HasTempFile(const std::wstring& path) {
+    std::wstring prefix = path+L"."+std::to_wstring(GetCurrentProcessId())+L"_"; 
+    for (int i=0; i<4096; ++i) {
+        if (music_data::MappedFile::Exists((prefix+std::to_wstring(i)+L".tmp").c_str())) {
+            return true; 
+        }
+    }
+    return false; 
+}
+
+/**
+ * @brief 生成测试用PNG：签名与IHDR之后是随机数据，足够PngImage解析宽高与位深
+ * @param[in] width 宽
+ * @param[in] height 高
+ * @param[in] length 总长度(byte)
+ * @param[in] seed 随机数种子
+ * @retval PNG数据
+*/
+static std::vector<uint8_t> MakePng(uint32_t width, uint32_t height, size_t length, uint32_t seed) {
+    static const uint8_t s_head[] = {0x89, 'P', 'N', 'G', 0x0D, 0x0A, 0x1A, 0x0A, 0, 0, 0, 13, 'I', 'H', 'D', 'R'}; 
+    std::vector<uint8_t> dest(std::max<size_t>(length, sizeof(s_head)+13)); 
+    memcpy(dest.data(), s_head, sizeof(s_head)); 
+    for (uint32_t i=0; i<4; ++i) {
+        dest[16+i] = (uint8_t)(width>>(24-8*i)); 
+        dest[20+i] = (uint8_t)(height>>(24-8*i)); 
+    }
+    // 位深8，真彩色
+    dest[24] = 8; 
+    dest[25] = 2; 
+    std::mt19937 rng(seed); 
+    for (size_t i=sizeof(s_head)+13; i<dest.size(); ++i) {
+        dest[i] = (uint8_t)rng(); 
+    }
+    return dest; 
+}
+
+/**
+ * @brief 写出一个subframe：variant决定类型（VERBATIM或0~4阶FIXED）、分区数、rice/rice2与哪些分区用escape；
+ *        低位全为0时写wasted bits
+ * @param[out] writer 输出
+ * @param[in] data 采样
+ * @param[in] length 采样数
+ * @param[in] sampleBits 采样位数，侧声道多1 bit
+ * @param[in] variant 编码方式的选择
+*/
+static void EncodeSubframe(TestBitWriter& writer, const int64_t* data, uint32_t length, uint32_t sampleBits, uint32_t variant) {
+    int64_t bitsOr = 0; 
+    for (uint32_t i=0; i<length; ++i) {
+        bitsOr|=data[i]; 
+    }
+    uint32_t wasted = 0; 
+    while (bitsOr!=0&&((bitsOr>>wasted)&1)==0) {
+        ++wasted; 
+    }
+    std::vector<int64_t> shifted(length); 
+    for (uint32_t i=0; i<length; ++i) {
+        shifted[i] = data[i]>>wasted; 
+    }
+    sampleBits-=wasted; 
+
+    // 32 bit以上时0阶残差放不进32 bit的escape分区，至少用1阶
+    bool verbatim = variant%7==6; 
+    uint32_t order = verbatim?0:(sampleBits<32?variant%5:1+variant%4); 
+    order = std::min(order, length-1); 
+    uint32_t code = verbatim?1:8+order; 
+    writer.writeBits((code<<1)|(wasted>0?1:0), 8); 
+    if (wasted>0) {
+        writer.writeBits(1, wasted); 
+    }
+    for (uint32_t i=0; i<(verbatim?length:order); ++i) {
+        writer.writeSigned(shifted[i], sampleBits); 
+    }
+    if (verbatim) {
+        return; 
+    }
+
+    // FIXED残差
+    std::vector<int64_t> residual(length); 
+    for (uint32_t i=order; i<length; ++i) {
+        const int64_t* x = shifted.data()+i; 
+        switch (order) {
+        case 0: residual[i] = x[0]; break; 
+        case 1: residual[i] = x[0]-x[-1]; break; 
+        case 2: residual[i] = x[0]-2*x[-1]+x[-2]; break; 
+        case 3: residual[i] = x[0]-3*x[-1]+3*x[-2]-x[-3]; break; 
+        default: residual[i] = x[0]-4*x[-1]+6*x[-2]-4*x[-3]+x[-4]; break; 
+        }
+    }
+
+    uint32_t partitionOrder = variant%4; 
+    while (partitionOrder>0&&((length>>partitionOrder)<=order||(length&((1u<<partitionOrder)-1))!=0)) {
+        --partitionOrder; 
+    }
+    bool rice2 = (variant/4)%2==1; 
+    uint32_t parts = 1u<<partitionOrder; 
+    uint32_t partSize = length>>partitionOrder; 
+    writer.writeBits(rice2?1:0, 2); 
+    writer.writeBits(partitionOrder, 4); 
+    const int64_t* pin = residual.data()+order; 
+    for (uint32_t p=0; p<parts; ++p) {
+        uint32_t num = p==0?partSize-order:partSize; 
+        // escape分区的位数：能表示全部残差的最小有符号位数，全为0时为0
+        uint64_t maxFolded = 0; 
+        uint32_t rawBits = 0; 
+        for (uint32_t j=0; j<num; ++j) {
+            uint64_t folded = pin[j]>=0?(uint64_t)pin[j]<<1:((uint64_t)(-pin[j])<<1)-1; 
+            maxFolded = std::max(maxFolded, folded); 
+        }
+        while (maxFolded>>rawBits) {
+            ++rawBits; 
+        }
+        uint32_t k = 0; 
+        while (k<(rice2?30u:14u)&&(maxFolded>>k)>32) {
+            ++k; 
+        }
+        // 每隔几个分区用escape，残差太大时也只能用escape
+        if ((p+variant)%3==0||(maxFolded>>k)>32) {
+            writer.writeBits(rice2?0x1F:0xF, rice2?5:4); 
+            writer.writeBits(rawBits, 5); 
+            for (uint32_t j=0; j<num; ++j) {
+                writer.writeSigned(pin[j], rawBits); 
+            }
+        } else {
+            writer.writeBits(k, rice2?5:4); 
+            for (uint32_t j=0; j<num; ++j) {
+                uint64_t folded = pin[j]>=0?(uint64_t)pin[j]<<1:((uint64_t)(-pin[j])<<1)-1; 
+                writer.writeRice(folded, k); 
+            }
+        }
+        pin+=num; 
+    }
+}
+
+/**
+ * @brief 按固定帧长逐帧编码，立体声时各帧轮流使用给定的声道编码
+ * @param[in] pcm PCM
+ * @param[in] blockSize 帧长
+ * @param[out] dest 各帧数据
+ * @param[out] frameOffsets 各帧起点
+ * @param[in] assignments 各帧轮流使用的声道编码（多声道时只能独立编码）
+*/
+static void EncodeFrames(const music_data::FlacPcmBlock& pcm, uint32_t blockSize, std::vector<uint8_t>& dest, std::vector<size_t>& frameOffsets,
+    const std::vector<uint32_t>& assignments = {ASSIGN_INDEPENDENT, ASSIGN_LEFT_SIDE, ASSIGN_SIDE_RIGHT, ASSIGN_MID_SIDE}) {
+    static const uint32_t s_bitsCodes[33] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 2, 0, 0, 0, 4, 0, 0, 0, 5, 0, 0, 0, 6, 0, 0, 0, 0, 0, 0, 0, 7}; 
+    uint32_t rateCode = pcm.sampleRate==44100?9:(pcm.sampleRate==48000?10:0); 
+    TestBitWriter writer; 
+    std::vector<int64_t> channels[8]; 
+    dest.clear(); 
+    frameOffsets.clear(); 
+    for (uint32_t frame=0; (uint64_t)frame*blockSize<pcm.blockSize; ++frame) {
+        uint32_t first = frame*blockSize; 
+        uint32_t length = std::min(blockSize, pcm.blockSize-first); 
+        uint32_t assignment = pcm.channels==2?assignments[frame%assignments.size()]:ASSIGN_INDEPENDENT; 
+        for (uint32_t c=0; c<pcm.channels; ++c) {
+            const int32_t* pin = pcm.getChannel(c)+first; 
+            channels[c].assign(pin, pin+length); 
+        }
+        uint32_t extraBits[2] = {0, 0}; 
+        if (assignment!=ASSIGN_INDEPENDENT) {
+            for (uint32_t i=0; i<length; ++i) {
+                int64_t left = channels[0][i]; 
+                int64_t right = channels[1][i]; 
+                int64_t side = left-right; 
+                if (assignment==ASSIGN_LEFT_SIDE) {
+                    channels[1][i] = side; 
+                } else if (assignment==ASSIGN_SIDE_RIGHT) {
+                    channels[0][i] = side; 
+                } else {
+                    channels[0][i] = (left+right)>>1; 
+                    channels[1][i] = side; 
+                }
+            }
+            extraBits[assignment==ASSIGN_SIDE_RIGHT?0:1] = 1; 
+        }
+
+        // 帧头：16 bit block size，采样率与位数没有对应编码时从STREAMINFO取
+        writer.reset(); 
+        writer.writeBits(0xFFF8, 16); 
+        writer.writeBits(7, 4); 
+        writer.writeBits(rateCode, 4); 
+        writer.writeBits(assignment==ASSIGN_INDEPENDENT?pcm.channels-1:assignment, 4); 
+        writer.writeBits(s_bitsCodes[pcm.sampleBits], 3); 
+        writer.writeBits(0, 1); 
+        writer.writeUtf8(frame); 
+        writer.writeBits(length-1, 16); 
+        writer.writeBits(music_data::crc8(writer.getData(), writer.getLength()), 8); 
+        for (uint32_t c=0; c<pcm.channels; ++c) {
+            EncodeSubframe(writer, channels[c].data(), length, pcm.sampleBits+(c<2?extraBits[c]:0), frame*3+c); 
+        }
+        writer.alignToByte(); 
+        writer.writeBits(music_data::crc16(writer.getData(), writer.getLength()), 16); 
+
+        frameOffsets.push_back(dest.size()); 
+        dest.insert(dest.end(), writer.getData(), writer.getData()+writer.getLength()); 
+    }
+}
+
+/**
+ * @brief 写出flac文件："fLaC"、STREAMINFO、可选的SEEKTABLE与帧
+ * @param[in] path 文件路径
+ * @param[in] pcm PCM，用于STREAMINFO，其中的MD5按PCM计算
+ * @param[in] blockSize 帧长
+ * @param[in] frames 各帧数据
+ * @param[in] frameOffsets 各帧起点
+ * @param[in] seekPointFrames 每隔多少帧一个定位点，0表示不写SEEKTABLE
+ * @retval 是否成功
+*/
+static bool WriteFlacFrames(const std::wstring& path, const music_data::FlacPcmBlock& pcm, uint32_t blockSize,
+    const std::vector<uint8_t>& frames, const std::vector<size_t>& frameOffsets, uint32_t seekPointFrames = 0) {
+    std::vector<uint8_t> data(4+4+34); 
+    memcpy(data.data(), "fLaC", 4); 
+    data[7] = 34; 
+    music_data::StreamInfoMetaBlock streamInfo(data.data()+8, 34); 
+    uint8_t digest[music_data::Md5::DIGEST_SIZE]; 
+    PcmMD5(pcm, digest); 
+    streamInfo.setMinBlockSize((uint16_t)blockSize); 
+    streamInfo.setMaxBlockSize((uint16_t)blockSize); 
+    if (!streamInfo.setSampleRate(pcm.sampleRate)||!streamInfo.setChannels(pcm.channels)||!streamInfo.setSampleBits(pcm.sampleBits)
+        ||!streamInfo.setSamplePerChannel(pcm.blockSize)||!streamInfo.setUnencoderedMD5(digest, sizeof(digest))
+        ||streamInfo.resave(data.data()+4, seekPointFrames==0)!=4+34) {
+        return false; 
+    }
+
+    // SEEKTABLE：每个定位点为首采样号、帧偏移各8 byte与帧的采样数2 byte，均为大端
+    if (seekPointFrames>0) {
+        std::vector<uint8_t> points; 
+        for (size_t i=0; i<frameOffsets.size(); i+=seekPointFrames) {
+            uint64_t first = (uint64_t)i*blockSize; 
+            uint64_t fields[2] = {first, frameOffsets[i]}; 
+            for (uint64_t val: fields) {
+                for (int b=56; b>=0; b-=8) {
+                    points.push_back((uint8_t)(val>>b)); 
+                }
+            }
+            uint32_t num = (uint32_t)std::min<uint64_t>(blockSize, pcm.blockSize-first); 
+            points.push_back((uint8_t)(num>>8)); 
+            points.push_back((uint8_t)num); 
+        }
+        uint32_t length = (uint32_t)points.size(); 
+        uint8_t blockHead[4] = {(uint8_t)(0x80|music_data::Metadata_block::SEEKTABLE), (uint8_t)(length>>16), (uint8_t)(length>>8), (uint8_t)length}; 
+        data.insert(data.end(), blockHead, blockHead+4); 
+        data.insert(data.end(), points.begin(), points.end()); 
+    }
+    data.insert(data.end(), frames.begin(), frames.end()); 
+    return WriteBytes(path, data); 
+}
+
+/**
+ * @brief 把PCM编码为flac文件，metadata只有STREAMINFO与可选的SEEKTABLE
+ * @param[in] path 文件路径
+ * @param[in] pcm PCM
+ * @param[in] seekPointFrames 每隔多少帧一个定位点，0表示不写SEEKTABLE
+ * @param[in] blockSize 帧长
+ * @retval 是否成功
+*/
+static bool WriteFlac(const std::wstring& path, const music_data::FlacPcmBlock& pcm, uint32_t seekPointFrames = 0, uint32_t blockSize = 4096) {
+    std::vector<uint8_t> frames; 
+    std::vector<size_t> frameOffsets; 
+    EncodeFrames(pcm, blockSize, frames, frameOffsets); 
+    return WriteFlacFrames(path, pcm, blockSize, frames, frameOffsets, seekPointFrames); 
+}
+
+/**
+ * @brief 依次解码文件中的全部帧
+ * @param[in] decoder flac解码器
+ * @param[out] dest PCM，按帧拼接
+ * @param[out] badFrames 跳过的损坏数据次数，可为nullptr
+ * @retval 是否解码到帧
+*/
+static bool DecodeAll(const music_data::MusicDecoderflac& decoder, music_data::FlacPcmBlock& dest, uint32_t* badFrames = nullptr) {
+    music_data::FlacAudioDecoder audio(decoder); 
+    if (!audio.isValid()) {
+        return false; 
+    }
+    std::vector<music_data::FlacPcmBlock> blocks; 
+    music_data::FlacPcmBlock block; 
+    uint64_t expected = 0; 
+    uint32_t bad = 0; 
+    while (audio.decodeNext(block)) {
+        if (block.firstSample!=expected) {
+            ++bad; 
+        }
+        expected = block.firstSample+block.blockSize; 
+        blocks.emplace_back(std::move(block)); 
+    }
+    if (badFrames!=nullptr) {
+        *badFrames = bad; 
+    }
+    if (blocks.empty()) {
+        return false; 
+    }
+
+    uint32_t total = 0; 
+    for (auto& item: blocks) {
+        total+=item.blockSize; 
+    }
+    dest = music_data::FlacPcmBlock(); 
+    dest.firstSample = blocks.front().firstSample; 
+    dest.blockSize = total; 
+    dest.sampleRate = blocks.front().sampleRate; 
+    dest.channels = blocks.front().channels; 
+    dest.sampleBits = blocks.front().sampleBits; 
+    dest.samples.resize((size_t)total*dest.channels); 
+    uint32_t pos = 0; 
+    for (auto& item: blocks) {
+        for (uint32_t c=0; c<dest.channels; ++c) {
+            memcpy(dest.getChannel(c)+pos, item.getChannel(c), item.blockSize*sizeof(int32_t)); 
+        }
+        pos+=item.blockSize; 
+    }
+    return true; 
+}
+
+/**
+ * @brief 比较两段PCM的参数与采样
+ * @param[in] a PCM
+ * @param[in] b PCM
+ * @retval 是否相同
+*/
+static bool SamePcm(const music_data::FlacPcmBlock& a, const music_data::FlacPcmBlock& b) {
+    return a.blockSize==b.blockSize&&a.channels==b.channels&&a.sampleBits==b.sampleBits&&a.samples==b.samples; 
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,180 @@
+#include "decoderflac.h"
+#include "image.h"
+#include "log.h"
+#include "flactestfile.h"
+
+#include <functional>
+#include <stdio.h>
+
+INITONLYLOGGER(); 
+
+using music_data::FlacPcmBlock; 
+using music_data::Metadata_block; 
+using music_data::MusicDecoderflac; 
+using music_data::PictureMetaBlock; 
+
+static const wchar_t* s_file = L"test_flacblocks.flac"; 
+
+/// @brief 初始padding大小
+static const uint32_t s_paddingSize = 64; 
+
+/**
+ * @brief 生成包含全部可编辑block的测试文件：PADDING、APPLICATION、SEEKTABLE、VORBIS_COMMENT、CUESHEET与一张封面
+*/
+static bool makeFile() {
+    FlacPcmBlock pcm = MakeSignal(4096*4, 44100, 2, 16, 29); 
+    if (!WriteFlac(s_file, pcm)) {
+        return false; 
+    }
+
+    MusicDecoderflac decoder(s_file); 
+    std::vector<uint8_t> padding(s_paddingSize); 
+    uint8_t application[12] = {'t', 'e', 's', 't', 1, 2, 3, 4, 5, 6, 7, 8}; 
+    // 一个seekpoint：第0个sample，偏移0，4096个sample
+    uint8_t seekPoint[18] = {0}; 
+    seekPoint[16] = 0x10; 
+    std::vector<uint8_t> cuesheet(396); 
+    std::vector<uint8_t> png = MakePng(16, 16, 200, 1); 
+    music_data::PngImage img(png.data(), png.size()); 
+
+    bool ans = decoder.addMetaDataBlock(padding.data(), padding.size(), Metadata_block::PADDING)
+        &&decoder.addMetaDataBlock(application, sizeof(application), Metadata_block::APPLICATION)
+        &&decoder.addMetaDataBlock(seekPoint, sizeof(seekPoint), Metadata_block::SEEKTABLE)
+        &&decoder.addMetaDataBlock(cuesheet.data(), cuesheet.size(), Metadata_block::CUESHEET)
+        &&decoder.addVorbisCommentMetaBlock("encoder")&&decoder.addbackCover(img); 
+    if (!ans) {
+        return false; 
+    }
+    auto comment = decoder.getVorbisComment(); 
+    return comment->addInfoLabel("TITLE", "a")&&comment->addInfoLabel("ARTIST", "x")&&comment->addInfoLabel("ARTIST", "y")
+        &&comment->addInfoLabel("GENRE", "g")&&decoder.save(); 
+}
+
+/**
+ * @brief 取得vorbis comment中某个key的全部值
+*/
+static std::vector<std::string> labels(const MusicDecoderflac& decoder, const std::string& key) {
+    std::vector<std::string> dest; 
+    decoder.getVorbisComment()->getLabelListWithKey(key, dest); 
+    return dest; 
+}
+
+/**
+ * @brief 取得第一张图片
+*/
+static PictureMetaBlock::ptr picture(const MusicDecoderflac& decoder) {
+    std::vector<PictureMetaBlock::ptr> dest; 
+    decoder.getPictures(dest); 
+    return dest.empty()?nullptr:dest[0]; 
+}
+
+/**
+ * @brief 每个block的每个修改接口单独修改一次后保存、重新打开，修改都应写入文件
+*/
+bool test_mutators() {
+    struct Case {
+        const char* name; 
+        std::function<bool(MusicDecoderflac&)> edit; 
+        std::function<bool(const MusicDecoderflac&)> check; 
+    }; 
+
+    static const uint8_t s_md5[16] = {0xA5, 0xA5, 0xA5, 0xA5, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12}; 
+    static const uint8_t s_appData[8] = {8, 7, 6, 5, 4, 3, 2, 1}; 
+    std::vector<uint8_t> png = MakePng(32, 24, 300, 2); 
+
+    std::vector<Case> cases = {
+        {"min block size", [](MusicDecoderflac& d) { d.getStreamInfo()->setMinBlockSize(16); return true; },
+            [](const MusicDecoderflac& d) { return d.getStreamInfo()->getMinBlockSize()==16; }},
+        {"max block size", [](MusicDecoderflac& d) { d.getStreamInfo()->setMaxBlockSize(8192); return true; },
+            [](const MusicDecoderflac& d) { return d.getStreamInfo()->getMaxBlockSize()==8192; }},
+        {"min frame size", [](MusicDecoderflac& d) { return d.getStreamInfo()->setMinFrameSize(100); },
+            [](const MusicDecoderflac& d) { return d.getStreamInfo()->getMinFrameSize()==100; }},
+        {"max frame size", [](MusicDecoderflac& d) { return d.getStreamInfo()->setMaxFrameSize(60000); },
+            [](const MusicDecoderflac& d) { return d.getStreamInfo()->getMaxFrameSize()==60000; }},
+        {"sample rate", [](MusicDecoderflac& d) { return d.getStreamInfo()->setSampleRate(48000); },
+            [](const MusicDecoderflac& d) { return d.getStreamInfo()->getSampleRate()==48000; }},
+        {"channels", [](MusicDecoderflac& d) { return d.getStreamInfo()->setChannels(1); },
+            [](const MusicDecoderflac& d) { return d.getStreamInfo()->getChannels()==1; }},
+        {"sample bits", [](MusicDecoderflac& d) { return d.getStreamInfo()->setSampleBits(24); },
+            [](const MusicDecoderflac& d) { return d.getStreamInfo()->getSampleBits()==24; }},
+        {"samples", [](MusicDecoderflac& d) { return d.getStreamInfo()->setSamplePerChannel(12345); },
+            [](const MusicDecoderflac& d) { return d.getStreamInfo()->getSamplePerChannel()==12345; }},
+        {"md5", [](MusicDecoderflac& d) { return d.getStreamInfo()->setUnencoderedMD5((void*)s_md5, sizeof(s_md5)); },
+            [](const MusicDecoderflac& d) {
+                uint8_t md5[16]; 
+                return d.getStreamInfo()->getUnencoderedMD5(md5, sizeof(md5))&&memcmp(md5, s_md5, sizeof(md5))==0; 
+            }},
+        {"add padding", [](MusicDecoderflac& d) { d.getPadding()->addPaddingByte(100); return true; },
+            [](const MusicDecoderflac& d) { return d.getPadding()!=nullptr&&d.getPadding()->getBlockSize()==s_paddingSize+100; }},
+        {"del padding", [](MusicDecoderflac& d) { d.getPadding()->delPaddingByte(16); return true; },
+            [](const MusicDecoderflac& d) { return d.getPadding()!=nullptr&&d.getPadding()->getBlockSize()==s_paddingSize-16; }},
+        {"app id", [](MusicDecoderflac& d) { d.getApplication()->setAppId(0x61626364); return true; },
+            [](const MusicDecoderflac& d) { return d.getApplication()->getAppId()==0x61626364; }},
+        {"app data", [](MusicDecoderflac& d) { d.getApplication()->setAppData((void*)s_appData, sizeof(s_appData)); return true; },
+            [](const MusicDecoderflac& d) {
+                uint8_t data[8]; 
+                return d.getApplication()->getAppData(data, sizeof(data))&&memcmp(data, s_appData, sizeof(data))==0; 
+            }},
+        {"add seek point", [](MusicDecoderflac& d) { return d.getSeekTable()->addSeekPoint(4096, 100, 4096); },
+            [](const MusicDecoderflac& d) { return d.getSeekTable()->getSeekPointsLength()==2; }},
+        {"del seek point", [](MusicDecoderflac& d) { return d.getSeekTable()->delSeekPoint(0, 0, 4096); },
+            [](const MusicDecoderflac& d) { return d.getSeekTable()->getSeekPointsLength()==0; }},
+        {"clear seek points", [](MusicDecoderflac& d) { d.getSeekTable()->clearSeekPoints(); return true; },
+            [](const MusicDecoderflac& d) { return d.getSeekTable()->getSeekPointsLength()==0; }},
+        {"encoder", [](MusicDecoderflac& d) { return d.getVorbisComment()->setEncoderIdentification("new encoder"); },
+            [](const MusicDecoderflac& d) { return d.getVorbisComment()->getEncoderIdentificationToString()=="new encoder"; }},
+        {"add label", [](MusicDecoderflac& d) { return d.getVorbisComment()->addInfoLabel("ALBUM", "new"); },
+            [](const MusicDecoderflac& d) { return labels(d, "ALBUM")==std::vector<std::string>{"new"}; }},
+        {"del label by value", [](MusicDecoderflac& d) { return d.getVorbisComment()->delInfoLabel("TITLE", "a"); },
+            [](const MusicDecoderflac& d) { return labels(d, "TITLE").empty(); }},
+        {"del label by pos", [](MusicDecoderflac& d) { return d.getVorbisComment()->delInfoLabel("ARTIST", 1u); },
+            [](const MusicDecoderflac& d) { return labels(d, "ARTIST")==std::vector<std::string>{"x"}; }},
+        {"del all labels", [](MusicDecoderflac& d) { return d.getVorbisComment()->delAllInfoLabel("ARTIST")==2; },
+            [](const MusicDecoderflac& d) { return labels(d, "ARTIST").empty(); }},
+        {"del all match labels", [](MusicDecoderflac& d) { return d.getVorbisComment()->delAllMatchInfoLabel("GENRE", "g")==1; },
+            [](const MusicDecoderflac& d) { return labels(d, "GENRE").empty(); }},
+        {"compact disc", [](MusicDecoderflac& d) { d.getCuesheet()->setIsCompactDisc(true); return true; },
+            [](const MusicDecoderflac& d) { return d.getCuesheet()->isCompactDisc(); }},
+        {"picture type", [](MusicDecoderflac& d) { picture(d)->setPictureType(PictureMetaBlock::BACK_COVER); return true; },
+            [](const MusicDecoderflac& d) { return picture(d)->getPictureType()==PictureMetaBlock::BACK_COVER; }},
+        {"descriptor", [](MusicDecoderflac& d) { return picture(d)->setDescriptor("desc"); },
+            [](const MusicDecoderflac& d) { return picture(d)->getDescriptorToString()=="desc"; }},
+        {"picture", [&png](MusicDecoderflac& d) { return picture(d)->setPicture(music_data::PngImage(png.data(), png.size())); },
+            [&png](const MusicDecoderflac& d) {
+                auto pic = picture(d); 
+                std::vector<uint8_t> data(pic->getPictureDataLength()); 
+                return pic->getPictureWidth()==32&&pic->getPictureHeight()==24&&pic->getPictureData(data.data(), data.size())&&data==png; 
+            }},
+    }; 
+
+    bool ans = true; 
+    for (auto& item: cases) {
+        if (!makeFile()) {
+            LOGE("%s: make file fail", item.name); 
+            ans = false; 
+            continue; 
+        }
+        MusicDecoderflac::SaveStrategy used = MusicDecoderflac::SAVE_UNCHANGED; 
+        {
+            MusicDecoderflac decoder(s_file); 
+            if (!item.edit(decoder)||!decoder.save(&used)||used==MusicDecoderflac::SAVE_UNCHANGED) {
+                LOGE("%s: edit not saved, strategy %d", item.name, used); 
+                ans = false; 
+                continue; 
+            }
+        }
+        MusicDecoderflac decoder(s_file); 
+        if (!decoder.isValid()||!item.check(decoder)) {
+            LOGE("%s: edit lost after reopen", item.name); 
+            ans = false; 
+        }
+    }
+    printf("mutators: %s\n", ans?"ok":"FAIL"); 
+    return ans; 
+}
+
+int main(int argc, char** argv) {
+    bool ok = test_mutators(); 
+    DeleteFileW(s_file); 
+    return ok?0:1; 
+}
\ No newline at end of file
@@ -0,0 +1,120 @@
+#include "flacdecoder.h"
+#include "decoderflac.h"
+#include "log.h"
+#include "flactestfile.h"
+
+#include <vector>
+#include <stdio.h>
+
+INITONLYLOGGER(); 
+
+using music_data::FlacPcmBlock; 
+using music_data::MusicDecoderflac; 
+
+static const wchar_t* s_file = L"test_flacdecoder.flac"; 
+
+/**
+ * @brief 解码文件，与参考PCM及STREAMINFO中的MD5比较
+*/
+static bool checkDecode(const char* name, const FlacPcmBlock& pcm) {
+    MusicDecoderflac decoder(s_file); 
+    FlacPcmBlock decoded; 
+    uint32_t badFrames = 0; 
+    if (!DecodeAll(decoder, decoded, &badFrames)||badFrames>0) {
+        LOGE("%s decode fail, %d bad frames", name, badFrames); 
+        return false; 
+    }
+    if (!SamePcm(decoded, pcm)) {
+        LOGE("%s pcm mismatch", name); 
+        return false; 
+    }
+    uint8_t expect[music_data::Md5::DIGEST_SIZE]; 
+    uint8_t digest[music_data::Md5::DIGEST_SIZE]; 
+    decoder.getStreamInfo()->getUnencoderedMD5(expect, sizeof(expect)); 
+    PcmMD5(decoded, digest); 
+    if (memcmp(expect, digest, sizeof(digest))!=0) {
+        LOGE("%s md5 mismatch", name); 
+        return false; 
+    }
+    return true; 
+}
+
+/**
+ * @brief 各种subframe、rice/rice2与escape分区、声道编码逐位还原，MD5与STREAMINFO一致
+*/
+bool test_reference() {
+    struct Case {
+        const char* name; 
+        uint32_t channels; 
+        uint32_t sampleBits; 
+        uint32_t wastedBits; 
+        uint32_t blockSize; 
+    }; 
+    static const Case s_cases[] = {
+        {"16 bit stereo", 2, 16, 0, 1152},
+        {"24 bit stereo wasted bits", 2, 24, 4, 1024},
+        {"32 bit stereo 33 bit side", 2, 32, 0, 576},
+        {"16 bit 6 channels", 6, 16, 0, 4096},
+    }; 
+
+    bool ans = true; 
+    for (auto& item: s_cases) {
+        // 采样数不是帧长的整数倍，最后一帧较短
+        FlacPcmBlock pcm = MakeSignal(item.blockSize*7+100, 44100, item.channels, item.sampleBits, item.sampleBits, item.wastedBits); 
+        if (!WriteFlac(s_file, pcm, 0, item.blockSize)||!checkDecode(item.name, pcm)) {
+            ans = false; 
+        }
+    }
+    printf("reference: %s\n", ans?"ok":"FAIL"); 
+    return ans; 
+}
+
+/**
+ * @brief 中间一帧损坏时decodeNext跳过该帧，之后的帧照常解码
+*/
+bool test_resync() {
+    const uint32_t blockSize = 1024; 
+    FlacPcmBlock pcm = MakeSignal(blockSize*6, 44100, 2, 16, 42); 
+    std::vector<uint8_t> frames; 
+    std::vector<size_t> offsets; 
+    EncodeFrames(pcm, blockSize, frames, offsets, {ASSIGN_MID_SIDE}); 
+    frames[(offsets[2]+offsets[3])/2]^=0x5A; 
+    if (!WriteFlacFrames(s_file, pcm, blockSize, frames, offsets)) {
+        printf("resync: FAIL\n"); 
+        return false; 
+    }
+
+    bool ans = true; 
+    MusicDecoderflac decoder(s_file); 
+    music_data::FlacAudioDecoder audio(decoder); 
+    FlacPcmBlock block; 
+    std::vector<uint64_t> firstSamples; 
+    while (audio.decodeNext(block)) {
+        firstSamples.push_back(block.firstSample); 
+        uint32_t frame = (uint32_t)(block.firstSample/blockSize); 
+        for (uint32_t c=0; c<2; ++c) {
+            if (memcmp(block.getChannel(c), pcm.getChannel(c)+block.firstSample, blockSize*sizeof(int32_t))!=0) {
+                LOGE("frame %d channel %d mismatch", frame, c); 
+                ans = false; 
+            }
+        }
+    }
+    std::vector<uint64_t> expect = {0, blockSize, 3*blockSize, 4*blockSize, 5*blockSize}; 
+    if (firstSamples!=expect) {
+        LOGE("decoded %d frames, expect frames other than the broken one", (int)firstSamples.size()); 
+        ans = false; 
+    }
+    if (audio.decodeFrame(offsets[2], block)) {
+        LOGE("broken frame decoded"); 
+        ans = false; 
+    }
+    printf("resync: %s\n", ans?"ok":"FAIL"); 
+    return ans; 
+}
+
+int main(int argc, char** argv) {
+    bool ok = test_reference(); 
+    ok = test_resync()&&ok; 
+    DeleteFileW(s_file); 
+    return ok?0:1; 
+}
\ No newline at end of file
@@ -0,0 +1,201 @@
+#include "flacedit.h"
+#include "decoderflac.h"
+#include "image.h"
+#include "log.h"
+#include "flactestfile.h"
+
+#include <stdio.h>
+
+INITONLYLOGGER(); 
+
+using music_data::FlacEdit; 
+using music_data::FlacPcmBlock; 
+using music_data::Metadata_block; 
+using music_data::MusicDecoderflac; 
+using music_data::PictureMetaBlock; 
+
+static const std::vector<std::wstring> s_files = {L"test_flacedit_0.flac", L"test_flacedit_1.flac", L"test_flacedit_2.flac"}; 
+static const wchar_t* s_missing = L"test_flacedit_missing.flac"; 
+
+/**
+ * @brief 生成测试文件：标签TITLE=old、GENRE=g与一张封面，可选padding
+ * @param[in] path 文件路径
+ * @param[in] pcm 音频
+ * @param[in] paddingSize padding大小，0表示没有padding
+ * @param[in] cover 封面
+*/
+static bool makeFile(const std::wstring& path, const FlacPcmBlock& pcm, uint32_t paddingSize, const std::vector<uint8_t>& cover) {
+    if (!WriteFlac(path, pcm)) {
+        return false; 
+    }
+    MusicDecoderflac decoder(path.c_str()); 
+    std::vector<uint8_t> padding(paddingSize); 
+    if (paddingSize>0&&!decoder.addMetaDataBlock(padding.data(), padding.size(), Metadata_block::PADDING)) {
+        return false; 
+    }
+    return decoder.setbackTitle("old")&&decoder.getVorbisComment()->addInfoLabel("GENRE", "g")
+        &&decoder.addbackCover(music_data::PngImage((void*)cover.data(), cover.size()))&&decoder.save(); 
+}
+
+/**
+ * @brief 重新打开文件，检查标签、封面逐字节相同与音频逐位还原
+*/
+static bool checkFile(const std::wstring& path, const FlacPcmBlock& pcm, const std::vector<std::string>& artists,
+    const std::vector<std::vector<uint8_t>>& covers) {
+    MusicDecoderflac decoder(path.c_str()); 
+    std::vector<std::string> values; 
+    std::vector<std::string> genres; 
+    std::vector<PictureMetaBlock::ptr> pictures; 
+    FlacPcmBlock decoded; 
+    decoder.getArtists(values); 
+    decoder.getVorbisComment()->getLabelListWithKey("GENRE", genres); 
+    decoder.getPictures(pictures); 
+    if (decoder.getTitle()!="new"||values!=artists||!genres.empty()||pictures.size()!=covers.size()) {
+        LOGE("tags or covers not committed"); 
+        return false; 
+    }
+    for (size_t i=0; i<covers.size(); ++i) {
+        std::vector<uint8_t> data(pictures[i]->getPictureDataLength()); 
+        if (!pictures[i]->getPictureData(data.data(), data.size())||data!=covers[i]) {
+            LOGE("cover %d mismatch", (int)i); 
+            return false; 
+        }
+    }
+    if (!DecodeAll(decoder, decoded)||!SamePcm(decoded, pcm)) {
+        LOGE("audio mismatch"); 
+        return false; 
+    }
+    return true; 
+}
+
+/**
+ * @brief 单个文件与批量提交：标签与封面修改都写入文件，音频不变，不留临时文件；打不开的文件单独失败
+*/
+bool test_commit() {
+    std::vector<uint8_t> oldCover = MakePng(16, 16, 2000, 10); 
+    std::vector<uint8_t> newCover = MakePng(32, 32, 6000, 11); 
+    std::vector<uint8_t> backCover = MakePng(24, 24, 4000, 12); 
+    std::vector<FlacPcmBlock> pcms; 
+    for (size_t i=0; i<s_files.size(); ++i) {
+        pcms.push_back(MakeSignal(4096*4+100*i, 44100, 2, 16, 33+i)); 
+    }
+
+    FlacEdit edit; 
+    edit.setTag("TITLE", "new"); 
+    edit.addTag("ARTIST", "a"); 
+    edit.addTag("ARTIST", "b"); 
+    edit.removeTag("GENRE"); 
+    edit.setCover(std::make_shared<music_data::PngImage>(newCover.data(), newCover.size())); 
+    edit.addCover(std::make_shared<music_data::PngImage>(backCover.data(), backCover.size())); 
+    std::vector<std::vector<uint8_t>> covers = {newCover, backCover}; 
+
+    bool ans = true; 
+    // 单个文件：padding足够时原地保存
+    MusicDecoderflac::SaveStrategy used = MusicDecoderflac::SAVE_UNCHANGED; 
+    if (!makeFile(s_files[0], pcms[0], 20000, oldCover)||!edit.commit(s_files[0].c_str(), &used)
+        ||used!=MusicDecoderflac::SAVE_PADDING_RESIZE||!checkFile(s_files[0], pcms[0], {"a", "b"}, covers)) {
+        LOGE("commit fail, strategy %d", used); 
+        ans = false; 
+    }
+
+    // 批量：有padding的原地保存，没有padding的整体重写
+    for (size_t i=0; i<s_files.size(); ++i) {
+        if (!makeFile(s_files[i], pcms[i], i==0?20000:0, oldCover)) {
+            ans = false; 
+        }
+    }
+    std::vector<std::wstring> files = s_files; 
+    files.insert(files.begin()+1, s_missing); 
+    std::vector<FlacEdit::Result> results; 
+    if (edit.commitBatch(files, &results)!=s_files.size()||results.size()!=files.size()||results[1].success) {
+        LOGE("commit batch count wrong"); 
+        ans = false; 
+    }
+    for (size_t i=0, k=0; i<results.size(); ++i) {
+        if (i==1) {
+            continue; 
+        }
+        MusicDecoderflac::SaveStrategy expect = k==0?MusicDecoderflac::SAVE_PADDING_RESIZE:MusicDecoderflac::SAVE_FULL_REWRITE; 
+        if (!results[i].success||results[i].path!=files[i]||results[i].strategy!=expect
+            ||!checkFile(s_files[k], pcms[k], {"a", "b"}, covers)||HasTempFile(s_files[k])) {
+            LOGE("commit batch file %d wrong", (int)k); 
+            ans = false; 
+        }
+        ++k; 
+    }
+    printf("commit: %s\n", ans?"ok":"FAIL"); 
+    return ans; 
+}
+
+/**
+ * @brief 分步保存：endSave之前源文件不变，之后才替换；beginSave后放弃保存时删除临时文件、源文件不变；
+ *        提交失败（修改无法应用、事务无效）时不写文件
+*/
+bool test_failedSave() {
+    FlacPcmBlock pcm = MakeSignal(4096*4, 44100, 2, 16, 34); 
+    std::vector<uint8_t> cover = MakePng(16, 16, 2000, 13); 
+    std::vector<uint8_t> original; 
+    std::vector<uint8_t> actual; 
+    const std::wstring& path = s_files[0]; 
+    if (!makeFile(path, pcm, 0, cover)||!ReadBytes(path, original)) {
+        printf("failed save: FAIL\n"); 
+        return false; 
+    }
+
+    bool ans = true; 
+    {
+        MusicDecoderflac decoder(path.c_str()); 
+        MusicDecoderflac::SaveStrategy used = MusicDecoderflac::SAVE_UNCHANGED; 
+        if (!decoder.setbackTitle("changed")||!decoder.beginSave(&used)||used!=MusicDecoderflac::SAVE_FULL_REWRITE
+            ||!decoder.flushSave()||!HasTempFile(path)||!ReadBytes(path, actual)||actual!=original) {
+            LOGE("source changed before endSave"); 
+            ans = false; 
+        }
+        if (!decoder.endSave()||HasTempFile(path)||decoder.getTitle()!="changed") {
+            LOGE("endSave fail"); 
+            ans = false; 
+        }
+    }
+    if (!makeFile(path, pcm, 0, cover)||!ReadBytes(path, original)) {
+        ans = false; 
+    }
+
+    // 开始保存后放弃：解码器析构时删除临时文件
+    {
+        MusicDecoderflac decoder(path.c_str()); 
+        if (!decoder.setbackTitle("abandoned")||!decoder.beginSave()||!HasTempFile(path)) {
+            LOGE("beginSave fail"); 
+            ans = false; 
+        }
+    }
+    if (HasTempFile(path)||!ReadBytes(path, actual)||actual!=original) {
+        LOGE("abandoned save left temp file or changed source"); 
+        ans = false; 
+    }
+
+    // 后面的修改无法应用（封面位置不存在）：前面的修改不写入文件
+    FlacEdit edit; 
+    edit.setTag("TITLE", "new"); 
+    edit.removeCover(3); 
+    if (edit.commit(path.c_str())||HasTempFile(path)||!ReadBytes(path, actual)||actual!=original) {
+        LOGE("failed commit changed source"); 
+        ans = false; 
+    }
+    FlacEdit invalid; 
+    if (invalid.setTag("BAD=KEY", "x")||invalid.isValid()||invalid.commit(path.c_str())
+        ||invalid.commitBatch(s_files)!=0||!ReadBytes(path, actual)||actual!=original) {
+        LOGE("invalid edit committed"); 
+        ans = false; 
+    }
+    printf("failed save: %s\n", ans?"ok":"FAIL"); 
+    return ans; 
+}
+
+int main(int argc, char** argv) {
+    bool ok = test_commit(); 
+    ok = test_failedSave()&&ok; 
+    for (auto& item: s_files) {
+        DeleteFileW(item.c_str()); 
+    }
+    return ok?0:1; 
+}
\ No newline at end of file
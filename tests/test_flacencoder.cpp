@@ -0,0 +1,178 @@
+#include "flacencoder.h"
+#include "decoderflac.h"
+#include "log.h"
+#include "flactestfile.h"
+
+#include <stdio.h>
+
+INITONLYLOGGER(); 
+
+using music_data::AudioVerifyResult; 
+using music_data::FlacEncoder; 
+using music_data::FlacPcmBlock; 
+using music_data::MusicDecoderflac; 
+
+static const wchar_t* s_file = L"test_flacencoder.flac"; 
+
+/// @brief STREAMINFO中MD5的位置："fLaC"、4 byte block头与MD5之前的18 byte
+static const size_t s_md5Offset = 4+4+18; 
+
+/**
+ * @brief 用FlacEncoder把PCM编码为文件，metadata只有STREAMINFO
+*/
+static bool encodeFile(const FlacPcmBlock& pcm, uint32_t level) {
+    FlacEncoder encoder(pcm.sampleRate, pcm.channels, pcm.sampleBits, level); 
+    if (!encoder.isValid()) {
+        return false; 
+    }
+    std::vector<uint8_t> data(4+4+34); 
+    memcpy(data.data(), "fLaC", 4); 
+    data[7] = 34; 
+    encoder.setSink([&data](const std::vector<music_data::WriteSegment>& frames) {
+        for (auto& item: frames) {
+            data.insert(data.end(), (const uint8_t*)item.data, (const uint8_t*)item.data+item.length); 
+        }
+        return true; 
+    }); 
+    if (!encoder.write(pcm)||!encoder.finish()) {
+        return false; 
+    }
+    music_data::StreamInfoMetaBlock streamInfo(data.data()+8, 34); 
+    return encoder.fillStreamInfo(streamInfo)&&streamInfo.resave(data.data()+4, true)==4+34&&WriteBytes(s_file, data); 
+}
+
+/**
+ * @brief 检查文件解码结果与STREAMINFO中的MD5都与源PCM一致
+*/
+static bool checkDecoded(const char* name, const FlacPcmBlock& pcm) {
+    uint8_t digest[music_data::Md5::DIGEST_SIZE]; 
+    uint8_t stored[music_data::Md5::DIGEST_SIZE]; 
+    PcmMD5(pcm, digest); 
+
+    MusicDecoderflac decoder(s_file); 
+    FlacPcmBlock decoded; 
+    uint32_t badFrames = 0; 
+    if (!decoder.isValid()||!DecodeAll(decoder, decoded, &badFrames)||badFrames>0||!SamePcm(decoded, pcm)) {
+        LOGE("%s: decoded pcm mismatch", name); 
+        return false; 
+    }
+    auto streamInfo = decoder.getStreamInfo(); 
+    streamInfo->getUnencoderedMD5(stored, sizeof(stored)); 
+    if (streamInfo->getSamplePerChannel()!=pcm.blockSize||memcmp(stored, digest, sizeof(digest))!=0) {
+        LOGE("%s: stream info mismatch", name); 
+        return false; 
+    }
+    AudioVerifyResult verify; 
+    if (!decoder.verifyAudio(&verify)||!verify.md5Match) {
+        LOGE("%s: audio verify fail", name); 
+        return false; 
+    }
+    return true; 
+}
+
+/**
+ * @brief 各压缩级别编码后解码，PCM与MD5都与源一致；级别越高文件不应更大
+*/
+bool test_roundTrip() {
+    struct Case {
+        const char* name; 
+        uint32_t sampleBits; 
+        uint32_t channels; 
+        uint32_t wastedBits; 
+    }; 
+    static const Case s_cases[] = {
+        {"8 bit 3 channels", 8, 3, 0},
+        {"16 bit mono", 16, 1, 0},
+        {"16 bit stereo", 16, 2, 0},
+        {"20 bit stereo wasted", 20, 2, 4},
+        {"24 bit 6 channels", 24, 6, 0},
+        {"32 bit stereo", 32, 2, 0},
+    }; 
+
+    bool ans = true; 
+    for (auto& item: s_cases) {
+        // 采样数不是块长的整数倍，最后一帧较短
+        FlacPcmBlock pcm = MakeSignal(44100*2+333, 44100, item.channels, item.sampleBits, item.sampleBits+item.channels, item.wastedBits); 
+        std::vector<size_t> sizes; 
+        for (uint32_t level : {0u, 5u, 8u}) {
+            std::vector<uint8_t> data; 
+            if (!encodeFile(pcm, level)||!ReadBytes(s_file, data)||!checkDecoded(item.name, pcm)) {
+                LOGE("%s level %d fail", item.name, level); 
+                ans = false; 
+            }
+            sizes.push_back(data.size()); 
+        }
+        if (sizes[1]>sizes[0]||sizes[2]>sizes[1]) {
+            LOGE("%s: level 0/5/8 size %d/%d/%d", item.name, (int)sizes[0], (int)sizes[1], (int)sizes[2]); 
+            ans = false; 
+        }
+    }
+    printf("round trip: %s\n", ans?"ok":"FAIL"); 
+    return ans; 
+}
+
+/**
+ * @brief 重新压缩：校验通过时替换原文件并保留标签；源MD5不一致或有损坏帧时原文件不变、不留临时文件；
+ *        批量中同一文件出现两次时临时文件不冲突
+*/
+bool test_recompress() {
+    FlacPcmBlock pcm = MakeSignal(44100*3+7, 44100, 2, 16, 50); 
+    std::vector<uint8_t> original; 
+    std::vector<uint8_t> actual; 
+    bool ans = encodeFile(pcm, 0); 
+    {
+        MusicDecoderflac decoder(s_file); 
+        ans = ans&&decoder.setbackTitle("recompress")&&decoder.save(); 
+    }
+    ans = ans&&ReadBytes(s_file, original); 
+    if (!ans) {
+        printf("recompress: FAIL\n"); 
+        return false; 
+    }
+
+    FlacEncoder::RecompressResult res; 
+    if (!FlacEncoder::Recompress(s_file, 8, &res)||!res.success||!res.replaced||!res.md5Verified
+        ||res.samples!=pcm.blockSize||res.originalSize!=original.size()||res.newSize>=res.originalSize) {
+        LOGE("recompress fail"); 
+        ans = false; 
+    }
+    if (!checkDecoded("recompressed", pcm)||MusicDecoderflac(s_file).getTitle()!="recompress"||HasTempFile(s_file)) {
+        LOGE("recompressed file wrong"); 
+        ans = false; 
+    }
+
+    // 源文件的MD5不一致：编码输入与STREAMINFO不符，不替换
+    std::vector<uint8_t> damaged(original); 
+    damaged[s_md5Offset]^=0x01; 
+    if (!WriteBytes(s_file, damaged)||FlacEncoder::Recompress(s_file, 8, &res)||res.success||res.replaced
+        ||!ReadBytes(s_file, actual)||actual!=damaged||HasTempFile(s_file)) {
+        LOGE("md5 mismatch: original file not kept"); 
+        ans = false; 
+    }
+
+    // 音频中间有一帧损坏：不替换
+    damaged = original; 
+    damaged[damaged.size()*2/3]^=0x10; 
+    if (!WriteBytes(s_file, damaged)||FlacEncoder::Recompress(s_file, 8, &res)||res.success||res.replaced
+        ||!ReadBytes(s_file, actual)||actual!=damaged||HasTempFile(s_file)) {
+        LOGE("broken frame: original file not kept"); 
+        ans = false; 
+    }
+
+    // 同一文件两次：各自写自己的临时文件，都成功
+    std::vector<FlacEncoder::RecompressResult> results; 
+    if (!WriteBytes(s_file, original)||FlacEncoder::RecompressFiles({s_file, s_file}, 8, results)!=2
+        ||!checkDecoded("recompressed twice", pcm)||MusicDecoderflac(s_file).getTitle()!="recompress"||HasTempFile(s_file)) {
+        LOGE("recompress same file twice fail"); 
+        ans = false; 
+    }
+    printf("recompress: %s\n", ans?"ok":"FAIL"); 
+    return ans; 
+}
+
+int main(int argc, char** argv) {
+    bool ok = test_roundTrip(); 
+    ok = test_recompress()&&ok; 
+    DeleteFileW(s_file); 
+    return ok?0:1; 
+}
\ No newline at end of file
@@ -0,0 +1,208 @@
+#include "decoderflac.h"
+#include "flacsnapshot.h"
+#include "flacedit.h"
+#include "log.h"
+#include "flactestfile.h"
+
+#include <stdio.h>
+
+INITONLYLOGGER(); 
+
+using music_data::MusicDecoderflac; 
+using music_data::Metadata_block; 
+using music_data::FlacPcmBlock; 
+
+static const wchar_t* s_source = L"test_flacfork.flac"; 
+static const wchar_t* s_copy = L"test_flacfork_out.flac"; 
+
+/**
+ * @brief 生成带标题的测试文件
+*/
+static bool makeSource(FlacPcmBlock& pcm) {
+    pcm = MakeSignal(44100, 44100, 2, 16, 39); 
+    if (!WriteFlac(s_source, pcm)) {
+        return false; 
+    }
+    MusicDecoderflac decoder(s_source); 
+    return decoder.setbackTitle("origin")&&decoder.save(); 
+}
+
+/**
+ * @brief 检查文件的标题与音频
+*/
+static bool checkFile(const wchar_t* path, const std::string& title, const FlacPcmBlock& pcm) {
+    MusicDecoderflac decoder(path); 
+    FlacPcmBlock decoded; 
+    if (decoder.getTitle()!=title) {
+        LOGE("%ls title is \"%s\", expect \"%s\"", path, decoder.getTitle().c_str(), title.c_str()); 
+        return false; 
+    }
+    if (!DecodeAll(decoder, decoded)||!SamePcm(decoded, pcm)) {
+        LOGE("%ls audio mismatch", path); 
+        return false; 
+    }
+    return true; 
+}
+
+/**
+ * @brief fork后保存副本不能改写源文件：源解码器的映射与共享的block仍然有效，释放源解码器后才能保存
+*/
+bool test_forkSave() {
+    FlacPcmBlock pcm; 
+    if (!makeSource(pcm)) {
+        printf("fork save: FAIL\n"); 
+        return false; 
+    }
+
+    bool ans = true; 
+    MusicDecoderflac::ptr d = std::make_shared<MusicDecoderflac>(s_source); 
+    MusicDecoderflac::ptr f = d->fork(1<<Metadata_block::VORBIS_COMMEN); 
+    if (f==nullptr||!f->setbackTitle("forked")) {
+        LOGE("fork fail"); 
+        printf("fork save: FAIL\n"); 
+        return false; 
+    }
+    if (f->save()) {
+        LOGE("forked decoder saved while the mapping is shared"); 
+        ans = false; 
+    }
+
+    // 源解码器不受影响，可以另存
+    FlacPcmBlock decoded; 
+    if (d->getTitle()!="origin"||!DecodeAll(*d, decoded)||!SamePcm(decoded, pcm)) {
+        LOGE("source decoder broken after forked save"); 
+        ans = false; 
+    }
+    if (!d->resave(s_copy)||!checkFile(s_copy, "origin", pcm)) {
+        LOGE("resave source decoder fail"); 
+        ans = false; 
+    }
+    if (!checkFile(s_source, "origin", pcm)) {
+        ans = false; 
+    }
+
+    // 源解码器释放后映射只剩副本引用
+    d = nullptr; 
+    if (!f->save()||!checkFile(s_source, "forked", pcm)) {
+        LOGE("save forked decoder fail after source released"); 
+        ans = false; 
+    }
+    if (f->getTitle()!="forked"||!DecodeAll(*f, decoded)||!SamePcm(decoded, pcm)) {
+        LOGE("forked decoder broken after save"); 
+        ans = false; 
+    }
+    printf("fork save: %s\n", ans?"ok":"FAIL"); 
+    return ans; 
+}
+
+/**
+ * @brief 音频解码器持有映射时不能保存
+*/
+bool test_readerBlocksSave() {
+    FlacPcmBlock pcm; 
+    if (!makeSource(pcm)) {
+        printf("reader blocks save: FAIL\n"); 
+        return false; 
+    }
+
+    bool ans = true; 
+    MusicDecoderflac decoder(s_source); 
+    decoder.setbackTitle("reader"); 
+    {
+        music_data::FlacAudioDecoder audio(decoder); 
+        FlacPcmBlock block; 
+        if (decoder.save()) {
+            LOGE("saved while audio decoder holds the mapping"); 
+            ans = false; 
+        }
+        if (!audio.decodeNext(block)||block.firstSample!=0) {
+            LOGE("audio decoder broken"); 
+            ans = false; 
+        }
+    }
+    if (!decoder.save()||!checkFile(s_source, "reader", pcm)) {
+        LOGE("save fail after audio decoder released"); 
+        ans = false; 
+    }
+    printf("reader blocks save: %s\n", ans?"ok":"FAIL"); 
+    return ans; 
+}
+
+/**
+ * @brief fork后共享的block双方都不能修改，复制的block可以各自修改
+*/
+bool test_sharedBlocks() {
+    FlacPcmBlock pcm; 
+    if (!makeSource(pcm)) {
+        printf("shared blocks: FAIL\n"); 
+        return false; 
+    }
+
+    bool ans = true; 
+    MusicDecoderflac::ptr d = std::make_shared<MusicDecoderflac>(s_source); 
+    MusicDecoderflac::ptr f = d->fork(1<<Metadata_block::VORBIS_COMMEN); 
+    if (f==nullptr||!f->getStreamInfo()->isShared()||f->getVorbisComment()->isShared()) {
+        LOGE("fork fail"); 
+        printf("shared blocks: FAIL\n"); 
+        return false; 
+    }
+    uint32_t sampleRate = d->getStreamInfo()->getSampleRate(); 
+    d->getStreamInfo()->setMinBlockSize(16); 
+    if (d->getStreamInfo()->setSampleRate(sampleRate+1)||f->getStreamInfo()->setSampleRate(sampleRate+1)
+        ||f->getStreamInfo()->getSampleRate()!=sampleRate||f->getStreamInfo()->getMinBlockSize()==16) {
+        LOGE("shared block modified"); 
+        ans = false; 
+    }
+    if (!f->setbackTitle("forked")||!d->setbackTitle("source")||f->getTitle()!="forked"||d->getTitle()!="source") {
+        LOGE("cloned block not modifiable"); 
+        ans = false; 
+    }
+    printf("shared blocks: %s\n", ans?"ok":"FAIL"); 
+    return ans; 
+}
+
+/**
+ * @brief 快照与源文件映射共享：新旧快照都可以读取和另存
+*/
+bool test_snapshot() {
+    FlacPcmBlock pcm; 
+    if (!makeSource(pcm)) {
+        printf("snapshot: FAIL\n"); 
+        return false; 
+    }
+
+    bool ans = true; 
+    music_data::FlacSnapshot::ptr first = music_data::FlacSnapshot::Create(s_source); 
+    music_data::FlacEdit edit; 
+    edit.setTag("TITLE", "snapshot"); 
+    music_data::FlacSnapshot::ptr second = first==nullptr?nullptr:first->apply(edit); 
+    if (second==nullptr) {
+        LOGE("apply fail"); 
+        printf("snapshot: FAIL\n"); 
+        return false; 
+    }
+    if (first->getTitle()!="origin"||second->getTitle()!="snapshot") {
+        LOGE("snapshot title mismatch"); 
+        ans = false; 
+    }
+    if (!second->resave(s_copy)||!checkFile(s_copy, "snapshot", pcm)) {
+        LOGE("resave snapshot fail"); 
+        ans = false; 
+    }
+    if (!first->resave(s_copy)||!checkFile(s_copy, "origin", pcm)) {
+        LOGE("resave first snapshot fail"); 
+        ans = false; 
+    }
+    printf("snapshot: %s\n", ans?"ok":"FAIL"); 
+    return ans; 
+}
+
+int main(int argc, char** argv) {
+    bool ok = test_forkSave(); 
+    ok = test_readerBlocksSave()&&ok; 
+    ok = test_sharedBlocks()&&ok; 
+    ok = test_snapshot()&&ok; 
+    DeleteFileW(s_source); 
+    DeleteFileW(s_copy); 
+    return ok?0:1; 
+}
\ No newline at end of file
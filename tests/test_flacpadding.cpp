@@ -0,0 +1,175 @@
+#include "decoderflac.h"
+#include "image.h"
+#include "log.h"
+#include "flactestfile.h"
+
+#include <stdio.h>
+
+INITONLYLOGGER(); 
+
+using music_data::FlacPcmBlock; 
+using music_data::Metadata_block; 
+using music_data::MusicDecoderflac; 
+using music_data::PictureMetaBlock; 
+
+static const wchar_t* s_file = L"test_flacpadding.flac"; 
+static const wchar_t* s_copy = L"test_flacpadding_copy.flac"; 
+
+/// @brief 初始padding大小
+static const uint32_t s_paddingSize = 1024; 
+
+/**
+ * @brief 生成带padding与若干封面的测试文件
+ * @param[in] pcm 音频
+ * @param[in] coverSizes 各封面图片数据大小(byte)
+ * @param[out] coverBlockSize 全部封面block（含4 byte block头）的总大小
+*/
+static bool makeFile(const FlacPcmBlock& pcm, const std::vector<size_t>& coverSizes, uint64_t* coverBlockSize) {
+    if (!WriteFlac(s_file, pcm)) {
+        return false; 
+    }
+    MusicDecoderflac decoder(s_file); 
+    std::vector<uint8_t> padding(s_paddingSize); 
+    if (!decoder.addMetaDataBlock(padding.data(), padding.size(), Metadata_block::PADDING)) {
+        return false; 
+    }
+    for (size_t i=0; i<coverSizes.size(); ++i) {
+        std::vector<uint8_t> png = MakePng(64, 64, coverSizes[i], i); 
+        if (!decoder.addbackCover(music_data::PngImage(png.data(), png.size()), i)) {
+            return false; 
+        }
+    }
+    std::vector<PictureMetaBlock::ptr> pictures; 
+    decoder.getPictures(pictures); 
+    *coverBlockSize = 0; 
+    for (auto& item: pictures) {
+        *coverBlockSize+=4+item->getCachedBlockSize(); 
+    }
+    return decoder.save(); 
+}
+
+/**
+ * @brief 取得封面个数
+*/
+static size_t coverNum(const MusicDecoderflac& decoder) {
+    std::vector<PictureMetaBlock::ptr> pictures; 
+    decoder.getPictures(pictures); 
+    return pictures.size(); 
+}
+
+/**
+ * @brief 删除全部封面并保存，检查保存方式、文件大小、padding大小与音频
+*/
+static bool removeCovers(const char* name, const FlacPcmBlock& pcm, bool ifAtomic, MusicDecoderflac::SaveStrategy expectStrategy,
+    int64_t expectSizeChange, uint32_t expectPadding) {
+    std::vector<uint8_t> before; 
+    std::vector<uint8_t> after; 
+    MusicDecoderflac::SaveStrategy used = MusicDecoderflac::SAVE_UNCHANGED; 
+    bool ans = ReadBytes(s_file, before); 
+    {
+        MusicDecoderflac decoder(s_file); 
+        decoder.setAtomicSave(ifAtomic); 
+        while (ans&&coverNum(decoder)>0) {
+            ans = decoder.delbackCover(0); 
+        }
+        ans = ans&&decoder.save(&used); 
+    }
+    if (!ans||used!=expectStrategy||!ReadBytes(s_file, after)||(int64_t)after.size()-(int64_t)before.size()!=expectSizeChange) {
+        LOGE("%s: strategy %d, size %lld -> %lld", name, used, (long long)before.size(), (long long)after.size()); 
+        return false; 
+    }
+
+    MusicDecoderflac decoder(s_file); 
+    FlacPcmBlock decoded; 
+    if (coverNum(decoder)!=0||decoder.getPadding()==nullptr||decoder.getPadding()->getBlockSize()!=expectPadding) {
+        LOGE("%s: padding %d, expect %d", name, decoder.getPadding()==nullptr?0:decoder.getPadding()->getBlockSize(), expectPadding); 
+        return false; 
+    }
+    if (!DecodeAll(decoder, decoded)||!SamePcm(decoded, pcm)) {
+        LOGE("%s: audio mismatch", name); 
+        return false; 
+    }
+    return true; 
+}
+
+/**
+ * @brief 删除封面：整体重写时文件变小且padding保持原大小；原地保存时空出的空间转为padding；
+ *        空出的空间超过padding上限时整体重写
+*/
+bool test_removeCover() {
+    FlacPcmBlock pcm = MakeSignal(4096*8, 44100, 2, 16, 31); 
+    uint64_t coverBlockSize = 0; 
+    bool ans = true; 
+
+    if (!makeFile(pcm, {4<<20}, &coverBlockSize)
+        ||!removeCovers("rewrite", pcm, true, MusicDecoderflac::SAVE_FULL_REWRITE, -(int64_t)coverBlockSize, s_paddingSize)) {
+        ans = false; 
+    }
+    if (!makeFile(pcm, {4<<20}, &coverBlockSize)
+        ||!removeCovers("in place", pcm, false, MusicDecoderflac::SAVE_PADDING_RESIZE, 0, s_paddingSize+coverBlockSize)) {
+        ans = false; 
+    }
+    // 两张9MB的封面：空出的空间超过padding block上限
+    if (!makeFile(pcm, {9<<20, 9<<20}, &coverBlockSize)
+        ||!removeCovers("over limit", pcm, false, MusicDecoderflac::SAVE_FULL_REWRITE, -(int64_t)coverBlockSize, s_paddingSize)) {
+        ans = false; 
+    }
+    printf("remove cover: %s\n", ans?"ok":"FAIL"); 
+    return ans; 
+}
+
+/**
+ * @brief 另存与计算排列不修改解码器中的padding；写回源文件后解码器改用按策略写出的padding
+*/
+bool test_saveAs() {
+    FlacPcmBlock pcm = MakeSignal(4096*4, 44100, 2, 16, 32); 
+    uint64_t coverBlockSize = 0; 
+    if (!makeFile(pcm, {1000}, &coverBlockSize)) {
+        printf("save as: FAIL\n"); 
+        return false; 
+    }
+
+    bool ans = true; 
+    MusicDecoderflac decoder(s_file); 
+    // 整体重写时padding才按策略改为固定大小
+    decoder.setAtomicSave(true); 
+    decoder.setPaddingPolicy(music_data::PaddingPolicy::Fixed(4000)); 
+    auto padding = decoder.getPadding(); 
+    std::vector<MusicDecoderflac::MetaBlockLayout> layout; 
+    if (!decoder.getMetaBlockLayout(layout)||!decoder.resave(s_copy)
+        ||decoder.getPadding()!=padding||padding->isDirty()||padding->getBlockSize()!=s_paddingSize||layout.back().length!=s_paddingSize) {
+        LOGE("save as changed padding in memory"); 
+        ans = false; 
+    }
+    padding = nullptr; 
+    {
+        MusicDecoderflac copy(s_copy); 
+        FlacPcmBlock decoded; 
+        if (copy.getPadding()==nullptr||copy.getPadding()->getBlockSize()!=4000||!DecodeAll(copy, decoded)||!SamePcm(decoded, pcm)) {
+            LOGE("saved copy wrong"); 
+            ans = false; 
+        }
+    }
+
+    // 写回源文件：解码器改用写出的padding，再次保存时与源文件相同
+    MusicDecoderflac::SaveStrategy used = MusicDecoderflac::SAVE_UNCHANGED; 
+    if (!decoder.save(&used)||used!=MusicDecoderflac::SAVE_FULL_REWRITE||decoder.getPadding()==nullptr
+        ||decoder.getPadding()->getBlockSize()!=4000||decoder.getPadding()->isDirty()) {
+        LOGE("padding not adopted after save, strategy %d", used); 
+        ans = false; 
+    }
+    if (!decoder.save(&used)||used!=MusicDecoderflac::SAVE_UNCHANGED) {
+        LOGE("second save not unchanged, strategy %d", used); 
+        ans = false; 
+    }
+    printf("save as: %s\n", ans?"ok":"FAIL"); 
+    return ans; 
+}
+
+int main(int argc, char** argv) {
+    bool ok = test_removeCover(); 
+    ok = test_saveAs()&&ok; 
+    DeleteFileW(s_file); 
+    DeleteFileW(s_copy); 
+    return ok?0:1; 
+}
\ No newline at end of file
@@ -0,0 +1,157 @@
+#include "flacparallel.h"
+#include "flacframe.h"
+#include "decoderflac.h"
+#include "threadpool.h"
+#include "log.h"
+#include "flactestfile.h"
+
+#include <stdio.h>
+
+INITONLYLOGGER(); 
+
+using music_data::FlacParallelDecoder; 
+using music_data::FlacPcmBlock; 
+using music_data::MusicDecoderflac; 
+
+static const wchar_t* s_file = L"test_flacparallel.flac"; 
+
+/**
+ * @brief 并行解码，按交付顺序拼接
+ * @param[out] firstSamples 各帧首采样号
+ * @param[out] chunkNum 分段数
+*/
+static bool decodeParallel(FlacParallelDecoder& decoder, std::vector<uint64_t>& firstSamples, FlacPcmBlock& dest, uint32_t& chunkNum) {
+    uint32_t expectIndex = 0; 
+    uint32_t badFrames = 0; 
+    bool ordered = true; 
+    dest = FlacPcmBlock(); 
+    firstSamples.clear(); 
+    bool finished = decoder.decode([&](const FlacParallelDecoder::Chunk& chunk) {
+        ordered = ordered&&chunk.index==expectIndex++; 
+        badFrames+=chunk.badFrames.size(); 
+        for (uint32_t i=0; i<chunk.blockNum; ++i) {
+            const FlacPcmBlock& block = chunk.blocks[i]; 
+            firstSamples.push_back(block.firstSample); 
+            if (dest.channels==0) {
+                dest.sampleRate = block.sampleRate; 
+                dest.channels = block.channels; 
+                dest.sampleBits = block.sampleBits; 
+            }
+            for (uint32_t c=0; c<block.channels; ++c) {
+                dest.samples.insert(dest.samples.end(), block.getChannel(c), block.getChannel(c)+block.blockSize); 
+            }
+            dest.blockSize+=block.blockSize; 
+        }
+        return true; 
+    }); 
+    chunkNum = decoder.getChunkNum(); 
+    if (!finished||!ordered||badFrames>0) {
+        LOGE("parallel decode fail, finished %d ordered %d, %d bad frames", finished, ordered, badFrames); 
+        return false; 
+    }
+    return true; 
+}
+
+/**
+ * @brief 按帧拼接的平面数据转为整体的平面数据（各帧长度相同，最后一帧可以较短）
+*/
+static FlacPcmBlock toPlanar(const FlacPcmBlock& frames, uint32_t blockSize) {
+    FlacPcmBlock ans = frames; 
+    for (uint32_t first=0; first<frames.blockSize; first+=blockSize) {
+        uint32_t length = std::min(blockSize, frames.blockSize-first); 
+        const int32_t* pin = frames.samples.data()+(size_t)first*frames.channels; 
+        for (uint32_t c=0; c<frames.channels; ++c) {
+            memcpy(ans.getChannel(c)+first, pin+(size_t)c*length, length*sizeof(int32_t)); 
+        }
+    }
+    return ans; 
+}
+
+/**
+ * @brief 帧索引、SEEKTABLE、扫描三种分段方式，各种段长与重排窗口下，并行解码结果与顺序解码一致
+*/
+bool test_sameAsSequential() {
+    bool ans = true; 
+    music_data::ThreadPool::ptr pool = std::make_shared<music_data::ThreadPool>(4); 
+    for (uint32_t seekPointFrames : {0u, 3u}) {
+        FlacPcmBlock pcm = MakeSignal(44100*6+123, 44100, 2, 16, 44); 
+        if (!WriteFlac(s_file, pcm, seekPointFrames)) {
+            printf("same as sequential: FAIL\n"); 
+            return false; 
+        }
+        MusicDecoderflac decoder(s_file); 
+        FlacPcmBlock sequential; 
+        if (!DecodeAll(decoder, sequential)||!SamePcm(sequential, pcm)) {
+            LOGE("sequential decode mismatch"); 
+            ans = false; 
+        }
+        if (seekPointFrames>0&&decoder.getSeekTable()==nullptr) {
+            LOGE("no seektable"); 
+            ans = false; 
+        }
+        uint32_t blockSize = decoder.getStreamInfo()->getMaxBlockSize(); 
+
+        music_data::FlacFrameIndex::ptr index = std::make_shared<music_data::FlacFrameIndex>(); 
+        if (!index->build(decoder, pool)) {
+            LOGE("build frame index fail"); 
+            ans = false; 
+        }
+        for (bool useIndex : {false, true}) {
+            for (uint64_t chunkSize : {0ull, 4096ull, 40000ull}) {
+                for (uint32_t maxPending : {0u, 1u}) {
+                    FlacParallelDecoder parallel(decoder, pool, maxPending); 
+                    parallel.setChunkSize(chunkSize); 
+                    if (useIndex) {
+                        parallel.setFrameIndex(index); 
+                    }
+                    std::vector<uint64_t> firstSamples; 
+                    FlacPcmBlock frames; 
+                    uint32_t chunkNum = 0; 
+                    bool res = decodeParallel(parallel, firstSamples, frames, chunkNum); 
+                    bool continuous = true; 
+                    for (size_t i=0; i<firstSamples.size(); ++i) {
+                        continuous = continuous&&firstSamples[i]==i*blockSize; 
+                    }
+                    if (!res||!continuous||!SamePcm(toPlanar(frames, blockSize), sequential)) {
+                        LOGE("seektable %d index %d chunk size %lld pending %d: mismatch", seekPointFrames, useIndex, (long long)chunkSize, maxPending); 
+                        ans = false; 
+                    }
+                    if (chunkSize==4096&&chunkNum<2) {
+                        LOGE("seektable %d index %d: only %d chunk", seekPointFrames, useIndex, chunkNum); 
+                        ans = false; 
+                    }
+                }
+            }
+        }
+    }
+    printf("same as sequential: %s\n", ans?"ok":"FAIL"); 
+    return ans; 
+}
+
+/**
+ * @brief 回调返回false时停止交付
+*/
+bool test_abort() {
+    FlacPcmBlock pcm = MakeSignal(44100*4, 44100, 1, 16, 45); 
+    if (!WriteFlac(s_file, pcm)) {
+        printf("abort: FAIL\n"); 
+        return false; 
+    }
+    MusicDecoderflac decoder(s_file); 
+    FlacParallelDecoder parallel(decoder); 
+    parallel.setChunkSize(4096); 
+    uint32_t delivered = 0; 
+    bool finished = parallel.decode([&delivered](const FlacParallelDecoder::Chunk&) {
+        return ++delivered<2; 
+    }); 
+    bool ans = !finished&&delivered==2; 
+    printf("abort: %s\n", ans?"ok":"FAIL"); 
+    return ans; 
+}
+
+int main(int argc, char** argv) {
+    bool ok = test_sameAsSequential(); 
+    ok = test_abort()&&ok; 
+    DeleteFileW(s_file); 
+    return ok?0:1; 
+}
\ No newline at end of file
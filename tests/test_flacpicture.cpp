@@ -0,0 +1,149 @@
+#include "decoderflac.h"
+#include "image.h"
+#include "log.h"
+#include "flactestfile.h"
+
+#include <stdio.h>
+
+INITONLYLOGGER(); 
+
+using music_data::FlacPcmBlock; 
+using music_data::MusicDecoderflac; 
+using music_data::PictureMetaBlock; 
+
+static const wchar_t* s_file = L"test_flacpicture.flac"; 
+static const wchar_t* s_cover = L"test_flacpicture_cover.png"; 
+static const wchar_t* s_prefix = L"test_flacpicture_covers"; 
+
+/**
+ * @brief 检查解码器中的封面：picture block数据、getCovers、resaveCover与resaveCovers导出的文件都与原图逐字节相同
+ * @param[in] name 检查点名称
+ * @param[in] decoder 解码器
+ * @param[in] pngs 原图
+ * @param[in] ifMapped 图片数据是否应仍在源文件映射中（未读入内存）
+*/
+static bool checkCovers(const char* name, const MusicDecoderflac& decoder, const std::vector<std::vector<uint8_t>>& pngs, bool ifMapped) {
+    std::vector<PictureMetaBlock::ptr> pictures; 
+    std::vector<music_data::Image::ptr> covers; 
+    decoder.getPictures(pictures); 
+    if (pictures.size()!=pngs.size()||!decoder.getCovers(covers)||covers.size()!=pngs.size()) {
+        LOGE("%s: %d pictures, expect %d", name, (int)pictures.size(), (int)pngs.size()); 
+        return false; 
+    }
+
+    bool ans = true; 
+    for (size_t i=0; i<pngs.size(); ++i) {
+        const std::vector<uint8_t>& png = pngs[i]; 
+        std::vector<uint8_t> data(pictures[i]->getPictureDataLength()); 
+        std::vector<uint8_t> cover(covers[i]->getDataSize()); 
+        std::vector<uint8_t> exported; 
+        std::vector<uint8_t> batch; 
+        if (pictures[i]->isPictureDataLoaded()==ifMapped||(pictures[i]->getMappedPictureData()!=nullptr)!=ifMapped) {
+            LOGE("%s: picture %d mapped state wrong", name, (int)i); 
+            ans = false; 
+        }
+        if (!pictures[i]->getPictureData(data.data(), data.size())||data!=png) {
+            LOGE("%s: picture %d data mismatch", name, (int)i); 
+            ans = false; 
+        }
+        if (!covers[i]->getData(cover.data(), cover.size())||cover!=png) {
+            LOGE("%s: cover %d mismatch", name, (int)i); 
+            ans = false; 
+        }
+        if (!decoder.resaveCover(s_cover, false, i)||!ReadBytes(s_cover, exported)||exported!=png) {
+            LOGE("%s: resave cover %d mismatch", name, (int)i); 
+            ans = false; 
+        }
+        std::wstring path = std::wstring(s_prefix)+L"_"+std::to_wstring(i)+L".png"; 
+        if (!ReadBytes(path, batch)||batch!=png) {
+            LOGE("%s: resave covers %d mismatch", name, (int)i); 
+            ans = false; 
+        }
+    }
+    return ans; 
+}
+
+/**
+ * @brief 导出全部封面后检查
+*/
+static bool checkAll(const char* name, const MusicDecoderflac& decoder, const std::vector<std::vector<uint8_t>>& pngs, bool ifMapped) {
+    for (size_t i=0; i<pngs.size(); ++i) {
+        DeleteFileW((std::wstring(s_prefix)+L"_"+std::to_wstring(i)+L".png").c_str()); 
+    }
+    if (decoder.resaveCovers(s_prefix)!=pngs.size()) {
+        LOGE("%s: resave covers fail", name); 
+        return false; 
+    }
+    return checkCovers(name, decoder, pngs, ifMapped); 
+}
+
+/**
+ * @brief 封面添加、保存、重新打开后，以及保存移动了图片数据（重新绑定到新文件）后，图片数据与导出的封面都不变；
+ *        未修改的封面保持在映射中按需读取
+*/
+bool test_coverRoundTrip() {
+    FlacPcmBlock pcm = MakeSignal(4096*4, 44100, 2, 16, 27); 
+    std::vector<std::vector<uint8_t>> pngs = {MakePng(64, 64, 50000, 1), MakePng(32, 48, 3000, 2)}; 
+    if (!WriteFlac(s_file, pcm)) {
+        printf("cover round trip: FAIL\n"); 
+        return false; 
+    }
+
+    bool ans = true; 
+    {
+        MusicDecoderflac decoder(s_file); 
+        for (size_t i=0; i<pngs.size(); ++i) {
+            if (!decoder.addbackCover(music_data::PngImage(pngs[i].data(), pngs[i].size()), i)) {
+                ans = false; 
+            }
+        }
+        if (!ans||!checkAll("added", decoder, pngs, false)) {
+            ans = false; 
+        }
+        // 保存后图片数据重新绑定到新文件的映射
+        if (!decoder.save()||!checkAll("saved", decoder, pngs, true)) {
+            ans = false; 
+        }
+    }
+    {
+        MusicDecoderflac decoder(s_file); 
+        if (!checkAll("reopened", decoder, pngs, true)) {
+            ans = false; 
+        }
+        // 在图片之前插入长标签，整体重写后图片数据在文件中的位置改变
+        MusicDecoderflac::SaveStrategy used = MusicDecoderflac::SAVE_UNCHANGED; 
+        if (!decoder.setbackTitle(std::string(5000, 't'))||!decoder.save(&used)||used!=MusicDecoderflac::SAVE_FULL_REWRITE
+            ||!checkAll("moved", decoder, pngs, true)) {
+            ans = false; 
+        }
+    }
+    {
+        MusicDecoderflac decoder(s_file); 
+        if (!checkAll("reopened after move", decoder, pngs, true)) {
+            ans = false; 
+        }
+        // 读入内存后不再依赖映射
+        std::vector<PictureMetaBlock::ptr> pictures; 
+        decoder.getPictures(pictures); 
+        for (auto& item: pictures) {
+            if (!item->loadPictureData()) {
+                ans = false; 
+            }
+        }
+        if (!checkAll("loaded", decoder, pngs, false)) {
+            ans = false; 
+        }
+    }
+    printf("cover round trip: %s\n", ans?"ok":"FAIL"); 
+    return ans; 
+}
+
+int main(int argc, char** argv) {
+    bool ok = test_coverRoundTrip(); 
+    DeleteFileW(s_file); 
+    DeleteFileW(s_cover); 
+    for (int i=0; i<2; ++i) {
+        DeleteFileW((std::wstring(s_prefix)+L"_"+std::to_wstring(i)+L".png").c_str()); 
+    }
+    return ok?0:1; 
+}
\ No newline at end of file
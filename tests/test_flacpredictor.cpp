@@ -0,0 +1,161 @@
+#include "flacpredictor.h"
+#include "log.h"
+
+#include <vector>
+#include <random>
+#include <chrono>
+#include <functional>
+#include <stdio.h>
+
+INITONLYLOGGER(); 
+
+using music_data::FlacPredictor; 
+
+static const char* s_isaName[] = {"scalar", "sse4.1", "avx2"}; 
+
+/**
+ * @brief 生成残差输入：前order个为预热采样，之后为残差
+*/
+static std::vector<int32_t> makeInput(std::mt19937& rng, uint32_t length, uint32_t sampleBits) {
+    std::uniform_int_distribution<int32_t> dist(-(1<<(sampleBits-2)), (1<<(sampleBits-2))-1); 
+    std::vector<int32_t> ans(length); 
+    for (auto& i : ans) {
+        i = dist(rng); 
+    }
+    return ans; 
+}
+
+static std::vector<int32_t> makeCoefs(std::mt19937& rng, uint32_t order, uint32_t precision) {
+    std::uniform_int_distribution<int32_t> dist(-(1<<(precision-1)), (1<<(precision-1))-1); 
+    std::vector<int32_t> ans(order); 
+    for (auto& i : ans) {
+        i = dist(rng); 
+    }
+    return ans; 
+}
+
+/**
+ * @brief 各指令集的FIXED、LPC恢复结果与标量版本逐位比较
+*/
+bool test_bitExact() {
+    std::mt19937 rng(20240917); 
+    bool ans = true; 
+    for (int isa=FlacPredictor::ISA_SSE41; isa<=FlacPredictor::GetSupportedIsa(); ++isa) {
+        FlacPredictor::SetIsa((FlacPredictor::Isa)isa); 
+        for (uint32_t length : {1u, 5u, 17u, 192u, 4096u, 4609u}) {
+            for (uint32_t order=1; order<=4; ++order) {
+                std::vector<int32_t> ref = makeInput(rng, length, 24); 
+                std::vector<int32_t> out = ref; 
+                FlacPredictor::RestoreFixedScalar(ref.data(), length, order); 
+                FlacPredictor::RestoreFixed(out.data(), length, order); 
+                if (ref!=out) {
+                    LOGE("%s fixed order %d length %d mismatch", s_isaName[isa], order, length); 
+                    ans = false; 
+                }
+            }
+            for (uint32_t order=1; order<=32; ++order) {
+                std::vector<int32_t> coefs = makeCoefs(rng, order, 15); 
+                int32_t shift = rng()%16; 
+
+                // 32 bit累加按回绕比较，输入不必满足不溢出的条件
+                std::vector<int32_t> ref = makeInput(rng, length, 16); 
+                std::vector<int32_t> out = ref; 
+                FlacPredictor::RestoreLpc32Scalar(ref.data(), length, coefs.data(), order, shift); 
+                FlacPredictor::RestoreLpc32(out.data(), length, coefs.data(), order, shift); 
+                if (ref!=out) {
+                    LOGE("%s lpc32 order %d length %d mismatch", s_isaName[isa], order, length); 
+                    ans = false; 
+                }
+
+                ref = makeInput(rng, length, 32); 
+                out = ref; 
+                FlacPredictor::RestoreLpc64Scalar(ref.data(), length, coefs.data(), order, shift); 
+                FlacPredictor::RestoreLpc64(out.data(), length, coefs.data(), order, shift); 
+                if (ref!=out) {
+                    LOGE("%s lpc64 order %d length %d mismatch", s_isaName[isa], order, length); 
+                    ans = false; 
+                }
+            }
+        }
+    }
+    FlacPredictor::SetIsa(FlacPredictor::GetSupportedIsa()); 
+    printf("bit exact: %s\n", ans?"ok":"FAIL"); 
+    return ans; 
+}
+
+/**
+ * @brief 按编码端计算残差后恢复，检查32/64 bit累加的选择
+*/
+bool test_roundTrip() {
+    std::mt19937 rng(7); 
+    bool ans = true; 
+    const uint32_t length = 4096; 
+    for (uint32_t sampleBits : {8u, 16u, 20u, 24u}) {
+        for (uint32_t order : {1u, 2u, 8u, 12u, 32u}) {
+            uint32_t precision = 15; 
+            int32_t shift = 14; 
+            std::vector<int32_t> coefs = makeCoefs(rng, order, precision); 
+            std::vector<int32_t> signal = makeInput(rng, length, sampleBits+1); 
+            std::vector<int32_t> data(signal); 
+            for (uint32_t i=order; i<length; ++i) {
+                int64_t sum = 0; 
+                for (uint32_t j=0; j<order; ++j) {
+                    sum+=(int64_t)coefs[j]*signal[i-1-j]; 
+                }
+                data[i] = (int32_t)(signal[i]-(sum>>shift)); 
+            }
+            FlacPredictor::RestoreLpc(data.data(), length, coefs.data(), order, shift, precision, sampleBits); 
+            if (data!=signal) {
+                LOGE("round trip %d bit order %d mismatch", sampleBits, order); 
+                ans = false; 
+            }
+        }
+    }
+    printf("round trip: %s\n", ans?"ok":"FAIL"); 
+    return ans; 
+}
+
+/**
+ * @brief 各内核吞吐量，按int32采样计算MB/s
+*/
+void test_benchmark() {
+    std::mt19937 rng(1); 
+    const uint32_t length = 4608; 
+    const uint32_t rounds = 2000; 
+    std::vector<int32_t> input = makeInput(rng, length, 16); 
+    std::vector<int32_t> data(length); 
+
+    auto run = [&](const char* name, int isa, uint32_t order, const std::function<void()>& func) {
+        FlacPredictor::SetIsa((FlacPredictor::Isa)isa); 
+        data = input; 
+        auto start = std::chrono::steady_clock::now(); 
+        // 运算量与数值无关，反复原地恢复，不计入复制输入的时间
+        for (uint32_t i=0; i<rounds; ++i) {
+            func(); 
+        }
+        double sec = std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count(); 
+        double samples = (double)length*rounds; 
+        printf("%-7s %-6s order %2d: %8.1f MB/s %8.1f Msamples/s\n",
+            name, s_isaName[isa], order, samples*4/sec/1e6, samples/sec/1e6); 
+    }; 
+
+    for (int isa=FlacPredictor::ISA_SCALAR; isa<=FlacPredictor::GetSupportedIsa(); ++isa) {
+        for (uint32_t order=1; order<=4; ++order) {
+            run("fixed", isa, order, [&]() { FlacPredictor::RestoreFixed(data.data(), length, order); }); 
+        }
+        for (uint32_t order : {2u, 4u, 6u, 8u, 10u, 12u, 16u, 32u}) {
+            std::vector<int32_t> coefs = makeCoefs(rng, order, 12); 
+            run("lpc32", isa, order, [&]() { FlacPredictor::RestoreLpc32(data.data(), length, coefs.data(), order, 12); }); 
+            run("lpc64", isa, order, [&]() { FlacPredictor::RestoreLpc64(data.data(), length, coefs.data(), order, 12); }); 
+        }
+    }
+    FlacPredictor::SetIsa(FlacPredictor::GetSupportedIsa()); 
+}
+
+int main(int argc, char** argv) {
+    printf("supported isa: %s\n", s_isaName[FlacPredictor::GetSupportedIsa()]); 
+    bool ok = test_bitExact(); 
+    ok = test_roundTrip()&&ok; 
+    test_benchmark(); 
+    return ok?0:1; 
+}
\ No newline at end of file
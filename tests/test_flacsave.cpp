@@ -0,0 +1,238 @@
+#include "decoderflac.h"
+#include "flacedit.h"
+#include "mappedfile.h"
+#include "log.h"
+#include "flactestfile.h"
+
+#include <functional>
+#include <stdio.h>
+
+INITONLYLOGGER(); 
+
+using music_data::FileWriter; 
+using music_data::FlacEdit; 
+using music_data::FlacPcmBlock; 
+using music_data::Metadata_block; 
+using music_data::MusicDecoderflac; 
+using music_data::WriteSegment; 
+
+static const wchar_t* s_file = L"test_flacsave.flac"; 
+static const wchar_t* s_journal = L"test_flacsave.flac.journal"; 
+
+/**
+ * @brief 生成带标签与padding的测试文件
+*/
+static bool makeFile(const FlacPcmBlock& pcm) {
+    if (!WriteFlac(s_file, pcm)) {
+        return false; 
+    }
+    MusicDecoderflac decoder(s_file); 
+    std::vector<uint8_t> padding(512); 
+    return decoder.addMetaDataBlock(padding.data(), padding.size(), Metadata_block::PADDING)
+        &&decoder.setbackTitle("title")&&decoder.save(); 
+}
+
+/**
+ * @brief getSaveStrategy的预测与save实际使用的保存方式一致，修改后的文件与音频正确
+*/
+bool test_strategy() {
+    struct Case {
+        const char* name; 
+        bool ifAtomic; 
+        std::function<bool(MusicDecoderflac&)> edit; 
+        MusicDecoderflac::SaveStrategy expect; 
+    }; 
+    std::vector<Case> cases = {
+        {"unchanged", false, [](MusicDecoderflac& d) { return true; }, MusicDecoderflac::SAVE_UNCHANGED},
+        {"same value", false, [](MusicDecoderflac& d) { return d.setbackTitle("title"); }, MusicDecoderflac::SAVE_UNCHANGED},
+        {"same value atomic", true, [](MusicDecoderflac& d) { return d.setbackTitle("title"); }, MusicDecoderflac::SAVE_UNCHANGED},
+        {"same size", false, [](MusicDecoderflac& d) { return d.setbackTitle("TITLE"); }, MusicDecoderflac::SAVE_IN_PLACE},
+        {"padding resize", false, [](MusicDecoderflac& d) { return d.setbackTitle("a longer title"); }, MusicDecoderflac::SAVE_PADDING_RESIZE},
+        {"atomic", true, [](MusicDecoderflac& d) { return d.setbackTitle("a longer title"); }, MusicDecoderflac::SAVE_FULL_REWRITE},
+        {"grow", false, [](MusicDecoderflac& d) { return d.setbackTitle(std::string(2000, 'x')); }, MusicDecoderflac::SAVE_FULL_REWRITE},
+    }; 
+
+    FlacPcmBlock pcm = MakeSignal(4096*4, 44100, 2, 16, 35); 
+    bool ans = true; 
+    for (auto& item: cases) {
+        std::vector<uint8_t> before; 
+        std::vector<uint8_t> after; 
+        std::string title; 
+        MusicDecoderflac::SaveStrategy predicted = MusicDecoderflac::SAVE_FULL_REWRITE; 
+        MusicDecoderflac::SaveStrategy used = MusicDecoderflac::SAVE_FULL_REWRITE; 
+        if (!makeFile(pcm)||!ReadBytes(s_file, before)) {
+            LOGE("%s: make file fail", item.name); 
+            ans = false; 
+            continue; 
+        }
+        {
+            MusicDecoderflac decoder(s_file); 
+            decoder.setAtomicSave(item.ifAtomic); 
+            if (!item.edit(decoder)) {
+                LOGE("%s: edit fail", item.name); 
+                ans = false; 
+                continue; 
+            }
+            title = decoder.getTitle(); 
+            predicted = decoder.getSaveStrategy(); 
+            if (!decoder.save(&used)||predicted!=item.expect||used!=item.expect) {
+                LOGE("%s: predicted %d, used %d, expect %d", item.name, predicted, used, item.expect); 
+                ans = false; 
+                continue; 
+            }
+        }
+
+        MusicDecoderflac decoder(s_file); 
+        FlacPcmBlock decoded; 
+        if (!ReadBytes(s_file, after)||decoder.getTitle()!=title||!DecodeAll(decoder, decoded)||!SamePcm(decoded, pcm)
+            ||(item.expect==MusicDecoderflac::SAVE_UNCHANGED&&after!=before)
+            ||((item.expect==MusicDecoderflac::SAVE_IN_PLACE||item.expect==MusicDecoderflac::SAVE_PADDING_RESIZE)&&after.size()!=before.size())) {
+            LOGE("%s: saved file wrong", item.name); 
+            ans = false; 
+        }
+        if (ReadBytes(s_journal, after)) {
+            LOGE("%s: journal left", item.name); 
+            ans = false; 
+        }
+    }
+    printf("strategy: %s\n", ans?"ok":"FAIL"); 
+    return ans; 
+}
+
+/**
+ * @brief 覆盖写入：提交后为新数据且不留日志；放弃时恢复原数据；崩溃后留下的日志在下次打开时恢复原数据
+*/
+bool test_journal() {
+    FlacPcmBlock pcm = MakeSignal(4096*4, 44100, 2, 16, 36); 
+    std::vector<uint8_t> original; 
+    std::vector<uint8_t> actual; 
+    if (!makeFile(pcm)||!ReadBytes(s_file, original)) {
+        printf("journal: FAIL\n"); 
+        return false; 
+    }
+    // 覆盖文件头部并追加一段，恢复时追加的部分要截断
+    std::vector<uint8_t> head(1000, 0x5A); 
+    std::vector<uint8_t> tail(100, 0xA5); 
+    std::vector<WriteSegment> segments(1, WriteSegment{head.data(), head.size()}); 
+
+    bool ans = true; 
+    {
+        FileWriter writer(s_file, FileWriter::OVERWRITE); 
+        if (!writer.write(segments)||!writer.writeAt(original.size(), tail.data(), tail.size())||!writer.commit()
+            ||!ReadBytes(s_file, actual)||actual.size()!=original.size()+tail.size()
+            ||memcmp(actual.data(), head.data(), head.size())!=0||ReadBytes(s_journal, actual)) {
+            LOGE("commit: file wrong or journal left"); 
+            ans = false; 
+        }
+    }
+
+    if (!WriteBytes(s_file, original)) {
+        ans = false; 
+    }
+    {
+        FileWriter writer(s_file, FileWriter::OVERWRITE); 
+        // 同一位置覆盖两次，恢复的应是最早的原数据
+        if (!writer.write(segments)||!writer.writeAt(10, tail.data(), tail.size())||!writer.flush()) {
+            ans = false; 
+        }
+        writer.abort(); 
+        if (!ReadBytes(s_file, actual)||actual!=original||ReadBytes(s_journal, actual)) {
+            LOGE("abort: original not restored"); 
+            ans = false; 
+        }
+    }
+
+    // 模拟崩溃：保留写到一半的文件与日志，之后打开文件时自动恢复
+    std::vector<uint8_t> broken; 
+    std::vector<uint8_t> journal; 
+    {
+        FileWriter writer(s_file, FileWriter::OVERWRITE); 
+        if (!writer.write(segments)||!writer.flush()||!ReadBytes(s_file, broken)||!ReadBytes(s_journal, journal)) {
+            ans = false; 
+        }
+    }
+    if (!WriteBytes(s_file, broken)||!WriteBytes(s_journal, journal)) {
+        ans = false; 
+    }
+    {
+        MusicDecoderflac decoder(s_file); 
+        FlacPcmBlock decoded; 
+        if (!decoder.isValid()||decoder.getTitle()!="title"||!DecodeAll(decoder, decoded)||!SamePcm(decoded, pcm)) {
+            LOGE("crash: file not recovered on open"); 
+            ans = false; 
+        }
+    }
+    if (!ReadBytes(s_file, actual)||actual!=original||ReadBytes(s_journal, actual)) {
+        LOGE("crash: original not restored or journal left"); 
+        ans = false; 
+    }
+    printf("journal: %s\n", ans?"ok":"FAIL"); 
+    return ans; 
+}
+
+/**
+ * @brief 取得文件最后修改时间
+*/
+static bool getWriteTime(const wchar_t* path, uint64_t& dest) {
+    WIN32_FILE_ATTRIBUTE_DATA data; 
+    if (!GetFileAttributesExW(path, GetFileExInfoStandard, &data)) {
+        return false; 
+    }
+    dest = ((uint64_t)data.ftLastWriteTime.dwHighDateTime<<32)|data.ftLastWriteTime.dwLowDateTime; 
+    return true; 
+}
+
+/**
+ * @brief 设置为已有的值：序列化结果与源文件相同，不写文件，文件内容与修改时间都不变；值真正改变时写文件
+*/
+bool test_unchanged() {
+    FlacPcmBlock pcm = MakeSignal(4096*4, 44100, 2, 16, 37); 
+    std::vector<uint8_t> before; 
+    std::vector<uint8_t> after; 
+    uint64_t beforeTime = 0; 
+    uint64_t afterTime = 0; 
+    if (!makeFile(pcm)||!ReadBytes(s_file, before)||!getWriteTime(s_file, beforeTime)) {
+        printf("unchanged: FAIL\n"); 
+        return false; 
+    }
+
+    bool ans = true; 
+    FlacEdit same; 
+    same.setTag("TITLE", "title"); 
+    std::vector<FlacEdit::Result> results; 
+    MusicDecoderflac::SaveStrategy used = MusicDecoderflac::SAVE_FULL_REWRITE; 
+    if (!same.commit(s_file, &used)||used!=MusicDecoderflac::SAVE_UNCHANGED
+        ||same.commitBatch({s_file}, &results)!=1||results[0].strategy!=MusicDecoderflac::SAVE_UNCHANGED) {
+        LOGE("same value not unchanged, strategy %d", used); 
+        ans = false; 
+    }
+    if (!ReadBytes(s_file, after)||after!=before||!getWriteTime(s_file, afterTime)||afterTime!=beforeTime) {
+        LOGE("file written for same value"); 
+        ans = false; 
+    }
+
+    FlacEdit changed; 
+    changed.setTag("TITLE", "other"); 
+    if (!changed.commit(s_file, &used)||used==MusicDecoderflac::SAVE_UNCHANGED
+        ||!ReadBytes(s_file, after)||after==before||!getWriteTime(s_file, afterTime)||afterTime==beforeTime) {
+        LOGE("changed value not written, strategy %d", used); 
+        ans = false; 
+    }
+    MusicDecoderflac decoder(s_file); 
+    FlacPcmBlock decoded; 
+    if (decoder.getTitle()!="other"||!DecodeAll(decoder, decoded)||!SamePcm(decoded, pcm)) {
+        LOGE("changed file wrong"); 
+        ans = false; 
+    }
+    printf("unchanged: %s\n", ans?"ok":"FAIL"); 
+    return ans; 
+}
+
+int main(int argc, char** argv) {
+    bool ok = test_strategy(); 
+    ok = test_journal()&&ok; 
+    ok = test_unchanged()&&ok; 
+    DeleteFileW(s_file); 
+    DeleteFileW(s_journal); 
+    return ok?0:1; 
+}
\ No newline at end of file
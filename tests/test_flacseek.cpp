@@ -0,0 +1,265 @@
+#include "decoderflac.h"
+#include "flacdecoder.h"
+#include "flacframe.h"
+#include "log.h"
+#include "flactestfile.h"
+
+#include <stdio.h>
+
+INITONLYLOGGER(); 
+
+using music_data::FlacPcmBlock; 
+using music_data::FlacSeekResult; 
+using music_data::MusicDecoderflac; 
+
+static const wchar_t* s_file = L"test_flacseek.flac"; 
+static const wchar_t* s_index = L"test_flacseek.flac.mdfi"; 
+
+/**
+ * @brief 检查定位结果：所在帧、裁剪后的采样与之后的一帧
+*/
+static bool checkSeek(const MusicDecoderflac& decoder, const FlacPcmBlock& pcm, const std::vector<music_data::FlacFrameIndex::FrameInfo>& frames,
+    uint64_t sample, music_data::FlacFrameIndex::ptr index) {
+    FlacSeekResult res; 
+    if (!decoder.seekToSample(sample, res, index)) {
+        LOGE("seek to %lld fail", (long long)sample); 
+        return false; 
+    }
+    size_t k = 0; 
+    while (k+1<frames.size()&&frames[k+1].firstSample<=sample) {
+        ++k; 
+    }
+    const auto& frame = frames[k]; 
+    uint64_t frameEnd = frame.firstSample+frame.blockSize; 
+    if (res.sample!=sample||res.frameFirstSample!=frame.firstSample||res.frameOffset!=frame.offset
+        ||res.block.firstSample!=sample||res.block.blockSize!=frameEnd-sample) {
+        LOGE("seek to %lld: frame %lld at %lld, expect frame %lld at %lld", (long long)sample,
+            (long long)res.frameFirstSample, (long long)res.frameOffset, (long long)frame.firstSample, (long long)frame.offset); 
+        return false; 
+    }
+    for (uint32_t c=0; c<pcm.channels; ++c) {
+        if (memcmp(res.block.getChannel(c), pcm.getChannel(c)+sample, res.block.blockSize*sizeof(int32_t))!=0) {
+            LOGE("seek to %lld: channel %d mismatch", (long long)sample, c); 
+            return false; 
+        }
+    }
+
+    // 之后从下一帧继续
+    FlacPcmBlock next; 
+    bool hasNext = res.decoder!=nullptr&&res.decoder->decodeNext(next); 
+    if (k+1<frames.size()?(!hasNext||next.firstSample!=frameEnd):hasNext) {
+        LOGE("seek to %lld: next frame wrong", (long long)sample); 
+        return false; 
+    }
+    return true; 
+}
+
+/**
+ * @brief 帧索引、SEEKTABLE、无SEEKTABLE三种方式下，定位到帧的首个与最后一个采样及total-1
+*/
+bool test_seek() {
+    bool ans = true; 
+    for (uint32_t seekPointFrames : {0u, 5u}) {
+        FlacPcmBlock pcm = MakeSignal(44100*8+321, 44100, 2, 16, 47); 
+        if (!WriteFlac(s_file, pcm, seekPointFrames)) {
+            printf("seek: FAIL\n"); 
+            return false; 
+        }
+        MusicDecoderflac decoder(s_file); 
+        music_data::FlacFrameIndex::ptr index = std::make_shared<music_data::FlacFrameIndex>(); 
+        if (!index->build(decoder)) {
+            printf("seek: FAIL\n"); 
+            return false; 
+        }
+        const auto& frames = index->getFrames(); 
+        uint64_t total = pcm.blockSize; 
+
+        std::vector<uint64_t> targets = {0, total-1}; 
+        for (size_t k : {(size_t)1, frames.size()/2, frames.size()-2, frames.size()-1}) {
+            targets.push_back(frames[k].firstSample); 
+            targets.push_back(frames[k].firstSample+frames[k].blockSize-1); 
+            targets.push_back(frames[k].firstSample+frames[k].blockSize/3); 
+        }
+        for (bool useIndex : {false, true}) {
+            for (uint64_t sample: targets) {
+                if (!checkSeek(decoder, pcm, frames, sample, useIndex?index:nullptr)) {
+                    LOGE("seektable %d index %d", seekPointFrames, useIndex); 
+                    ans = false; 
+                }
+            }
+            FlacSeekResult res; 
+            if (decoder.seekToSample(total, res, useIndex?index:nullptr)) {
+                LOGE("seek past the end succeeded"); 
+                ans = false; 
+            }
+        }
+    }
+    printf("seek: %s\n", ans?"ok":"FAIL"); 
+    return ans; 
+}
+
+/**
+ * @brief 没有SEEKTABLE的文件按秒或按采样数间隔重建SEEKTABLE并保存，每个定位点都是包含目标采样的帧；
+ *        STREAMINFO中总采样数为0（未知）时同样扫描到最后一帧
+*/
+bool test_rebuildSeekTable() {
+    struct Case {
+        const char* name; 
+        uint64_t spacing; 
+        MusicDecoderflac::SeekPointSpacing unit; 
+        bool ifUnknownTotal; 
+    }; 
+    static const Case s_cases[] = {
+        {"seconds", 1, MusicDecoderflac::SPACING_SECONDS, false},
+        {"samples", 10000, MusicDecoderflac::SPACING_SAMPLES, false},
+        {"seconds unknown total", 1, MusicDecoderflac::SPACING_SECONDS, true},
+        {"samples unknown total", 10000, MusicDecoderflac::SPACING_SAMPLES, true},
+    }; 
+
+    bool ans = true; 
+    FlacPcmBlock pcm = MakeSignal(44100*8+321, 44100, 2, 16, 26); 
+    uint64_t total = pcm.blockSize; 
+    for (auto& item: s_cases) {
+        if (!WriteFlac(s_file, pcm)) {
+            ans = false; 
+            continue; 
+        }
+        if (item.ifUnknownTotal) {
+            MusicDecoderflac decoder(s_file); 
+            if (!decoder.getStreamInfo()->setSamplePerChannel(0)||!decoder.save()) {
+                LOGE("%s: clear total samples fail", item.name); 
+                ans = false; 
+                continue; 
+            }
+        }
+        {
+            MusicDecoderflac decoder(s_file); 
+            if (decoder.getSeekTable()!=nullptr||!decoder.rebuildSeekTable(item.spacing, item.unit)||!decoder.save()) {
+                LOGE("%s: rebuild seektable fail", item.name); 
+                ans = false; 
+                continue; 
+            }
+        }
+
+        MusicDecoderflac decoder(s_file); 
+        music_data::FlacFrameIndex index; 
+        std::vector<music_data::SeekTableMetaBlock::SeekPoint> points; 
+        if (decoder.getSeekTable()==nullptr||!decoder.getSeekTable()->getSeekPoints(points)||!index.build(decoder)
+            ||index.getFrames().back().firstSample+index.getFrames().back().blockSize!=total) {
+            LOGE("%s: seektable not saved or frames missing", item.name); 
+            ans = false; 
+            continue; 
+        }
+
+        // 每个目标采样取包含它的帧，相邻目标落在同一帧时只取一次
+        uint64_t spacingSamples = item.unit==MusicDecoderflac::SPACING_SECONDS?item.spacing*pcm.sampleRate:item.spacing; 
+        uint64_t firstOffset = index.getFrames()[0].offset; 
+        std::vector<music_data::FlacFrameIndex::FrameInfo> expect; 
+        for (uint64_t target=0; target<total; target+=spacingSamples) {
+            music_data::FlacFrameIndex::FrameInfo frame; 
+            if (index.find(target, frame)&&(expect.empty()||expect.back().firstSample!=frame.firstSample)) {
+                expect.push_back(frame); 
+            }
+        }
+        if (points.size()!=expect.size()) {
+            LOGE("%s: %d seek points, expect %d", item.name, (int)points.size(), (int)expect.size()); 
+            ans = false; 
+            continue; 
+        }
+        for (size_t i=0; i<points.size(); ++i) {
+            if (points[i].firstSampleNO!=expect[i].firstSample||points[i].offsetFromFirst!=expect[i].offset-firstOffset
+                ||points[i].sampleNum!=expect[i].blockSize) {
+                LOGE("%s: seek point %d mismatch", item.name, (int)i); 
+                ans = false; 
+            }
+        }
+    }
+    printf("rebuild seektable: %s\n", ans?"ok":"FAIL"); 
+    return ans; 
+}
+
+/**
+ * @brief 两个帧索引是否相同
+*/
+static bool sameFrames(const music_data::FlacFrameIndex& a, const music_data::FlacFrameIndex& b) {
+    const auto& x = a.getFrames(); 
+    const auto& y = b.getFrames(); 
+    if (x.empty()||x.size()!=y.size()) {
+        return false; 
+    }
+    for (size_t i=0; i<x.size(); ++i) {
+        if (x[i].firstSample!=y[i].firstSample||x[i].offset!=y[i].offset||x[i].blockSize!=y[i].blockSize) {
+            return false; 
+        }
+    }
+    return true; 
+}
+
+/**
+ * @brief 索引文件：第一次扫描后保存，之后直接加载；音频改变或索引文件损坏时不加载，重新扫描并覆盖
+*/
+bool test_sidecar() {
+    bool ans = true; 
+    DeleteFileW(s_index); 
+    FlacPcmBlock pcm = MakeSignal(44100*4, 44100, 2, 16, 48); 
+    if (!WriteFlac(s_file, pcm)) {
+        printf("sidecar: FAIL\n"); 
+        return false; 
+    }
+    {
+        MusicDecoderflac decoder(s_file); 
+        music_data::FlacFrameIndex expect; 
+        music_data::FlacFrameIndex index; 
+        music_data::FlacFrameIndex loaded; 
+        if (music_data::FlacFrameIndex::GetSidecarPath(s_file)!=s_index||!expect.build(decoder)
+            ||!index.loadOrBuild(decoder)||!sameFrames(index, expect)) {
+            LOGE("first build fail"); 
+            ans = false; 
+        }
+        if (!loaded.load(s_index, decoder)||!sameFrames(loaded, expect)) {
+            LOGE("saved index not loaded"); 
+            ans = false; 
+        }
+    }
+
+    // 同样长度的不同音频：索引已过期
+    std::vector<uint8_t> oldIndex; 
+    FlacPcmBlock other = MakeSignal(44100*4, 44100, 2, 16, 49); 
+    if (!ReadBytes(s_index, oldIndex)||!WriteFlac(s_file, other)) {
+        ans = false; 
+    }
+    {
+        MusicDecoderflac decoder(s_file); 
+        music_data::FlacFrameIndex expect; 
+        music_data::FlacFrameIndex index; 
+        std::vector<uint8_t> newIndex; 
+        if (index.load(s_index, decoder)||!index.empty()) {
+            LOGE("stale index loaded"); 
+            ans = false; 
+        }
+        if (!expect.build(decoder)||!index.loadOrBuild(decoder)||!sameFrames(index, expect)
+            ||!ReadBytes(s_index, newIndex)||newIndex==oldIndex) {
+            LOGE("stale index not rebuilt"); 
+            ans = false; 
+        }
+
+        // 截断的索引文件
+        newIndex.resize(newIndex.size()/2); 
+        if (!WriteBytes(s_index, newIndex)||index.load(s_index, decoder)
+            ||!index.loadOrBuild(decoder)||!sameFrames(index, expect)) {
+            LOGE("broken index not rebuilt"); 
+            ans = false; 
+        }
+    }
+    printf("sidecar: %s\n", ans?"ok":"FAIL"); 
+    return ans; 
+}
+
+int main(int argc, char** argv) {
+    bool ok = test_seek(); 
+    ok = test_rebuildSeekTable()&&ok; 
+    ok = test_sidecar()&&ok; 
+    DeleteFileW(s_file); 
+    DeleteFileW(s_index); 
+    return ok?0:1; 
+}
\ No newline at end of file
@@ -0,0 +1,117 @@
+#include "flacstream.h"
+#include "pcmconvert.h"
+#include "decoderflac.h"
+#include "log.h"
+#include "flactestfile.h"
+
+#include <stdio.h>
+
+INITONLYLOGGER(); 
+
+using music_data::FlacPcmBlock; 
+using music_data::FlacPcmStream; 
+using music_data::MusicDecoderflac; 
+using music_data::PcmConverter; 
+
+static const wchar_t* s_file = L"test_flacstream.flac"; 
+
+/**
+ * @brief 从当前位置读到结尾，每次读chunk帧
+*/
+static std::vector<uint8_t> readAll(FlacPcmStream& stream, uint32_t chunk) {
+    std::vector<uint8_t> ans; 
+    std::vector<uint8_t> buffer((size_t)chunk*stream.getFrameBytes()); 
+    uint32_t num = 0; 
+    do {
+        num = stream.read(buffer.data(), chunk); 
+        ans.insert(ans.end(), buffer.begin(), buffer.begin()+(size_t)num*stream.getFrameBytes()); 
+    } while (num==chunk); 
+    return ans; 
+}
+
+/**
+ * @brief 不降低位数时输出与源PCM逐字节一致，与每次读出的长度无关
+*/
+bool test_lossless() {
+    struct Case {
+        uint32_t sampleBits; 
+        PcmConverter::SampleFormat format; 
+    }; 
+    static const Case s_cases[] = {{16, PcmConverter::FORMAT_INT16}, {24, PcmConverter::FORMAT_INT24}}; 
+
+    bool ans = true; 
+    for (auto& item: s_cases) {
+        FlacPcmBlock pcm = MakeSignal(44100*3+17, 44100, 2, item.sampleBits, 48); 
+        if (!WriteFlac(s_file, pcm)) {
+            printf("lossless: FAIL\n"); 
+            return false; 
+        }
+        std::vector<uint8_t> expect((size_t)pcm.blockSize*pcm.channels*(item.sampleBits/8)); 
+        pcm.interleave(expect.data(), item.sampleBits/8); 
+
+        MusicDecoderflac::ptr decoder = std::make_shared<MusicDecoderflac>(s_file); 
+        FlacPcmStream stream(*decoder, item.format); 
+        // 解码器释放后流仍然有效
+        decoder = nullptr; 
+        for (uint32_t chunk : {1000u, 4096u, 10007u}) {
+            if (!stream.seek(0)||readAll(stream, chunk)!=expect||stream.getPosition()!=pcm.blockSize) {
+                LOGE("%d bit chunk %d mismatch", item.sampleBits, chunk); 
+                ans = false; 
+            }
+        }
+    }
+    printf("lossless: %s\n", ans?"ok":"FAIL"); 
+    return ans; 
+}
+
+/**
+ * @brief 定位后读出的数据与从头连续读出的同一段一致，包括抖动；read与pump结果相同
+*/
+bool test_seekRead() {
+    FlacPcmBlock pcm = MakeSignal(44100*3+17, 44100, 2, 24, 49); 
+    if (!WriteFlac(s_file, pcm)) {
+        printf("seek read: FAIL\n"); 
+        return false; 
+    }
+
+    bool ans = true; 
+    MusicDecoderflac decoder(s_file); 
+    uint32_t blockSize = decoder.getStreamInfo()->getMaxBlockSize(); 
+    for (PcmConverter::SampleFormat format : {PcmConverter::FORMAT_INT24, PcmConverter::FORMAT_INT16, PcmConverter::FORMAT_FLOAT32}) {
+        FlacPcmStream stream(decoder, format, PcmConverter::DITHER_TRIANGULAR, blockSize*2); 
+        std::vector<uint8_t> full = readAll(stream, 4096); 
+        uint32_t frameBytes = stream.getFrameBytes(); 
+
+        for (uint64_t sample : {(uint64_t)0, (uint64_t)blockSize, (uint64_t)blockSize*3-1, (uint64_t)blockSize*5+blockSize/2, (uint64_t)pcm.blockSize-1}) {
+            // 先读一部分再定位，缓冲区中的旧数据要丢弃
+            std::vector<uint8_t> buffer((size_t)777*frameBytes); 
+            stream.seek(pcm.blockSize/2); 
+            stream.read(buffer.data(), 777); 
+
+            std::vector<uint8_t> expect(full.begin()+(size_t)sample*frameBytes, full.end()); 
+            if (!stream.seek(sample)||stream.getPosition()!=sample||readAll(stream, 1500)!=expect) {
+                LOGE("format %d seek to %lld: read mismatch", format, (long long)sample); 
+                ans = false; 
+            }
+
+            std::vector<uint8_t> pumped; 
+            bool finished = stream.seek(sample)&&stream.pump([&pumped, frameBytes](const void* data, uint32_t frames) {
+                pumped.insert(pumped.end(), (const uint8_t*)data, (const uint8_t*)data+(size_t)frames*frameBytes); 
+                return true; 
+            }); 
+            if (!finished||pumped!=expect) {
+                LOGE("format %d seek to %lld: pump mismatch", format, (long long)sample); 
+                ans = false; 
+            }
+        }
+    }
+    printf("seek read: %s\n", ans?"ok":"FAIL"); 
+    return ans; 
+}
+
+int main(int argc, char** argv) {
+    bool ok = test_lossless(); 
+    ok = test_seekRead()&&ok; 
+    DeleteFileW(s_file); 
+    return ok?0:1; 
+}
\ No newline at end of file
@@ -0,0 +1,167 @@
+#include "decoderflac.h"
+#include "flacframe.h"
+#include "log.h"
+#include "flactestfile.h"
+
+#include <stdio.h>
+
+INITONLYLOGGER(); 
+
+using music_data::AudioVerifyResult; 
+using music_data::IntegrityCheckResult; 
+using music_data::FlacPcmBlock; 
+using music_data::MusicDecoderflac; 
+
+static const wchar_t* s_good = L"test_flacverify_good.flac"; 
+static const wchar_t* s_bad = L"test_flacverify_bad.flac"; 
+
+/// @brief STREAMINFO中MD5的位置："fLaC"、4 byte block头与MD5之前的18 byte
+static const size_t s_md5Offset = 4+4+18; 
+
+/**
+ * @brief 生成测试文件，另外写出改动过STREAMINFO中MD5的副本
+*/
+static bool makeFiles(FlacPcmBlock& pcm, uint8_t fill) {
+    pcm = MakeSignal(44100*3+7, 44100, 2, 24, 45); 
+    std::vector<uint8_t> data; 
+    if (!WriteFlac(s_good, pcm)||!ReadBytes(s_good, data)) {
+        return false; 
+    }
+    for (size_t i=0; i<music_data::Md5::DIGEST_SIZE; ++i) {
+        data[s_md5Offset+i] = fill==0?0:data[s_md5Offset+i]^fill; 
+    }
+    return WriteBytes(s_bad, data); 
+}
+
+/**
+ * @brief MD5一致与不一致：不一致时帧都能解码，只有MD5比较失败
+*/
+bool test_md5() {
+    FlacPcmBlock pcm; 
+    if (!makeFiles(pcm, 0x01)) {
+        printf("md5: FAIL\n"); 
+        return false; 
+    }
+    uint8_t digest[music_data::Md5::DIGEST_SIZE]; 
+    PcmMD5(pcm, digest); 
+
+    bool ans = true; 
+    AudioVerifyResult good; 
+    if (!MusicDecoderflac(s_good).verifyAudio(&good)||!good.success||!good.hasMD5||!good.md5Match
+        ||good.decodedSamples!=pcm.blockSize||good.badFrameNum!=0||memcmp(good.actualMD5, digest, sizeof(digest))!=0) {
+        LOGE("verify good file fail"); 
+        ans = false; 
+    }
+
+    AudioVerifyResult bad; 
+    if (MusicDecoderflac(s_bad).verifyAudio(&bad)||bad.success||!bad.hasMD5||bad.md5Match) {
+        LOGE("md5 mismatch not reported"); 
+        ans = false; 
+    }
+    if (bad.decodedSamples!=pcm.blockSize||bad.badFrameNum!=0||bad.firstBadSample!=UINT64_MAX
+        ||memcmp(bad.actualMD5, digest, sizeof(digest))!=0||memcmp(bad.expectedMD5, digest, sizeof(digest))==0) {
+        LOGE("md5 mismatch result wrong"); 
+        ans = false; 
+    }
+
+    // 多个文件并行校验
+    std::vector<AudioVerifyResult> results; 
+    if (MusicDecoderflac::VerifyAudio({s_good, s_bad, s_good}, results)!=2||results.size()!=3
+        ||!results[0].success||results[1].success||!results[2].success) {
+        LOGE("verify files fail"); 
+        ans = false; 
+    }
+    printf("md5: %s\n", ans?"ok":"FAIL"); 
+    return ans; 
+}
+
+/**
+ * @brief STREAMINFO中没有MD5时只检查解码与采样数
+*/
+bool test_noMD5() {
+    FlacPcmBlock pcm; 
+    if (!makeFiles(pcm, 0)) {
+        printf("no md5: FAIL\n"); 
+        return false; 
+    }
+    AudioVerifyResult res; 
+    bool ans = MusicDecoderflac(s_bad).verifyAudio(&res)&&res.success&&!res.hasMD5&&res.decodedSamples==pcm.blockSize; 
+    printf("no md5: %s\n", ans?"ok":"FAIL"); 
+    return ans; 
+}
+
+/**
+ * @brief 不解码的完整性检查：完好、帧内一个字节损坏、在帧中间与帧边界截断
+*/
+bool test_integrity() {
+    FlacPcmBlock pcm; 
+    std::vector<uint8_t> data; 
+    if (!makeFiles(pcm, 0x01)||!ReadBytes(s_good, data)) {
+        printf("integrity: FAIL\n"); 
+        return false; 
+    }
+    std::vector<music_data::FlacFrameIndex::FrameInfo> frames; 
+    size_t audioOffset = 0; 
+    {
+        MusicDecoderflac decoder(s_good); 
+        music_data::FlacFrameIndex index; 
+        if (!index.build(decoder)||index.getFrames().size()<4) {
+            printf("integrity: FAIL\n"); 
+            return false; 
+        }
+        frames = index.getFrames(); 
+        audioOffset = decoder.getAudioFrames()-decoder.getSource()->getData(); 
+    }
+
+    bool ans = true; 
+    IntegrityCheckResult res; 
+    if (!MusicDecoderflac(s_good).checkIntegrity(&res)||!res.success||res.frameNum!=frames.size()
+        ||!res.badFrames.empty()||res.truncated||res.trailingBytes!=0) {
+        LOGE("check good file fail"); 
+        ans = false; 
+    }
+
+    // 帧中间的一个字节损坏：只有该帧CRC-16不一致，解码校验也只有这一帧失败
+    const auto& broken = frames[2]; 
+    std::vector<uint8_t> damaged(data); 
+    damaged[audioOffset+(broken.offset+frames[3].offset)/2]^=0x10; 
+    AudioVerifyResult verify; 
+    if (!WriteBytes(s_bad, damaged)||MusicDecoderflac(s_bad).checkIntegrity(&res)||res.success
+        ||res.badFrames!=std::vector<uint64_t>{broken.offset}||res.frameNum!=frames.size()||res.truncated) {
+        LOGE("flipped byte not found"); 
+        ans = false; 
+    }
+    if (MusicDecoderflac(s_bad).verifyAudio(&verify)||verify.badFrameNum!=1||verify.firstBadFrame!=broken.offset
+        ||verify.firstBadSample!=broken.firstSample) {
+        LOGE("flipped byte not found by audio verify"); 
+        ans = false; 
+    }
+
+    // 截断在最后一帧中间：帧头完好，最后一帧按CRC-16不一致报告
+    const auto& last = frames.back(); 
+    std::vector<uint8_t> truncated(data.begin(), data.begin()+audioOffset+last.offset+10); 
+    if (!WriteBytes(s_bad, truncated)||MusicDecoderflac(s_bad).checkIntegrity(&res)||res.success
+        ||res.badFrames!=std::vector<uint64_t>{last.offset}) {
+        LOGE("truncation inside the last frame not found"); 
+        ans = false; 
+    }
+
+    // 截断在帧边界：各帧完好，但采样数不到STREAMINFO中的总数
+    truncated.resize(audioOffset+last.offset); 
+    if (!WriteBytes(s_bad, truncated)||MusicDecoderflac(s_bad).checkIntegrity(&res)||res.success||!res.truncated
+        ||!res.badFrames.empty()||res.frameNum!=frames.size()-1) {
+        LOGE("truncation at frame boundary not found"); 
+        ans = false; 
+    }
+    printf("integrity: %s\n", ans?"ok":"FAIL"); 
+    return ans; 
+}
+
+int main(int argc, char** argv) {
+    bool ok = test_md5(); 
+    ok = test_noMD5()&&ok; 
+    ok = test_integrity()&&ok; 
+    DeleteFileW(s_good); 
+    DeleteFileW(s_bad); 
+    return ok?0:1; 
+}
\ No newline at end of file
@@ -0,0 +1,316 @@
+#include "wavexport.h"
+#include "decoderflac.h"
+#include "mappedfile.h"
+#include "log.h"
+#include "flactestfile.h"
+
+#include <stdio.h>
+
+INITONLYLOGGER(); 
+
+using music_data::FlacPcmBlock; 
+using music_data::MusicDecoderflac; 
+using music_data::WavExporter; 
+
+static const wchar_t* s_flac = L"test_wavexport.flac"; 
+static const wchar_t* s_wav = L"test_wavexport.wav"; 
+
+static void putTag(std::vector<uint8_t>& dest, const char* tag) {
+    dest.insert(dest.end(), tag, tag+4); 
+}
+
+static void putLE(std::vector<uint8_t>& dest, uint64_t val, uint32_t bytes) {
+    for (uint32_t i=0; i<bytes; ++i) {
+        dest.push_back((uint8_t)(val>>(i*8))); 
+    }
+}
+
+/**
+ * @brief 按规范逐字段生成参考WAV：RIFF（或RF64与ds64，RIFF时同位置为28 byte的JUNK）、fmt、LIST/INFO、data；
+ *        多于2声道、多于16 bit或位数不是整字节时用WAVE_FORMAT_EXTENSIBLE，声道掩码与flac命令行工具一致；
+ *        采样在容器内左对齐，8 bit为无符号数
+ * @param[in] pcm PCM
+ * @param[in] rf64 是否为RF64
+ * @param[in] info LIST/INFO chunk的子chunk，按id、文本交替排列
+*/
+static std::vector<uint8_t> makeWav(const FlacPcmBlock& pcm, bool rf64, const std::vector<std::string>& info) {
+    static const uint32_t s_masks[8] = {0x1, 0x3, 0x7, 0x33, 0x607, 0x60F, 0x70F, 0x63F}; 
+    uint32_t sampleBytes = (pcm.sampleBits+7)/8; 
+    uint32_t blockAlign = sampleBytes*pcm.channels; 
+    bool extensible = pcm.channels>2||pcm.sampleBits>16||pcm.sampleBits%8!=0; 
+
+    std::vector<uint8_t> data; 
+    for (uint32_t i=0; i<pcm.blockSize; ++i) {
+        for (uint32_t c=0; c<pcm.channels; ++c) {
+            uint32_t val = (uint32_t)pcm.getChannel(c)[i]<<(sampleBytes*8-pcm.sampleBits); 
+            if (sampleBytes==1) {
+                val+=0x80; 
+            }
+            putLE(data, val, sampleBytes); 
+        }
+    }
+    uint64_t dataSize = data.size(); 
+    if (dataSize&1) {
+        data.push_back(0); 
+    }
+
+    std::vector<uint8_t> list; 
+    if (!info.empty()) {
+        putTag(list, "LIST"); 
+        putLE(list, 0, 4); 
+        putTag(list, "INFO"); 
+        for (size_t i=0; i+1<info.size(); i+=2) {
+            putTag(list, info[i].c_str()); 
+            putLE(list, info[i+1].size()+1, 4); 
+            list.insert(list.end(), info[i+1].begin(), info[i+1].end()); 
+            list.push_back(0); 
+            if (list.size()&1) {
+                list.push_back(0); 
+            }
+        }
+        uint32_t listSize = list.size()-8; 
+        for (uint32_t i=0; i<4; ++i) {
+            list[4+i] = (uint8_t)(listSize>>(i*8)); 
+        }
+    }
+
+    std::vector<uint8_t> fmt; 
+    putLE(fmt, extensible?0xFFFE:1, 2); 
+    putLE(fmt, pcm.channels, 2); 
+    putLE(fmt, pcm.sampleRate, 4); 
+    putLE(fmt, pcm.sampleRate*blockAlign, 4); 
+    putLE(fmt, blockAlign, 2); 
+    putLE(fmt, sampleBytes*8, 2); 
+    if (extensible) {
+        static const uint8_t s_pcmGuid[16] = {1, 0, 0, 0, 0, 0, 0x10, 0, 0x80, 0, 0, 0xAA, 0, 0x38, 0x9B, 0x71}; 
+        putLE(fmt, 22, 2); 
+        putLE(fmt, pcm.sampleBits, 2); 
+        putLE(fmt, s_masks[pcm.channels-1], 4); 
+        fmt.insert(fmt.end(), s_pcmGuid, s_pcmGuid+16); 
+    }
+
+    uint64_t riffSize = 4+(8+28)+(8+fmt.size())+list.size()+8+data.size(); 
+    std::vector<uint8_t> ans; 
+    putTag(ans, rf64?"RF64":"RIFF"); 
+    putLE(ans, rf64?0xFFFFFFFF:riffSize, 4); 
+    putTag(ans, "WAVE"); 
+    putTag(ans, rf64?"ds64":"JUNK"); 
+    putLE(ans, 28, 4); 
+    if (rf64) {
+        putLE(ans, riffSize, 8); 
+        putLE(ans, dataSize, 8); 
+        putLE(ans, pcm.blockSize, 8); 
+        putLE(ans, 0, 4); 
+    } else {
+        ans.resize(ans.size()+28, 0); 
+    }
+    putTag(ans, "fmt "); 
+    putLE(ans, fmt.size(), 4); 
+    ans.insert(ans.end(), fmt.begin(), fmt.end()); 
+    ans.insert(ans.end(), list.begin(), list.end()); 
+    putTag(ans, "data"); 
+    putLE(ans, rf64?0xFFFFFFFF:dataSize, 4); 
+    ans.insert(ans.end(), data.begin(), data.end()); 
+    return ans; 
+}
+
+/**
+ * @brief 超长流中各帧的常量采样值，各帧、各声道不同
+*/
+static int32_t longFrameValue(uint64_t frame, uint32_t channel) {
+    return (int16_t)(frame*7919+channel*12345); 
+}
+
+/**
+ * @brief 写出只含CONSTANT subframe的16 bit立体声flac，解码后的数据可以超过4 GB而文件很小；
+ *        STREAMINFO的MD5为0（未知），最后一帧较短
+ * @param[in] samples 总采样数
+ * @param[in] blockSize 帧长
+ * @retval 是否成功
+*/
+static bool writeLongFlac(uint64_t samples, uint32_t blockSize) {
+    std::vector<uint8_t> data(4+4+34); 
+    memcpy(data.data(), "fLaC", 4); 
+    data[7] = 34; 
+    music_data::StreamInfoMetaBlock streamInfo(data.data()+8, 34); 
+    streamInfo.setMinBlockSize((uint16_t)blockSize); 
+    streamInfo.setMaxBlockSize((uint16_t)blockSize); 
+    if (!streamInfo.setSampleRate(44100)||!streamInfo.setChannels(2)||!streamInfo.setSampleBits(16)
+        ||!streamInfo.setSamplePerChannel(samples)||streamInfo.resave(data.data()+4, true)!=4+34) {
+        return false; 
+    }
+
+    TestBitWriter writer; 
+    for (uint64_t frame=0; frame*blockSize<samples; ++frame) {
+        uint32_t length = (uint32_t)std::min<uint64_t>(blockSize, samples-frame*blockSize); 
+        // 帧头：16 bit block size，44.1 kHz，独立立体声，16 bit
+        writer.reset(); 
+        writer.writeBits(0xFFF8, 16); 
+        writer.writeBits(7, 4); 
+        writer.writeBits(9, 4); 
+        writer.writeBits(1, 4); 
+        writer.writeBits(4, 3); 
+        writer.writeBits(0, 1); 
+        writer.writeUtf8(frame); 
+        writer.writeBits(length-1, 16); 
+        writer.writeBits(music_data::crc8(writer.getData(), writer.getLength()), 8); 
+        for (uint32_t c=0; c<2; ++c) {
+            // subframe头：CONSTANT，无wasted bits
+            writer.writeBits(0, 8); 
+            writer.writeSigned(longFrameValue(frame, c), 16); 
+        }
+        writer.writeBits(music_data::crc16(writer.getData(), writer.getLength()), 16); 
+        data.insert(data.end(), writer.getData(), writer.getData()+writer.getLength()); 
+    }
+    return WriteBytes(s_flac, data); 
+}
+
+static uint64_t getLE(const uint8_t* data, uint32_t bytes) {
+    uint64_t val = 0; 
+    for (uint32_t i=0; i<bytes; ++i) {
+        val|=(uint64_t)data[i]<<(i*8); 
+    }
+    return val; 
+}
+
+/**
+ * @brief 导出并与参考WAV逐字节比较
+*/
+static bool checkExport(const char* name, const FlacPcmBlock& pcm, WavExporter::Rf64Mode mode, const std::vector<std::string>& info) {
+    MusicDecoderflac decoder(s_flac); 
+    WavExporter exporter(decoder); 
+    // 缓冲区取小值，让写出跨越多个缓冲区
+    exporter.setBufferSize(64<<10); 
+    exporter.setRf64Mode(mode); 
+    WavExporter::Result res; 
+    std::vector<uint8_t> actual; 
+    std::vector<uint8_t> expect = makeWav(pcm, mode==WavExporter::RF64_ALWAYS, info); 
+    if (!exporter.save(s_wav, &res)||!ReadBytes(s_wav, actual)) {
+        LOGE("%s export fail", name); 
+        return false; 
+    }
+    if (actual!=expect||res.samples!=pcm.blockSize||res.fileSize!=expect.size()||res.rf64!=(mode==WavExporter::RF64_ALWAYS)) {
+        size_t pos = 0; 
+        while (pos<actual.size()&&pos<expect.size()&&actual[pos]==expect[pos]) {
+            ++pos; 
+        }
+        LOGE("%s mismatch at byte %d, %d byte exported, expect %d", name, (int)pos, (int)actual.size(), (int)expect.size()); 
+        return false; 
+    }
+    return true; 
+}
+
+/**
+ * @brief 8~32 bit、1/2/3/6声道导出与参考WAV逐字节一致
+*/
+bool test_formats() {
+    struct Case {
+        const char* name; 
+        uint32_t sampleBits; 
+        uint32_t channels; 
+    }; 
+    static const Case s_cases[] = {
+        {"8 bit mono", 8, 1},
+        {"8 bit 3 channels", 8, 3},
+        {"12 bit stereo", 12, 2},
+        {"16 bit mono", 16, 1},
+        {"16 bit stereo", 16, 2},
+        {"16 bit 6 channels", 16, 6},
+        {"20 bit 3 channels", 20, 3},
+        {"24 bit stereo", 24, 2},
+        {"24 bit 6 channels", 24, 6},
+        {"32 bit stereo", 32, 2},
+    }; 
+
+    bool ans = true; 
+    for (auto& item: s_cases) {
+        // 奇数个采样，8 bit单声道时data chunk需要对齐字节
+        FlacPcmBlock pcm = MakeSignal(30001, 48000, item.channels, item.sampleBits, item.sampleBits*10+item.channels); 
+        if (!WriteFlac(s_flac, pcm)||!checkExport(item.name, pcm, WavExporter::RF64_AUTO, {})) {
+            ans = false; 
+        }
+    }
+    printf("formats: %s\n", ans?"ok":"FAIL"); 
+    return ans; 
+}
+
+/**
+ * @brief RF64与LIST/INFO标签
+*/
+bool test_rf64Info() {
+    FlacPcmBlock pcm = MakeSignal(44100+1, 44100, 2, 24, 49); 
+    bool ans = WriteFlac(s_flac, pcm); 
+    {
+        MusicDecoderflac decoder(s_flac); 
+        ans = ans&&decoder.setbackTitle("wav title")&&decoder.setbackArtist("ab", 0)&&decoder.save(); 
+    }
+    std::vector<std::string> info = {"INAM", "wav title", "IART", "ab"}; 
+    ans = ans&&checkExport("rf64", pcm, WavExporter::RF64_ALWAYS, info); 
+    ans = checkExport("riff info", pcm, WavExporter::RF64_AUTO, info)&&ans; 
+    printf("rf64 and info: %s\n", ans?"ok":"FAIL"); 
+    return ans; 
+}
+
+/**
+ * @brief 自动模式下数据超过4 GB时改为RF64：RIFF与data长度为0xFFFFFFFF，ds64中回填64 bit的RIFF长度、data长度与采样数；
+ *        每帧的首尾采样与源一致
+*/
+bool test_rf64Large() {
+    const uint32_t blockSize = 4096; 
+    const uint64_t samples = (1ull<<30)+blockSize*2+1001; 
+    if (!writeLongFlac(samples, blockSize)) {
+        printf("rf64 large: FAIL\n"); 
+        return false; 
+    }
+
+    bool ans = true; 
+    WavExporter::Result res; 
+    {
+        MusicDecoderflac decoder(s_flac); 
+        WavExporter exporter(decoder); 
+        exporter.setRf64Mode(WavExporter::RF64_AUTO); 
+        if (!exporter.save(s_wav, &res)||!res.rf64||res.samples!=samples) {
+            LOGE("rf64 large export fail, rf64 %d, %lld samples", (int)res.rf64, (long long)res.samples); 
+            ans = false; 
+        }
+    }
+
+    // 文件头：RF64、ds64、fmt（16 bit立体声不用extensible）、data，共80 byte
+    const uint64_t headerSize = 12+(8+28)+(8+16)+8; 
+    const uint64_t dataSize = samples*4; 
+    music_data::MappedFile file(s_wav); 
+    const uint8_t* pin = file.getData(); 
+    if (!ans||!file.isOpen()||file.getSize()!=headerSize+dataSize||res.fileSize!=file.getSize()) {
+        LOGE("rf64 large file size wrong"); 
+        printf("rf64 large: FAIL\n"); 
+        return false; 
+    }
+    if (memcmp(pin, "RF64", 4)!=0||getLE(pin+4, 4)!=0xFFFFFFFF||memcmp(pin+8, "WAVEds64", 8)!=0||getLE(pin+16, 4)!=28
+        ||getLE(pin+20, 8)!=file.getSize()-8||getLE(pin+28, 8)!=dataSize||getLE(pin+36, 8)!=samples||getLE(pin+44, 4)!=0
+        ||memcmp(pin+72, "data", 4)!=0||getLE(pin+76, 4)!=0xFFFFFFFF) {
+        LOGE("rf64 large header wrong"); 
+        ans = false; 
+    }
+    for (uint64_t frame=0; ans&&frame*blockSize<samples; ++frame) {
+        uint64_t last = std::min<uint64_t>(frame*blockSize+blockSize, samples)-1; 
+        for (uint64_t i: {frame*blockSize, last}) {
+            for (uint32_t c=0; c<2; ++c) {
+                if ((int16_t)getLE(pin+headerSize+i*4+c*2, 2)!=longFrameValue(frame, c)) {
+                    LOGE("rf64 large sample %lld channel %d mismatch", (long long)i, c); 
+                    ans = false; 
+                }
+            }
+        }
+    }
+    printf("rf64 large: %s\n", ans?"ok":"FAIL"); 
+    return ans; 
+}
+
+int main(int argc, char** argv) {
+    bool ok = test_formats(); 
+    ok = test_rf64Info()&&ok; 
+    ok = test_rf64Large()&&ok; 
+    DeleteFileW(s_flac); 
+    DeleteFileW(s_wav); 
+    return ok?0:1; 
+}
\ No newline at end of file